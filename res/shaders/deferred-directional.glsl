@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.glh"
+
+#if defined(VS_BUILD)
+#include "deferredLighting.vsh"
+#elif defined(FS_BUILD)
+
+#include "lighting.glh"
+#include "sampling.glh"
+#include "shadowing.glh"
+
+uniform vec3 R_deferredEyePos;
+
+//Read from the G-buffer for each pixel
+float specularIntensity;
+float specularPower;
+
+uniform DirectionalLight R_directionalLight;
+
+vec4 CalcLightingEffect(vec3 normal, vec3 worldPos)
+{
+	return CalcLight(R_directionalLight.base, -R_directionalLight.direction, normal, worldPos,
+	                 specularIntensity, specularPower, R_deferredEyePos);
+}
+
+#include "deferredLightingMain.fsh"
+#endif
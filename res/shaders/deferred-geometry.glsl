@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.glh"
+
+varying vec2 texCoord0;
+varying vec3 worldPos0;
+varying mat3 tbnMatrix;
+
+#if defined(VS_BUILD)
+attribute vec3 position;
+attribute vec2 texCoord;
+attribute vec3 normal;
+attribute vec3 tangent;
+
+#include "instancing.glh"
+
+uniform mat4 T_model;
+uniform mat4 T_MVP;
+
+void main()
+{
+    gl_Position = InstanceTransform(T_MVP) * vec4(position, 1.0);
+    texCoord0 = texCoord; 
+    worldPos0 = (MODEL_MATRIX * vec4(position, 1.0)).xyz;
+    
+    vec3 n = normalize((MODEL_MATRIX * vec4(normal, 0.0)).xyz);
+    vec3 t = normalize((MODEL_MATRIX * vec4(tangent, 0.0)).xyz);
+    t = normalize(t - dot(t, n) * n);
+    
+    vec3 biTangent = cross(t, n);
+    tbnMatrix = mat3(t, biTangent, n);
+}
+#elif defined(FS_BUILD)
+#include "sampling.glh"
+
+uniform vec3 R_ambient;
+uniform vec3 C_eyePos;
+uniform float specularIntensity;
+uniform float specularPower;
+uniform sampler2D diffuse;
+uniform sampler2D normalMap;
+uniform sampler2D dispMap;
+
+uniform float dispMapScale;
+uniform float dispMapBias;
+
+DeclareFragOutput(0, vec4); //Albedo
+DeclareFragOutput(1, vec4); //World space normal
+DeclareFragOutput(2, vec4); //Specular intensity and power
+DeclareFragOutput(3, vec4); //Lighting, which starts out as the ambient term
+void main()
+{
+	vec3 directionToEye = normalize(C_eyePos - worldPos0);
+	vec2 texCoords = CalcParallaxTexCoords(dispMap, tbnMatrix, directionToEye, texCoord0, dispMapScale, dispMapBias);
+	vec3 normal = normalize(tbnMatrix * (255.0/128.0 * texture2D(normalMap, texCoords).xyz - 1));
+	vec4 albedo = texture2D(diffuse, texCoords);
+	
+	SetFragOutput(0, albedo);
+	SetFragOutput(1, vec4(normal, 0.0));
+	SetFragOutput(2, vec4(specularIntensity, specularPower, 0.0, 0.0));
+	SetFragOutput(3, albedo * vec4(R_ambient, 1));
+}
+#endif
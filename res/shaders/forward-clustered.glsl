@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "common.glh"
+
+varying vec2 texCoord0;
+varying vec3 worldPos0;
+varying mat3 tbnMatrix;
+
+#if defined(VS_BUILD)
+attribute vec3 position;
+attribute vec2 texCoord;
+attribute vec3 normal;
+attribute vec3 tangent;
+
+#include "instancing.glh"
+
+uniform mat4 T_model;
+uniform mat4 T_MVP;
+
+void main()
+{
+    gl_Position = InstanceTransform(T_MVP) * vec4(position, 1.0);
+    texCoord0 = texCoord; 
+    worldPos0 = (MODEL_MATRIX * vec4(position, 1.0)).xyz;
+    
+    vec3 n = normalize((MODEL_MATRIX * vec4(normal, 0.0)).xyz);
+    vec3 t = normalize((MODEL_MATRIX * vec4(tangent, 0.0)).xyz);
+    t = normalize(t - dot(t, n) * n);
+    
+    vec3 biTangent = cross(t, n);
+    tbnMatrix = mat3(t, biTangent, n);
+}
+#elif defined(FS_BUILD)
+#include "lighting.glh"
+#include "sampling.glh"
+
+uniform vec3 C_eyePos;
+uniform float specularIntensity;
+uniform float specularPower;
+
+uniform sampler2D diffuse;
+uniform sampler2D normalMap;
+uniform sampler2D dispMap;
+
+uniform float dispMapScale;
+uniform float dispMapBias;
+
+//Four texels per light: position and range, color and intensity, 
+//attenuation and spot flag, then spot direction and cutoff.
+uniform samplerBuffer R_clusterLights;
+//An offset and count per cluster, followed by the light indices they point into.
+uniform usamplerBuffer R_clusterData;
+
+uniform vec3 R_clusterGrid;       //Tiles across, tiles down, depth slices
+uniform vec3 R_clusterDepth;      //Near plane, slices per log of depth
+uniform vec3 R_clusterScreen;     //Tiles per pixel
+uniform vec3 R_clusterViewForward;
+
+int FindCluster()
+{
+	ivec3 grid = ivec3(R_clusterGrid);
+	
+	float viewDepth = dot(worldPos0 - C_eyePos, R_clusterViewForward);
+	int slice = int(floor(log(max(viewDepth, R_clusterDepth.x)/R_clusterDepth.x) * R_clusterDepth.y));
+	ivec2 tile = ivec2(gl_FragCoord.xy * R_clusterScreen.xy);
+	
+	slice = clamp(slice, 0, grid.z - 1);
+	tile = clamp(tile, ivec2(0, 0), grid.xy - 1);
+	
+	return (slice * grid.y + tile.y) * grid.x + tile.x;
+}
+
+vec4 CalcClusteredLight(int lightIndex, vec3 normal, vec3 worldPos)
+{
+	vec4 positionAndRange = texelFetch(R_clusterLights, lightIndex * 4);
+	vec4 colorAndIntensity = texelFetch(R_clusterLights, lightIndex * 4 + 1);
+	vec4 attenAndSpot = texelFetch(R_clusterLights, lightIndex * 4 + 2);
+	
+	PointLight pointLight;
+	pointLight.base.color = colorAndIntensity.xyz;
+	pointLight.base.intensity = colorAndIntensity.w;
+	pointLight.atten.constant = attenAndSpot.x;
+	pointLight.atten.linear = attenAndSpot.y;
+	pointLight.atten.exponent = attenAndSpot.z;
+	pointLight.position = positionAndRange.xyz;
+	pointLight.range = positionAndRange.w;
+	
+	if(attenAndSpot.w == 0.0)
+	{
+		return CalcPointLight(pointLight, normal, worldPos, specularIntensity, specularPower, C_eyePos);
+	}
+	
+	vec4 directionAndCutoff = texelFetch(R_clusterLights, lightIndex * 4 + 3);
+	float spotFactor = dot(normalize(worldPos - pointLight.position), directionAndCutoff.xyz);
+	
+	if(spotFactor <= directionAndCutoff.w)
+	{
+		return vec4(0,0,0,0);
+	}
+	
+	return CalcPointLight(pointLight, normal, worldPos, specularIntensity, specularPower, C_eyePos) *
+	       (1.0 - (1.0 - spotFactor)/(1.0 - directionAndCutoff.w));
+}
+
+DeclareFragOutput(0, vec4);
+void main()
+{
+	vec3 directionToEye = normalize(C_eyePos - worldPos0);
+	vec2 texCoords = CalcParallaxTexCoords(dispMap, tbnMatrix, directionToEye, texCoord0, dispMapScale, dispMapBias);
+	vec3 normal = normalize(tbnMatrix * (255.0/128.0 * texture2D(normalMap, texCoords).xyz - 1));
+	
+	int cluster = FindCluster();
+	int offset = int(texelFetch(R_clusterData, cluster * 2).r);
+	int count = int(texelFetch(R_clusterData, cluster * 2 + 1).r);
+	
+	vec4 lightingAmt = vec4(0,0,0,0);
+	for(int i = 0; i < count; i++)
+	{
+		int lightIndex = int(texelFetch(R_clusterData, offset + i).r);
+		lightingAmt += CalcClusteredLight(lightIndex, normal, worldPos0);
+	}
+	
+	SetFragOutput(0, texture2D(diffuse, texCoords) * lightingAmt);
+}
+#endif
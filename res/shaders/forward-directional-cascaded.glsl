@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.glh"
+#include "forwardlighting.glh"
+
+#if defined(VS_BUILD)
+#include "forwardlighting.vsh"
+#elif defined(FS_BUILD)
+
+#include "lighting.glh"
+#include "sampling.glh"
+#include "shadowCascades.glh"
+
+uniform vec3 C_eyePos;
+uniform float specularIntensity;
+uniform float specularPower;
+
+uniform DirectionalLight R_directionalLight;
+
+vec4 CalcLightingEffect(vec3 normal, vec3 worldPos)
+{
+	return CalcLight(R_directionalLight.base, -R_directionalLight.direction, normal, worldPos,
+	                 specularIntensity, specularPower, C_eyePos);
+}
+
+#include "lightingMain.fsh"
+#endif
@@ -22,6 +22,8 @@
 #elif defined(FS_BUILD)
 
 #include "lighting.glh"
+#include "sampling.glh"
+#include "shadowing.glh"
 
 uniform vec3 C_eyePos;
 uniform float specularIntensity;
@@ -19,11 +19,13 @@
 #if defined(VS_BUILD)
 attribute vec3 position;
 
+#include "instancing.glh"
+
 uniform mat4 T_MVP;
 
 void main()
 {
-    gl_Position = T_MVP * vec4(position, 1.0);
+    gl_Position = InstanceTransform(T_MVP) * vec4(position, 1.0);
 }
 #elif defined(FS_BUILD)
 DeclareFragOutput(0, vec4);
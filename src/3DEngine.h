@@ -29,6 +29,7 @@
 #include "rendering/window.h"
 #include "core/coreEngine.h"
 #include "core/game.h"
+#include "core/jobSystem.h"
 
 //SDL2 defines a main macro, which can prevent certain compilers from finding the main function.
 #undef main
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ARCHETYPESTORECOMPONENT_H
+#define ARCHETYPESTORECOMPONENT_H
+
+#include "../core/entityComponent.h"
+#include "../core/archetypeStore.h"
+
+//Puts an ArchetypeStore into the scene, so its entities are updated and rendered
+//along with the rest of the Entity tree.
+class ArchetypeStoreComponent : public EntityComponent
+{
+public:
+	//Takes ownership of store.
+	ArchetypeStoreComponent(ArchetypeStore* store) :
+		m_store(store) {}
+	virtual ~ArchetypeStoreComponent() { delete m_store; }
+	
+	virtual void ProcessInput(const Input& input, float delta) { m_store->ProcessInput(input, delta); }
+	virtual void Update(float delta)                           { m_store->Update(delta); }
+	virtual void Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const 
+	{ 
+		m_store->Render(shader, renderingEngine, camera); 
+	}
+	
+	//Systems draw through Render, and the legacy components are queued on their own.
+	virtual void AddToRenderQueue(RenderQueue& queue) const
+	{
+		queue.AddComponent(*this);
+		m_store->AddToRenderQueue(queue);
+	}
+	
+	virtual void AddToEngine(CoreEngine* engine) const { m_store->SetEngine(engine); }
+	
+	inline ArchetypeStore* GetStore() { return m_store; }
+private:
+	ArchetypeStore* m_store;
+};
+
+#endif // ARCHETYPESTORECOMPONENT_H
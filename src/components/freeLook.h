@@ -30,6 +30,7 @@ public:
 		m_windowCenter(windowCenter) {}
 	
 	virtual void ProcessInput(const Input& input, float delta);
+	virtual void AddToRenderQueue(RenderQueue& queue) const {}
 protected:
 private:
 	float    m_sensitivity;
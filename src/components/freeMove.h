@@ -31,6 +31,7 @@ public:
 		m_rightKey(rightKey) {}
 	
 	virtual void ProcessInput(const Input& input, float delta);
+	virtual void AddToRenderQueue(RenderQueue& queue) const {}
 protected:
 private:
 	void Move(const Vector3f& direction, float amt);
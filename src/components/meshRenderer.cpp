@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "meshRenderer.h"
+#include "../core/coreEngine.h"
+#include "../rendering/renderingEngine.h"
+#include "../rendering/shader.h"
+
+MeshRenderer::~MeshRenderer()
+{
+	RemoveFromSceneTree();
+}
+
+void MeshRenderer::Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const
+{
+	shader.Bind();
+	shader.UpdateUniforms(GetTransform(), m_material, renderingEngine, camera);
+	m_mesh.Draw();
+}
+
+void MeshRenderer::AddToRenderQueue(RenderQueue& queue) const
+{
+	//Without an engine the mesh isn't in the scene tree, so it's drawn the slow way.
+	if(!IsInSceneTree())
+	{
+		queue.AddMesh(m_mesh, m_material, GetTransform());
+	}
+}
+
+void MeshRenderer::AddToEngine(CoreEngine* engine) const
+{
+	RemoveFromSceneTree();
+	
+	m_renderingEngine = engine ? engine->GetRenderingEngine() : 0;
+	
+	if(m_renderingEngine)
+	{
+		m_renderingEngine->AddToSceneTree(&m_packet);
+		
+		//Only a packet in the scene tree needs to hear about the transform moving.
+		const_cast<Transform&>(GetTransform()).AddListener(const_cast<MeshRenderer*>(this));
+	}
+}
+
+void MeshRenderer::SetParent(Entity* parent)
+{
+	EntityComponent::SetParent(parent);
+	
+	m_packet = RenderPacket(m_mesh, m_material, *GetTransform());
+}
+
+void MeshRenderer::OnTransformChanged()
+{
+	if(IsInSceneTree())
+	{
+		m_renderingEngine->OnSceneTreePacketMoved(m_packet);
+	}
+}
+
+void MeshRenderer::RemoveFromSceneTree() const
+{
+	//Only a renderer attached to an entity can have joined the scene tree.
+	if(IsInSceneTree())
+	{
+		m_renderingEngine->RemoveFromSceneTree(&m_packet);
+		const_cast<Transform&>(GetTransform()).RemoveListener(const_cast<MeshRenderer*>(this));
+	}
+}
@@ -19,24 +19,34 @@
 
 #include "../core/entityComponent.h"
 #include "../rendering/mesh.h"
+#include "../rendering/boundingVolumeHierarchy.h"
 
-class MeshRenderer : public EntityComponent
+//Draws a mesh at its entity's transform. Once the component is added to an engine,
+//the mesh lives in the RenderingEngine's scene tree and follows the transform there.
+class MeshRenderer : public EntityComponent, public TransformListener
 {
 public:
 	MeshRenderer(const Mesh& mesh, const Material& material) :
 		m_mesh(mesh),
-		m_material(material) {}
+		m_material(material),
+		m_renderingEngine(0) {}
+	virtual ~MeshRenderer();
 
-	virtual void Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const
-	{
-		shader.Bind();
-		shader.UpdateUniforms(GetTransform(), m_material, renderingEngine, camera);
-		m_mesh.Draw();
-	}
+	virtual void Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const;
+	virtual void AddToRenderQueue(RenderQueue& queue) const;
+	virtual void AddToEngine(CoreEngine* engine) const;
+	virtual void SetParent(Entity* parent);
+	virtual void OnTransformChanged();
 protected:
 private:
-	Mesh m_mesh;
-	Material m_material;
+	Mesh                     m_mesh;
+	Material                 m_material;
+	mutable RenderPacket     m_packet;
+	mutable RenderingEngine* m_renderingEngine;
+	
+	void RemoveFromSceneTree() const;
+	
+	inline bool IsInSceneTree() const { return m_packet.GetSceneTreeHandle() != BoundingVolumeHierarchy::INVALID_HANDLE; }
 };
 
 #endif // MESHRENDERER_H_INCLUDED
@@ -31,6 +31,7 @@ public:
 		m_physicsEngine(engine) {}
 
 	virtual void Update(float delta);
+	virtual void AddToRenderQueue(RenderQueue& queue) const {}
 
 	inline const PhysicsEngine& GetPhysicsEngine() { return m_physicsEngine; }
 private:
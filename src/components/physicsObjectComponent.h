@@ -31,6 +31,7 @@ public:
 		m_physicsObject(object) {}
 
 	virtual void Update(float delta);
+	virtual void AddToRenderQueue(RenderQueue& queue) const {}
 private:
 	const PhysicsObject* m_physicsObject;
 };
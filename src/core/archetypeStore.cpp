@@ -0,0 +1,508 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "archetypeStore.h"
+#include "entity.h"
+#include "entityComponent.h"
+#include "profiling.h"
+#include <cassert>
+#include <cstring>
+#include <cstdio>
+
+std::vector<int> ComponentTypeRegistry::s_sizes;
+
+int ComponentTypeRegistry::Register(int size)
+{
+	assert(s_sizes.size() < MAX_COMPONENT_TYPES);
+	s_sizes.push_back(size);
+	return (int)s_sizes.size() - 1;
+}
+
+Archetype::Archetype(ComponentMask mask) :
+	m_mask(mask)
+{
+	for(int i = 0; i < ComponentTypeRegistry::MAX_COMPONENT_TYPES; i++)
+	{
+		m_columnIndices[i] = -1;
+		
+		if(mask & (((ComponentMask)1) << i))
+		{
+			m_columnIndices[i] = (int)m_columns.size();
+			m_columnTypes.push_back(i);
+			m_columns.push_back(std::vector<unsigned char>());
+		}
+	}
+}
+
+int Archetype::AddRow(int handle)
+{
+	for(unsigned int i = 0; i < m_columns.size(); i++)
+	{
+		m_columns[i].resize(m_columns[i].size() + ComponentTypeRegistry::GetSize(m_columnTypes[i]), 0);
+	}
+	
+	m_handles.push_back(handle);
+	return (int)m_handles.size() - 1;
+}
+
+int Archetype::RemoveRow(int row)
+{
+	int lastRow = (int)m_handles.size() - 1;
+	int movedHandle = -1;
+	
+	for(unsigned int i = 0; i < m_columns.size(); i++)
+	{
+		int size = ComponentTypeRegistry::GetSize(m_columnTypes[i]);
+		
+		if(row != lastRow)
+		{
+			memcpy(&m_columns[i][row * size], &m_columns[i][lastRow * size], size);
+		}
+		
+		m_columns[i].resize(lastRow * size);
+	}
+	
+	if(row != lastRow)
+	{
+		m_handles[row] = m_handles[lastRow];
+		movedHandle = m_handles[row];
+	}
+	
+	m_handles.pop_back();
+	return movedHandle;
+}
+
+ArchetypeStore::ArchetypeStore() :
+	m_coreEngine(0) {}
+
+ArchetypeStore::~ArchetypeStore()
+{
+	for(unsigned int i = 0; i < m_archetypes.size(); i++)
+	{
+		LegacyHost* hosts = m_archetypes[i]->GetColumn<LegacyHost>();
+		
+		for(int j = 0; hosts && j < m_archetypes[i]->GetSize(); j++)
+		{
+			delete hosts[j].m_entity;
+		}
+		
+		delete m_archetypes[i];
+	}
+	
+	for(unsigned int i = 0; i < m_systems.size(); i++)
+	{
+		delete m_systems[i];
+	}
+}
+
+int ArchetypeStore::CreateEntity()
+{
+	int handle;
+	
+	if(m_freeHandles.empty())
+	{
+		handle = (int)m_records.size();
+		m_records.push_back(EntityRecord());
+	}
+	else
+	{
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+	
+	Archetype* archetype = FindOrCreateArchetype(0);
+	m_records[handle] = EntityRecord(archetype, archetype->AddRow(handle));
+	return handle;
+}
+
+int ArchetypeStore::CreateEntity(const Vector3f& pos, const Quaternion& rot, float scale)
+{
+	int handle = CreateEntity();
+	
+	TransformData transform;
+	transform.m_pos = pos;
+	transform.m_rot = rot;
+	transform.m_scale = scale;
+	AddComponent(handle, transform);
+	
+	return handle;
+}
+
+void ArchetypeStore::DestroyEntity(int handle)
+{
+	EntityRecord& record = m_records[handle];
+	LegacyHost* host = GetComponent<LegacyHost>(handle);
+	
+	if(host)
+	{
+		delete host->m_entity;
+	}
+	
+	int movedHandle = record.m_archetype->RemoveRow(record.m_row);
+	if(movedHandle != -1)
+	{
+		m_records[movedHandle].m_row = record.m_row;
+	}
+	
+	record = EntityRecord();
+	m_freeHandles.push_back(handle);
+}
+
+void ArchetypeStore::AddLegacyComponent(int handle, EntityComponent* component)
+{
+	LegacyHost* host = GetComponent<LegacyHost>(handle);
+	
+	if(!host)
+	{
+		LegacyHost newHost;
+		newHost.m_entity = new Entity();
+		newHost.m_entity->SetEngine(m_coreEngine);
+		AddComponent(handle, newHost);
+		
+		host = GetComponent<LegacyHost>(handle);
+	}
+	
+	TransformData* transform = GetComponent<TransformData>(handle);
+	if(transform)
+	{
+		Transform* hostTransform = host->m_entity->GetTransform();
+		hostTransform->SetPos(transform->m_pos);
+		hostTransform->SetRot(transform->m_rot);
+		hostTransform->SetScale(transform->m_scale);
+	}
+	
+	//Entity::AddComponent doesn't announce components to an engine that is already set,
+	//so this has to happen here to let cameras and lights register themselves.
+	host->m_entity->AddComponent(component);
+	if(m_coreEngine)
+	{
+		component->AddToEngine(m_coreEngine);
+	}
+}
+
+ArchetypeStore* ArchetypeStore::AddSystem(ArchetypeSystem* system)
+{
+	m_systems.push_back(system);
+	return this;
+}
+
+void ArchetypeStore::ProcessInput(const Input& input, float delta)
+{
+	ComponentMask legacyMask = ComponentType<LegacyHost>::GetMask();
+	
+	for(unsigned int i = 0; i < m_systems.size(); i++)
+	{
+		ComponentMask required = m_systems[i]->GetRequiredComponents();
+		
+		for(unsigned int j = 0; j < m_archetypes.size(); j++)
+		{
+			if((m_archetypes[j]->GetMask() & required) == required && m_archetypes[j]->GetSize() > 0)
+			{
+				m_systems[i]->ProcessInput(*m_archetypes[j], input, delta);
+			}
+		}
+	}
+	
+	for(unsigned int i = 0; i < m_archetypes.size(); i++)
+	{
+		if(m_archetypes[i]->GetMask() & legacyMask)
+		{
+			Archetype& archetype = *m_archetypes[i];
+			LegacyHost* hosts = archetype.GetColumn<LegacyHost>();
+			
+			CopyToLegacyHosts(archetype);
+			for(int j = 0; j < archetype.GetSize(); j++)
+			{
+				hosts[j].m_entity->ProcessInputAll(input, delta);
+			}
+			CopyFromLegacyHosts(archetype);
+		}
+	}
+}
+
+void ArchetypeStore::Update(float delta)
+{
+	ComponentMask legacyMask = ComponentType<LegacyHost>::GetMask();
+	
+	for(unsigned int i = 0; i < m_systems.size(); i++)
+	{
+		ComponentMask required = m_systems[i]->GetRequiredComponents();
+		
+		for(unsigned int j = 0; j < m_archetypes.size(); j++)
+		{
+			if((m_archetypes[j]->GetMask() & required) == required && m_archetypes[j]->GetSize() > 0)
+			{
+				m_systems[i]->Update(*m_archetypes[j], delta);
+			}
+		}
+	}
+	
+	for(unsigned int i = 0; i < m_archetypes.size(); i++)
+	{
+		if(m_archetypes[i]->GetMask() & legacyMask)
+		{
+			Archetype& archetype = *m_archetypes[i];
+			LegacyHost* hosts = archetype.GetColumn<LegacyHost>();
+			
+			CopyToLegacyHosts(archetype);
+			for(int j = 0; j < archetype.GetSize(); j++)
+			{
+				hosts[j].m_entity->UpdateAll(delta);
+			}
+			CopyFromLegacyHosts(archetype);
+		}
+	}
+}
+
+void ArchetypeStore::Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const
+{
+	for(unsigned int i = 0; i < m_systems.size(); i++)
+	{
+		ComponentMask required = m_systems[i]->GetRequiredComponents();
+		
+		for(unsigned int j = 0; j < m_archetypes.size(); j++)
+		{
+			if((m_archetypes[j]->GetMask() & required) == required && m_archetypes[j]->GetSize() > 0)
+			{
+				m_systems[i]->Render(*m_archetypes[j], shader, renderingEngine, camera);
+			}
+		}
+	}
+}
+
+void ArchetypeStore::AddToRenderQueue(RenderQueue& queue) const
+{
+	ComponentMask legacyMask = ComponentType<LegacyHost>::GetMask();
+	
+	//Host transforms were brought up to date at the end of the last update. Components 
+	//in the scene tree, like MeshRenderers added to an engine, add nothing here.
+	for(unsigned int i = 0; i < m_archetypes.size(); i++)
+	{
+		if(m_archetypes[i]->GetMask() & legacyMask)
+		{
+			const LegacyHost* hosts = ((const Archetype*)m_archetypes[i])->GetColumn<LegacyHost>();
+			
+			for(int j = 0; j < m_archetypes[i]->GetSize(); j++)
+			{
+				hosts[j].m_entity->AddToRenderQueueAll(queue);
+			}
+		}
+	}
+}
+
+void ArchetypeStore::SetEngine(CoreEngine* engine)
+{
+	m_coreEngine = engine;
+	
+	for(unsigned int i = 0; i < m_archetypes.size(); i++)
+	{
+		LegacyHost* hosts = m_archetypes[i]->GetColumn<LegacyHost>();
+		
+		for(int j = 0; hosts && j < m_archetypes[i]->GetSize(); j++)
+		{
+			hosts[j].m_entity->SetEngine(engine);
+		}
+	}
+}
+
+void ArchetypeStore::SetMask(int handle, ComponentMask mask)
+{
+	EntityRecord& record = m_records[handle];
+	Archetype* source = record.m_archetype;
+	
+	if(source->GetMask() == mask)
+	{
+		return;
+	}
+	
+	Archetype* dest = FindOrCreateArchetype(mask);
+	int destRow = dest->AddRow(handle);
+	
+	//Components the entity keeps are copied over; new ones start zeroed.
+	for(int typeId = 0; typeId < ComponentTypeRegistry::GetNumTypes(); typeId++)
+	{
+		if(source->HasComponent(typeId) && dest->HasComponent(typeId))
+		{
+			memcpy(dest->GetElement(typeId, destRow), source->GetElement(typeId, record.m_row), ComponentTypeRegistry::GetSize(typeId));
+		}
+	}
+	
+	int movedHandle = source->RemoveRow(record.m_row);
+	if(movedHandle != -1)
+	{
+		m_records[movedHandle].m_row = record.m_row;
+	}
+	
+	record = EntityRecord(dest, destRow);
+}
+
+Archetype* ArchetypeStore::FindOrCreateArchetype(ComponentMask mask)
+{
+	std::map<ComponentMask, Archetype*>::iterator it = m_archetypeMap.find(mask);
+	
+	if(it != m_archetypeMap.end())
+	{
+		return it->second;
+	}
+	
+	Archetype* archetype = new Archetype(mask);
+	m_archetypeMap.insert(std::pair<ComponentMask, Archetype*>(mask, archetype));
+	m_archetypes.push_back(archetype);
+	return archetype;
+}
+
+void ArchetypeStore::CopyToLegacyHosts(Archetype& archetype)
+{
+	const TransformData* transforms = archetype.GetColumn<TransformData>();
+	LegacyHost* hosts = archetype.GetColumn<LegacyHost>();
+	
+	for(int i = 0; transforms && i < archetype.GetSize(); i++)
+	{
+		Transform* hostTransform = hosts[i].m_entity->GetTransform();
+		hostTransform->SetPos(transforms[i].m_pos);
+		hostTransform->SetRot(transforms[i].m_rot);
+		hostTransform->SetScale(transforms[i].m_scale);
+	}
+}
+
+void ArchetypeStore::CopyFromLegacyHosts(Archetype& archetype)
+{
+	TransformData* transforms = archetype.GetColumn<TransformData>();
+	const LegacyHost* hosts = archetype.GetColumn<LegacyHost>();
+	
+	for(int i = 0; transforms && i < archetype.GetSize(); i++)
+	{
+		const Transform& hostTransform = *hosts[i].m_entity->GetTransform();
+		transforms[i].m_pos = hostTransform.GetPos();
+		transforms[i].m_rot = hostTransform.GetRot();
+		transforms[i].m_scale = hostTransform.GetScale();
+	}
+}
+
+class VelocityData
+{
+public:
+	Vector3f m_velocity;
+};
+
+class MoveSystem : public ArchetypeSystem
+{
+public:
+	MoveSystem() :
+		ArchetypeSystem(ComponentType<TransformData>::GetMask() | ComponentType<VelocityData>::GetMask()) {}
+	
+	virtual void Update(Archetype& archetype, float delta)
+	{
+		TransformData* transforms = archetype.GetColumn<TransformData>();
+		const VelocityData* velocities = archetype.GetColumn<VelocityData>();
+		
+		for(int i = 0; i < archetype.GetSize(); i++)
+		{
+			transforms[i].m_pos += velocities[i].m_velocity * delta;
+		}
+	}
+};
+
+//The same work as MoveSystem, done the EntityComponent way.
+class MoveComponent : public EntityComponent
+{
+public:
+	MoveComponent(const Vector3f& velocity) :
+		m_velocity(velocity) {}
+	
+	virtual void Update(float delta)
+	{
+		GetTransform()->SetPos(*GetTransform()->GetPos() + m_velocity * delta);
+	}
+private:
+	Vector3f m_velocity;
+};
+
+void ArchetypeStore::Test()
+{
+	ArchetypeStore store;
+	store.AddSystem(new MoveSystem());
+	
+	VelocityData velocity;
+	velocity.m_velocity = Vector3f(1.0f, 0.0f, 0.0f);
+	
+	int still = store.CreateEntity(Vector3f(0.0f, 0.0f, 0.0f));
+	int moving = store.CreateEntity(Vector3f(0.0f, 1.0f, 0.0f));
+	int legacy = store.CreateEntity(Vector3f(0.0f, 2.0f, 0.0f));
+	store.AddComponent(moving, velocity);
+	store.AddLegacyComponent(legacy, new MoveComponent(Vector3f(0.0f, 0.0f, 1.0f)));
+	
+	assert(store.GetNumEntities() == 3);
+	assert(store.GetComponent<VelocityData>(still) == 0);
+	
+	store.Update(2.0f);
+	assert(store.GetComponent<TransformData>(still)->m_pos == Vector3f(0.0f, 0.0f, 0.0f));
+	assert(store.GetComponent<TransformData>(moving)->m_pos == Vector3f(2.0f, 1.0f, 0.0f));
+	assert(store.GetComponent<TransformData>(legacy)->m_pos == Vector3f(0.0f, 2.0f, 2.0f));
+	
+	//Moving an entity between archetypes must keep its data and the rows of the others.
+	store.AddComponent(still, velocity);
+	store.RemoveComponent<VelocityData>(moving);
+	store.Update(1.0f);
+	assert(store.GetComponent<TransformData>(still)->m_pos == Vector3f(1.0f, 0.0f, 0.0f));
+	assert(store.GetComponent<TransformData>(moving)->m_pos == Vector3f(2.0f, 1.0f, 0.0f));
+	
+	store.DestroyEntity(still);
+	assert(store.GetNumEntities() == 2);
+	assert(store.CreateEntity() == still);
+	assert(store.GetComponent<TransformData>(moving)->m_pos == Vector3f(2.0f, 1.0f, 0.0f));
+}
+
+void ArchetypeStore::Benchmark(int numEntities)
+{
+	static const int NUM_ITERATIONS = 20;
+	
+	Entity root;
+	ArchetypeStore store;
+	store.AddSystem(new MoveSystem());
+	
+	VelocityData velocity;
+	velocity.m_velocity = Vector3f(1.0f, 0.0f, 0.0f);
+	
+	for(int i = 0; i < numEntities; i++)
+	{
+		Vector3f pos((float)(i % 100), (float)(i / 100), 1.0f);
+		
+		root.AddChild((new Entity(pos))->AddComponent(new MoveComponent(velocity.m_velocity)));
+		store.AddComponent(store.CreateEntity(pos), velocity);
+	}
+	
+	ProfileTimer entityTimer;
+	ProfileTimer storeTimer;
+	
+	for(int iteration = 0; iteration < NUM_ITERATIONS; iteration++)
+	{
+		entityTimer.StartInvocation();
+		root.UpdateAll(0.01f);
+		entityTimer.StopInvocation();
+		
+		storeTimer.StartInvocation();
+		store.Update(0.01f);
+		storeTimer.StopInvocation();
+	}
+	
+	double entityTime = entityTimer.GetTimeAndReset();
+	double storeTime = storeTimer.GetTimeAndReset();
+	
+	printf("Entity update benchmark, %d entities:\n", numEntities);
+	printf("Entity::UpdateAll:                      %f entities/s\n", (1000.0 * numEntities) / entityTime);
+	printf("ArchetypeStore::Update:                 %f entities/s\n\n", (1000.0 * numEntities) / storeTime);
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ARCHETYPESTORE_H
+#define ARCHETYPESTORE_H
+
+#include "math3d.h"
+#include "input.h"
+#include <vector>
+#include <map>
+class Camera;
+class CoreEngine;
+class Entity;
+class EntityComponent;
+class RenderingEngine;
+class RenderQueue;
+class Shader;
+
+//A bitmask with one bit per component type, so at most 64 component types exist.
+typedef unsigned long long ComponentMask;
+
+//Gives every component type a small id, in the order the types are first used.
+class ComponentTypeRegistry
+{
+public:
+	static const int MAX_COMPONENT_TYPES = 64;
+	
+	static int Register(int size);
+	static inline int GetSize(int typeId) { return s_sizes[typeId]; }
+	static inline int GetNumTypes()       { return (int)s_sizes.size(); }
+private:
+	static std::vector<int> s_sizes;
+};
+
+template<class T>
+class ComponentType
+{
+public:
+	static inline int GetId()
+	{
+		static const int id = ComponentTypeRegistry::Register(sizeof(T));
+		return id;
+	}
+	
+	static inline ComponentMask GetMask() { return ((ComponentMask)1) << GetId(); }
+};
+
+//Components stored in an ArchetypeStore are plain data. They are moved around with
+//memcpy and start out zeroed, so they must not have virtual functions, pointers they
+//own, or members that rely on their constructor or destructor.
+class TransformData
+{
+public:
+	Vector3f   m_pos;
+	Quaternion m_rot;
+	float      m_scale;
+};
+
+//All entities with exactly the same set of components share an Archetype, which
+//stores each component type in its own packed column. Entities are rows, and rows
+//are kept packed by moving the last row into any hole left behind.
+class Archetype
+{
+public:
+	Archetype(ComponentMask mask);
+	
+	int AddRow(int handle);
+	int RemoveRow(int row); //Returns the handle of the entity moved into row, or -1
+	
+	inline ComponentMask GetMask()             const { return m_mask; }
+	inline int GetSize()                       const { return (int)m_handles.size(); }
+	inline int GetHandle(int row)              const { return m_handles[row]; }
+	inline bool HasComponent(int typeId)       const { return m_columnIndices[typeId] != -1; }
+	
+	inline void* GetElement(int typeId, int row)
+	{
+		return &m_columns[m_columnIndices[typeId]][row * ComponentTypeRegistry::GetSize(typeId)];
+	}
+	
+	template<class T> inline T* GetColumn()
+	{
+		int columnIndex = m_columnIndices[ComponentType<T>::GetId()];
+		return (columnIndex == -1 || m_handles.empty()) ? 0 : (T*)&m_columns[columnIndex][0];
+	}
+	
+	template<class T> inline const T* GetColumn() const
+	{
+		int columnIndex = m_columnIndices[ComponentType<T>::GetId()];
+		return (columnIndex == -1 || m_handles.empty()) ? 0 : (const T*)&m_columns[columnIndex][0];
+	}
+private:
+	ComponentMask                            m_mask;
+	int                                      m_columnIndices[ComponentTypeRegistry::MAX_COMPONENT_TYPES]; //-1 for missing types
+	std::vector<int>                         m_columnTypes;
+	std::vector<std::vector<unsigned char> > m_columns;
+	std::vector<int>                         m_handles;
+};
+
+//Systems hold the logic for archetype components. The store calls a system once for
+//every archetype that has all of its required components, and the system then walks
+//the columns itself, so there is one virtual call per archetype instead of one per component.
+class ArchetypeSystem
+{
+public:
+	ArchetypeSystem(ComponentMask requiredComponents) :
+		m_requiredComponents(requiredComponents) {}
+	virtual ~ArchetypeSystem() {}
+	
+	virtual void ProcessInput(Archetype& archetype, const Input& input, float delta) {}
+	virtual void Update(Archetype& archetype, float delta) {}
+	virtual void Render(const Archetype& archetype, const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const {}
+	
+	inline ComponentMask GetRequiredComponents() const { return m_requiredComponents; }
+private:
+	ComponentMask m_requiredComponents;
+};
+
+//Entity storage grouped by archetype, as an alternative to the Entity tree for
+//scenes with large numbers of similar entities. Transforms in the store are in world space.
+//
+//Existing EntityComponents can still be used through AddLegacyComponent. These are
+//attached to a hidden Entity, whose transform is kept in sync with the entity's
+//TransformData. They're updated after all systems have run, and go through the
+//RenderQueue like the components of any other Entity.
+class ArchetypeStore
+{
+public:
+	ArchetypeStore();
+	virtual ~ArchetypeStore();
+	
+	int CreateEntity();
+	int CreateEntity(const Vector3f& pos, const Quaternion& rot = Quaternion(0,0,0,1), float scale = 1.0f);
+	void DestroyEntity(int handle);
+	
+	template<class T> void AddComponent(int handle, const T& component)
+	{
+		int typeId = ComponentType<T>::GetId();
+		SetMask(handle, m_records[handle].m_archetype->GetMask() | ComponentType<T>::GetMask());
+		*(T*)m_records[handle].m_archetype->GetElement(typeId, m_records[handle].m_row) = component;
+	}
+	
+	template<class T> void RemoveComponent(int handle)
+	{
+		SetMask(handle, m_records[handle].m_archetype->GetMask() & ~ComponentType<T>::GetMask());
+	}
+	
+	template<class T> T* GetComponent(int handle)
+	{
+		int typeId = ComponentType<T>::GetId();
+		Archetype* archetype = m_records[handle].m_archetype;
+		return archetype->HasComponent(typeId) ? (T*)archetype->GetElement(typeId, m_records[handle].m_row) : 0;
+	}
+	
+	//Adds an existing EntityComponent to the entity. The store takes ownership of it.
+	void AddLegacyComponent(int handle, EntityComponent* component);
+	ArchetypeStore* AddSystem(ArchetypeSystem* system);
+	
+	void ProcessInput(const Input& input, float delta);
+	void Update(float delta);
+	void Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const;
+	void AddToRenderQueue(RenderQueue& queue) const;
+	void SetEngine(CoreEngine* engine);
+	
+	inline int GetNumEntities()             const { return (int)m_records.size() - (int)m_freeHandles.size(); }
+	inline int GetNumArchetypes()           const { return (int)m_archetypes.size(); }
+	inline Archetype* GetArchetype(int index)     { return m_archetypes[index]; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+	/** Prints entity updates per second for this class next to the Entity tree */
+	static void Benchmark(int numEntities);
+protected:
+private:
+	class EntityRecord
+	{
+	public:
+		EntityRecord(Archetype* archetype = 0, int row = 0) :
+			m_archetype(archetype),
+			m_row(row) {}
+		
+		Archetype* m_archetype;
+		int        m_row;
+	};
+	
+	class LegacyHost
+	{
+	public:
+		Entity* m_entity;
+	};
+	
+	void SetMask(int handle, ComponentMask mask);
+	Archetype* FindOrCreateArchetype(ComponentMask mask);
+	void CopyToLegacyHosts(Archetype& archetype);
+	void CopyFromLegacyHosts(Archetype& archetype);
+	
+	std::vector<EntityRecord>            m_records;      //Indexed by entity handle
+	std::vector<int>                     m_freeHandles;
+	std::map<ComponentMask, Archetype*>  m_archetypeMap;
+	std::vector<Archetype*>              m_archetypes;
+	std::vector<ArchetypeSystem*>        m_systems;
+	CoreEngine*                          m_coreEngine;
+	
+	ArchetypeStore(const ArchetypeStore& other) {}
+	void operator=(const ArchetypeStore& other) {}
+};
+
+#endif // ARCHETYPESTORE_H
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "assetLoader.h"
+#include "timing.h"
+#include <cassert>
+
+AssetLoader::AssetLoader(int numThreads) :
+	m_loadLock(0),
+	m_uploadLock(0)
+{
+	m_loadSemaphore = SDL_CreateSemaphore(0);
+	SDL_AtomicSet(&m_isRunning, 1);
+	SDL_AtomicSet(&m_numPending, 0);
+	
+	m_threads.reserve(numThreads);
+	for(int i = 0; i < numThreads; i++)
+	{
+		m_threads.push_back(SDL_CreateThread(LoaderMain, "AssetLoader", this));
+	}
+}
+
+AssetLoader::~AssetLoader()
+{
+	//Requests that haven't been uploaded yet are dropped. Flush first to keep them.
+	SDL_AtomicSet(&m_isRunning, 0);
+	
+	for(unsigned int i = 0; i < m_threads.size(); i++)
+	{
+		SDL_SemPost(m_loadSemaphore);
+	}
+	
+	for(unsigned int i = 0; i < m_threads.size(); i++)
+	{
+		SDL_WaitThread(m_threads[i], 0);
+	}
+	
+	SDL_DestroySemaphore(m_loadSemaphore);
+}
+
+void AssetLoader::Load(AssetFunction load, AssetFunction upload, void* data)
+{
+	SDL_AtomicAdd(&m_numPending, 1);
+	
+	if(m_threads.empty())
+	{
+		load(data);
+		OnLoaded(Request(load, upload, data));
+		return;
+	}
+	
+	SDL_AtomicLock(&m_loadLock);
+	m_loads.push_back(Request(load, upload, data));
+	SDL_AtomicUnlock(&m_loadLock);
+	
+	SDL_SemPost(m_loadSemaphore);
+}
+
+int AssetLoader::ProcessUploads(double timeBudget)
+{
+	double endTime = Time::GetTime() + timeBudget;
+	int numUploaded = 0;
+	
+	while(numUploaded == 0 || Time::GetTime() < endTime)
+	{
+		if(!TryUpload())
+		{
+			break;
+		}
+		
+		numUploaded++;
+	}
+	
+	return numUploaded;
+}
+
+void AssetLoader::Flush()
+{
+	//Rather than blocking, help out until everything has been uploaded.
+	while(GetNumPending() > 0)
+	{
+		if(!TryUpload())
+		{
+			TryLoad();
+		}
+	}
+}
+
+AssetLoader& AssetLoader::GetAssetLoader()
+{
+	//Never destroyed, so loads still running at shutdown never see a dead loader.
+	static AssetLoader* loader = new AssetLoader();
+	return *loader;
+}
+
+int AssetLoader::LoaderMain(void* data)
+{
+	AssetLoader* loader = (AssetLoader*)data;
+	
+	while(SDL_AtomicGet(&loader->m_isRunning))
+	{
+		if(!loader->TryLoad())
+		{
+			SDL_SemWait(loader->m_loadSemaphore);
+		}
+	}
+	
+	return 0;
+}
+
+bool AssetLoader::TryLoad()
+{
+	Request request;
+	bool found = false;
+	
+	SDL_AtomicLock(&m_loadLock);
+	if(!m_loads.empty())
+	{
+		request = m_loads.front();
+		m_loads.pop_front();
+		found = true;
+	}
+	SDL_AtomicUnlock(&m_loadLock);
+	
+	if(found)
+	{
+		request.m_load(request.m_data);
+		OnLoaded(request);
+	}
+	
+	return found;
+}
+
+bool AssetLoader::TryUpload()
+{
+	Request request;
+	bool found = false;
+	
+	SDL_AtomicLock(&m_uploadLock);
+	if(!m_uploads.empty())
+	{
+		request = m_uploads.front();
+		m_uploads.pop_front();
+		found = true;
+	}
+	SDL_AtomicUnlock(&m_uploadLock);
+	
+	if(found)
+	{
+		request.m_upload(request.m_data);
+		SDL_AtomicAdd(&m_numPending, -1);
+	}
+	
+	return found;
+}
+
+void AssetLoader::OnLoaded(const Request& request)
+{
+	//The lock also makes everything the load wrote visible to the uploading thread.
+	SDL_AtomicLock(&m_uploadLock);
+	m_uploads.push_back(request);
+	SDL_AtomicUnlock(&m_uploadLock);
+}
+
+//Squares its value when loaded, and counts uploads only if the load has already happened.
+class TestAsset
+{
+public:
+	TestAsset(int value = 0, int* numUploaded = 0) :
+		m_value(value),
+		m_numUploaded(numUploaded) {}
+	
+	static void Load(void* data)
+	{
+		TestAsset* asset = (TestAsset*)data;
+		asset->m_value *= asset->m_value;
+	}
+	
+	static void Upload(void* data)
+	{
+		TestAsset* asset = (TestAsset*)data;
+		if(asset->m_value < 0)
+		{
+			return;
+		}
+		
+		(*asset->m_numUploaded)++;
+		asset->m_value = -asset->m_value;
+	}
+	
+	int  m_value;
+	int* m_numUploaded;
+};
+
+void AssetLoader::Test()
+{
+	static const int NUM_ASSETS = 64;
+	TestAsset assets[NUM_ASSETS];
+	int numUploaded = 0;
+	
+	//Without threads, loads happen at once but uploads still wait to be processed.
+	{
+		AssetLoader loader(0);
+		for(int i = 0; i < 3; i++)
+		{
+			assets[i] = TestAsset(i + 1, &numUploaded);
+			loader.Load(TestAsset::Load, TestAsset::Upload, &assets[i]);
+		}
+		
+		assert(assets[2].m_value == 9);
+		assert(numUploaded == 0 && loader.GetNumPending() == 3);
+		
+		//Even without any budget, one upload always goes through.
+		int numProcessed = loader.ProcessUploads(0.0);
+		assert(numProcessed == 1);
+		assert(numUploaded == 1 && assets[0].m_value == -1);
+		
+		numProcessed = loader.ProcessUploads(1.0);
+		assert(numProcessed == 2);
+		numProcessed = loader.ProcessUploads(1.0);
+		assert(numProcessed == 0);
+		assert(numUploaded == 3 && loader.GetNumPending() == 0);
+	}
+	
+	numUploaded = 0;
+	{
+		AssetLoader loader(2);
+		for(int i = 0; i < NUM_ASSETS; i++)
+		{
+			assets[i] = TestAsset(i, &numUploaded);
+			loader.Load(TestAsset::Load, TestAsset::Upload, &assets[i]);
+		}
+		
+		loader.Flush();
+		assert(numUploaded == NUM_ASSETS && loader.GetNumPending() == 0);
+		
+		for(int i = 0; i < NUM_ASSETS; i++)
+		{
+			assert(assets[i].m_value == -i * i);
+		}
+	}
+}
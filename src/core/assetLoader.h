@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <SDL2/SDL.h>
+#include <deque>
+#include <vector>
+
+typedef void (*AssetFunction)(void* data);
+
+//The AssetLoader reads and decodes assets on threads of its own, and hands the results
+//back to the thread that owns the GL context to be uploaded. Assets are uploaded a few
+//at a time each frame, so loading in the background never causes a hitch.
+//
+//The loader threads are kept apart from the JobSystem's workers, which the main thread
+//helps out whenever it waits on them, so a long import can never hold up a frame.
+class AssetLoader
+{
+public:
+	//Loading mostly waits on the disk, so a couple of threads is enough. With no threads,
+	//everything is loaded as soon as it's requested, though still uploaded later.
+	AssetLoader(int numThreads = 2);
+	virtual ~AssetLoader();
+	
+	//Calls load on a loader thread, then upload on whichever thread calls ProcessUploads.
+	//upload is always called, and owns data from then on.
+	void Load(AssetFunction load, AssetFunction upload, void* data);
+	
+	//Uploads loaded assets until timeBudget seconds have passed, and returns how many
+	//were uploaded. At least one is always uploaded if any are ready, so a slow upload
+	//can't hold up the rest forever.
+	int ProcessUploads(double timeBudget);
+	
+	//Loads and uploads everything requested so far before returning, helping the
+	//loader threads out meanwhile.
+	void Flush();
+	
+	//Assets requested but not yet uploaded.
+	inline int GetNumPending() { return SDL_AtomicGet(&m_numPending); }
+	inline int GetNumThreads() const { return (int)m_threads.size(); }
+	
+	//The loader the engine's assets are loaded with, whose uploads CoreEngine processes every frame.
+	static AssetLoader& GetAssetLoader();
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	class Request
+	{
+	public:
+		Request(AssetFunction load = 0, AssetFunction upload = 0, void* data = 0) :
+			m_load(load),
+			m_upload(upload),
+			m_data(data) {}
+		
+		AssetFunction m_load;
+		AssetFunction m_upload;
+		void*         m_data;
+	};
+	
+	std::deque<Request>       m_loads;
+	SDL_SpinLock              m_loadLock;
+	std::deque<Request>       m_uploads;
+	SDL_SpinLock              m_uploadLock;
+	std::vector<SDL_Thread*>  m_threads;
+	SDL_sem*                  m_loadSemaphore;
+	SDL_atomic_t              m_isRunning;
+	SDL_atomic_t              m_numPending;
+	
+	static int LoaderMain(void* data);
+	
+	bool TryLoad();
+	bool TryUpload();
+	void OnLoaded(const Request& request);
+	
+	AssetLoader(const AssetLoader& other) {}
+	void operator=(const AssetLoader& other) {}
+};
+
+#endif // ASSETLOADER_H
@@ -17,19 +17,30 @@
 #include "coreEngine.h"
 #include "timing.h"
 #include "../rendering/window.h"
+#include "../rendering/glState.h"
 #include "input.h"
 #include "util.h"
 #include "game.h"
+#include "memoryPool.h"
+#include "frameArena.h"
+#include "assetLoader.h"
 
 #include <stdio.h>
+#include <algorithm>
 
-CoreEngine::CoreEngine(double frameRate, Window* window, RenderingEngine* renderingEngine, Game* game) :
+//How long, in seconds, each frame may spend uploading assets that have finished loading.
+static const double ASSET_UPLOAD_TIME_BUDGET = 0.002;
+
+CoreEngine::CoreEngine(double frameRate, Window* window, RenderingEngine* renderingEngine, Game* game, JobSystem* jobSystem) :
 	m_isRunning(false),
 	m_frameTime(1.0/frameRate),
 	m_window(window),
 	m_renderingEngine(renderingEngine),
-	m_game(game)
+	m_game(game),
+	m_jobSystem(jobSystem)
 {
+	m_renderingEngine->SetJobSystem(m_jobSystem);
+	
 	//We're telling the game about this engine so it can send the engine any information it needs
 	//to the various subsystems.
 	m_game->SetEngine(this);
@@ -57,9 +68,13 @@ void CoreEngine::Start()
 	ProfileTimer sleepTimer;
 	ProfileTimer swapBufferTimer;
 	ProfileTimer windowUpdateTimer;
+	ProfileTimer assetUploadTimer;
 	while(m_isRunning)
 	{
 		bool render = false;           //Whether or not the game needs to be rerendered.
+		
+		//Everything allocated from the frame arena during the last iteration is released here.
+		FrameArena::GetFrameArena().Reset();
 
 		double startTime = Time::GetTime();       //Current time at the start of the frame.
 		double passedTime = startTime - lastTime; //Amount of passed time since last frame.
@@ -80,11 +95,31 @@ void CoreEngine::Start()
 			totalMeasuredTime += m_renderingEngine->DisplayRenderTime((double)frames);
 			totalMeasuredTime += sleepTimer.DisplayAndReset("Sleep Time: ", (double)frames);
 			totalMeasuredTime += windowUpdateTimer.DisplayAndReset("Window Update Time: ", (double)frames);
+			totalMeasuredTime += assetUploadTimer.DisplayAndReset("Asset Upload Time: ", (double)frames);
 			totalMeasuredTime += swapBufferTimer.DisplayAndReset("Buffer Swap Time: ", (double)frames);
 			totalMeasuredTime += m_renderingEngine->DisplayWindowSyncTime((double)frames);
+			m_renderingEngine->DisplayOcclusionCullingTime((double)frames); //Already counted in the render time
 			
 			printf("Other Time:                             %f ms\n", (totalTime - totalMeasuredTime));
-			printf("Total Time:                             %f ms\n\n", totalTime);
+			printf("Total Time:                             %f ms\n", totalTime);
+			printf("Frame Arena Peak:                       %lu bytes\n", (unsigned long)FrameArena::GetFrameArena().GetPeakBytes());
+			printf("Assets Loading:                         %d\n", AssetLoader::GetAssetLoader().GetNumPending());
+			printf("Scene Draw Calls:                       %d\n", m_renderingEngine->GetNumDrawCalls());
+			printf("Scene Triangles Drawn:                  %d\n", m_renderingEngine->GetNumTriangles());
+			printf("Scene Meshes Visible/Culled:            %d / %d\n", m_renderingEngine->GetNumVisiblePackets(), m_renderingEngine->GetNumCulledPackets());
+			printf("Scene Meshes Occluded:                  %d\n", m_renderingEngine->GetNumOccludedPackets());
+			printf("Shadow Maps Cached/Rendered:            %f / %f (%.1f%% hit rate)\n", 
+				(double)m_renderingEngine->GetNumShadowMapsCached()/(double)frames, (double)m_renderingEngine->GetNumShadowMapsRendered()/(double)frames,
+				100.0 * (double)m_renderingEngine->GetNumShadowMapsCached()/
+				(double)std::max(1, m_renderingEngine->GetNumShadowMapsCached() + m_renderingEngine->GetNumShadowMapsRendered()));
+			printf("GL State Changes Issued/Skipped:        %f / %f\n\n", (double)GLState::GetNumIssued()/(double)frames, (double)GLState::GetNumSkipped()/(double)frames);
+			GLState::ResetCounters();
+			m_renderingEngine->ResetShadowMapCounters();
+			
+#if PROFILING_DISPLAY_MEMORY_POOLS != 0
+			MemoryPool::DisplayAllStats();
+			printf("\n");
+#endif
 			frames = 0;
 			frameCounter = 0;
 		}
@@ -121,6 +156,15 @@ void CoreEngine::Start()
 
 		if(render)
 		{
+			//Assets loaded in the background are uploaded a few at a time, so a burst
+			//of them finishing at once doesn't cause a hitch.
+			assetUploadTimer.StartInvocation();
+			if(AssetLoader::GetAssetLoader().ProcessUploads(ASSET_UPLOAD_TIME_BUDGET) > 0)
+			{
+				m_renderingEngine->OnAssetsUploaded();
+			}
+			assetUploadTimer.StopInvocation();
+			
 			m_game->Render(m_renderingEngine);
 			
 			//The newly rendered image will be in the window's backbuffer,
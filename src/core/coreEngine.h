@@ -20,18 +20,20 @@
 #include "../rendering/renderingEngine.h"
 #include <string>
 class Game;
+class JobSystem;
 
 //This is the central part of the game engine. It's purpose is to manage interaction 
 //between the various sub-engines (such as the rendering and physics engines) and the game itself.
 class CoreEngine
 {
 public:
-	CoreEngine(double frameRate, Window* window, RenderingEngine* renderingEngine, Game* game);
+	CoreEngine(double frameRate, Window* window, RenderingEngine* renderingEngine, Game* game, JobSystem* jobSystem = 0);
 	
 	void Start(); //Starts running the game; contains central game loop.
 	void Stop();  //Stops running the game, and disables all subsystems.
 	
 	inline RenderingEngine* GetRenderingEngine() { return m_renderingEngine; }
+	inline JobSystem* GetJobSystem()             { return m_jobSystem; }
 protected:
 private:
 	bool             m_isRunning;       //Whether or not the engine is running
@@ -39,6 +41,7 @@ private:
 	Window*          m_window;          //Used to display the game
 	RenderingEngine* m_renderingEngine; //Used to render the game. Stored as pointer so the user can pass in a derived class.
 	Game*            m_game;            //The game itself. Stored as pointer so the user can pass in a derived class.
+	JobSystem*       m_jobSystem;       //Runs work across threads. Optional; 0 means everything runs on the main thread.
 };
 
 #endif // COREENGINE_H
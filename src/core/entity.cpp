@@ -17,6 +17,14 @@
 #include "entity.h"
 #include "entityComponent.h"
 #include "coreEngine.h"
+#include "jobSystem.h"
+
+MemoryPool& Entity::GetMemoryPool()
+{
+	//Never destroyed, so entities deleted during shutdown can still be freed.
+	static MemoryPool* pool = new MemoryPool("Entity", sizeof(Entity));
+	return *pool;
+}
 
 Entity::~Entity()
 {
@@ -72,6 +80,45 @@ void Entity::UpdateAll(float delta)
 	}
 }
 
+//Everything an UpdateAllParallel batch needs to update its share of the children.
+class ParallelUpdateInfo
+{
+public:
+	ParallelUpdateInfo(Entity* parent, float delta) :
+		m_parent(parent),
+		m_delta(delta) {}
+	
+	Entity* m_parent;
+	float   m_delta;
+};
+
+void Entity::UpdateAllParallel(float delta, JobSystem* jobSystem)
+{
+	Update(delta);
+	
+	//Children compute their world matrices from this one, so it's resolved here,
+	//before several threads could try to recompute it at once.
+	m_transform.GetTransformation();
+	
+	//Several subtrees per batch keeps job overhead low for small scenes, while leaving
+	//enough batches for idle threads to steal when subtree sizes are uneven.
+	int numChildren = (int)m_children.size();
+	int batchSize = numChildren / (jobSystem->GetNumThreads() * 4);
+	
+	ParallelUpdateInfo info(this, delta);
+	jobSystem->ParallelFor(UpdateChildren, &info, numChildren, batchSize);
+}
+
+void Entity::UpdateChildren(void* data, int start, int end)
+{
+	ParallelUpdateInfo* info = (ParallelUpdateInfo*)data;
+	
+	for(int i = start; i < end; i++)
+	{
+		info->m_parent->m_children[i]->UpdateAll(info->m_delta);
+	}
+}
+
 void Entity::RenderAll(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const
 {
 	Render(shader, renderingEngine, camera);
@@ -82,10 +129,21 @@ void Entity::RenderAll(const Shader& shader, const RenderingEngine& renderingEng
 	}
 }
 
-void Entity::ProcessInput(const Input& input, float delta)
+void Entity::AddToRenderQueueAll(RenderQueue& queue) const
 {
-	m_transform.Update();
+	for(unsigned int i = 0; i < m_components.size(); i++)
+	{
+		m_components[i]->AddToRenderQueue(queue);
+	}
+
+	for(unsigned int i = 0; i < m_children.size(); i++)
+	{
+		m_children[i]->AddToRenderQueueAll(queue);
+	}
+}
 
+void Entity::ProcessInput(const Input& input, float delta)
+{
 	for(unsigned int i = 0; i < m_components.size(); i++)
 	{
 		m_components[i]->ProcessInput(input, delta);
@@ -129,13 +187,16 @@ void Entity::SetEngine(CoreEngine* engine)
 std::vector<Entity*> Entity::GetAllAttached()
 {
 	std::vector<Entity*> result;
-	
+	AddAllAttached(&result);
+	return result;
+}
+
+void Entity::AddAllAttached(std::vector<Entity*>* result)
+{
 	for(unsigned int i = 0; i < m_children.size(); i++)
 	{
-		std::vector<Entity*> childObjects = m_children[i]->GetAllAttached();
-		result.insert(result.end(), childObjects.begin(), childObjects.end());
+		m_children[i]->AddAllAttached(result);
 	}
 	
-	result.push_back(this);
-	return result;
+	result->push_back(this);
 }
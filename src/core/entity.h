@@ -20,11 +20,14 @@
 #include <vector>
 #include "transform.h"
 #include "input.h"
+#include "memoryPool.h"
 class Camera;
 class CoreEngine;
 class EntityComponent;
 class Shader;
 class RenderingEngine;
+class JobSystem;
+class RenderQueue;
 
 class Entity
 {
@@ -35,12 +38,20 @@ public:
 		
 	virtual ~Entity();
 	
+	static void* operator new(size_t size)                 { return GetMemoryPool().Allocate(size); }
+	static void operator delete(void* object, size_t size) { GetMemoryPool().Free(object, size); }
+	
 	Entity* AddChild(Entity* child);
 	Entity* AddComponent(EntityComponent* component);
 	
 	void ProcessInputAll(const Input& input, float delta);
 	void UpdateAll(float delta);
+	
+	//Updates this entity, then each child subtree as its own job. Only safe when
+	//components in different subtrees don't write to shared state.
+	void UpdateAllParallel(float delta, JobSystem* jobSystem);
 	void RenderAll(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const;
+	void AddToRenderQueueAll(RenderQueue& queue) const;
 	
 	std::vector<Entity*> GetAllAttached();
 	
@@ -57,6 +68,10 @@ private:
 	void Update(float delta);
 	void Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const;
 	
+	void AddAllAttached(std::vector<Entity*>* result);
+	static void UpdateChildren(void* data, int start, int end);
+	static MemoryPool& GetMemoryPool();
+	
 	Entity(const Entity& other) {}
 	void operator=(const Entity& other) {}
 };
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "entityComponent.h"
+
+#include <sstream>
+#include <cassert>
+
+static const int NUM_MEMORY_POOLS = (int)(EntityComponent::MAX_POOLED_SIZE / EntityComponent::POOL_SIZE_STEP);
+
+static MemoryPool** CreateMemoryPools();
+
+MemoryPool& EntityComponent::GetMemoryPool(size_t size)
+{
+	//Never destroyed, so components deleted during shutdown can still be freed.
+	static MemoryPool** pools = CreateMemoryPools();
+	
+	int index = size == 0 ? 0 : (int)((size - 1) / POOL_SIZE_STEP);
+	if(index >= NUM_MEMORY_POOLS)
+	{
+		index = NUM_MEMORY_POOLS - 1;
+	}
+	
+	return *pools[index];
+}
+
+void EntityComponent::Test()
+{
+	//Sizes in the same step share a pool, and different steps don't.
+	assert(&GetMemoryPool(1) == &GetMemoryPool(POOL_SIZE_STEP));
+	assert(&GetMemoryPool(POOL_SIZE_STEP + 1) == &GetMemoryPool(2 * POOL_SIZE_STEP));
+	assert(&GetMemoryPool(POOL_SIZE_STEP) != &GetMemoryPool(2 * POOL_SIZE_STEP));
+	
+	//Every pooled size is served from the pool, and anything bigger goes to the heap.
+	size_t sizes[] = { 1, POOL_SIZE_STEP, POOL_SIZE_STEP + 1, MAX_POOLED_SIZE, MAX_POOLED_SIZE + 1 };
+	
+	for(unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		MemoryPool& pool = GetMemoryPool(sizes[i]);
+		int numLiveObjects = pool.GetNumLiveObjects();
+		int numHeapObjects = pool.GetNumHeapObjects();
+		bool isPooled = sizes[i] <= MAX_POOLED_SIZE;
+		
+		void* component = EntityComponent::operator new(sizes[i]);
+		assert(pool.GetNumLiveObjects() == numLiveObjects + (isPooled ? 1 : 0));
+		assert(pool.GetNumHeapObjects() == numHeapObjects + (isPooled ? 0 : 1));
+		
+		EntityComponent::operator delete(component, sizes[i]);
+		assert(pool.GetNumLiveObjects() == numLiveObjects);
+	}
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static MemoryPool** CreateMemoryPools()
+{
+	MemoryPool** pools = new MemoryPool*[NUM_MEMORY_POOLS];
+	
+	for(int i = 0; i < NUM_MEMORY_POOLS; i++)
+	{
+		size_t blockSize = (i + 1) * EntityComponent::POOL_SIZE_STEP;
+		
+		std::ostringstream name;
+		name << "EntityComponent (" << blockSize << " bytes)";
+		pools[i] = new MemoryPool(name.str(), blockSize);
+	}
+	
+	return pools;
+}
@@ -20,6 +20,8 @@
 #include "transform.h"
 #include "entity.h"
 #include "input.h"
+#include "memoryPool.h"
+#include "../rendering/renderQueue.h"
 class RenderingEngine;
 class Shader;
 
@@ -29,17 +31,36 @@ public:
 	EntityComponent() :
 		m_parent(0) {}
 	virtual ~EntityComponent() {}
+	
+	static void* operator new(size_t size)                 { return GetMemoryPool(size).Allocate(size); }
+	static void operator delete(void* object, size_t size) { GetMemoryPool(size).Free(object, size); }
 
 	virtual void ProcessInput(const Input& input, float delta) {}
 	virtual void Update(float delta) {}
 	virtual void Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera) const {}
 	
+	//By default the component is drawn through its Render function in every pass.
+	//Components that draw nothing, or draw a single mesh, should override this.
+	virtual void AddToRenderQueue(RenderQueue& queue) const { queue.AddComponent(*this); }
+	
 	virtual void AddToEngine(CoreEngine* engine) const { }
 	
 	inline Transform* GetTransform()             { return m_parent->GetTransform(); }
 	inline const Transform& GetTransform() const { return *m_parent->GetTransform(); }
 	
 	virtual void SetParent(Entity* parent) { m_parent = parent; }
+	
+	//Components are pooled by size, in steps of POOL_SIZE_STEP, so components of the
+	//same type sit next to each other. The pools are created up front and looked up by
+	//index, so allocating only ever takes the chosen pool's own lock. Anything larger
+	//than MAX_POOLED_SIZE is passed on to the heap by the largest pool, and shows up in
+	//its heap counters.
+	static const size_t POOL_SIZE_STEP = 16;
+	static const size_t MAX_POOLED_SIZE = 512;
+	static MemoryPool& GetMemoryPool(size_t size);
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
 private:
 	Entity* m_parent;
 	
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frameArena.h"
+#include <cassert>
+
+FrameArena::FrameArena(size_t capacity) :
+	m_block((char*)::operator new(capacity)),
+	m_capacity(capacity),
+	m_offset(0),
+	m_usedBytes(0),
+	m_peakBytes(0),
+	m_lock(0) {}
+
+FrameArena::~FrameArena()
+{
+	for(unsigned int i = 0; i < m_overflowBlocks.size(); i++)
+	{
+		::operator delete(m_overflowBlocks[i]);
+	}
+	
+	::operator delete(m_block);
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	SDL_AtomicLock(&m_lock);
+	
+	size_t start = (m_offset + alignment - 1) & ~(alignment - 1);
+	void* result;
+	
+	if(start + size <= m_capacity)
+	{
+		result = m_block + start;
+		m_usedBytes += (start + size) - m_offset;
+		m_offset = start + size;
+	}
+	else
+	{
+		//::operator new already aligns for any built in type, which covers
+		//everything the engine puts in here.
+		result = ::operator new(size);
+		m_overflowBlocks.push_back((char*)result);
+		m_usedBytes += size;
+	}
+	
+	SDL_AtomicUnlock(&m_lock);
+	return result;
+}
+
+void FrameArena::Reset()
+{
+	SDL_AtomicLock(&m_lock);
+	
+	if(m_usedBytes > m_peakBytes)
+	{
+		m_peakBytes = m_usedBytes;
+	}
+	
+	if(!m_overflowBlocks.empty())
+	{
+		for(unsigned int i = 0; i < m_overflowBlocks.size(); i++)
+		{
+			::operator delete(m_overflowBlocks[i]);
+		}
+		m_overflowBlocks.clear();
+		
+		//Grow so that a frame like this one fits next time, with some room to spare.
+		while(m_capacity < m_peakBytes + m_peakBytes / 2)
+		{
+			m_capacity *= 2;
+		}
+		
+		::operator delete(m_block);
+		m_block = (char*)::operator new(m_capacity);
+	}
+	
+	m_offset = 0;
+	m_usedBytes = 0;
+	
+	SDL_AtomicUnlock(&m_lock);
+}
+
+FrameArena& FrameArena::GetFrameArena()
+{
+	//Never destroyed, so nothing running during shutdown can use a dead arena.
+	static FrameArena* arena = new FrameArena();
+	return *arena;
+}
+
+void FrameArena::Test()
+{
+	FrameArena arena(256);
+	
+	char* a = (char*)arena.Allocate(10);
+	char* b = (char*)arena.Allocate(10);
+	assert(b - a == 16);
+	assert(arena.GetUsedBytes() == 26);
+	
+	//Too big for the block, so it spills over and the block grows at the next reset.
+	arena.Allocate(300);
+	assert(arena.GetUsedBytes() == 326);
+	
+	arena.Reset();
+	assert(arena.GetUsedBytes() == 0);
+	assert(arena.GetPeakBytes() == 326);
+	assert(arena.GetCapacity() >= 326);
+	
+	//After the reset, memory is handed out from the start of the block again.
+	char* c = (char*)arena.Allocate(300);
+	assert(arena.Allocate(1) == c + 304);
+	arena.Reset();
+	assert(arena.GetPeakBytes() == 326);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cstddef>
+#include <new>
+
+//A FrameArena hands out memory by bumping an offset through one large block, and
+//frees everything at once when it is reset. The engine resets its arena at the start
+//of every frame, so anything allocated from it must not be kept past the current frame.
+//
+//If a frame needs more than the block holds, the extra requests are served from
+//overflow blocks, and the main block grows to fit at the next reset. After a few frames
+//a steady state frame no longer touches the global heap at all.
+class FrameArena
+{
+public:
+	FrameArena(size_t capacity = 64 * 1024);
+	virtual ~FrameArena();
+	
+	void* Allocate(size_t size, size_t alignment = 16);
+	void Reset();
+	
+	inline size_t GetUsedBytes() const { return m_usedBytes; }
+	inline size_t GetPeakBytes() const { return m_peakBytes; } //Most bytes used by any single frame
+	inline size_t GetCapacity()  const { return m_capacity; }
+	
+	//The arena reset by CoreEngine every frame.
+	static FrameArena& GetFrameArena();
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	char*              m_block;
+	size_t             m_capacity;
+	size_t             m_offset;
+	size_t             m_usedBytes;
+	size_t             m_peakBytes;
+	std::vector<char*> m_overflowBlocks;
+	SDL_SpinLock       m_lock;
+	
+	FrameArena(const FrameArena& other) {}
+	void operator=(const FrameArena& other) {}
+};
+
+//Lets STL containers allocate from the frame arena, for example
+//std::vector<Entity*, FrameAllocator<Entity*> >. Such containers must be
+//destroyed before the end of the frame.
+template<class T>
+class FrameAllocator
+{
+public:
+	typedef T              value_type;
+	typedef T*             pointer;
+	typedef const T*       const_pointer;
+	typedef T&             reference;
+	typedef const T&       const_reference;
+	typedef size_t         size_type;
+	typedef ptrdiff_t      difference_type;
+	
+	template<class U> class rebind
+	{
+	public:
+		typedef FrameAllocator<U> other;
+	};
+	
+	FrameAllocator() {}
+	template<class U> FrameAllocator(const FrameAllocator<U>& other) {}
+	
+	inline pointer address(reference value)             const { return &value; }
+	inline const_pointer address(const_reference value) const { return &value; }
+	inline size_type max_size()                         const { return ((size_type)-1) / sizeof(T); }
+	
+	inline pointer allocate(size_type n, const void* hint = 0)
+	{
+		return (pointer)FrameArena::GetFrameArena().Allocate(n * sizeof(T));
+	}
+	
+	//Memory is only given back when the whole arena is reset.
+	inline void deallocate(pointer p, size_type n) {}
+	
+	inline void construct(pointer p, const T& value) { new((void*)p) T(value); }
+	inline void destroy(pointer p)                   { p->~T(); }
+};
+
+template<class T, class U>
+inline bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b) { return true; }
+
+template<class T, class U>
+inline bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b) { return false; }
+
+#endif // FRAMEARENA_H
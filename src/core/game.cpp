@@ -30,11 +30,23 @@ void Game::ProcessInput(const Input& input, float delta)
 void Game::Update(float delta)
 {
 	m_updateTimer.StartInvocation();
-	m_root.UpdateAll(delta);
+	
+	if(m_jobSystem && m_isParallelUpdateEnabled)
+	{
+		m_root.UpdateAllParallel(delta, m_jobSystem);
+	}
+	else
+	{
+		m_root.UpdateAll(delta);
+	}
+	
 	m_updateTimer.StopInvocation();
 }
 
 void Game::Render(RenderingEngine* renderingEngine)
 {
+	//Every render pass reads world matrices, so they're brought up to date once
+	//here instead of being recomputed on demand for each draw.
+	m_root.GetTransform()->UpdateHierarchy();
 	renderingEngine->Render(m_root);
 }
@@ -24,7 +24,9 @@
 class Game
 {
 public:
-	Game() {}
+	Game() :
+		m_jobSystem(0),
+		m_isParallelUpdateEnabled(false) {}
 	virtual ~Game() {}
 
 	virtual void Init(const Window& window) {}
@@ -35,9 +37,13 @@ public:
 	inline double DisplayInputTime(double dividend) { return m_inputTimer.DisplayAndReset("Input Time: ", dividend); }
 	inline double DisplayUpdateTime(double dividend) { return m_updateTimer.DisplayAndReset("Update Time: ", dividend); }
 	
-	inline void SetEngine(CoreEngine* engine) { m_root.SetEngine(engine); }
+	inline void SetEngine(CoreEngine* engine) { m_root.SetEngine(engine); m_jobSystem = engine->GetJobSystem(); }
 protected:
 	void AddToScene(Entity* child) { m_root.AddChild(child); }
+	
+	//Updates each top level entity's subtree on its own job when the engine has a JobSystem.
+	//Only enable this if components never touch state outside their own subtree.
+	inline void SetParallelUpdate(bool enabled) { m_isParallelUpdateEnabled = enabled; }
 private:
 	Game(Game& game) {}
 	void operator=(Game& game) {}
@@ -45,6 +51,8 @@ private:
 	ProfileTimer m_updateTimer;
 	ProfileTimer m_inputTimer;
 	Entity       m_root;
+	JobSystem*   m_jobSystem;
+	bool         m_isParallelUpdateEnabled;
 };
 
 #endif
@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jobSystem.h"
+#include "frameArena.h"
+#include <cassert>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(_WIN64) || defined(WIN64)
+	#define OS_WINDOWS
+#elif defined(__linux__)
+	#define OS_LINUX
+#else
+	#define OS_OTHER
+#endif
+
+#ifdef OS_WINDOWS
+	#include <Windows.h>
+#endif
+
+#ifdef OS_LINUX
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+//Passed to a worker thread when it starts, so it knows which queue it owns.
+class WorkerInfo
+{
+public:
+	WorkerInfo(JobSystem* jobSystem, int queueIndex) :
+		m_jobSystem(jobSystem),
+		m_queueIndex(queueIndex) {}
+	
+	JobSystem* m_jobSystem;
+	int        m_queueIndex;
+};
+
+class ParallelForBatch
+{
+public:
+	ParallelForBatch(ParallelForFunction function, void* data, int start, int end) :
+		m_function(function),
+		m_data(data),
+		m_start(start),
+		m_end(end) {}
+	
+	static void Execute(void* batch)
+	{
+		ParallelForBatch* self = (ParallelForBatch*)batch;
+		self->m_function(self->m_data, self->m_start, self->m_end);
+	}
+private:
+	ParallelForFunction m_function;
+	void*               m_data;
+	int                 m_start;
+	int                 m_end;
+};
+
+static void PinCurrentThread(int cpuIndex)
+{
+#ifdef OS_WINDOWS
+	SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1) << cpuIndex);
+#elif defined(OS_LINUX)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpuIndex, &cpuSet);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+#else
+	//No portable way to set affinity here; the OS scheduler decides instead.
+	(void)cpuIndex;
+#endif
+}
+
+void Job::Execute() const
+{
+	m_function(m_data);
+	
+	//Must be the last thing touching the counter, as whoever waits on it may
+	//free it as soon as it reaches 0.
+	if(m_counter)
+	{
+		m_counter->Decrement();
+	}
+}
+
+void JobQueue::Push(const Job& job)
+{
+	SDL_AtomicLock(&m_lock);
+	m_jobs.push_back(job);
+	SDL_AtomicUnlock(&m_lock);
+}
+
+bool JobQueue::Pop(Job* result)
+{
+	bool found = false;
+	
+	SDL_AtomicLock(&m_lock);
+	if(!m_jobs.empty())
+	{
+		*result = m_jobs.back();
+		m_jobs.pop_back();
+		found = true;
+	}
+	SDL_AtomicUnlock(&m_lock);
+	
+	return found;
+}
+
+bool JobQueue::Steal(Job* result)
+{
+	bool found = false;
+	
+	SDL_AtomicLock(&m_lock);
+	if(!m_jobs.empty())
+	{
+		*result = m_jobs.front();
+		m_jobs.pop_front();
+		found = true;
+	}
+	SDL_AtomicUnlock(&m_lock);
+	
+	return found;
+}
+
+JobSystem::JobSystem(int numWorkers, bool pinThreads) :
+	m_pinThreads(pinThreads)
+{
+	int numCPUs = SDL_GetCPUCount();
+	
+	if(numWorkers < 0)
+	{
+		numWorkers = numCPUs > 1 ? numCPUs - 1 : 0;
+	}
+	
+	m_numQueues = numWorkers + 1;
+	m_queues = new JobQueue[m_numQueues];
+	m_jobSemaphore = SDL_CreateSemaphore(0);
+	SDL_AtomicSet(&m_isRunning, 1);
+	
+	//Jobs can only be started once the constructor returns, so workers will never
+	//look at m_threadIds while it is still being filled in.
+	m_threads.reserve(numWorkers);
+	m_threadIds.reserve(numWorkers + 1);
+	m_threadIds.push_back(SDL_ThreadID());
+	
+	for(int i = 0; i < numWorkers; i++)
+	{
+		SDL_Thread* thread = SDL_CreateThread(WorkerMain, "JobSystemWorker", new WorkerInfo(this, i + 1));
+		m_threads.push_back(thread);
+		m_threadIds.push_back(SDL_GetThreadID(thread));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	SDL_AtomicSet(&m_isRunning, 0);
+	
+	for(unsigned int i = 0; i < m_threads.size(); i++)
+	{
+		SDL_SemPost(m_jobSemaphore);
+	}
+	
+	for(unsigned int i = 0; i < m_threads.size(); i++)
+	{
+		SDL_WaitThread(m_threads[i], 0);
+	}
+	
+	SDL_DestroySemaphore(m_jobSemaphore);
+	delete[] m_queues;
+}
+
+void JobSystem::Run(JobFunction function, void* data, JobCounter* counter)
+{
+	if(counter)
+	{
+		counter->Increment();
+	}
+	
+	m_queues[GetQueueIndex()].Push(Job(function, data, counter));
+	SDL_SemPost(m_jobSemaphore);
+}
+
+void JobSystem::Wait(JobCounter* counter)
+{
+	int queueIndex = GetQueueIndex();
+	
+	//Rather than blocking, help out until the jobs being waited on are finished.
+	while(!counter->IsDone())
+	{
+		TryRunJob(queueIndex);
+	}
+}
+
+void JobSystem::ParallelFor(ParallelForFunction function, void* data, int count, int batchSize)
+{
+	if(batchSize < 1)
+	{
+		batchSize = 1;
+	}
+	
+	if(m_numQueues == 1 || count <= batchSize)
+	{
+		function(data, 0, count);
+		return;
+	}
+	
+	//All batches are created up front, so their addresses stay valid while they run.
+	std::vector<ParallelForBatch, FrameAllocator<ParallelForBatch> > batches;
+	batches.reserve((count + batchSize - 1) / batchSize);
+	
+	for(int start = 0; start < count; start += batchSize)
+	{
+		int end = start + batchSize < count ? start + batchSize : count;
+		batches.push_back(ParallelForBatch(function, data, start, end));
+	}
+	
+	JobCounter counter;
+	for(unsigned int i = 0; i < batches.size(); i++)
+	{
+		Run(ParallelForBatch::Execute, &batches[i], &counter);
+	}
+	
+	Wait(&counter);
+}
+
+int JobSystem::WorkerMain(void* data)
+{
+	WorkerInfo* info = (WorkerInfo*)data;
+	JobSystem* jobSystem = info->m_jobSystem;
+	int queueIndex = info->m_queueIndex;
+	delete info;
+	
+	if(jobSystem->m_pinThreads)
+	{
+		int numCPUs = SDL_GetCPUCount();
+		PinCurrentThread(queueIndex % (numCPUs > 0 ? numCPUs : 1));
+	}
+	
+	while(SDL_AtomicGet(&jobSystem->m_isRunning))
+	{
+		if(!jobSystem->TryRunJob(queueIndex))
+		{
+			SDL_SemWait(jobSystem->m_jobSemaphore);
+		}
+	}
+	
+	return 0;
+}
+
+int JobSystem::GetQueueIndex() const
+{
+	SDL_threadID threadId = SDL_ThreadID();
+	
+	for(unsigned int i = 1; i < m_threadIds.size(); i++)
+	{
+		if(m_threadIds[i] == threadId)
+		{
+			return i;
+		}
+	}
+	
+	//The creating thread, and any thread outside the system, share queue 0.
+	return 0;
+}
+
+bool JobSystem::TryRunJob(int queueIndex)
+{
+	Job job;
+	int numQueues = GetNumThreads();
+	
+	if(!m_queues[queueIndex].Pop(&job))
+	{
+		bool stolen = false;
+		
+		for(int i = 1; i < numQueues && !stolen; i++)
+		{
+			stolen = m_queues[(queueIndex + i) % numQueues].Steal(&job);
+		}
+		
+		if(!stolen)
+		{
+			return false;
+		}
+	}
+	
+	job.Execute();
+	return true;
+}
+
+static void TestIncrementJob(void* data)
+{
+	SDL_AtomicAdd((SDL_atomic_t*)data, 1);
+}
+
+static void TestNestedJob(void* data)
+{
+	JobSystem* jobSystem = (JobSystem*)((void**)data)[0];
+	SDL_atomic_t* total = (SDL_atomic_t*)((void**)data)[1];
+	
+	JobCounter counter;
+	for(int i = 0; i < 10; i++)
+	{
+		jobSystem->Run(TestIncrementJob, total, &counter);
+	}
+	jobSystem->Wait(&counter);
+}
+
+static void TestFillRange(void* data, int start, int end)
+{
+	for(int i = start; i < end; i++)
+	{
+		((int*)data)[i] += i;
+	}
+}
+
+void JobSystem::Test()
+{
+	JobSystem jobSystem(3);
+	assert(jobSystem.GetNumWorkers() == 3);
+	
+	SDL_atomic_t total;
+	SDL_AtomicSet(&total, 0);
+	
+	JobCounter counter;
+	for(int i = 0; i < 1000; i++)
+	{
+		jobSystem.Run(TestIncrementJob, &total, &counter);
+	}
+	jobSystem.Wait(&counter);
+	assert(counter.IsDone());
+	assert(SDL_AtomicGet(&total) == 1000);
+	
+	//Jobs running on workers must be able to start and wait on jobs of their own.
+	SDL_AtomicSet(&total, 0);
+	void* nestedData[] = { &jobSystem, &total };
+	for(int i = 0; i < 20; i++)
+	{
+		jobSystem.Run(TestNestedJob, nestedData, &counter);
+	}
+	jobSystem.Wait(&counter);
+	assert(SDL_AtomicGet(&total) == 200);
+	
+	const int numValues = 1027;
+	int values[numValues] = { 0 };
+	jobSystem.ParallelFor(TestFillRange, values, numValues, 16);
+	
+	for(int i = 0; i < numValues; i++)
+	{
+		assert(values[i] == i);
+	}
+	
+	//With no workers, everything must still run on the calling thread.
+	JobSystem serialSystem(0);
+	int serialValues[numValues] = { 0 };
+	serialSystem.ParallelFor(TestFillRange, serialValues, numValues, 16);
+	assert(serialValues[numValues - 1] == numValues - 1);
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <SDL2/SDL.h>
+#include <deque>
+#include <vector>
+
+typedef void (*JobFunction)(void* data);
+typedef void (*ParallelForFunction)(void* data, int start, int end);
+
+//JobCounters are used as fences. Every job started with a counter increments it,
+//and decrements it once the job has finished, so a group of jobs is complete
+//once their shared counter reaches 0.
+class JobCounter
+{
+public:
+	JobCounter() { SDL_AtomicSet(&m_count, 0); }
+	
+	inline void Increment()  { SDL_AtomicAdd(&m_count, 1); }
+	
+	//The barriers make sure everything a job wrote is visible to whoever sees the
+	//counter reach 0, even on CPUs with weaker memory ordering than x86.
+	inline void Decrement()  { SDL_MemoryBarrierRelease(); SDL_AtomicAdd(&m_count, -1); }
+	inline bool IsDone()
+	{
+		bool isDone = SDL_AtomicGet(&m_count) == 0;
+		SDL_MemoryBarrierAcquire();
+		return isDone;
+	}
+private:
+	SDL_atomic_t m_count;
+	
+	JobCounter(const JobCounter& other) {}
+	void operator=(const JobCounter& other) {}
+};
+
+class Job
+{
+public:
+	Job(JobFunction function = 0, void* data = 0, JobCounter* counter = 0) :
+		m_function(function),
+		m_data(data),
+		m_counter(counter) {}
+	
+	void Execute() const;
+private:
+	JobFunction m_function;
+	void*       m_data;
+	JobCounter* m_counter;
+};
+
+//Each thread owns one JobQueue. The owner pushes and pops at the back, so it works
+//on its most recent (and most likely cached) jobs first, while other threads steal
+//from the front, where the oldest and usually largest jobs are.
+class JobQueue
+{
+public:
+	JobQueue() :
+		m_lock(0) {}
+	
+	void Push(const Job& job);
+	bool Pop(Job* result);
+	bool Steal(Job* result);
+private:
+	std::deque<Job> m_jobs;
+	SDL_SpinLock    m_lock;
+	
+	JobQueue(const JobQueue& other) {}
+	void operator=(const JobQueue& other) {}
+};
+
+//The JobSystem runs jobs on a pool of worker threads. The thread that created the
+//JobSystem also takes part whenever it waits on a JobCounter, so it never sits idle
+//while there is work left.
+class JobSystem
+{
+public:
+	//A negative worker count uses one worker per CPU core, besides the creating thread.
+	//Pinning locks each worker to its own core, which helps on large machines where
+	//the OS would otherwise move threads between cores.
+	JobSystem(int numWorkers = -1, bool pinThreads = false);
+	virtual ~JobSystem();
+	
+	void Run(JobFunction function, void* data, JobCounter* counter);
+	void Wait(JobCounter* counter);
+	
+	//Calls function on [0, count) split into batches of batchSize, and returns once all
+	//batches are done.
+	void ParallelFor(ParallelForFunction function, void* data, int count, int batchSize = 1);
+	
+	inline int GetNumWorkers()  const { return m_numQueues - 1; }
+	inline int GetNumThreads()  const { return m_numQueues; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	int                       m_numQueues;
+	JobQueue*                 m_queues;     //Queue 0 belongs to the creating thread, the rest to the workers
+	std::vector<SDL_Thread*>  m_threads;
+	std::vector<SDL_threadID> m_threadIds;
+	SDL_sem*                  m_jobSemaphore;
+	SDL_atomic_t              m_isRunning;
+	bool                      m_pinThreads;
+	
+	static int WorkerMain(void* data);
+	
+	int GetQueueIndex() const;
+	bool TryRunJob(int queueIndex);
+	
+	JobSystem(const JobSystem& other) {}
+	void operator=(const JobSystem& other) {}
+};
+
+#endif // JOBSYSTEM_H
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mappedFile.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(_WIN64) || defined(WIN64)
+	#define OS_WINDOWS
+#else
+	#define OS_POSIX
+#endif
+
+#ifdef OS_WINDOWS
+	#include <Windows.h>
+#endif
+
+#ifdef OS_POSIX
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() :
+	m_isOpen(false),
+	m_data(0),
+	m_size(0),
+	m_handle(0) {}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string& fileName)
+{
+	Close();
+	
+	#ifdef OS_WINDOWS
+		HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+		if(file == INVALID_HANDLE_VALUE)
+			return false;
+		
+		LARGE_INTEGER size;
+		if(!GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			return false;
+		}
+		
+		m_size = (size_t)size.QuadPart;
+		
+		//The mapping keeps the file open after its handle is closed.
+		if(m_size != 0)
+		{
+			m_handle = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+			m_data = m_handle ? (unsigned char*)MapViewOfFile(m_handle, FILE_MAP_READ, 0, 0, 0) : 0;
+		}
+		
+		CloseHandle(file);
+	#else
+		int file = open(fileName.c_str(), O_RDONLY);
+		if(file < 0)
+			return false;
+		
+		struct stat status;
+		if(fstat(file, &status) != 0)
+		{
+			close(file);
+			return false;
+		}
+		
+		m_size = (size_t)status.st_size;
+		
+		if(m_size != 0)
+		{
+			void* data = mmap(0, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+			m_data = data != MAP_FAILED ? (unsigned char*)data : 0;
+		}
+		
+		close(file);
+	#endif
+	
+	if(m_size != 0 && !m_data)
+	{
+		Close();
+		return false;
+	}
+	
+	m_isOpen = true;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	#ifdef OS_WINDOWS
+		if(m_data) UnmapViewOfFile(m_data);
+		if(m_handle) CloseHandle(m_handle);
+	#else
+		if(m_data) munmap(m_data, m_size);
+	#endif
+	
+	m_isOpen = false;
+	m_data = 0;
+	m_size = 0;
+	m_handle = 0;
+}
+
+void MappedFile::Test()
+{
+	const char* fileName = "mappedFileTest.tmp";
+	const char contents[] = "Mapped file contents";
+	
+	FILE* file = fopen(fileName, "wb");
+	assert(file);
+	if(!file)
+	{
+		return;
+	}
+	
+	fwrite(contents, 1, sizeof(contents), file);
+	fclose(file);
+	
+	MappedFile mappedFile;
+	assert(!mappedFile.IsOpen());
+	bool isOpen = mappedFile.Open(fileName);
+	assert(isOpen);
+	assert(mappedFile.GetSize() == sizeof(contents));
+	assert(memcmp(mappedFile.GetData(), contents, sizeof(contents)) == 0);
+	
+	mappedFile.Close();
+	assert(!mappedFile.IsOpen() && mappedFile.GetData() == 0);
+	
+	//Empty files have nothing to map, but still open.
+	file = fopen(fileName, "wb");
+	assert(file);
+	if(file)
+	{
+		fclose(file);
+	}
+	
+	isOpen = mappedFile.Open(fileName);
+	assert(isOpen);
+	assert(mappedFile.GetSize() == 0 && mappedFile.GetData() == 0);
+	mappedFile.Close();
+	
+	remove(fileName);
+	isOpen = mappedFile.Open(fileName);
+	assert(!isOpen);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+//A file mapped read only into memory, so it can be read without copying it first.
+//Pages are only loaded from disk as they're touched.
+class MappedFile
+{
+public:
+	MappedFile();
+	virtual ~MappedFile();
+	
+	//Returns false if the file can't be opened. Empty files open with no data.
+	bool Open(const std::string& fileName);
+	void Close();
+	
+	inline bool IsOpen()                    const { return m_isOpen; }
+	inline const unsigned char* GetData()   const { return m_data; }
+	inline size_t GetSize()                 const { return m_size; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	bool           m_isOpen;
+	unsigned char* m_data;
+	size_t         m_size;
+	void*          m_handle; //The mapping object on Windows
+	
+	MappedFile(const MappedFile& other) {}
+	void operator=(const MappedFile& other) {}
+};
+
+#endif // MAPPEDFILE_H
@@ -17,11 +17,46 @@
 #ifndef MAPPEDVALUES_H_INCLUDED
 #define MAPPEDVALUES_H_INCLUDED
 
-#include <map>
+#include <vector>
 
 #include "../rendering/texture.h"
 #include "math3d.h"
+#include "propertyTable.h"
 
+//Values indexed directly by PropertyTable id. Each id maps to a slot in a packed
+//array of values, so unset ids don't need a default constructed value.
+template<class T>
+class PropertyArray
+{
+public:
+	inline const T* Get(int id) const
+	{
+		return (id >= 0 && id < (int)m_slots.size() && m_slots[id] != -1) ? &m_values[m_slots[id]] : 0;
+	}
+	
+	void Set(int id, const T& value)
+	{
+		if(id >= (int)m_slots.size())
+		{
+			m_slots.resize(id + 1, -1);
+		}
+		
+		if(m_slots[id] == -1)
+		{
+			m_slots[id] = (int)m_values.size();
+			m_values.push_back(value);
+		}
+		else
+		{
+			m_values[m_slots[id]] = value;
+		}
+	}
+private:
+	std::vector<int> m_slots;
+	std::vector<T>   m_values;
+};
+
+//Named values, set and read either by PropertyTable id or, more slowly, by name.
 class MappedValues
 {
 public:
@@ -29,18 +64,40 @@ public:
 		m_defaultTexture(Texture("defaultTexture.png")),
 		m_defaultVector3f(Vector3f(0,0,0)) {}
 
-	inline void SetVector3f(const std::string& name, const Vector3f& value) { m_vector3fMap[name] = value; }
-	inline void SetFloat(const std::string& name, float value)              { m_floatMap[name] = value; }
-	inline void SetTexture(const std::string& name, const Texture& value)   { m_textureMap[name] = value; }
+	inline void SetVector3f(int id, const Vector3f& value) { m_vector3fs.Set(id, value); }
+	inline void SetFloat(int id, float value)              { m_floats.Set(id, value); }
+	inline void SetTexture(int id, const Texture& value)   { m_textures.Set(id, value); }
+	
+	inline void SetVector3f(const std::string& name, const Vector3f& value) { SetVector3f(PropertyTable::GetId(name), value); }
+	inline void SetFloat(const std::string& name, float value)              { SetFloat(PropertyTable::GetId(name), value); }
+	inline void SetTexture(const std::string& name, const Texture& value)   { SetTexture(PropertyTable::GetId(name), value); }
+	
+	inline const Vector3f& GetVector3f(int id) const 
+	{ 
+		const Vector3f* value = m_vector3fs.Get(id);
+		return value ? *value : m_defaultVector3f; 
+	}
+	
+	inline float GetFloat(int id) const 
+	{ 
+		const float* value = m_floats.Get(id);
+		return value ? *value : 0; 
+	}
+	
+	inline const Texture& GetTexture(int id) const 
+	{ 
+		const Texture* value = m_textures.Get(id);
+		return value ? *value : m_defaultTexture; 
+	}
 	
-	const Vector3f& GetVector3f(const std::string& name) const;
-	float GetFloat(const std::string& name)              const;
-	const Texture& GetTexture(const std::string& name)   const;
+	inline const Vector3f& GetVector3f(const std::string& name) const { return GetVector3f(PropertyTable::FindId(name)); }
+	inline float GetFloat(const std::string& name)              const { return GetFloat(PropertyTable::FindId(name)); }
+	inline const Texture& GetTexture(const std::string& name)   const { return GetTexture(PropertyTable::FindId(name)); }
 protected:
 private:
-	std::map<std::string, Vector3f> m_vector3fMap;
-	std::map<std::string, float> m_floatMap;
-	std::map<std::string, Texture> m_textureMap;
+	PropertyArray<Vector3f> m_vector3fs;
+	PropertyArray<float>    m_floats;
+	PropertyArray<Texture>  m_textures;
 	
 	Texture m_defaultTexture;
 	Vector3f m_defaultVector3f;
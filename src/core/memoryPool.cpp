@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "memoryPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+//Blocks are kept 16 byte aligned so they can hold SIMD friendly types.
+static const size_t BLOCK_ALIGNMENT = 16;
+
+MemoryPool::MemoryPool(const std::string& name, size_t objectSize, int objectsPerSlab) :
+	m_name(name),
+	m_objectSize(((std::max(objectSize, sizeof(FreeBlock)) + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT) * BLOCK_ALIGNMENT),
+	m_objectsPerSlab(objectsPerSlab),
+	m_freeList(0),
+	m_numLiveObjects(0),
+	m_numHeapObjects(0),
+	m_heapBytes(0),
+	m_lock(0)
+{
+	GetAllPools().push_back(this);
+}
+
+MemoryPool::~MemoryPool()
+{
+	std::vector<MemoryPool*>& pools = GetAllPools();
+	pools.erase(std::remove(pools.begin(), pools.end(), this), pools.end());
+	
+	//Objects still using the slabs would be left dangling, so in that case the
+	//memory is deliberately leaked.
+	if(m_numLiveObjects == 0)
+	{
+		for(unsigned int i = 0; i < m_slabs.size(); i++)
+		{
+			::operator delete(m_slabs[i]);
+		}
+	}
+}
+
+void* MemoryPool::Allocate(size_t size)
+{
+	SDL_AtomicLock(&m_lock);
+	
+	if(size > m_objectSize)
+	{
+		m_numHeapObjects++;
+		m_heapBytes += size;
+		SDL_AtomicUnlock(&m_lock);
+		
+		return ::operator new(size);
+	}
+	
+	if(!m_freeList)
+	{
+		AddSlab();
+	}
+	
+	FreeBlock* block = m_freeList;
+	m_freeList = block->m_next;
+	m_numLiveObjects++;
+	
+	SDL_AtomicUnlock(&m_lock);
+	return block;
+}
+
+void MemoryPool::Free(void* object, size_t size)
+{
+	if(!object)
+	{
+		return;
+	}
+	
+	SDL_AtomicLock(&m_lock);
+	
+	if(size > m_objectSize)
+	{
+		m_numHeapObjects--;
+		m_heapBytes -= size;
+		SDL_AtomicUnlock(&m_lock);
+		
+		::operator delete(object);
+		return;
+	}
+	
+	FreeBlock* block = (FreeBlock*)object;
+	block->m_next = m_freeList;
+	m_freeList = block;
+	m_numLiveObjects--;
+	
+	SDL_AtomicUnlock(&m_lock);
+}
+
+void MemoryPool::AddSlab()
+{
+	char* slab = (char*)::operator new(m_objectSize * m_objectsPerSlab);
+	m_slabs.push_back(slab);
+	
+	//Blocks are linked in address order, so consecutive allocations are adjacent.
+	for(int i = m_objectsPerSlab - 1; i >= 0; i--)
+	{
+		FreeBlock* block = (FreeBlock*)(slab + i * m_objectSize);
+		block->m_next = m_freeList;
+		m_freeList = block;
+	}
+}
+
+std::vector<MemoryPool*>& MemoryPool::GetAllPools()
+{
+	static std::vector<MemoryPool*> pools;
+	return pools;
+}
+
+void MemoryPool::DisplayAllStats()
+{
+	const std::vector<MemoryPool*>& pools = GetAllPools();
+	
+	for(unsigned int i = 0; i < pools.size(); i++)
+	{
+		const MemoryPool& pool = *pools[i];
+		
+		//Pools that are created up front but never used would only add noise.
+		if(pool.GetNumSlabs() == 0 && pool.GetNumHeapObjects() == 0)
+		{
+			continue;
+		}
+		
+		std::string name = pool.GetName() + " Pool: ";
+		
+		printf("%-40s%d live (%lu / %lu bytes, %d slabs), %d on heap (%lu bytes)\n", name.c_str(),
+			pool.GetNumLiveObjects(), (unsigned long)pool.GetLiveBytes(), (unsigned long)pool.GetReservedBytes(), 
+			pool.GetNumSlabs(), pool.GetNumHeapObjects(), (unsigned long)pool.GetHeapBytes());
+	}
+}
+
+void MemoryPool::Test()
+{
+	MemoryPool pool("Test", 24, 4);
+	assert(pool.GetNumSlabs() == 0);
+	
+	void* objects[6];
+	for(int i = 0; i < 6; i++)
+	{
+		objects[i] = pool.Allocate(24);
+		assert(((size_t)objects[i] % BLOCK_ALIGNMENT) == 0);
+	}
+	
+	assert(pool.GetNumLiveObjects() == 6);
+	assert(pool.GetNumSlabs() == 2);
+	assert((char*)objects[1] - (char*)objects[0] == 32);
+	
+	//Freed blocks are handed out again before any new slab is made.
+	pool.Free(objects[2], 24);
+	assert(pool.Allocate(24) == objects[2]);
+	
+	void* large = pool.Allocate(100);
+	assert(pool.GetNumHeapObjects() == 1 && pool.GetHeapBytes() == 100);
+	pool.Free(large, 100);
+	assert(pool.GetNumHeapObjects() == 0);
+	
+	for(int i = 0; i < 6; i++)
+	{
+		pool.Free(objects[i], 24);
+	}
+	
+	assert(pool.GetNumLiveObjects() == 0);
+	assert(pool.GetNumSlabs() == 2);
+}
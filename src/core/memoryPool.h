@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEMORYPOOL_H
+#define MEMORYPOOL_H
+
+#include <SDL2/SDL.h>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//A MemoryPool hands out fixed size blocks carved from large slabs, and keeps freed
+//blocks on a free list for reuse. Classes use one through their own operator new and
+//operator delete, so objects of the same type end up next to each other in memory and
+//creating thousands of them only costs a handful of real allocations.
+//
+//Requests larger than the block size (usually from derived classes) are passed on to
+//the global heap, and are counted separately.
+class MemoryPool
+{
+public:
+	MemoryPool(const std::string& name, size_t objectSize, int objectsPerSlab = 256);
+	virtual ~MemoryPool();
+	
+	void* Allocate(size_t size);
+	void Free(void* object, size_t size);
+	
+	inline const std::string& GetName()   const { return m_name; }
+	inline int GetNumLiveObjects()        const { return m_numLiveObjects; }
+	inline int GetNumSlabs()              const { return (int)m_slabs.size(); }
+	inline size_t GetLiveBytes()          const { return m_numLiveObjects * m_objectSize; }
+	inline size_t GetReservedBytes()      const { return m_slabs.size() * m_objectsPerSlab * m_objectSize; }
+	inline int GetNumHeapObjects()        const { return m_numHeapObjects; }
+	inline size_t GetHeapBytes()          const { return m_heapBytes; }
+	
+	//Prints the counters of every pool that has been used.
+	static void DisplayAllStats();
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	class FreeBlock
+	{
+	public:
+		FreeBlock* m_next;
+	};
+	
+	void AddSlab();
+	
+	std::string        m_name;
+	size_t             m_objectSize;
+	int                m_objectsPerSlab;
+	std::vector<char*> m_slabs;
+	FreeBlock*         m_freeList;
+	int                m_numLiveObjects;
+	int                m_numHeapObjects;
+	size_t             m_heapBytes;
+	SDL_SpinLock       m_lock;
+	
+	static std::vector<MemoryPool*>& GetAllPools();
+	
+	MemoryPool(const MemoryPool& other) {}
+	void operator=(const MemoryPool& other) {}
+};
+
+#endif // MEMORYPOOL_H
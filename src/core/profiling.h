@@ -23,6 +23,16 @@
 #define PROFILING_DISABLE_SHADING 0
 #define PROFILING_SET_1x1_VIEWPORT 0
 #define PROFILING_SET_2x2_TEXTURE 0
+#define PROFILING_RUN_BENCHMARKS 0
+#define PROFILING_DISPLAY_MEMORY_POOLS 0
+#define PROFILING_DISABLE_GL_STATE_CACHE 0
+#define PROFILING_DISABLE_INSTANCING 0
+#define PROFILING_DISABLE_FRUSTUM_CULLING 0
+#define PROFILING_DISABLE_LIGHT_CULLING 0
+#define PROFILING_DISABLE_CLUSTERED_LIGHTING 0
+#define PROFILING_DISABLE_SHADOW_MAP_CACHE 0
+#define PROFILING_DISABLE_OCCLUSION_CULLING 0
+#define PROFILING_DISABLE_MESH_LODS 0
 
 class ProfileTimer
 {
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "propertyTable.h"
+#include <cassert>
+
+int PropertyTable::GetId(const std::string& name)
+{
+	std::map<std::string, int>& ids = GetIds();
+	std::map<std::string, int>::const_iterator it = ids.find(name);
+	
+	if(it != ids.end())
+	{
+		return it->second;
+	}
+	
+	int id = (int)GetNames().size();
+	ids.insert(std::pair<std::string, int>(name, id));
+	GetNames().push_back(name);
+	return id;
+}
+
+int PropertyTable::FindId(const std::string& name)
+{
+	std::map<std::string, int>& ids = GetIds();
+	std::map<std::string, int>::const_iterator it = ids.find(name);
+	
+	return it != ids.end() ? it->second : INVALID_ID;
+}
+
+//The tables are created on first use, so ids can be looked up while other static
+//objects are being initialized.
+std::map<std::string, int>& PropertyTable::GetIds()
+{
+	static std::map<std::string, int> ids;
+	return ids;
+}
+
+std::vector<std::string>& PropertyTable::GetNames()
+{
+	static std::vector<std::string> names;
+	return names;
+}
+
+void PropertyTable::Test()
+{
+	int numIds = GetNumIds();
+	int id = GetId("propertyTableTest");
+	
+	assert(id == numIds);
+	assert(GetId("propertyTableTest") == id);
+	assert(FindId("propertyTableTest") == id);
+	assert(GetName(id) == "propertyTableTest");
+	assert(FindId("propertyTableTestMissing") == INVALID_ID);
+	assert(GetNumIds() == numIds + 1);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROPERTYTABLE_H
+#define PROPERTYTABLE_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+//Interns property names, such as material and rendering engine values, into small
+//ids that are handed out in order starting at 0. Code on hot paths looks its ids up
+//once and then indexes with them, instead of comparing strings every time.
+class PropertyTable
+{
+public:
+	static const int INVALID_ID = -1;
+	
+	static int GetId(const std::string& name);  //Adds name to the table if it isn't there yet
+	static int FindId(const std::string& name); //Returns INVALID_ID for names never added
+	
+	static inline const std::string& GetName(int id) { return GetNames()[id]; }
+	static inline int GetNumIds()                    { return (int)GetNames().size(); }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+private:
+	static std::map<std::string, int>& GetIds();
+	static std::vector<std::string>& GetNames();
+};
+
+#endif // PROPERTYTABLE_H
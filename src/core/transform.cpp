@@ -15,46 +15,50 @@
  */
 
 #include "transform.h"
+#include <algorithm>
+#include <cassert>
 
-bool Transform::HasChanged()
-{	
-	if(m_parent != 0 && m_parent->HasChanged())
-	{
-		return true;
-	}
-	
-	if(m_pos != m_oldPos)
-	{
-		return true;
-	}
+Transform::Transform(const Transform& other) :
+	m_pos(other.m_pos),
+	m_rot(other.m_rot),
+	m_scale(other.m_scale),
+	m_parent(0),
+	m_worldMatrix(Matrix4f().InitIdentity()),
+	m_worldRot(Quaternion(0,0,0,1)),
+	m_isDirty(true) {}
+
+void Transform::operator=(const Transform& other)
+{
+	m_pos = other.m_pos;
+	m_rot = other.m_rot;
+	m_scale = other.m_scale;
+	MarkDirty();
+}
 
-	if(m_rot != m_oldRot)
+Transform::~Transform()
+{
+	if(m_parent)
 	{
-		return true;
+		m_parent->RemoveChild(this);
 	}
 	
-	if(m_scale != m_scale)
+	for(unsigned int i = 0; i < m_children.size(); i++)
 	{
-		return true;
+		m_children[i]->m_parent = 0;
+		m_children[i]->MarkDirty();
 	}
-		
-	return false;
 }
 
-void Transform::Update()
+void Transform::UpdateHierarchy() const
 {
-	if(m_initializedOldStuff)
+	if(m_isDirty)
 	{
-		m_oldPos = m_pos;
-		m_oldRot = m_rot;
-		m_oldScale = m_scale;
+		CalcWorldTransform();
 	}
-	else
+	
+	for(unsigned int i = 0; i < m_children.size(); i++)
 	{
-		m_oldPos = m_pos + Vector3f(1,1,1);
-		m_oldRot = m_rot * 0.5f;
-		m_oldScale = m_scale + 1;
-		m_initializedOldStuff = true;
+		m_children[i]->UpdateHierarchy();
 	}
 }
 
@@ -66,44 +70,150 @@ void Transform::Rotate(const Vector3f& axis, float angle)
 void Transform::Rotate(const Quaternion& rotation)
 {
 	m_rot = Quaternion((rotation * m_rot).Normalized());
+	MarkDirty();
 }
 
 void Transform::LookAt(const Vector3f& point, const Vector3f& up)
 {
 	m_rot = GetLookAtRotation(point, up);
+	MarkDirty();
 }
 
-Matrix4f Transform::GetTransformation() const
+void Transform::SetParent(Transform* parent)
+{
+	if(m_parent)
+	{
+		m_parent->RemoveChild(this);
+	}
+	
+	m_parent = parent;
+	
+	if(m_parent)
+	{
+		m_parent->m_children.push_back(this);
+	}
+	
+	MarkDirty();
+}
+
+void Transform::AddListener(TransformListener* listener)
+{
+	m_listeners.push_back(listener);
+}
+
+void Transform::RemoveListener(TransformListener* listener)
+{
+	m_listeners.erase(std::remove(m_listeners.begin(), m_listeners.end(), listener), m_listeners.end());
+}
+
+void Transform::MarkDirty()
+{
+	//A dirty transform always has a dirty subtree, so there's no need to walk
+	//any further once an already dirty transform is found.
+	if(m_isDirty)
+	{
+		return;
+	}
+	
+	m_isDirty = true;
+	
+	for(unsigned int i = 0; i < m_listeners.size(); i++)
+	{
+		m_listeners[i]->OnTransformChanged();
+	}
+	
+	for(unsigned int i = 0; i < m_children.size(); i++)
+	{
+		m_children[i]->MarkDirty();
+	}
+}
+
+void Transform::CalcWorldTransform() const
 {
 	Matrix4f translationMatrix;
 	Matrix4f scaleMatrix;
 
-	translationMatrix.InitTranslation(Vector3f(m_pos.GetX(), m_pos.GetY(), m_pos.GetZ()));
+	translationMatrix.InitTranslation(m_pos);
 	scaleMatrix.InitScale(Vector3f(m_scale, m_scale, m_scale));
 
-	Matrix4f result = translationMatrix * m_rot.ToRotationMatrix() * scaleMatrix;
+	Matrix4f localMatrix = translationMatrix * m_rot.ToRotationMatrix() * scaleMatrix;
 
-	return GetParentMatrix() * result;
+	if(m_parent)
+	{
+		m_worldMatrix = m_parent->GetTransformation() * localMatrix;
+		m_worldRot = m_parent->GetTransformedRot() * m_rot;
+	}
+	else
+	{
+		m_worldMatrix = localMatrix;
+		m_worldRot = m_rot;
+	}
+	
+	m_isDirty = false;
 }
 
-const Matrix4f& Transform::GetParentMatrix() const
+void Transform::RemoveChild(Transform* child)
 {
-	if(m_parent != 0 && m_parent->HasChanged())
+	for(unsigned int i = 0; i < m_children.size(); i++)
 	{
-		m_parentMatrix = m_parent->GetTransformation();
+		if(m_children[i] == child)
+		{
+			m_children[i] = m_children.back();
+			m_children.pop_back();
+			return;
+		}
 	}
-		
-	return m_parentMatrix;
 }
 
-Quaternion Transform::GetTransformedRot() const
+//Counts how many times the transform it listens to has changed.
+class CountingListener : public TransformListener
 {
-	Quaternion parentRot = Quaternion(0,0,0,1);
+public:
+	CountingListener() : m_numChanges(0) {}
+	virtual void OnTransformChanged() { m_numChanges++; }
 	
-	if(m_parent)
-	{
-		parentRot = m_parent->GetTransformedRot();
-	}
+	int m_numChanges;
+};
+
+void Transform::Test()
+{
+	Transform root(Vector3f(1.0f, 0.0f, 0.0f));
+	Transform child(Vector3f(0.0f, 2.0f, 0.0f), Quaternion(0,0,0,1), 2.0f);
+	Transform grandChild(Vector3f(0.0f, 0.0f, 3.0f));
+	
+	child.SetParent(&root);
+	grandChild.SetParent(&child);
+	root.UpdateHierarchy();
+	
+	assert(!root.IsDirty() && !child.IsDirty() && !grandChild.IsDirty());
+	assert(grandChild.GetTransformedPos() == Vector3f(1.0f, 2.0f, 6.0f));
+	
+	root.SetPos(Vector3f(0.0f, 0.0f, 0.0f));
+	assert(root.IsDirty() && child.IsDirty() && grandChild.IsDirty());
+	
+	//Reading a child must bring its ancestors up to date first.
+	assert(grandChild.GetTransformedPos() == Vector3f(0.0f, 2.0f, 6.0f));
+	assert(!root.IsDirty());
+	
+	child.SetPos(Vector3f(0.0f, 0.0f, 0.0f));
+	assert(!root.IsDirty() && child.IsDirty() && grandChild.IsDirty());
+	root.UpdateHierarchy();
+	assert(grandChild.GetTransformedPos() == Vector3f(0.0f, 0.0f, 6.0f));
+	
+	//Listeners hear about changes to their transform's parents, but only once until
+	//the world matrix has been brought up to date again.
+	CountingListener listener;
+	grandChild.AddListener(&listener);
+	root.SetPos(Vector3f(1.0f, 0.0f, 0.0f));
+	child.SetPos(Vector3f(0.0f, 1.0f, 0.0f));
+	assert(listener.m_numChanges == 1);
+	
+	root.UpdateHierarchy();
+	grandChild.SetScale(2.0f);
+	assert(listener.m_numChanges == 2);
 	
-	return parentRot * m_rot;
+	grandChild.RemoveListener(&listener);
+	root.UpdateHierarchy();
+	root.SetPos(Vector3f(0.0f, 0.0f, 0.0f));
+	assert(listener.m_numChanges == 2);
 }
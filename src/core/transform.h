@@ -18,7 +18,23 @@
 #define TRANSFORM_H
 
 #include "math3d.h"
+#include <vector>
 
+//Implemented by anything that needs to know when a Transform's world matrix changes.
+class TransformListener
+{
+public:
+	virtual ~TransformListener() {}
+	
+	//Called when the world matrix goes from up to date to dirty. It can be called
+	//from whichever thread wrote to the transform or one of its parents.
+	virtual void OnTransformChanged() = 0;
+};
+
+//Transforms cache their world matrix. Any write to the position, rotation or scale
+//marks the transform and every transform below it as dirty, and dirty world matrices
+//are recomputed either by UpdateHierarchy (once per frame, parents before children)
+//or lazily the first time they are requested.
 class Transform
 {
 public:
@@ -27,12 +43,14 @@ public:
 		m_rot(rot),
 		m_scale(scale),
 		m_parent(0),
-		m_parentMatrix(Matrix4f().InitIdentity()),
-		m_initializedOldStuff(false) {}
+		m_worldMatrix(Matrix4f().InitIdentity()),
+		m_worldRot(Quaternion(0,0,0,1)),
+		m_isDirty(true) {}
+	Transform(const Transform& other);
+	void operator=(const Transform& other);
+	virtual ~Transform();
 
-	Matrix4f GetTransformation() const;
-	bool HasChanged();
-	void Update();
+	void UpdateHierarchy() const;
 	void Rotate(const Vector3f& axis, float angle);
 	void Rotate(const Quaternion& rotation);
 	void LookAt(const Vector3f& point, const Vector3f& up);
@@ -42,33 +60,70 @@ public:
 		return Quaternion(Matrix4f().InitRotationFromDirection((point - m_pos).Normalized(), up)); 
 	}
 	
-	inline Vector3f* GetPos()                   { return &m_pos; }
+	//The mutable getters can't know what the caller will do with the result,
+	//so they have to assume it will be written to.
+	inline Vector3f* GetPos()                   { MarkDirty(); return &m_pos; }
 	inline const Vector3f& GetPos()       const { return m_pos; }
-	inline Quaternion* GetRot()                 { return &m_rot; }
+	inline Quaternion* GetRot()                 { MarkDirty(); return &m_rot; }
 	inline const Quaternion& GetRot()     const { return m_rot; }
 	inline float GetScale()               const { return m_scale; }
-	inline Vector3f GetTransformedPos()   const { return Vector3f(GetParentMatrix().Transform(m_pos)); }
-	Quaternion GetTransformedRot()        const;
+	inline bool IsDirty()                 const { return m_isDirty; }
+	
+	inline const Matrix4f& GetTransformation() const 
+	{ 
+		if(m_isDirty)
+		{
+			CalcWorldTransform();
+		}
+		
+		return m_worldMatrix; 
+	}
+	
+	inline const Quaternion& GetTransformedRot() const
+	{
+		if(m_isDirty)
+		{
+			CalcWorldTransform();
+		}
+		
+		return m_worldRot;
+	}
+	
+	inline Vector3f GetTransformedPos() const 
+	{ 
+		const Matrix4f& worldMatrix = GetTransformation();
+		return Vector3f(worldMatrix[3][0], worldMatrix[3][1], worldMatrix[3][2]); 
+	}
 
-	inline void SetPos(const Vector3f& pos) { m_pos = pos; }
-	inline void SetRot(const Quaternion& rot) { m_rot = rot; }
-	inline void SetScale(float scale) { m_scale = scale; }
-	inline void SetParent(Transform* parent) { m_parent = parent; }
+	inline void SetPos(const Vector3f& pos)   { m_pos = pos; MarkDirty(); }
+	inline void SetRot(const Quaternion& rot) { m_rot = rot; MarkDirty(); }
+	inline void SetScale(float scale)         { m_scale = scale; MarkDirty(); }
+	void SetParent(Transform* parent);
+	
+	//Listeners aren't copied along with the transform.
+	void AddListener(TransformListener* listener);
+	void RemoveListener(TransformListener* listener);
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
 protected:
 private:
-	const Matrix4f& GetParentMatrix() const;
+	void MarkDirty();
+	void CalcWorldTransform() const;
+	void RemoveChild(Transform* child);
 
 	Vector3f m_pos;
 	Quaternion m_rot;
 	float m_scale;
 	
-	Transform* m_parent;
-	mutable Matrix4f m_parentMatrix;
+	Transform*              m_parent;
+	std::vector<Transform*> m_children;
+	
+	std::vector<TransformListener*> m_listeners;
 	
-	mutable Vector3f m_oldPos;
-	mutable Quaternion m_oldRot;
-	mutable float m_oldScale;
-	mutable bool m_initializedOldStuff;
+	mutable Matrix4f   m_worldMatrix;
+	mutable Quaternion m_worldRot;
+	mutable bool       m_isDirty;
 };
 
 #endif
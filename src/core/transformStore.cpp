@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "transformStore.h"
+#include "transform.h"
+#include "profiling.h"
+
+#include "../staticLibs/simdaccel.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+//--------------------------------------------------------------------------------
+// Forward declarations
+//--------------------------------------------------------------------------------
+static SIMD4f LoadPadded(const std::vector<float>& values, int start, float padValue);
+static void ApplyParentMatrix(const Matrix4f& parent, Matrix4f* local);
+
+//--------------------------------------------------------------------------------
+// Member Function Implementation
+//--------------------------------------------------------------------------------
+int TransformStore::AddTransform(const Vector3f& pos, const Quaternion& rot, float scale, int parentHandle)
+{
+	int parentIndex = NO_PARENT;
+	int depth = 0;
+	
+	if(parentHandle != NO_PARENT)
+	{
+		assert(parentHandle >= 0 && parentHandle < (int)m_handleToIndex.size());
+		parentIndex = m_handleToIndex[parentHandle];
+		depth = m_depths[parentIndex] + 1;
+	}
+	
+	int lastDepth = m_depths.size() == 0 ? -1 : m_depths.back();
+	if(depth < lastDepth)
+	{
+		m_isSorted = false;
+	}
+	else if(depth > lastDepth)
+	{
+		m_levelStarts.push_back((int)m_depths.size());
+	}
+	
+	int handle = (int)m_handleToIndex.size();
+	m_handleToIndex.push_back((int)m_parents.size());
+	m_indexToHandle.push_back(handle);
+	
+	m_posX.push_back(pos.GetX());
+	m_posY.push_back(pos.GetY());
+	m_posZ.push_back(pos.GetZ());
+	m_rotX.push_back(rot.GetX());
+	m_rotY.push_back(rot.GetY());
+	m_rotZ.push_back(rot.GetZ());
+	m_rotW.push_back(rot.GetW());
+	m_scales.push_back(scale);
+	m_parents.push_back(parentIndex);
+	m_depths.push_back(depth);
+	m_worldMatrices.push_back(Matrix4f().InitIdentity());
+	
+	return handle;
+}
+
+void TransformStore::CalcWorldMatrices()
+{
+	if(!m_isSorted)
+	{
+		SortByDepth();
+	}
+	
+	CalcLocalMatrices();
+	
+	//Depth 0 transforms have no parents, so their local matrix is already their world matrix.
+	for(int level = 1; level < GetNumLevels(); level++)
+	{
+		CalcLevelWorldMatrices(level);
+	}
+}
+
+Vector3f TransformStore::GetPos(int handle) const
+{
+	int index = m_handleToIndex[handle];
+	return Vector3f(m_posX[index], m_posY[index], m_posZ[index]);
+}
+
+Quaternion TransformStore::GetRot(int handle) const
+{
+	int index = m_handleToIndex[handle];
+	return Quaternion(m_rotX[index], m_rotY[index], m_rotZ[index], m_rotW[index]);
+}
+
+void TransformStore::SetPos(int handle, const Vector3f& pos)
+{
+	int index = m_handleToIndex[handle];
+	m_posX[index] = pos.GetX();
+	m_posY[index] = pos.GetY();
+	m_posZ[index] = pos.GetZ();
+}
+
+void TransformStore::SetRot(int handle, const Quaternion& rot)
+{
+	int index = m_handleToIndex[handle];
+	m_rotX[index] = rot.GetX();
+	m_rotY[index] = rot.GetY();
+	m_rotZ[index] = rot.GetZ();
+	m_rotW[index] = rot.GetW();
+}
+
+void TransformStore::SortByDepth()
+{
+	int numTransforms = GetNumTransforms();
+	int numLevels = 0;
+	
+	for(int i = 0; i < numTransforms; i++)
+	{
+		if(m_depths[i] + 1 > numLevels)
+		{
+			numLevels = m_depths[i] + 1;
+		}
+	}
+	
+	//Counting sort, which keeps transforms of the same depth in the order they were added.
+	m_levelStarts.assign(numLevels, 0);
+	for(int i = 0; i < numTransforms; i++)
+	{
+		if(m_depths[i] + 1 < numLevels)
+		{
+			m_levelStarts[m_depths[i] + 1]++;
+		}
+	}
+	
+	for(int level = 1; level < numLevels; level++)
+	{
+		m_levelStarts[level] += m_levelStarts[level - 1];
+	}
+	
+	std::vector<int> nextSlot = m_levelStarts;
+	std::vector<int> newIndices(numTransforms);
+	for(int i = 0; i < numTransforms; i++)
+	{
+		newIndices[i] = nextSlot[m_depths[i]]++;
+	}
+	
+	std::vector<float> posX(numTransforms), posY(numTransforms), posZ(numTransforms);
+	std::vector<float> rotX(numTransforms), rotY(numTransforms), rotZ(numTransforms), rotW(numTransforms);
+	std::vector<float> scales(numTransforms);
+	std::vector<int> parents(numTransforms), depths(numTransforms), indexToHandle(numTransforms);
+	
+	for(int i = 0; i < numTransforms; i++)
+	{
+		int newIndex = newIndices[i];
+		
+		posX[newIndex] = m_posX[i];
+		posY[newIndex] = m_posY[i];
+		posZ[newIndex] = m_posZ[i];
+		rotX[newIndex] = m_rotX[i];
+		rotY[newIndex] = m_rotY[i];
+		rotZ[newIndex] = m_rotZ[i];
+		rotW[newIndex] = m_rotW[i];
+		scales[newIndex] = m_scales[i];
+		parents[newIndex] = m_parents[i] == NO_PARENT ? NO_PARENT : newIndices[m_parents[i]];
+		depths[newIndex] = m_depths[i];
+		indexToHandle[newIndex] = m_indexToHandle[i];
+		m_handleToIndex[m_indexToHandle[i]] = newIndex;
+	}
+	
+	m_posX.swap(posX);
+	m_posY.swap(posY);
+	m_posZ.swap(posZ);
+	m_rotX.swap(rotX);
+	m_rotY.swap(rotY);
+	m_rotZ.swap(rotZ);
+	m_rotW.swap(rotW);
+	m_scales.swap(scales);
+	m_parents.swap(parents);
+	m_depths.swap(depths);
+	m_indexToHandle.swap(indexToHandle);
+	
+	m_isSorted = true;
+}
+
+void TransformStore::CalcLocalMatrices()
+{
+	static const SIMD4f ONE(1.0f);
+	static const SIMD4f TWO(2.0f);
+	
+	int numTransforms = GetNumTransforms();
+	
+	for(int start = 0; start < numTransforms; start += 4)
+	{
+		SIMD4f x = LoadPadded(m_rotX, start, 0.0f);
+		SIMD4f y = LoadPadded(m_rotY, start, 0.0f);
+		SIMD4f z = LoadPadded(m_rotZ, start, 0.0f);
+		SIMD4f w = LoadPadded(m_rotW, start, 1.0f);
+		SIMD4f scale = LoadPadded(m_scales, start, 1.0f);
+		
+		SIMD4f xx = x * x;
+		SIMD4f yy = y * y;
+		SIMD4f zz = z * z;
+		SIMD4f xy = x * y;
+		SIMD4f xz = x * z;
+		SIMD4f yz = y * z;
+		SIMD4f wx = w * x;
+		SIMD4f wy = w * y;
+		SIMD4f wz = w * z;
+		SIMD4f twoScale = TWO * scale;
+		
+		//Rotation * scale, written out column by column. This is the same matrix
+		//Quaternion::ToRotationMatrix builds, without going through the basis vectors.
+		float columns[9][4];
+		((ONE - TWO * (yy + zz)) * scale).Get(columns[0]);
+		(twoScale * (xy + wz)).Get(columns[1]);
+		(twoScale * (xz - wy)).Get(columns[2]);
+		(twoScale * (xy - wz)).Get(columns[3]);
+		((ONE - TWO * (xx + zz)) * scale).Get(columns[4]);
+		(twoScale * (yz + wx)).Get(columns[5]);
+		(twoScale * (xz + wy)).Get(columns[6]);
+		(twoScale * (yz - wx)).Get(columns[7]);
+		((ONE - TWO * (xx + yy)) * scale).Get(columns[8]);
+		
+		int end = start + 4 < numTransforms ? start + 4 : numTransforms;
+		for(int i = start; i < end; i++)
+		{
+			int lane = i - start;
+			Matrix4f& local = m_worldMatrices[i];
+			
+			local[0][0] = columns[0][lane]; local[0][1] = columns[1][lane]; local[0][2] = columns[2][lane]; local[0][3] = 0.0f;
+			local[1][0] = columns[3][lane]; local[1][1] = columns[4][lane]; local[1][2] = columns[5][lane]; local[1][3] = 0.0f;
+			local[2][0] = columns[6][lane]; local[2][1] = columns[7][lane]; local[2][2] = columns[8][lane]; local[2][3] = 0.0f;
+			local[3][0] = m_posX[i];        local[3][1] = m_posY[i];        local[3][2] = m_posZ[i];        local[3][3] = 1.0f;
+		}
+	}
+}
+
+void TransformStore::CalcLevelWorldMatrices(int level)
+{
+	int start = m_levelStarts[level];
+	int end = level + 1 < GetNumLevels() ? m_levelStarts[level + 1] : GetNumTransforms();
+	
+	for(int i = start; i < end; i++)
+	{
+		ApplyParentMatrix(m_worldMatrices[m_parents[i]], &m_worldMatrices[i]);
+	}
+}
+
+void TransformStore::Test()
+{
+	TransformStore store;
+	Transform transforms[6];
+	int handles[6];
+	
+	//Children are deliberately added out of depth order to exercise the sort.
+	int parentIndices[6] = { -1, 0, 1, -1, 3, 0 };
+	for(int i = 0; i < 6; i++)
+	{
+		Vector3f pos((float)i, (float)(i * 2), -(float)i);
+		Quaternion rot(Vector3f(0.0f, 1.0f, 0.0f).Rotate((float)i, Vector3f(1.0f, 0.0f, 0.0f)), 0.3f * (float)i);
+		float scale = 1.0f + 0.5f * (float)i;
+		int parentHandle = parentIndices[i] == -1 ? NO_PARENT : handles[parentIndices[i]];
+		
+		handles[i] = store.AddTransform(pos, rot, scale, parentHandle);
+		
+		transforms[i].SetPos(pos);
+		transforms[i].SetRot(rot);
+		transforms[i].SetScale(scale);
+		if(parentIndices[i] != -1)
+		{
+			transforms[i].SetParent(&transforms[parentIndices[i]]);
+		}
+	}
+	
+	store.CalcWorldMatrices();
+	assert(store.GetNumLevels() == 3);
+	
+	for(int i = 0; i < 6; i++)
+	{
+		const Matrix4f& expected = transforms[i].GetTransformation();
+		const Matrix4f& actual = store.GetWorldMatrix(handles[i]);
+		
+		for(int j = 0; j < 4; j++)
+		{
+			for(int k = 0; k < 4; k++)
+			{
+				assert(fabs(expected[j][k] - actual[j][k]) < 0.001f);
+			}
+		}
+		
+		assert(store.GetPos(handles[i]) == *transforms[i].GetPos());
+	}
+}
+
+void TransformStore::Benchmark(int numTransforms)
+{
+	static const int NUM_ITERATIONS = 20;
+	static const int CHAIN_LENGTH = 4;
+
+	TransformStore store;
+	std::vector<Transform> transforms(numTransforms);
+	
+	for(int i = 0; i < numTransforms; i++)
+	{
+		bool isRoot = (i % CHAIN_LENGTH) == 0;
+		Vector3f pos((float)(i % 100), (float)(i / 100), 1.0f);
+		
+		store.AddTransform(pos, Quaternion(0,0,0,1), 1.0f, isRoot ? NO_PARENT : i - 1);
+		transforms[i].SetPos(pos);
+		if(!isRoot)
+		{
+			transforms[i].SetParent(&transforms[i - 1]);
+		}
+	}
+	
+	ProfileTimer transformTimer;
+	ProfileTimer storeTimer;
+	float checksum = 0.0f;
+	
+	for(int iteration = 0; iteration < NUM_ITERATIONS; iteration++)
+	{
+		Quaternion rot(Vector3f(0.0f, 1.0f, 0.0f), 0.01f * (float)iteration);
+		
+		transformTimer.StartInvocation();
+		for(int i = 0; i < numTransforms; i++)
+		{
+			transforms[i].SetRot(rot);
+		}
+		for(int i = 0; i < numTransforms; i++)
+		{
+			checksum += transforms[i].GetTransformation()[3][0];
+		}
+		transformTimer.StopInvocation();
+		
+		storeTimer.StartInvocation();
+		for(int i = 0; i < numTransforms; i++)
+		{
+			store.SetRot(i, rot);
+		}
+		store.CalcWorldMatrices();
+		for(int i = 0; i < numTransforms; i++)
+		{
+			checksum -= store.GetWorldMatrix(i)[3][0];
+		}
+		storeTimer.StopInvocation();
+	}
+	
+	double transformTime = transformTimer.GetTimeAndReset();
+	double storeTime = storeTimer.GetTimeAndReset();
+	
+	printf("World matrix benchmark, %d transforms (checksum %f):\n", numTransforms, checksum);
+	printf("Transform::GetTransformation:           %f matrices/s\n", (1000.0 * numTransforms) / transformTime);
+	printf("TransformStore::CalcWorldMatrices:      %f matrices/s\n\n", (1000.0 * numTransforms) / storeTime);
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static SIMD4f LoadPadded(const std::vector<float>& values, int start, float padValue)
+{
+	float lanes[4] = { padValue, padValue, padValue, padValue };
+	
+	for(int i = 0; i < 4 && start + i < (int)values.size(); i++)
+	{
+		lanes[i] = values[start + i];
+	}
+	
+	SIMD4f result;
+	result.Set(lanes);
+	return result;
+}
+
+static void ApplyParentMatrix(const Matrix4f& parent, Matrix4f* local)
+{
+	SIMD4f parentColumns[4];
+	for(int i = 0; i < 4; i++)
+	{
+		parentColumns[i].Set(parent[i]);
+	}
+	
+	//Each column of parent * local is the parent's columns weighted by one column of local.
+	for(int i = 0; i < 4; i++)
+	{
+		float* column = (*local)[i];
+		SIMD4f result = parentColumns[0] * SIMD4f(column[0])
+		              + parentColumns[1] * SIMD4f(column[1])
+		              + parentColumns[2] * SIMD4f(column[2])
+		              + parentColumns[3] * SIMD4f(column[3]);
+		result.Get(column);
+	}
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRANSFORMSTORE_H
+#define TRANSFORMSTORE_H
+
+#include "math3d.h"
+#include <vector>
+
+//TransformStore keeps large numbers of transforms in flat arrays, one array per
+//component, sorted by hierarchy depth. This lets CalcWorldMatrices build every
+//local matrix four at a time with SIMD and then apply parent matrices one depth
+//level after another, with each parent guaranteed to be finished before its children.
+//
+//Transforms are referred to by handles, which stay valid when the store re-sorts itself.
+class TransformStore
+{
+public:
+	static const int NO_PARENT = -1;
+
+	TransformStore() :
+		m_isSorted(true) {}
+	virtual ~TransformStore() {}
+	
+	int AddTransform(const Vector3f& pos = Vector3f(0,0,0), const Quaternion& rot = Quaternion(0,0,0,1), float scale = 1.0f, int parentHandle = NO_PARENT);
+	void CalcWorldMatrices();
+	
+	inline int GetNumTransforms()                        const { return (int)m_parents.size(); }
+	inline int GetNumLevels()                            const { return (int)m_levelStarts.size(); }
+	inline const Matrix4f& GetWorldMatrix(int handle)    const { return m_worldMatrices[m_handleToIndex[handle]]; }
+	inline float GetScale(int handle)                    const { return m_scales[m_handleToIndex[handle]]; }
+	Vector3f GetPos(int handle)                          const;
+	Quaternion GetRot(int handle)                        const;
+	
+	void SetPos(int handle, const Vector3f& pos);
+	void SetRot(int handle, const Quaternion& rot);
+	inline void SetScale(int handle, float scale) { m_scales[m_handleToIndex[handle]] = scale; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+	/** Prints matrices per second for this class next to the Transform class */
+	static void Benchmark(int numTransforms);
+protected:
+private:
+	void SortByDepth();
+	void CalcLocalMatrices();
+	void CalcLevelWorldMatrices(int level);
+
+	std::vector<float>    m_posX;
+	std::vector<float>    m_posY;
+	std::vector<float>    m_posZ;
+	std::vector<float>    m_rotX;
+	std::vector<float>    m_rotY;
+	std::vector<float>    m_rotZ;
+	std::vector<float>    m_rotW;
+	std::vector<float>    m_scales;
+	std::vector<int>      m_parents;       //Index of the parent in these arrays, or NO_PARENT
+	std::vector<int>      m_depths;
+	std::vector<Matrix4f> m_worldMatrices;
+	
+	std::vector<int>      m_levelStarts;   //Index of the first transform at each depth
+	std::vector<int>      m_handleToIndex;
+	std::vector<int>      m_indexToHandle;
+	bool                  m_isSorted;
+};
+
+#endif // TRANSFORMSTORE_H
@@ -37,10 +37,13 @@ private:
 
 void TestGame::Init(const Window& window)
 {
-	Material bricks("bricks", Texture("bricks.jpg"), 0.0f, 0, 
-			Texture("bricks_normal.jpg"), Texture("bricks_disp.png"), 0.03f, -0.5f);
-	Material bricks2("bricks2", Texture("bricks2.jpg"), 0.0f, 0, 
-			Texture("bricks2_normal.png"), Texture("bricks2_disp.jpg"), 0.04f, -1.0f);
+	//Everything loads in the background, and shows placeholders until it's ready.
+	Material bricks("bricks", Texture::LoadAsync("bricks.jpg"), 0.0f, 0, 
+			Texture::LoadAsync("bricks_normal.jpg", "default_normal.jpg"), 
+			Texture::LoadAsync("bricks_disp.png", "default_disp.png"), 0.03f, -0.5f);
+	Material bricks2("bricks2", Texture::LoadAsync("bricks2.jpg"), 0.0f, 0, 
+			Texture::LoadAsync("bricks2_normal.png", "default_normal.jpg"), 
+			Texture::LoadAsync("bricks2_disp.jpg", "default_disp.png"), 0.04f, -1.0f);
 
 	IndexedModel square;
 	{
@@ -138,13 +141,13 @@ void TestGame::Init(const Window& window)
 					if(i == 0 || j == 0 || k == 0)
 					{
 						AddToScene((new Entity(Vector3f(i * 2, j * 2, k * 2)))
-							->AddComponent(new MeshRenderer(Mesh("sphere.obj"), 
+							->AddComponent(new MeshRenderer(Mesh::LoadAsync("sphere.obj"), 
 									Material("bricks"))));
 					}
 					else
 					{
 						AddToScene((new Entity(Vector3f(i * 2, j * 2, k * 2)))
-							->AddComponent(new MeshRenderer(Mesh("cube.obj"), 
+							->AddComponent(new MeshRenderer(Mesh::LoadAsync("cube.obj"), 
 									Material("bricks2"))));
 					}
 			
@@ -153,22 +156,38 @@ void TestGame::Init(const Window& window)
 		}
 	}
 
-
+	//The camera, lights and renderers in this scene only move in ProcessInput, and none of them
+	//override Update, so each top level entity can safely update on its own job.
+	SetParallelUpdate(true);
 }
 
 #include <iostream>
+#include <cstring>
 
-int main()
+int main(int argc, char** argv)
 {
 	Testing::RunAllTests();
+	
+	#if PROFILING_RUN_BENCHMARKS != 0
+		Testing::RunAllBenchmarks();
+	#endif
+
+	RenderingEngine::RenderPath renderPath = RenderingEngine::RENDER_PATH_FORWARD;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--deferred") == 0)
+			renderPath = RenderingEngine::RENDER_PATH_DEFERRED;
+	}
 
 	TestGame game;
 	Window window(800, 600, "3D Game Engine");
-	RenderingEngine renderer(window);
+	RenderingEngine renderer(window, renderPath);
+	
+	JobSystem jobSystem;
 	
 	//window.SetFullScreen(true);
 	
-	CoreEngine engine(60, &window, &renderer, &game);
+	CoreEngine engine(60, &window, &renderer, &game, &jobSystem);
 	engine.Start();
 	
 	//window.SetFullScreen(false);
@@ -3,6 +3,12 @@
 #include <iostream>
 #include <cstdlib>
 
+MemoryPool& Collider::GetMemoryPool()
+{
+	static MemoryPool* pool = new MemoryPool("Collider", 64);
+	return *pool;
+}
+
 IntersectData Collider::Intersect(const Collider& other) const
 {
 	if(m_type == TYPE_SPHERE && other.GetType() == TYPE_SPHERE)
@@ -24,6 +24,7 @@
 #include "intersectData.h"
 #include "../core/math3d.h"
 #include "../core/referenceCounter.h"
+#include "../core/memoryPool.h"
 
 /**
  * The Collider class is the base class for colliders that can be used in the
@@ -52,6 +53,16 @@ public:
 		ReferenceCounter(),
 		m_type(type) {}
 	
+	/**
+	 * Colliders are deleted through Collider pointers, and the memory pool
+	 * needs the size of the actual subclass when that happens.
+	 */
+	virtual ~Collider() {}
+	
+	/** Colliders of every type share one pool, sized for the largest one. */
+	static void* operator new(size_t size)                 { return GetMemoryPool().Allocate(size); }
+	static void operator delete(void* object, size_t size) { GetMemoryPool().Free(object, size); }
+	
 	/**
 	 * Calculates information about if this collider is intersecting with 
 	 * another collider.
@@ -83,6 +94,8 @@ private:
 	 * subclass or strange behaviour may result!
 	 */
 	int m_type;
+	
+	static MemoryPool& GetMemoryPool();
 };
 
 #endif
@@ -0,0 +1,811 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boundingVolumeHierarchy.h"
+#include "frustum.h"
+#include "../core/profiling.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+//--------------------------------------------------------------------------------
+// Forward declarations
+//--------------------------------------------------------------------------------
+static float CalcSurfaceArea(const Vector3f& minExtents, const Vector3f& maxExtents);
+static float CalcCombinedSurfaceArea(const Vector3f& minExtents1, const Vector3f& maxExtents1, const Vector3f& minExtents2, const Vector3f& maxExtents2);
+static bool Contains(const Vector3f& outerMin, const Vector3f& outerMax, const Vector3f& innerMin, const Vector3f& innerMax);
+static bool Overlaps(const Vector3f& minExtents1, const Vector3f& maxExtents1, const Vector3f& minExtents2, const Vector3f& maxExtents2);
+
+//--------------------------------------------------------------------------------
+// Constructors/Destructors
+//--------------------------------------------------------------------------------
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(float margin) :
+	m_root(NULL_NODE),
+	m_freeList(NULL_NODE),
+	m_numLeaves(0),
+	m_numInsertedSinceRebuild(0),
+	m_margin(margin) {}
+
+//--------------------------------------------------------------------------------
+// Member Function Implementation
+//--------------------------------------------------------------------------------
+int BoundingVolumeHierarchy::Insert(const Vector3f& minExtents, const Vector3f& maxExtents, void* userData)
+{
+	int leaf = AllocateNode();
+	
+	Vector3f size = maxExtents - minExtents;
+	Vector3f margin(size.Max() * m_margin, size.Max() * m_margin, size.Max() * m_margin);
+	
+	m_nodes[leaf].m_minExtents = minExtents - margin;
+	m_nodes[leaf].m_maxExtents = maxExtents + margin;
+	m_nodes[leaf].m_userData = userData;
+	m_nodes[leaf].m_height = 0;
+	
+	InsertLeaf(leaf);
+	m_numLeaves++;
+	m_numInsertedSinceRebuild++;
+	
+	return leaf;
+}
+
+void BoundingVolumeHierarchy::Remove(int handle)
+{
+	assert(handle >= 0 && handle < (int)m_nodes.size() && m_nodes[handle].IsLeaf());
+	
+	RemoveLeaf(handle);
+	FreeNode(handle);
+	m_numLeaves--;
+}
+
+bool BoundingVolumeHierarchy::Move(int handle, const Vector3f& minExtents, const Vector3f& maxExtents)
+{
+	assert(handle >= 0 && handle < (int)m_nodes.size() && m_nodes[handle].IsLeaf());
+	
+	if(Contains(m_nodes[handle].m_minExtents, m_nodes[handle].m_maxExtents, minExtents, maxExtents))
+	{
+		return false;
+	}
+	
+	Vector3f size = maxExtents - minExtents;
+	Vector3f margin(size.Max() * m_margin, size.Max() * m_margin, size.Max() * m_margin);
+	
+	RemoveLeaf(handle);
+	m_nodes[handle].m_minExtents = minExtents - margin;
+	m_nodes[handle].m_maxExtents = maxExtents + margin;
+	InsertLeaf(handle);
+	
+	return true;
+}
+
+void BoundingVolumeHierarchy::Rebuild()
+{
+	std::vector<int> leaves;
+	leaves.reserve(m_numLeaves);
+	
+	//Leaves keep their nodes so handles stay valid; only the nodes above them are rebuilt.
+	for(int i = 0; i < (int)m_nodes.size(); i++)
+	{
+		if(m_nodes[i].m_height == 0)
+		{
+			leaves.push_back(i);
+		}
+		else if(m_nodes[i].m_height > 0)
+		{
+			FreeNode(i);
+		}
+	}
+	
+	m_root = leaves.empty() ? NULL_NODE : BuildRange(leaves, 0, (int)leaves.size());
+	
+	if(m_root != NULL_NODE)
+	{
+		m_nodes[m_root].m_parent = NULL_NODE;
+	}
+	
+	m_numInsertedSinceRebuild = 0;
+}
+
+void BoundingVolumeHierarchy::QueryFrustum(const Frustum& frustum, std::vector<void*>* results) const
+{
+	if(m_root != NULL_NODE)
+	{
+		QueryFrustum(m_root, frustum, (1 << frustum.GetNumPlanes()) - 1, results);
+	}
+}
+
+void BoundingVolumeHierarchy::QueryAABB(const Vector3f& minExtents, const Vector3f& maxExtents, std::vector<void*>* results) const
+{
+	if(m_root == NULL_NODE)
+	{
+		return;
+	}
+	
+	std::vector<int> stack;
+	stack.push_back(m_root);
+	
+	while(!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+		
+		const Node& current = m_nodes[node];
+		if(!Overlaps(current.m_minExtents, current.m_maxExtents, minExtents, maxExtents))
+		{
+			continue;
+		}
+		
+		if(Contains(minExtents, maxExtents, current.m_minExtents, current.m_maxExtents))
+		{
+			AddSubtree(node, results);
+		}
+		else if(current.IsLeaf())
+		{
+			results->push_back(current.m_userData);
+		}
+		else
+		{
+			stack.push_back(current.m_children[0]);
+			stack.push_back(current.m_children[1]);
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::QuerySphere(const Vector3f& center, float radius, std::vector<void*>* results) const
+{
+	if(m_root == NULL_NODE)
+	{
+		return;
+	}
+	
+	float radiusSquared = radius * radius;
+	std::vector<int> stack;
+	stack.push_back(m_root);
+	
+	while(!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+		
+		const Node& current = m_nodes[node];
+		
+		//The closest and farthest points of the box from the sphere's center.
+		Vector3f closest = Vector3f(Vector3f(center.Max(current.m_minExtents)).Min(current.m_maxExtents));
+		Vector3f farthest = Vector3f(Vector3f(center - current.m_minExtents).Max(current.m_maxExtents - center));
+		
+		if((closest - center).LengthSq() > radiusSquared)
+		{
+			continue;
+		}
+		
+		if(farthest.LengthSq() <= radiusSquared)
+		{
+			AddSubtree(node, results);
+		}
+		else if(current.IsLeaf())
+		{
+			results->push_back(current.m_userData);
+		}
+		else
+		{
+			stack.push_back(current.m_children[0]);
+			stack.push_back(current.m_children[1]);
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::QueryAll(std::vector<void*>* results) const
+{
+	if(m_root != NULL_NODE)
+	{
+		AddSubtree(m_root, results);
+	}
+}
+
+float BoundingVolumeHierarchy::CalcCost() const
+{
+	if(m_root == NULL_NODE)
+	{
+		return 0.0f;
+	}
+	
+	float rootArea = CalcSurfaceArea(m_nodes[m_root].m_minExtents, m_nodes[m_root].m_maxExtents);
+	float totalArea = 0.0f;
+	
+	for(unsigned int i = 0; i < m_nodes.size(); i++)
+	{
+		if(m_nodes[i].m_height > 0)
+		{
+			totalArea += CalcSurfaceArea(m_nodes[i].m_minExtents, m_nodes[i].m_maxExtents);
+		}
+	}
+	
+	return rootArea > 0.0f ? totalArea / rootArea : 0.0f;
+}
+
+int BoundingVolumeHierarchy::AllocateNode()
+{
+	int node = m_freeList;
+	
+	if(node == NULL_NODE)
+	{
+		node = (int)m_nodes.size();
+		m_nodes.push_back(Node());
+	}
+	else
+	{
+		m_freeList = m_nodes[node].m_parent;
+	}
+	
+	Node& result = m_nodes[node];
+	result.m_userData = 0;
+	result.m_parent = NULL_NODE;
+	result.m_children[0] = NULL_NODE;
+	result.m_children[1] = NULL_NODE;
+	result.m_height = 0;
+	
+	return node;
+}
+
+void BoundingVolumeHierarchy::FreeNode(int node)
+{
+	m_nodes[node].m_parent = m_freeList;
+	m_nodes[node].m_height = -1;
+	m_freeList = node;
+}
+
+void BoundingVolumeHierarchy::InsertLeaf(int leaf)
+{
+	if(m_root == NULL_NODE)
+	{
+		m_root = leaf;
+		m_nodes[leaf].m_parent = NULL_NODE;
+		return;
+	}
+	
+	const Vector3f leafMin = m_nodes[leaf].m_minExtents;
+	const Vector3f leafMax = m_nodes[leaf].m_maxExtents;
+	
+	//Walk down towards the sibling that grows the tree's total surface area the least.
+	//Every node passed on the way has to grow to fit the leaf, which is the inherited cost.
+	int sibling = m_root;
+	while(!m_nodes[sibling].IsLeaf())
+	{
+		const Node& node = m_nodes[sibling];
+		
+		float area = CalcSurfaceArea(node.m_minExtents, node.m_maxExtents);
+		float combinedArea = CalcCombinedSurfaceArea(node.m_minExtents, node.m_maxExtents, leafMin, leafMax);
+		
+		float cost = 2.0f * combinedArea;
+		float inheritedCost = 2.0f * (combinedArea - area);
+		float childCosts[2];
+		
+		for(int i = 0; i < 2; i++)
+		{
+			const Node& child = m_nodes[node.m_children[i]];
+			childCosts[i] = CalcCombinedSurfaceArea(child.m_minExtents, child.m_maxExtents, leafMin, leafMax) + inheritedCost;
+			
+			if(!child.IsLeaf())
+			{
+				childCosts[i] -= CalcSurfaceArea(child.m_minExtents, child.m_maxExtents);
+			}
+		}
+		
+		if(cost < childCosts[0] && cost < childCosts[1])
+		{
+			break;
+		}
+		
+		sibling = childCosts[0] < childCosts[1] ? node.m_children[0] : node.m_children[1];
+	}
+	
+	int oldParent = m_nodes[sibling].m_parent;
+	int newParent = AllocateNode();
+	
+	m_nodes[newParent].m_parent = oldParent;
+	m_nodes[newParent].m_children[0] = sibling;
+	m_nodes[newParent].m_children[1] = leaf;
+	m_nodes[sibling].m_parent = newParent;
+	m_nodes[leaf].m_parent = newParent;
+	
+	if(oldParent == NULL_NODE)
+	{
+		m_root = newParent;
+	}
+	else
+	{
+		int index = m_nodes[oldParent].m_children[0] == sibling ? 0 : 1;
+		m_nodes[oldParent].m_children[index] = newParent;
+	}
+	
+	Refit(newParent);
+}
+
+void BoundingVolumeHierarchy::RemoveLeaf(int leaf)
+{
+	if(leaf == m_root)
+	{
+		m_root = NULL_NODE;
+		return;
+	}
+	
+	int parent = m_nodes[leaf].m_parent;
+	int grandParent = m_nodes[parent].m_parent;
+	int sibling = m_nodes[parent].m_children[0] == leaf ? m_nodes[parent].m_children[1] : m_nodes[parent].m_children[0];
+	
+	//The sibling takes the parent's place.
+	if(grandParent == NULL_NODE)
+	{
+		m_root = sibling;
+		m_nodes[sibling].m_parent = NULL_NODE;
+	}
+	else
+	{
+		int index = m_nodes[grandParent].m_children[0] == parent ? 0 : 1;
+		m_nodes[grandParent].m_children[index] = sibling;
+		m_nodes[sibling].m_parent = grandParent;
+		Refit(grandParent);
+	}
+	
+	FreeNode(parent);
+	m_nodes[leaf].m_parent = NULL_NODE;
+}
+
+void BoundingVolumeHierarchy::Refit(int node)
+{
+	while(node != NULL_NODE)
+	{
+		Node& current = m_nodes[node];
+		const Node& child0 = m_nodes[current.m_children[0]];
+		const Node& child1 = m_nodes[current.m_children[1]];
+		
+		current.m_minExtents = Vector3f(child0.m_minExtents.Min(child1.m_minExtents));
+		current.m_maxExtents = Vector3f(child0.m_maxExtents.Max(child1.m_maxExtents));
+		current.m_height = 1 + std::max(child0.m_height, child1.m_height);
+		
+		node = current.m_parent;
+	}
+}
+
+int BoundingVolumeHierarchy::BuildRange(std::vector<int>& leaves, int start, int end)
+{
+	static const int NUM_BINS = 16;
+	
+	if(end - start == 1)
+	{
+		return leaves[start];
+	}
+	
+	//Leaves are split on the axis their centers are most spread out along.
+	Vector3f centroidMin = (m_nodes[leaves[start]].m_minExtents + m_nodes[leaves[start]].m_maxExtents) / 2.0f;
+	Vector3f centroidMax = centroidMin;
+	
+	for(int i = start + 1; i < end; i++)
+	{
+		Vector3f centroid = (m_nodes[leaves[i]].m_minExtents + m_nodes[leaves[i]].m_maxExtents) / 2.0f;
+		centroidMin = Vector3f(centroidMin.Min(centroid));
+		centroidMax = Vector3f(centroidMax.Max(centroid));
+	}
+	
+	Vector3f centroidSize = centroidMax - centroidMin;
+	int axis = 0;
+	if(centroidSize[1] > centroidSize[axis]) axis = 1;
+	if(centroidSize[2] > centroidSize[axis]) axis = 2;
+	
+	int mid = (start + end) / 2;
+	
+	if(centroidSize[axis] > 0.0f)
+	{
+		//Leaves are sorted into bins along the axis, and the split between bins that
+		//gives the lowest surface area heuristic cost is used.
+		int binCounts[NUM_BINS] = { 0 };
+		Vector3f binMins[NUM_BINS];
+		Vector3f binMaxs[NUM_BINS];
+		float binScale = (float)NUM_BINS / centroidSize[axis];
+		
+		for(int i = start; i < end; i++)
+		{
+			const Node& leaf = m_nodes[leaves[i]];
+			float centroid = (leaf.m_minExtents[axis] + leaf.m_maxExtents[axis]) / 2.0f;
+			int bin = std::min(NUM_BINS - 1, (int)((centroid - centroidMin[axis]) * binScale));
+			
+			if(binCounts[bin] == 0)
+			{
+				binMins[bin] = leaf.m_minExtents;
+				binMaxs[bin] = leaf.m_maxExtents;
+			}
+			else
+			{
+				binMins[bin] = Vector3f(binMins[bin].Min(leaf.m_minExtents));
+				binMaxs[bin] = Vector3f(binMaxs[bin].Max(leaf.m_maxExtents));
+			}
+			
+			binCounts[bin]++;
+		}
+		
+		//Costs of everything to the right of each split, swept from the right.
+		float rightCosts[NUM_BINS];
+		int rightCount = 0;
+		Vector3f rightMin, rightMax;
+		
+		for(int i = NUM_BINS - 1; i > 0; i--)
+		{
+			if(binCounts[i] != 0)
+			{
+				rightMin = rightCount == 0 ? binMins[i] : Vector3f(rightMin.Min(binMins[i]));
+				rightMax = rightCount == 0 ? binMaxs[i] : Vector3f(rightMax.Max(binMaxs[i]));
+				rightCount += binCounts[i];
+			}
+			
+			rightCosts[i] = rightCount == 0 ? 0.0f : CalcSurfaceArea(rightMin, rightMax) * rightCount;
+		}
+		
+		int leftCount = 0;
+		int bestSplit = -1;
+		float bestCost = 0.0f;
+		Vector3f leftMin, leftMax;
+		
+		for(int i = 0; i < NUM_BINS - 1; i++)
+		{
+			if(binCounts[i] != 0)
+			{
+				leftMin = leftCount == 0 ? binMins[i] : Vector3f(leftMin.Min(binMins[i]));
+				leftMax = leftCount == 0 ? binMaxs[i] : Vector3f(leftMax.Max(binMaxs[i]));
+				leftCount += binCounts[i];
+			}
+			
+			if(leftCount == 0 || leftCount == end - start)
+			{
+				continue;
+			}
+			
+			float cost = CalcSurfaceArea(leftMin, leftMax) * leftCount + rightCosts[i + 1];
+			if(bestSplit == -1 || cost < bestCost)
+			{
+				bestSplit = i;
+				bestCost = cost;
+			}
+		}
+		
+		if(bestSplit != -1)
+		{
+			int left = start;
+			int right = end - 1;
+			
+			while(left <= right)
+			{
+				const Node& leaf = m_nodes[leaves[left]];
+				float centroid = (leaf.m_minExtents[axis] + leaf.m_maxExtents[axis]) / 2.0f;
+				int bin = std::min(NUM_BINS - 1, (int)((centroid - centroidMin[axis]) * binScale));
+				
+				if(bin <= bestSplit)
+				{
+					left++;
+				}
+				else
+				{
+					std::swap(leaves[left], leaves[right]);
+					right--;
+				}
+			}
+			
+			mid = left;
+		}
+	}
+	
+	//Children are built first, since allocating nodes can move the node array.
+	int child0 = BuildRange(leaves, start, mid);
+	int child1 = BuildRange(leaves, mid, end);
+	int node = AllocateNode();
+	
+	m_nodes[node].m_children[0] = child0;
+	m_nodes[node].m_children[1] = child1;
+	m_nodes[child0].m_parent = node;
+	m_nodes[child1].m_parent = node;
+	
+	const Node& left = m_nodes[child0];
+	const Node& right = m_nodes[child1];
+	m_nodes[node].m_minExtents = Vector3f(left.m_minExtents.Min(right.m_minExtents));
+	m_nodes[node].m_maxExtents = Vector3f(left.m_maxExtents.Max(right.m_maxExtents));
+	m_nodes[node].m_height = 1 + std::max(left.m_height, right.m_height);
+	
+	return node;
+}
+
+void BoundingVolumeHierarchy::QueryFrustum(int node, const Frustum& frustum, int planeMask, std::vector<void*>* results) const
+{
+	const Node& current = m_nodes[node];
+	Vector3f center = (current.m_minExtents + current.m_maxExtents) / 2.0f;
+	Vector3f extents = (current.m_maxExtents - current.m_minExtents) / 2.0f;
+	
+	for(int i = 0; i < frustum.GetNumPlanes(); i++)
+	{
+		if(!(planeMask & (1 << i)))
+		{
+			continue;
+		}
+		
+		const Vector3f& normal = frustum.GetNormal(i);
+		float distance = normal.Dot(center) + frustum.GetDistance(i);
+		float reach = fabs(normal.GetX()) * extents.GetX() + fabs(normal.GetY()) * extents.GetY() + fabs(normal.GetZ()) * extents.GetZ();
+		
+		if(distance < -reach)
+		{
+			return;
+		}
+		
+		//Children of a node entirely inside a plane are too, so they skip testing it.
+		if(distance >= reach)
+		{
+			planeMask &= ~(1 << i);
+		}
+	}
+	
+	if(planeMask == 0)
+	{
+		AddSubtree(node, results);
+	}
+	else if(current.IsLeaf())
+	{
+		results->push_back(current.m_userData);
+	}
+	else
+	{
+		QueryFrustum(current.m_children[0], frustum, planeMask, results);
+		QueryFrustum(current.m_children[1], frustum, planeMask, results);
+	}
+}
+
+void BoundingVolumeHierarchy::AddSubtree(int node, std::vector<void*>* results) const
+{
+	const Node& current = m_nodes[node];
+	
+	if(current.IsLeaf())
+	{
+		results->push_back(current.m_userData);
+	}
+	else
+	{
+		AddSubtree(current.m_children[0], results);
+		AddSubtree(current.m_children[1], results);
+	}
+}
+
+#include <iostream>
+
+static void BruteForceAABB(const BoundingVolumeHierarchy& tree, const std::vector<int>& handles, const Vector3f& minExtents, const Vector3f& maxExtents, std::vector<void*>* results)
+{
+	for(unsigned int i = 0; i < handles.size(); i++)
+	{
+		if(Overlaps(tree.GetMinExtents(handles[i]), tree.GetMaxExtents(handles[i]), minExtents, maxExtents))
+		{
+			results->push_back(tree.GetUserData(handles[i]));
+		}
+	}
+}
+
+static void RandomBox(float range, Vector3f* minExtents, Vector3f* maxExtents)
+{
+	Vector3f center((float)(rand() % (int)range) - range / 2.0f, (float)(rand() % (int)range) - range / 2.0f, (float)(rand() % (int)range) - range / 2.0f);
+	Vector3f extents((float)(rand() % 5 + 1), (float)(rand() % 5 + 1), (float)(rand() % 5 + 1));
+	
+	*minExtents = center - extents;
+	*maxExtents = center + extents;
+}
+
+static void CheckQueries(const BoundingVolumeHierarchy& tree, const std::vector<int>& handles)
+{
+	Matrix4f projection = Matrix4f().InitPerspective(ToRadians(70.0f), 1.0f, 0.1f, 100.0f);
+	Frustum frustum(projection);
+	
+	std::vector<void*> actual;
+	std::vector<void*> expected;
+	
+	tree.QueryFrustum(frustum, &actual);
+	for(unsigned int i = 0; i < handles.size(); i++)
+	{
+		Vector3f center = (tree.GetMinExtents(handles[i]) + tree.GetMaxExtents(handles[i])) / 2.0f;
+		Vector3f extents = (tree.GetMaxExtents(handles[i]) - tree.GetMinExtents(handles[i])) / 2.0f;
+		
+		if(frustum.IntersectsAABB(center, extents))
+		{
+			expected.push_back(tree.GetUserData(handles[i]));
+		}
+	}
+	
+	std::sort(actual.begin(), actual.end());
+	std::sort(expected.begin(), expected.end());
+	assert(actual == expected);
+	
+	for(int i = 0; i < 10; i++)
+	{
+		Vector3f minExtents, maxExtents;
+		RandomBox(200.0f, &minExtents, &maxExtents);
+		minExtents = minExtents - Vector3f(20.0f, 20.0f, 20.0f);
+		maxExtents = maxExtents + Vector3f(20.0f, 20.0f, 20.0f);
+		
+		actual.clear();
+		expected.clear();
+		tree.QueryAABB(minExtents, maxExtents, &actual);
+		BruteForceAABB(tree, handles, minExtents, maxExtents, &expected);
+		
+		std::sort(actual.begin(), actual.end());
+		std::sort(expected.begin(), expected.end());
+		assert(actual == expected);
+		
+		//A sphere query is at least what the sphere's inner box overlaps and at most
+		//what its outer box overlaps.
+		Vector3f center = (minExtents + maxExtents) / 2.0f;
+		float radius = 25.0f;
+		Vector3f inner(radius / 1.75f, radius / 1.75f, radius / 1.75f);
+		Vector3f outer(radius, radius, radius);
+		
+		std::vector<void*> lower, upper;
+		actual.clear();
+		tree.QuerySphere(center, radius, &actual);
+		BruteForceAABB(tree, handles, center - inner, center + inner, &lower);
+		BruteForceAABB(tree, handles, center - outer, center + outer, &upper);
+		
+		std::sort(actual.begin(), actual.end());
+		std::sort(lower.begin(), lower.end());
+		std::sort(upper.begin(), upper.end());
+		assert(std::includes(actual.begin(), actual.end(), lower.begin(), lower.end()));
+		assert(std::includes(upper.begin(), upper.end(), actual.begin(), actual.end()));
+	}
+}
+
+void BoundingVolumeHierarchy::Test()
+{
+	const int NUM_OBJECTS = 300;
+	
+	BoundingVolumeHierarchy tree;
+	std::vector<int> handles;
+	int objects[NUM_OBJECTS];
+	
+	srand(11);
+	for(int i = 0; i < NUM_OBJECTS; i++)
+	{
+		Vector3f minExtents, maxExtents;
+		RandomBox(200.0f, &minExtents, &maxExtents);
+		handles.push_back(tree.Insert(minExtents, maxExtents, &objects[i]));
+	}
+	
+	assert(tree.GetNumLeaves() == NUM_OBJECTS);
+	assert(tree.GetNumInsertedSinceRebuild() == NUM_OBJECTS);
+	CheckQueries(tree, handles);
+	
+	//Small moves stay inside the enlarged box; large ones don't.
+	Vector3f minExtents = tree.GetMinExtents(handles[0]) + Vector3f(0.6f, 0.6f, 0.6f);
+	Vector3f maxExtents = tree.GetMaxExtents(handles[0]) - Vector3f(0.6f, 0.6f, 0.6f);
+	assert(tree.Move(handles[0], minExtents, maxExtents) == false);
+	assert(tree.Move(handles[0], minExtents + Vector3f(50.0f, 0.0f, 0.0f), maxExtents + Vector3f(50.0f, 0.0f, 0.0f)) == true);
+	
+	for(int i = 0; i < NUM_OBJECTS; i += 3)
+	{
+		RandomBox(200.0f, &minExtents, &maxExtents);
+		tree.Move(handles[i], minExtents, maxExtents);
+	}
+	CheckQueries(tree, handles);
+	
+	for(int i = NUM_OBJECTS - 1; i >= 0; i -= 4)
+	{
+		tree.Remove(handles[i]);
+		handles.erase(handles.begin() + i);
+	}
+	assert(tree.GetNumLeaves() == (int)handles.size());
+	CheckQueries(tree, handles);
+	
+	//Rebuilding keeps handles valid and shouldn't make the tree worse than inserting did.
+	float insertedCost = tree.CalcCost();
+	tree.Rebuild();
+	assert(tree.GetNumInsertedSinceRebuild() == 0);
+	assert(tree.CalcCost() <= insertedCost);
+	assert(tree.GetUserData(handles[5]) == &objects[6]);
+	CheckQueries(tree, handles);
+	
+	std::vector<void*> all;
+	tree.QueryAll(&all);
+	assert((int)all.size() == tree.GetNumLeaves());
+	
+	for(unsigned int i = 0; i < handles.size(); i++)
+	{
+		tree.Remove(handles[i]);
+	}
+	assert(tree.GetNumLeaves() == 0 && tree.GetHeight() == 0);
+}
+
+void BoundingVolumeHierarchy::Benchmark(int numObjects)
+{
+	static const int NUM_ITERATIONS = 100;
+	
+	BoundingVolumeHierarchy tree;
+	std::vector<float> centerX(numObjects), centerY(numObjects), centerZ(numObjects);
+	std::vector<float> extentX(numObjects), extentY(numObjects), extentZ(numObjects);
+	std::vector<unsigned char> visible(numObjects);
+	std::vector<void*> results;
+	
+	//A large, mostly static scene, of which a camera sees a small part.
+	srand(13);
+	for(int i = 0; i < numObjects; i++)
+	{
+		Vector3f minExtents, maxExtents;
+		RandomBox(2000.0f, &minExtents, &maxExtents);
+		
+		Vector3f center = (minExtents + maxExtents) / 2.0f;
+		Vector3f extents = (maxExtents - minExtents) / 2.0f;
+		centerX[i] = center.GetX(); centerY[i] = center.GetY(); centerZ[i] = center.GetZ();
+		extentX[i] = extents.GetX(); extentY[i] = extents.GetY(); extentZ[i] = extents.GetZ();
+		
+		tree.Insert(minExtents, maxExtents, 0);
+	}
+	tree.Rebuild();
+	
+	ProfileTimer flatTimer;
+	ProfileTimer treeTimer;
+	int numFlatVisible = 0;
+	int numTreeVisible = 0;
+	
+	for(int iteration = 0; iteration < NUM_ITERATIONS; iteration++)
+	{
+		Matrix4f projection = Matrix4f().InitPerspective(ToRadians(70.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+		Matrix4f rotation = Matrix4f().InitRotationEuler(0.0f, ToRadians(3.6f * (float)iteration), 0.0f);
+		Frustum frustum(projection * rotation);
+		
+		flatTimer.StartInvocation();
+		numFlatVisible += frustum.CullAABBs(&centerX[0], &centerY[0], &centerZ[0], &extentX[0], &extentY[0], &extentZ[0], numObjects, &visible[0]);
+		flatTimer.StopInvocation();
+		
+		treeTimer.StartInvocation();
+		results.clear();
+		tree.QueryFrustum(frustum, &results);
+		numTreeVisible += (int)results.size();
+		treeTimer.StopInvocation();
+	}
+	
+	double flatTime = flatTimer.GetTimeAndReset();
+	double treeTime = treeTimer.GetTimeAndReset();
+	
+	printf("Frustum culling benchmark, %d objects, %d visible on average, height %d:\n", numObjects, numTreeVisible / NUM_ITERATIONS, tree.GetHeight());
+	printf("Frustum::CullAABBs:                     %f ms/query (%d visible)\n", flatTime, numFlatVisible / NUM_ITERATIONS);
+	printf("BoundingVolumeHierarchy::QueryFrustum:  %f ms/query (%d visible)\n\n", treeTime, numTreeVisible / NUM_ITERATIONS);
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static float CalcSurfaceArea(const Vector3f& minExtents, const Vector3f& maxExtents)
+{
+	Vector3f size = maxExtents - minExtents;
+	return 2.0f * (size.GetX() * size.GetY() + size.GetY() * size.GetZ() + size.GetZ() * size.GetX());
+}
+
+static float CalcCombinedSurfaceArea(const Vector3f& minExtents1, const Vector3f& maxExtents1, const Vector3f& minExtents2, const Vector3f& maxExtents2)
+{
+	return CalcSurfaceArea(Vector3f(minExtents1.Min(minExtents2)), Vector3f(maxExtents1.Max(maxExtents2)));
+}
+
+static bool Contains(const Vector3f& outerMin, const Vector3f& outerMax, const Vector3f& innerMin, const Vector3f& innerMax)
+{
+	return outerMin.GetX() <= innerMin.GetX() && outerMin.GetY() <= innerMin.GetY() && outerMin.GetZ() <= innerMin.GetZ() &&
+	       outerMax.GetX() >= innerMax.GetX() && outerMax.GetY() >= innerMax.GetY() && outerMax.GetZ() >= innerMax.GetZ();
+}
+
+static bool Overlaps(const Vector3f& minExtents1, const Vector3f& maxExtents1, const Vector3f& minExtents2, const Vector3f& maxExtents2)
+{
+	return minExtents1.GetX() <= maxExtents2.GetX() && minExtents1.GetY() <= maxExtents2.GetY() && minExtents1.GetZ() <= maxExtents2.GetZ() &&
+	       maxExtents1.GetX() >= minExtents2.GetX() && maxExtents1.GetY() >= minExtents2.GetY() && maxExtents1.GetZ() >= minExtents2.GetZ();
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BOUNDINGVOLUMEHIERARCHY_H
+#define BOUNDINGVOLUMEHIERARCHY_H
+
+#include "../core/math3d.h"
+#include <vector>
+class Frustum;
+
+//A tree of axis aligned boxes over objects in the scene, so that culling and region
+//queries only visit the parts of the scene they overlap. A subtree entirely inside a
+//query is accepted without testing anything below it, so a query's cost depends on
+//how much it finds rather than on how large the scene is.
+//
+//Leaves store a slightly enlarged box, so objects that move a little don't change the
+//tree at all. Objects that leave their box are taken out and inserted again where they
+//fit best. Inserting is cheap but builds a worse tree than Rebuild, which splits the
+//whole tree top down with the surface area heuristic. Rebuild suits content that has
+//just been loaded and won't move much afterwards.
+//
+//Objects are referred to by handles, which stay valid across Rebuild.
+class BoundingVolumeHierarchy
+{
+public:
+	static const int INVALID_HANDLE = -1;
+	
+	//Leaf boxes are enlarged by this fraction of their size on each side.
+	BoundingVolumeHierarchy(float margin = 0.1f);
+	virtual ~BoundingVolumeHierarchy() {}
+	
+	int Insert(const Vector3f& minExtents, const Vector3f& maxExtents, void* userData);
+	void Remove(int handle);
+	
+	//Returns true if the object left its enlarged box and was inserted again.
+	bool Move(int handle, const Vector3f& minExtents, const Vector3f& maxExtents);
+	void Rebuild();
+	
+	//Each query adds the user data of every object it finds to results.
+	void QueryFrustum(const Frustum& frustum, std::vector<void*>* results) const;
+	void QueryAABB(const Vector3f& minExtents, const Vector3f& maxExtents, std::vector<void*>* results) const;
+	void QuerySphere(const Vector3f& center, float radius, std::vector<void*>* results) const;
+	void QueryAll(std::vector<void*>* results) const;
+	
+	inline void* GetUserData(int handle)              const { return m_nodes[handle].m_userData; }
+	inline const Vector3f& GetMinExtents(int handle)  const { return m_nodes[handle].m_minExtents; }
+	inline const Vector3f& GetMaxExtents(int handle)  const { return m_nodes[handle].m_maxExtents; }
+	inline int GetNumLeaves()                         const { return m_numLeaves; }
+	inline int GetNumInsertedSinceRebuild()           const { return m_numInsertedSinceRebuild; }
+	inline int GetHeight()                            const { return m_root == NULL_NODE ? 0 : m_nodes[m_root].m_height; }
+	
+	//The sum of every internal node's surface area relative to the root's, which is
+	//what the surface area heuristic minimizes. Lower means cheaper queries.
+	float CalcCost() const;
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+	/** Prints frustum query times for this class next to culling every box in a flat list */
+	static void Benchmark(int numObjects);
+protected:
+private:
+	static const int NULL_NODE = -1;
+	
+	struct Node
+	{
+		Vector3f m_minExtents;
+		Vector3f m_maxExtents;
+		void*    m_userData;
+		int      m_parent;    //Also links free nodes together
+		int      m_children[2];
+		int      m_height;    //0 for leaves, -1 for free nodes
+		
+		inline bool IsLeaf() const { return m_children[0] == NULL_NODE; }
+	};
+	
+	std::vector<Node> m_nodes;
+	int               m_root;
+	int               m_freeList;
+	int               m_numLeaves;
+	int               m_numInsertedSinceRebuild;
+	float             m_margin;
+	
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	void Refit(int node);
+	int BuildRange(std::vector<int>& leaves, int start, int end);
+	
+	void QueryFrustum(int node, const Frustum& frustum, int planeMask, std::vector<void*>* results) const;
+	void AddSubtree(int node, std::vector<void*>* results) const;
+};
+
+#endif // BOUNDINGVOLUMEHIERARCHY_H
@@ -20,6 +20,11 @@
 #include "../core/coreEngine.h"
 
 Matrix4f Camera::GetViewProjection() const
+{
+	return m_projection * GetView();
+}
+
+Matrix4f Camera::GetView() const
 {
 	//This comes from the conjugate rotation because the world should appear to rotate
 	//opposite to the camera's rotation.
@@ -30,7 +35,7 @@ Matrix4f Camera::GetViewProjection() const
 	//to the camera's movement.
 	cameraTranslation.InitTranslation(GetTransform().GetTransformedPos() * -1);
 	
-	return m_projection * cameraRotation * cameraTranslation;
+	return cameraRotation * cameraTranslation;
 }
 
 void CameraComponent::AddToEngine(CoreEngine* engine) const
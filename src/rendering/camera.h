@@ -40,6 +40,10 @@ public:
 	//of the screen, and 1 represents the top/right of the screen.
 	Matrix4f GetViewProjection()           const;
 	
+	//Moves a point from world space into the camera's space, where it looks down +Z.
+	Matrix4f GetView()                     const;
+	inline const Matrix4f& GetProjection() const { return m_projection; }
+	
 	inline void SetProjection(const Matrix4f& projection) { m_projection = projection; }
 	inline void SetTransform(Transform* transform)        { m_transform = transform; }
 protected:
@@ -60,6 +64,7 @@ public:
 		m_camera(projection, 0) {}
 	
 	virtual void AddToEngine(CoreEngine* engine) const;
+	virtual void AddToRenderQueue(RenderQueue& queue) const {}
 	
 	inline Matrix4f GetViewProjection() const { return m_camera.GetViewProjection(); }
 	
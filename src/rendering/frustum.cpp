@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frustum.h"
+#include "../staticLibs/simdaccel.h"
+#include <cassert>
+#include <cstdlib>
+
+Frustum::Frustum(const Matrix4f& viewProjection, bool useNearPlane)
+{
+	//A point is inside when -w <= x, y, z <= w in clip space, so each plane is the
+	//bottom row of the matrix plus or minus one of the other rows.
+	static const int ROWS[NUM_PLANES]  = { 0, 0, 1, 1, 2, 2 };
+	static const float SIGNS[NUM_PLANES] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+	
+	m_numPlanes = 0;
+	for(int i = 0; i < NUM_PLANES; i++)
+	{
+		if(i == PLANE_NEAR && !useNearPlane)
+			continue;
+		
+		int row = ROWS[i];
+		Vector3f normal(viewProjection[0][3] + SIGNS[i] * viewProjection[0][row],
+		                viewProjection[1][3] + SIGNS[i] * viewProjection[1][row],
+		                viewProjection[2][3] + SIGNS[i] * viewProjection[2][row]);
+		float distance = viewProjection[3][3] + SIGNS[i] * viewProjection[3][row];
+		
+		float length = normal.Length();
+		m_normals[m_numPlanes] = normal / length;
+		m_distances[m_numPlanes] = distance / length;
+		m_numPlanes++;
+	}
+}
+
+bool Frustum::IntersectsSphere(const Vector3f& center, float radius) const
+{
+	for(int i = 0; i < m_numPlanes; i++)
+	{
+		if(m_normals[i].Dot(center) + m_distances[i] < -radius)
+			return false;
+	}
+	
+	return true;
+}
+
+bool Frustum::IntersectsAABB(const Vector3f& center, const Vector3f& extents) const
+{
+	for(int i = 0; i < m_numPlanes; i++)
+	{
+		//How far the box reaches towards the plane from its center.
+		float reach = fabs(m_normals[i].GetX()) * extents.GetX() + 
+		              fabs(m_normals[i].GetY()) * extents.GetY() + 
+		              fabs(m_normals[i].GetZ()) * extents.GetZ();
+		
+		if(m_normals[i].Dot(center) + m_distances[i] < -reach)
+			return false;
+	}
+	
+	return true;
+}
+
+int Frustum::CullAABBs(const float* centerX, const float* centerY, const float* centerZ, 
+                       const float* extentX, const float* extentY, const float* extentZ, 
+                       int numBoxes, unsigned char* visible) const
+{
+	SIMD4f normalX[NUM_PLANES];
+	SIMD4f normalY[NUM_PLANES];
+	SIMD4f normalZ[NUM_PLANES];
+	SIMD4f absNormalX[NUM_PLANES];
+	SIMD4f absNormalY[NUM_PLANES];
+	SIMD4f absNormalZ[NUM_PLANES];
+	SIMD4f distance[NUM_PLANES];
+	
+	for(int i = 0; i < m_numPlanes; i++)
+	{
+		normalX[i] = SIMD4f(m_normals[i].GetX());
+		normalY[i] = SIMD4f(m_normals[i].GetY());
+		normalZ[i] = SIMD4f(m_normals[i].GetZ());
+		absNormalX[i] = normalX[i].Abs();
+		absNormalY[i] = normalY[i].Abs();
+		absNormalZ[i] = normalZ[i].Abs();
+		distance[i] = SIMD4f(m_distances[i]);
+	}
+	
+	static const SIMD4f ZERO(0.0f);
+	int numVisible = 0;
+	int i = 0;
+	
+	for(; i + 4 <= numBoxes; i += 4)
+	{
+		SIMD4f cx, cy, cz, ex, ey, ez;
+		cx.Set(centerX + i);
+		cy.Set(centerY + i);
+		cz.Set(centerZ + i);
+		ex.Set(extentX + i);
+		ey.Set(extentY + i);
+		ez.Set(extentZ + i);
+		
+		SIMD4f outside(0.0f);
+		for(int j = 0; j < m_numPlanes; j++)
+		{
+			SIMD4f signedDistance = normalX[j] * cx + normalY[j] * cy + normalZ[j] * cz + distance[j];
+			SIMD4f reach = absNormalX[j] * ex + absNormalY[j] * ey + absNormalZ[j] * ez;
+			
+			outside |= (signedDistance + reach) < ZERO;
+		}
+		
+		int32_t lanes[4];
+		outside.GetBytes((int8_t*)lanes);
+		
+		for(int j = 0; j < 4; j++)
+		{
+			visible[i + j] = lanes[j] == 0 ? 1 : 0;
+			numVisible += visible[i + j];
+		}
+	}
+	
+	//The last few boxes don't fill a whole group.
+	for(; i < numBoxes; i++)
+	{
+		visible[i] = IntersectsAABB(Vector3f(centerX[i], centerY[i], centerZ[i]), Vector3f(extentX[i], extentY[i], extentZ[i])) ? 1 : 0;
+		numVisible += visible[i];
+	}
+	
+	return numVisible;
+}
+
+#include <iostream>
+
+void Frustum::Test()
+{
+	//Looking down +Z from the origin, seeing between 0.1 and 100 units away.
+	Matrix4f projection = Matrix4f().InitPerspective(ToRadians(90.0f), 1.0f, 0.1f, 100.0f);
+	Frustum frustum(projection);
+	
+	assert(frustum.GetNumPlanes() == NUM_PLANES);
+	
+	assert(frustum.IntersectsSphere(Vector3f(0.0f, 0.0f, 10.0f), 1.0f) == true);
+	assert(frustum.IntersectsSphere(Vector3f(0.0f, 0.0f, -10.0f), 1.0f) == false);
+	assert(frustum.IntersectsSphere(Vector3f(0.0f, 0.0f, 200.0f), 1.0f) == false);
+	assert(frustum.IntersectsSphere(Vector3f(20.0f, 0.0f, 10.0f), 1.0f) == false);
+	assert(frustum.IntersectsSphere(Vector3f(10.5f, 0.0f, 10.0f), 1.0f) == true);
+	
+	assert(frustum.IntersectsAABB(Vector3f(0.0f, 0.0f, 10.0f), Vector3f(1.0f, 1.0f, 1.0f)) == true);
+	assert(frustum.IntersectsAABB(Vector3f(0.0f, 0.0f, -10.0f), Vector3f(1.0f, 1.0f, 1.0f)) == false);
+	assert(frustum.IntersectsAABB(Vector3f(0.0f, -13.0f, 10.0f), Vector3f(1.0f, 1.0f, 1.0f)) == false);
+	assert(frustum.IntersectsAABB(Vector3f(0.0f, -10.5f, 10.0f), Vector3f(1.0f, 1.0f, 1.0f)) == true);
+	
+	//Without the near plane, things behind the camera can still be in front of the far plane.
+	Frustum noNearPlane(projection, false);
+	assert(noNearPlane.GetNumPlanes() == NUM_PLANES - 1);
+	assert(noNearPlane.IntersectsAABB(Vector3f(0.0f, 0.0f, 0.05f), Vector3f(0.01f, 0.01f, 0.01f)) == true);
+	assert(frustum.IntersectsAABB(Vector3f(0.0f, 0.0f, 0.05f), Vector3f(0.01f, 0.01f, 0.01f)) == false);
+	
+	//The SIMD path has to agree with the scalar one, including the leftover boxes.
+	const int NUM_BOXES = 103;
+	float centerX[NUM_BOXES], centerY[NUM_BOXES], centerZ[NUM_BOXES];
+	float extentX[NUM_BOXES], extentY[NUM_BOXES], extentZ[NUM_BOXES];
+	unsigned char visible[NUM_BOXES];
+	
+	srand(7);
+	for(int i = 0; i < NUM_BOXES; i++)
+	{
+		centerX[i] = (float)(rand() % 400 - 200);
+		centerY[i] = (float)(rand() % 400 - 200);
+		centerZ[i] = (float)(rand() % 400 - 200);
+		extentX[i] = (float)(rand() % 20);
+		extentY[i] = (float)(rand() % 20);
+		extentZ[i] = (float)(rand() % 20);
+	}
+	
+	int numVisible = frustum.CullAABBs(centerX, centerY, centerZ, extentX, extentY, extentZ, NUM_BOXES, visible);
+	int expectedVisible = 0;
+	
+	for(int i = 0; i < NUM_BOXES; i++)
+	{
+		bool expected = frustum.IntersectsAABB(Vector3f(centerX[i], centerY[i], centerZ[i]), Vector3f(extentX[i], extentY[i], extentZ[i]));
+		assert((visible[i] != 0) == expected);
+		expectedVisible += expected ? 1 : 0;
+	}
+	
+	assert(numVisible == expectedVisible);
+	assert(numVisible > 0 && numVisible < NUM_BOXES);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "../core/math3d.h"
+
+//The six planes bounding what a camera can see, taken from its view projection
+//matrix. Each plane's normal points into the frustum, so anything entirely behind
+//one of them can't be seen.
+class Frustum
+{
+public:
+	enum
+	{
+		PLANE_LEFT,
+		PLANE_RIGHT,
+		PLANE_BOTTOM,
+		PLANE_TOP,
+		PLANE_NEAR,
+		PLANE_FAR,
+		
+		NUM_PLANES
+	};
+	
+	//Leaving out the near plane keeps objects between the camera and the near plane,
+	//which passes with depth clamping still need to draw.
+	Frustum(const Matrix4f& viewProjection, bool useNearPlane = true);
+	
+	bool IntersectsSphere(const Vector3f& center, float radius) const;
+	bool IntersectsAABB(const Vector3f& center, const Vector3f& extents) const;
+	
+	//Tests numBoxes boxes, given as centers and half sizes split into one array per
+	//axis, four at a time. visible is set to 1 for boxes that intersect the frustum
+	//and 0 for the rest, and the number of visible boxes is returned.
+	int CullAABBs(const float* centerX, const float* centerY, const float* centerZ, 
+	              const float* extentX, const float* extentY, const float* extentZ, 
+	              int numBoxes, unsigned char* visible) const;
+	
+	inline const Vector3f& GetNormal(int plane) const { return m_normals[plane]; }
+	inline float GetDistance(int plane)         const { return m_distances[plane]; }
+	inline int GetNumPlanes()                   const { return m_numPlanes; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+private:
+	Vector3f m_normals[NUM_PLANES];
+	float    m_distances[NUM_PLANES];
+	int      m_numPlanes;
+};
+
+#endif // FRUSTUM_H
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glState.h"
+#include "../core/profiling.h"
+
+#include <cassert>
+
+//Stored in place of a value the cache doesn't know yet, so the next call is issued.
+static const GLuint UNKNOWN_NAME = 0xFFFFFFFF;
+static const GLenum UNKNOWN_ENUM = 0xFFFFFFFF;
+static const int    UNKNOWN_FLAG = -1;
+
+//Stands in for glActiveTexture while Test runs.
+static GLenum s_recordedActiveTexture = UNKNOWN_ENUM;
+static void GLAPIENTRY RecordActiveTexture(GLenum texture);
+
+GLuint       GLState::s_program = UNKNOWN_NAME;
+unsigned int GLState::s_activeTextureUnit = 0;
+GLuint       GLState::s_textures[GLState::MAX_TEXTURE_UNITS][GLState::NUM_TEXTURE_TARGETS];
+GLuint       GLState::s_vertexArray = UNKNOWN_NAME;
+GLuint       GLState::s_framebuffer = UNKNOWN_NAME;
+GLint        GLState::s_viewport[4] = { -1, -1, -1, -1 };
+GLint        GLState::s_scissor[4] = { -1, -1, -1, -1 };
+int          GLState::s_capabilities[GLState::NUM_CAPABILITIES];
+GLenum       GLState::s_blendFunc[2] = { UNKNOWN_ENUM, UNKNOWN_ENUM };
+GLenum       GLState::s_depthFunc = UNKNOWN_ENUM;
+int          GLState::s_depthMask = UNKNOWN_FLAG;
+GLenum       GLState::s_cullFace = UNKNOWN_ENUM;
+GLenum       GLState::s_stencilFunc = UNKNOWN_ENUM;
+GLint        GLState::s_stencilRef = -1;
+GLuint       GLState::s_stencilMask = UNKNOWN_NAME;
+GLenum       GLState::s_stencilOps[2][3] = { { UNKNOWN_ENUM, UNKNOWN_ENUM, UNKNOWN_ENUM }, { UNKNOWN_ENUM, UNKNOWN_ENUM, UNKNOWN_ENUM } };
+unsigned int GLState::s_numIssued = 0;
+unsigned int GLState::s_numSkipped = 0;
+
+bool GLState::Changed(bool changed)
+{
+	#if PROFILING_DISABLE_GL_STATE_CACHE != 0
+		changed = true;
+	#endif
+	
+	if(changed)
+		s_numIssued++;
+	else
+		s_numSkipped++;
+	
+	return changed;
+}
+
+int GLState::GetCapabilityIndex(GLenum capability)
+{
+	switch(capability)
+	{
+		case GL_CULL_FACE:    return CAP_CULL_FACE;
+		case GL_DEPTH_TEST:   return CAP_DEPTH_TEST;
+		case GL_DEPTH_CLAMP:  return CAP_DEPTH_CLAMP;
+		case GL_BLEND:        return CAP_BLEND;
+		case GL_SCISSOR_TEST: return CAP_SCISSOR_TEST;
+		case GL_STENCIL_TEST: return CAP_STENCIL_TEST;
+		default:              return -1;
+	}
+}
+
+int GLState::GetTextureTargetIndex(GLenum target)
+{
+	switch(target)
+	{
+		case GL_TEXTURE_2D:       return TARGET_2D;
+		case GL_TEXTURE_2D_ARRAY: return TARGET_2D_ARRAY;
+		case GL_TEXTURE_CUBE_MAP: return TARGET_CUBE_MAP;
+		case GL_TEXTURE_BUFFER:   return TARGET_BUFFER;
+		default:                  return -1;
+	}
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if(Changed(program != s_program))
+	{
+		glUseProgram(program);
+		s_program = program;
+	}
+}
+
+void GLState::BindTexture(unsigned int unit, GLenum target, GLuint texture)
+{
+	assert(unit < MAX_TEXTURE_UNITS);
+	int targetIndex = GetTextureTargetIndex(target);
+	
+	//Targets the cache doesn't track are always bound.
+	if(!Changed(targetIndex == -1 || s_textures[unit][targetIndex] != texture))
+		return;
+	
+	if(unit != s_activeTextureUnit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		s_activeTextureUnit = unit;
+		s_numIssued++;
+	}
+	
+	glBindTexture(target, texture);
+	
+	if(targetIndex != -1)
+		s_textures[unit][targetIndex] = texture;
+}
+
+void GLState::BindVertexArray(GLuint vertexArray)
+{
+	if(Changed(vertexArray != s_vertexArray))
+	{
+		glBindVertexArray(vertexArray);
+		s_vertexArray = vertexArray;
+	}
+}
+
+void GLState::BindFramebuffer(GLuint framebuffer)
+{
+	if(Changed(framebuffer != s_framebuffer))
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		s_framebuffer = framebuffer;
+	}
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if(Changed(x != s_viewport[0] || y != s_viewport[1] || width != s_viewport[2] || height != s_viewport[3]))
+	{
+		glViewport(x, y, width, height);
+		s_viewport[0] = x;
+		s_viewport[1] = y;
+		s_viewport[2] = width;
+		s_viewport[3] = height;
+	}
+}
+
+void GLState::Scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if(Changed(x != s_scissor[0] || y != s_scissor[1] || width != s_scissor[2] || height != s_scissor[3]))
+	{
+		glScissor(x, y, width, height);
+		s_scissor[0] = x;
+		s_scissor[1] = y;
+		s_scissor[2] = width;
+		s_scissor[3] = height;
+	}
+}
+
+void GLState::SetEnabled(GLenum capability, bool enabled)
+{
+	int index = GetCapabilityIndex(capability);
+	
+	if(Changed(index == -1 || s_capabilities[index] != (int)enabled))
+	{
+		if(enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+		
+		if(index != -1)
+			s_capabilities[index] = (int)enabled;
+	}
+}
+
+void GLState::BlendFunc(GLenum sourceFactor, GLenum destFactor)
+{
+	if(Changed(sourceFactor != s_blendFunc[0] || destFactor != s_blendFunc[1]))
+	{
+		glBlendFunc(sourceFactor, destFactor);
+		s_blendFunc[0] = sourceFactor;
+		s_blendFunc[1] = destFactor;
+	}
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+	if(Changed(func != s_depthFunc))
+	{
+		glDepthFunc(func);
+		s_depthFunc = func;
+	}
+}
+
+void GLState::DepthMask(bool enabled)
+{
+	if(Changed(s_depthMask != (int)enabled))
+	{
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+		s_depthMask = (int)enabled;
+	}
+}
+
+void GLState::CullFace(GLenum face)
+{
+	if(Changed(face != s_cullFace))
+	{
+		glCullFace(face);
+		s_cullFace = face;
+	}
+}
+
+void GLState::StencilFunc(GLenum func, GLint ref, GLuint mask)
+{
+	if(Changed(func != s_stencilFunc || ref != s_stencilRef || mask != s_stencilMask))
+	{
+		glStencilFunc(func, ref, mask);
+		s_stencilFunc = func;
+		s_stencilRef = ref;
+		s_stencilMask = mask;
+	}
+}
+
+void GLState::StencilOpSeparate(GLenum face, GLenum stencilFail, GLenum depthFail, GLenum depthPass)
+{
+	//Index 0 holds the front face ops and index 1 the back face ops.
+	int first = face == GL_BACK ? 1 : 0;
+	int last = face == GL_FRONT ? 0 : 1;
+	
+	bool changed = false;
+	for(int i = first; i <= last; i++)
+	{
+		changed = changed || stencilFail != s_stencilOps[i][0] || depthFail != s_stencilOps[i][1] || depthPass != s_stencilOps[i][2];
+	}
+	
+	if(Changed(changed))
+	{
+		glStencilOpSeparate(face, stencilFail, depthFail, depthPass);
+		
+		for(int i = first; i <= last; i++)
+		{
+			s_stencilOps[i][0] = stencilFail;
+			s_stencilOps[i][1] = depthFail;
+			s_stencilOps[i][2] = depthPass;
+		}
+	}
+}
+
+void GLState::OnProgramDeleted(GLuint program)
+{
+	if(s_program == program)
+		s_program = UNKNOWN_NAME;
+}
+
+void GLState::OnTexturesDeleted(GLsizei numTextures, const GLuint* textures)
+{
+	//Deleting a bound texture binds 0 in its place, on every unit it was bound to.
+	for(GLsizei i = 0; i < numTextures; i++)
+	{
+		for(int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		{
+			for(int target = 0; target < NUM_TEXTURE_TARGETS; target++)
+			{
+				if(s_textures[unit][target] == textures[i])
+					s_textures[unit][target] = 0;
+			}
+		}
+	}
+}
+
+void GLState::OnVertexArrayDeleted(GLuint vertexArray)
+{
+	if(s_vertexArray == vertexArray)
+		s_vertexArray = 0;
+}
+
+void GLState::OnFramebufferDeleted(GLuint framebuffer)
+{
+	if(s_framebuffer == framebuffer)
+		s_framebuffer = 0;
+}
+
+void GLState::Invalidate()
+{
+	s_program = UNKNOWN_NAME;
+	s_vertexArray = UNKNOWN_NAME;
+	s_framebuffer = UNKNOWN_NAME;
+	
+	for(int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+	{
+		for(int target = 0; target < NUM_TEXTURE_TARGETS; target++)
+			s_textures[unit][target] = UNKNOWN_NAME;
+	}
+	
+	for(int i = 0; i < 4; i++)
+	{
+		s_viewport[i] = -1;
+		s_scissor[i] = -1;
+	}
+	
+	for(int i = 0; i < NUM_CAPABILITIES; i++)
+		s_capabilities[i] = UNKNOWN_FLAG;
+	
+	s_blendFunc[0] = UNKNOWN_ENUM;
+	s_blendFunc[1] = UNKNOWN_ENUM;
+	s_depthFunc = UNKNOWN_ENUM;
+	s_depthMask = UNKNOWN_FLAG;
+	s_cullFace = UNKNOWN_ENUM;
+	s_stencilFunc = UNKNOWN_ENUM;
+	s_stencilRef = -1;
+	s_stencilMask = UNKNOWN_NAME;
+	
+	for(int i = 0; i < 2; i++)
+	{
+		for(int j = 0; j < 3; j++)
+			s_stencilOps[i][j] = UNKNOWN_ENUM;
+	}
+	
+	//Callers bind on whichever unit is active, so rather than being forgotten it's
+	//put back to a unit that's known to be valid.
+	glActiveTexture(GL_TEXTURE0);
+	s_activeTextureUnit = 0;
+}
+
+void GLState::Test()
+{
+	//This runs before there's a context, so glActiveTexture is swapped for a function that
+	//records the unit. glBindTexture is core GL 1.1, and does nothing without a context.
+	PFNGLACTIVETEXTUREPROC activeTexture = __glewActiveTexture;
+	__glewActiveTexture = RecordActiveTexture;
+	
+	s_recordedActiveTexture = UNKNOWN_ENUM;
+	Invalidate();
+	assert(s_recordedActiveTexture == GL_TEXTURE0);
+	assert(GetActiveTextureUnit() == 0);
+	
+	//The first bind after Invalidate, on the active unit, is issued without switching units.
+	ResetCounters();
+	s_recordedActiveTexture = UNKNOWN_ENUM;
+	BindTexture(GetActiveTextureUnit(), GL_TEXTURE_2D, 0);
+	assert(GetNumIssued() == 1);
+	assert(s_recordedActiveTexture == UNKNOWN_ENUM);
+	assert(s_textures[0][TARGET_2D] == 0);
+	
+	#if PROFILING_DISABLE_GL_STATE_CACHE == 0
+		BindTexture(GetActiveTextureUnit(), GL_TEXTURE_2D, 0);
+		assert(GetNumIssued() == 1 && GetNumSkipped() == 1);
+	#endif
+	
+	//Binding on another unit switches to it first.
+	BindTexture(3, GL_TEXTURE_2D, 0);
+	assert(s_recordedActiveTexture == GL_TEXTURE0 + 3);
+	assert(GetActiveTextureUnit() == 3);
+	assert(s_textures[3][TARGET_2D] == 0);
+	
+	Invalidate();
+	ResetCounters();
+	__glewActiveTexture = activeTexture;
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static void GLAPIENTRY RecordActiveTexture(GLenum texture)
+{
+	s_recordedActiveTexture = texture;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+
+//GLState shadows the OpenGL state the engine changes while drawing, and only calls
+//into the driver when a value actually changes. Everything that binds programs,
+//textures, vertex arrays or framebuffers, or changes the viewport or fixed function
+//state, should go through here so the shadow copy stays in sync with the context.
+//
+//Window calls Invalidate once its context exists, so the first call for each value is
+//always issued, and texture unit 0 is active. Code that changes state behind the
+//cache's back should do the same.
+class GLState
+{
+public:
+	static const int MAX_TEXTURE_UNITS = 32;
+	
+	static void UseProgram(GLuint program);
+	static void BindTexture(unsigned int unit, GLenum target, GLuint texture);
+	static void BindVertexArray(GLuint vertexArray);
+	static void BindFramebuffer(GLuint framebuffer);
+	static void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	static void Scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+	
+	static void SetEnabled(GLenum capability, bool enabled);
+	static void BlendFunc(GLenum sourceFactor, GLenum destFactor);
+	static void DepthFunc(GLenum func);
+	static void DepthMask(bool enabled);
+	static void CullFace(GLenum face);
+	static void StencilFunc(GLenum func, GLint ref, GLuint mask);
+	static void StencilOpSeparate(GLenum face, GLenum stencilFail, GLenum depthFail, GLenum depthPass);
+	
+	//Deleted names can be handed out again by the driver, so the cache has to forget them.
+	static void OnProgramDeleted(GLuint program);
+	static void OnTexturesDeleted(GLsizei numTextures, const GLuint* textures);
+	static void OnVertexArrayDeleted(GLuint vertexArray);
+	static void OnFramebufferDeleted(GLuint framebuffer);
+	
+	static void Invalidate();
+	
+	static inline unsigned int GetActiveTextureUnit() { return s_activeTextureUnit; }
+	
+	//Calls passed on to the driver and calls dropped as redundant, since the last ResetCounters.
+	static inline unsigned int GetNumIssued()  { return s_numIssued; }
+	static inline unsigned int GetNumSkipped() { return s_numSkipped; }
+	static inline void ResetCounters()         { s_numIssued = 0; s_numSkipped = 0; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+private:
+	enum
+	{
+		CAP_CULL_FACE,
+		CAP_DEPTH_TEST,
+		CAP_DEPTH_CLAMP,
+		CAP_BLEND,
+		CAP_SCISSOR_TEST,
+		CAP_STENCIL_TEST,
+		NUM_CAPABILITIES
+	};
+	
+	enum
+	{
+		TARGET_2D,
+		TARGET_2D_ARRAY,
+		TARGET_CUBE_MAP,
+		TARGET_BUFFER,
+		NUM_TEXTURE_TARGETS
+	};
+	
+	static bool Changed(bool changed);
+	static int GetCapabilityIndex(GLenum capability);
+	static int GetTextureTargetIndex(GLenum target);
+	
+	static GLuint       s_program;
+	static unsigned int s_activeTextureUnit;
+	static GLuint       s_textures[MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+	static GLuint       s_vertexArray;
+	static GLuint       s_framebuffer;
+	static GLint        s_viewport[4];
+	static GLint        s_scissor[4];
+	static int          s_capabilities[NUM_CAPABILITIES];
+	static GLenum       s_blendFunc[2];
+	static GLenum       s_depthFunc;
+	static int          s_depthMask;
+	static GLenum       s_cullFace;
+	static GLenum       s_stencilFunc;
+	static GLint        s_stencilRef;
+	static GLuint       s_stencilMask;
+	static GLenum       s_stencilOps[2][3]; //Front and back faces
+	
+	static unsigned int s_numIssued;
+	static unsigned int s_numSkipped;
+};
+
+#endif // GLSTATE_H
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lightClusters.h"
+#include "glState.h"
+#include "../core/frameArena.h"
+#include "../core/profiling.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+LightClusters::LightClusters() :
+	m_near(1.0f),
+	m_far(2.0f),
+	m_slicesPerLogDepth(1.0f),
+	m_scaleX(1.0f),
+	m_scaleY(1.0f),
+	m_lightBuffer(0),
+	m_lightTexture(0),
+	m_clusterBuffer(0),
+	m_clusterTexture(0) {}
+
+LightClusters::~LightClusters()
+{
+	if(m_lightTexture)
+	{
+		GLuint textures[2] = { m_lightTexture, m_clusterTexture };
+		glDeleteTextures(2, textures);
+		GLState::OnTexturesDeleted(2, textures);
+		
+		GLuint buffers[2] = { m_lightBuffer, m_clusterBuffer };
+		glDeleteBuffers(2, buffers);
+	}
+}
+
+void LightClusters::Clear()
+{
+	m_lightSpheres.clear();
+	m_lightData.clear();
+}
+
+void LightClusters::AddPointLight(const Vector3f& position, float range, const Vector3f& color, float intensity, const Vector3f& attenuation)
+{
+	m_lightSpheres.push_back(Vector4f(position.GetX(), position.GetY(), position.GetZ(), range));
+	AddLightData(position, range, color, intensity, attenuation, Vector3f(0.0f, 0.0f, 1.0f), -1.0f, false);
+}
+
+void LightClusters::AddSpotLight(const Vector3f& position, float range, const Vector3f& color, float intensity, const Vector3f& attenuation,
+                                 const Vector3f& direction, float cutoff)
+{
+	//Binned by the sphere around its whole range; the cone is left to the shader.
+	m_lightSpheres.push_back(Vector4f(position.GetX(), position.GetY(), position.GetZ(), range));
+	AddLightData(position, range, color, intensity, attenuation, direction, cutoff, true);
+}
+
+void LightClusters::AddLightData(const Vector3f& position, float range, const Vector3f& color, float intensity, const Vector3f& attenuation,
+                                 const Vector3f& direction, float cutoff, bool isSpot)
+{
+	float texels[TEXELS_PER_LIGHT * 4] = 
+	{
+		position.GetX(),    position.GetY(),    position.GetZ(),    range,
+		color.GetX(),       color.GetY(),       color.GetZ(),       intensity,
+		attenuation.GetX(), attenuation.GetY(), attenuation.GetZ(), isSpot ? 1.0f : 0.0f,
+		direction.GetX(),   direction.GetY(),   direction.GetZ(),   cutoff
+	};
+	
+	m_lightData.insert(m_lightData.end(), texels, texels + TEXELS_PER_LIGHT * 4);
+}
+
+void LightClusters::Build(const Matrix4f& view, const Matrix4f& projection)
+{
+	//Perspective matrices map view depth z to clip depth A*z + B, with w = z.
+	float a = projection[2][2];
+	float b = projection[3][2];
+	
+	m_near = -b / (a + 1.0f);
+	m_far = b / (1.0f - a);
+	m_slicesPerLogDepth = (float)NUM_SLICES / log(m_far / m_near);
+	m_scaleX = projection[0][0];
+	m_scaleY = projection[1][1];
+	
+	//Lights are binned twice: once to count each cluster's lights, so every cluster's
+	//list can be given its place in one array, and once more to fill the lists in.
+	std::vector<Vector3f, FrameAllocator<Vector3f> > viewCenters(m_lightSpheres.size());
+	m_clusterCounts.assign(NUM_CLUSTERS, 0);
+	
+	for(unsigned int i = 0; i < m_lightSpheres.size(); i++)
+	{
+		const Vector4f& sphere = m_lightSpheres[i];
+		viewCenters[i] = Vector3f(view.Transform(Vector3f(sphere.GetX(), sphere.GetY(), sphere.GetZ())));
+		BinSphere(viewCenters[i], sphere.GetW(), i, true);
+	}
+	
+	int offset = 2 * NUM_CLUSTERS;
+	for(int i = 0; i < NUM_CLUSTERS; i++)
+	{
+		offset += m_clusterCounts[i];
+	}
+	
+	m_clusterData.resize(offset);
+	offset = 2 * NUM_CLUSTERS;
+	
+	for(int i = 0; i < NUM_CLUSTERS; i++)
+	{
+		m_clusterData[i * 2] = offset;
+		m_clusterData[i * 2 + 1] = 0;
+		offset += m_clusterCounts[i];
+	}
+	
+	for(unsigned int i = 0; i < m_lightSpheres.size(); i++)
+	{
+		BinSphere(viewCenters[i], m_lightSpheres[i].GetW(), i, false);
+	}
+}
+
+void LightClusters::Upload()
+{
+	if(m_lightTexture == 0)
+	{
+		GLuint buffers[2];
+		GLuint textures[2];
+		glGenBuffers(2, buffers);
+		glGenTextures(2, textures);
+		
+		m_lightBuffer = buffers[0];
+		m_clusterBuffer = buffers[1];
+		m_lightTexture = textures[0];
+		m_clusterTexture = textures[1];
+		
+		//A buffer texture reads whatever its buffer holds, so they only need linking once.
+		GLState::BindTexture(GLState::GetActiveTextureUnit(), GL_TEXTURE_BUFFER, m_lightTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_lightBuffer);
+		GLState::BindTexture(GLState::GetActiveTextureUnit(), GL_TEXTURE_BUFFER, m_clusterTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, m_clusterBuffer);
+	}
+	
+	//Buffer textures can't be empty, so a light's worth of zeros stands in for no lights.
+	static const float NO_LIGHTS[TEXELS_PER_LIGHT * 4] = { 0.0f };
+	const float* lightData = m_lightData.empty() ? NO_LIGHTS : &m_lightData[0];
+	size_t lightDataSize = m_lightData.empty() ? sizeof(NO_LIGHTS) : m_lightData.size() * sizeof(float);
+	
+	glBindBuffer(GL_TEXTURE_BUFFER, m_lightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, lightDataSize, lightData, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_clusterBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, m_clusterData.size() * sizeof(unsigned int), &m_clusterData[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+int LightClusters::FindCluster(const Vector3f& viewPos) const
+{
+	float depth = viewPos.GetZ();
+	float ndcX = m_scaleX * viewPos.GetX() / depth;
+	float ndcY = m_scaleY * viewPos.GetY() / depth;
+	
+	if(depth < m_near || depth > m_far || fabs(ndcX) > 1.0f || fabs(ndcY) > 1.0f)
+	{
+		return -1;
+	}
+	
+	int tileX = std::min(NUM_TILES_X - 1, (int)((ndcX * 0.5f + 0.5f) * NUM_TILES_X));
+	int tileY = std::min(NUM_TILES_Y - 1, (int)((ndcY * 0.5f + 0.5f) * NUM_TILES_Y));
+	
+	return (CalcSlice(depth) * NUM_TILES_Y + tileY) * NUM_TILES_X + tileX;
+}
+
+void LightClusters::BinSphere(const Vector3f& viewCenter, float radius, int lightIndex, bool isCounting)
+{
+	float minDepth = viewCenter.GetZ() - radius;
+	float maxDepth = viewCenter.GetZ() + radius;
+	
+	if(maxDepth < m_near || minDepth > m_far)
+	{
+		return;
+	}
+	
+	int firstSlice = CalcSlice(std::max(minDepth, m_near));
+	int lastSlice = CalcSlice(std::min(maxDepth, m_far));
+	
+	for(int slice = firstSlice; slice <= lastSlice; slice++)
+	{
+		//The sphere's box is projected using only the depths this slice covers, which
+		//is tighter than using its whole depth range.
+		float sliceNear = m_near * exp((float)slice / m_slicesPerLogDepth);
+		float sliceFar = m_near * exp((float)(slice + 1) / m_slicesPerLogDepth);
+		float nearDepth = std::max(minDepth, sliceNear);
+		float farDepth = std::min(maxDepth, sliceFar);
+		
+		int firstX, lastX, firstY, lastY;
+		CalcTileRange(viewCenter.GetX() - radius, viewCenter.GetX() + radius, nearDepth, farDepth, m_scaleX, NUM_TILES_X, &firstX, &lastX);
+		CalcTileRange(viewCenter.GetY() - radius, viewCenter.GetY() + radius, nearDepth, farDepth, m_scaleY, NUM_TILES_Y, &firstY, &lastY);
+		
+		for(int y = firstY; y <= lastY; y++)
+		{
+			for(int x = firstX; x <= lastX; x++)
+			{
+				int cluster = (slice * NUM_TILES_Y + y) * NUM_TILES_X + x;
+				
+				if(isCounting)
+				{
+					m_clusterCounts[cluster]++;
+				}
+				else
+				{
+					unsigned int& count = m_clusterData[cluster * 2 + 1];
+					m_clusterData[m_clusterData[cluster * 2] + count] = lightIndex;
+					count++;
+				}
+			}
+		}
+	}
+}
+
+int LightClusters::CalcSlice(float viewDepth) const
+{
+	int slice = (int)floor(log(viewDepth / m_near) * m_slicesPerLogDepth);
+	return Clamp(slice, 0, NUM_SLICES - 1);
+}
+
+void LightClusters::CalcTileRange(float minValue, float maxValue, float minDepth, float maxDepth, float scale, int numTiles, int* first, int* last) const
+{
+	//Dividing by the nearest depth pushes a coordinate furthest from the center of the
+	//screen, and dividing by the farthest pulls it closest, so each edge of the range
+	//picks whichever depth moves it outwards.
+	float minNdc = scale * minValue / (minValue < 0.0f ? minDepth : maxDepth);
+	float maxNdc = scale * maxValue / (maxValue < 0.0f ? maxDepth : minDepth);
+	
+	if(maxNdc < -1.0f || minNdc > 1.0f)
+	{
+		*first = 1;
+		*last = 0;
+		return;
+	}
+	
+	*first = Clamp((int)floor((minNdc * 0.5f + 0.5f) * numTiles), 0, numTiles - 1);
+	*last = Clamp((int)floor((maxNdc * 0.5f + 0.5f) * numTiles), 0, numTiles - 1);
+}
+
+static Vector3f RandomPoint(const Vector3f& minExtents, const Vector3f& maxExtents)
+{
+	Vector3f t((float)rand() / RAND_MAX, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX);
+	Vector3f size = maxExtents - minExtents;
+	
+	return minExtents + Vector3f(size.GetX() * t.GetX(), size.GetY() * t.GetY(), size.GetZ() * t.GetZ());
+}
+
+void LightClusters::Test()
+{
+	const int NUM_LIGHTS = 200;
+	const int NUM_POINTS = 5000;
+	
+	Matrix4f projection = Matrix4f().InitPerspective(ToRadians(70.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+	Matrix4f view = Matrix4f().InitTranslation(Vector3f(-5.0f, 2.0f, 3.0f));
+	Matrix4f inverseView = Matrix4f().InitTranslation(Vector3f(5.0f, -2.0f, -3.0f));
+	
+	LightClusters clusters;
+	srand(17);
+	
+	for(int i = 0; i < NUM_LIGHTS; i++)
+	{
+		Vector3f position = RandomPoint(Vector3f(-40.0f, -20.0f, -5.0f), Vector3f(40.0f, 20.0f, 60.0f));
+		float range = 1.0f + (float)(rand() % 10);
+		
+		if(i % 2 == 0)
+			clusters.AddPointLight(position, range, Vector3f(1, 1, 1), 1.0f, Vector3f(0, 0, 1));
+		else
+			clusters.AddSpotLight(position, range, Vector3f(1, 1, 1), 1.0f, Vector3f(0, 0, 1), Vector3f(0, 0, 1), 0.5f);
+	}
+	
+	clusters.Build(view, projection);
+	assert(fabs(clusters.GetNear() - 0.1f) < 0.001f);
+	assert(clusters.GetNumLights() == NUM_LIGHTS);
+	assert(clusters.GetNumIndices() > 0);
+	
+	//Every cluster's list has to hold every light that reaches any point inside it.
+	int numFound = 0;
+	for(int i = 0; i < NUM_POINTS; i++)
+	{
+		Vector3f viewPos = RandomPoint(Vector3f(-30.0f, -15.0f, 0.2f), Vector3f(30.0f, 15.0f, 50.0f));
+		int cluster = clusters.FindCluster(viewPos);
+		
+		if(cluster == -1)
+			continue;
+		
+		Vector3f worldPos = Vector3f(inverseView.Transform(viewPos));
+		int offset = clusters.GetClusterOffset(cluster);
+		int count = clusters.GetClusterCount(cluster);
+		
+		for(int light = 0; light < NUM_LIGHTS; light++)
+		{
+			const Vector4f& sphere = clusters.m_lightSpheres[light];
+			if((worldPos - Vector3f(sphere.GetX(), sphere.GetY(), sphere.GetZ())).Length() > sphere.GetW())
+				continue;
+			
+			bool isListed = false;
+			for(int j = 0; j < count && !isListed; j++)
+			{
+				isListed = clusters.GetLightIndex(offset + j) == light;
+			}
+			
+			assert(isListed);
+			numFound++;
+		}
+	}
+	
+	assert(numFound > 0);
+	
+	//Points outside the frustum belong to no cluster.
+	assert(clusters.FindCluster(Vector3f(0.0f, 0.0f, -1.0f)) == -1);
+	assert(clusters.FindCluster(Vector3f(0.0f, 0.0f, 2000.0f)) == -1);
+	assert(clusters.FindCluster(Vector3f(100.0f, 0.0f, 1.0f)) == -1);
+	
+	clusters.Clear();
+	clusters.Build(view, projection);
+	assert(clusters.GetNumLights() == 0 && clusters.GetNumIndices() == 0);
+}
+
+void LightClusters::Benchmark(int numLights)
+{
+	static const int NUM_ITERATIONS = 50;
+	
+	Matrix4f projection = Matrix4f().InitPerspective(ToRadians(70.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+	Matrix4f view = Matrix4f().InitIdentity();
+	
+	//Small lights spread through the part of the scene in front of the camera.
+	LightClusters clusters;
+	srand(19);
+	for(int i = 0; i < numLights; i++)
+	{
+		Vector3f position = RandomPoint(Vector3f(-60.0f, -30.0f, 1.0f), Vector3f(60.0f, 30.0f, 100.0f));
+		clusters.AddPointLight(position, 2.0f + (float)(rand() % 7), Vector3f(1, 1, 1), 1.0f, Vector3f(0, 0, 1));
+	}
+	
+	ProfileTimer buildTimer;
+	for(int i = 0; i < NUM_ITERATIONS; i++)
+	{
+		//Each build stands in for a frame, and frees its scratch memory like one.
+		FrameArena::GetFrameArena().Reset();
+		
+		buildTimer.StartInvocation();
+		clusters.Build(view, projection);
+		buildTimer.StopInvocation();
+	}
+	
+	int maxCount = 0;
+	int numOccupied = 0;
+	for(int i = 0; i < NUM_CLUSTERS; i++)
+	{
+		maxCount = std::max(maxCount, clusters.GetClusterCount(i));
+		numOccupied += clusters.GetClusterCount(i) != 0 ? 1 : 0;
+	}
+	
+	double averageCount = numOccupied == 0 ? 0.0 : (double)clusters.GetNumIndices() / numOccupied;
+	
+	//Benchmarks run before there's a window, so this only covers the CPU side of the
+	//clustered path. The cluster sizes show how many lights each fragment loops over.
+	printf("Light clustering benchmark (CPU only), %d point lights:\n", numLights);
+	printf("LightClusters::Build:                   %f ms\n", buildTimer.GetTimeAndReset());
+	printf("Lights per lit cluster (average/max):   %f/%d\n\n", averageCount, maxCount);
+}
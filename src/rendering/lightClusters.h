@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include "../core/math3d.h"
+#include <GL/glew.h>
+#include <vector>
+
+//Splits what a camera sees into a grid of clusters, tiles across the screen by slices
+//in depth, and lists the lights that can reach each cluster. A clustered forward
+//shader then finds its fragment's cluster and only loops over those lights, so every
+//fragment is shaded once however many lights the scene has.
+//
+//Depth slices get exponentially thicker with distance, so clusters stay roughly cube
+//shaped in view space instead of long thin columns far from the camera.
+//
+//The lights and cluster lists are uploaded to two buffer textures. Each light takes
+//four RGBA32F texels: position and range, color and intensity, attenuation with a
+//flag for spot lights, and spot direction and cutoff. The cluster data is R32UI,
+//starting with an offset and a count for each cluster, followed by the light indices
+//those point at.
+class LightClusters
+{
+public:
+	static const int NUM_TILES_X = 16;
+	static const int NUM_TILES_Y = 9;
+	static const int NUM_SLICES = 24;
+	static const int NUM_CLUSTERS = NUM_TILES_X * NUM_TILES_Y * NUM_SLICES;
+	static const int TEXELS_PER_LIGHT = 4;
+	
+	LightClusters();
+	virtual ~LightClusters();
+	
+	void Clear();
+	void AddPointLight(const Vector3f& position, float range, const Vector3f& color, float intensity, const Vector3f& attenuation);
+	void AddSpotLight(const Vector3f& position, float range, const Vector3f& color, float intensity, const Vector3f& attenuation,
+	                  const Vector3f& direction, float cutoff);
+	
+	//Bins the added lights for a camera with the given view and perspective projection.
+	void Build(const Matrix4f& view, const Matrix4f& projection);
+	void Upload();
+	
+	//The cluster a point in view space falls in, found the same way the shader does,
+	//or -1 if it isn't between the near and far planes.
+	int FindCluster(const Vector3f& viewPos) const;
+	
+	inline int GetNumLights()                    const { return (int)m_lightSpheres.size(); }
+	inline int GetNumIndices()                   const { return (int)m_clusterData.size() - 2 * NUM_CLUSTERS; }
+	inline int GetClusterOffset(int cluster)     const { return (int)m_clusterData[cluster * 2]; }
+	inline int GetClusterCount(int cluster)      const { return (int)m_clusterData[cluster * 2 + 1]; }
+	inline int GetLightIndex(int index)          const { return (int)m_clusterData[index]; }
+	
+	inline float GetNear()                       const { return m_near; }
+	inline float GetSlicesPerLogDepth()          const { return m_slicesPerLogDepth; }
+	inline GLuint GetLightTexture()              const { return m_lightTexture; }
+	inline GLuint GetClusterTexture()            const { return m_clusterTexture; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+	/** Prints the CPU time taken to bin numLights point lights, and how many each fragment loops over */
+	static void Benchmark(int numLights);
+protected:
+private:
+	std::vector<Vector4f>     m_lightSpheres; //World space center and radius
+	std::vector<float>        m_lightData;
+	std::vector<unsigned int> m_clusterData;
+	std::vector<int>          m_clusterCounts;
+	
+	float  m_near;
+	float  m_far;
+	float  m_slicesPerLogDepth;
+	float  m_scaleX;
+	float  m_scaleY;
+	
+	GLuint m_lightBuffer;
+	GLuint m_lightTexture;
+	GLuint m_clusterBuffer;
+	GLuint m_clusterTexture;
+	
+	void AddLightData(const Vector3f& position, float range, const Vector3f& color, float intensity, const Vector3f& attenuation,
+	                  const Vector3f& direction, float cutoff, bool isSpot);
+	
+	//Calls AddToCluster for every cluster the sphere touches, which either counts or
+	//writes the light depending on the pass.
+	void BinSphere(const Vector3f& viewCenter, float radius, int lightIndex, bool isCounting);
+	int CalcSlice(float viewDepth) const;
+	void CalcTileRange(float minValue, float maxValue, float minDepth, float maxDepth, float scale, int numTiles, int* first, int* last) const;
+	
+	LightClusters(const LightClusters& other) {}
+	void operator=(const LightClusters& other) {}
+};
+
+#endif // LIGHTCLUSTERS_H
@@ -16,10 +16,25 @@
 
 #include "lighting.h"
 #include "renderingEngine.h"
+#include "lightClusters.h"
+#include "shadowCascades.h"
 #include "../core/coreEngine.h"
 
+#include <cassert>
+
 #define COLOR_DEPTH 256
 
+//How far a directional light's shadow camera can move before its shadow map is
+//rendered again, as a fraction of half the shadow area.
+#define SHADOW_CACHE_MOVE_FRACTION 0.125f
+
+//Cascades live in an array texture, which needs OpenGL 3.0.
+static bool UsesShadowCascades(int shadowMapSizeAsPowerOf2, int numShadowCascades)
+{
+	assert(numShadowCascades > 0 && numShadowCascades <= ShadowCascades::MAX_CASCADES);
+	return shadowMapSizeAsPowerOf2 != 0 && numShadowCascades > 1 && GLEW_VERSION_3_0;
+}
+
 void BaseLight::AddToEngine(CoreEngine* engine) const
 {
 	engine->GetRenderingEngine()->AddLight(*this);
@@ -31,15 +46,22 @@ ShadowCameraTransform BaseLight::CalcShadowCameraTransform(const Vector3f& mainC
 }
 
 DirectionalLight::DirectionalLight(const Vector3f& color, float intensity, int shadowMapSizeAsPowerOf2, 
-	                 float shadowArea, float shadowSoftness, float lightBleedReductionAmount, float minVariance) :
-	BaseLight(color, intensity, Shader("forward-directional")),
-	m_halfShadowArea(shadowArea / 2.0f)
+	                 float shadowArea, float shadowSoftness, float lightBleedReductionAmount, float minVariance,
+	                 int numShadowCascades, float cascadeSplitLambda) :
+	BaseLight(color, intensity, Shader(UsesShadowCascades(shadowMapSizeAsPowerOf2, numShadowCascades) ? 
+		"forward-directional-cascaded" : "forward-directional")),
+	m_halfShadowArea(shadowArea / 2.0f),
+	m_cascadeSplitLambda(cascadeSplitLambda)
 {
+	//The shadow camera follows the main camera, but its shadow map covers more than the
+	//main camera can see, so it can lag behind a little before it needs rendering again.
 	if(shadowMapSizeAsPowerOf2 != 0)
 	{
 		SetShadowInfo(ShadowInfo(Matrix4f().InitOrthographic(-m_halfShadowArea, m_halfShadowArea, -m_halfShadowArea, 
 		                                                      m_halfShadowArea, -m_halfShadowArea, m_halfShadowArea), 
-								 true, shadowMapSizeAsPowerOf2, shadowSoftness, lightBleedReductionAmount, minVariance));
+								 true, shadowMapSizeAsPowerOf2, shadowSoftness, lightBleedReductionAmount, minVariance, 
+								 m_halfShadowArea * SHADOW_CACHE_MOVE_FRACTION, 
+								 UsesShadowCascades(shadowMapSizeAsPowerOf2, numShadowCascades) ? numShadowCascades : 1));
 	}
 }
 
@@ -61,6 +83,19 @@ ShadowCameraTransform DirectionalLight::CalcShadowCameraTransform(const Vector3f
 	return ShadowCameraTransform(resultPos, resultRot);
 }
 
+void DirectionalLight::CalcShadowCascades(const Matrix4f& mainCameraProjection, const Vector3f& mainCameraPos, const Quaternion& mainCameraRot, 
+                                          ShadowCascades* cascades) const
+{
+	//Each cascade is padded by the same fraction the single shadow map lags behind by.
+	cascades->Fit(mainCameraProjection, mainCameraPos, mainCameraRot, GetTransform().GetTransformedRot(), GetShadowInfo().GetNumCascades(), 
+		m_halfShadowArea * 2.0f, m_cascadeSplitLambda, 1 << GetShadowInfo().GetShadowMapSizeAsPowerOf2(), SHADOW_CACHE_MOVE_FRACTION);
+}
+
+void DirectionalLight::RenderDeferred(RenderingEngine& renderingEngine) const
+{
+	renderingEngine.RenderDeferredLight(*this);
+}
+
 PointLight::PointLight(const Vector3f& color, float intensity, const Attenuation& attenuation, const Shader& shader) :
 	BaseLight(color, intensity, shader),
 	m_attenuation(attenuation)
@@ -72,6 +107,27 @@ PointLight::PointLight(const Vector3f& color, float intensity, const Attenuation
 	m_range = (-b + sqrtf(b*b - 4*a*c))/(2*a);
 }
 
+bool PointLight::CalcBoundingSphere(Vector3f* center, float* radius) const
+{
+	*center = GetTransform().GetTransformedPos();
+	*radius = m_range;
+	return true;
+}
+
+bool PointLight::AddToLightClusters(LightClusters* clusters) const
+{
+	const Attenuation& attenuation = GetAttenuation();
+	
+	clusters->AddPointLight(GetTransform().GetTransformedPos(), m_range, GetColor(), GetIntensity(), 
+		Vector3f(attenuation.GetConstant(), attenuation.GetLinear(), attenuation.GetExponent()));
+	return true;
+}
+
+void PointLight::RenderDeferred(RenderingEngine& renderingEngine) const
+{
+	renderingEngine.RenderDeferredLight(*this);
+}
+
 SpotLight::SpotLight(const Vector3f& color, float intensity, const Attenuation& attenuation, float viewAngle, 
                      int shadowMapSizeAsPowerOf2, float shadowSoftness, float lightBleedReductionAmount, float minVariance) :
 	PointLight(color, intensity, attenuation, Shader("forward-spot")),
@@ -83,3 +139,98 @@ SpotLight::SpotLight(const Vector3f& color, float intensity, const Attenuation&
 		                             shadowSoftness, lightBleedReductionAmount, minVariance));
 	}
 }
+
+bool SpotLight::CalcBoundingSphere(Vector3f* center, float* radius) const
+{
+	CalcConeBoundingSphere(GetTransform().GetTransformedPos(), GetTransform().GetTransformedRot().GetForward(), 
+		GetRange(), m_cutoff, center, radius);
+	return true;
+}
+
+void SpotLight::CalcConeBoundingSphere(const Vector3f& apex, const Vector3f& direction, float range, float cutoff, 
+                                       Vector3f* center, float* radius)
+{
+	//A narrow cone fits in the sphere through its apex and the rim of its base. A wide
+	//one fits in the sphere around its base, which has the tip of the cap inside it too.
+	//Cones wider than a hemisphere reach back past the apex, so they get the whole range.
+	if(cutoff >= 0.70710678f)
+	{
+		*radius = range / (2.0f * cutoff);
+		*center = apex + direction * *radius;
+	}
+	else if(cutoff >= 0.0f)
+	{
+		*radius = range * sqrtf(1.0f - cutoff * cutoff);
+		*center = apex + direction * (range * cutoff);
+	}
+	else
+	{
+		*radius = range;
+		*center = apex;
+	}
+}
+
+void SpotLight::Test()
+{
+	static const int NUM_ANGLE_STEPS = 8;
+	static const int NUM_AROUND_STEPS = 12;
+	static const float EPSILON = 0.0001f;
+	
+	Vector3f apex(1.0f, -2.0f, 3.0f);
+	Vector3f direction = Vector3f(1.0f, 2.0f, -1.0f).Normalized();
+	Vector3f side = direction.Cross(Vector3f(0.0f, 0.0f, 1.0f)).Normalized();
+	Vector3f up = side.Cross(direction);
+	float range = 10.0f;
+	
+	//Narrow and wide cones, either side of the switch between the two fits, and ones
+	//wider than a hemisphere.
+	float cutoffs[] = { 0.99f, 0.9f, 0.75f, 0.70710678f, 0.6f, 0.3f, 0.0f, -0.5f };
+	
+	for(unsigned int i = 0; i < sizeof(cutoffs) / sizeof(cutoffs[0]); i++)
+	{
+		Vector3f center;
+		float radius;
+		CalcConeBoundingSphere(apex, direction, range, cutoffs[i], &center, &radius);
+		
+		//Never bigger than the sphere a point light of the same range would get.
+		assert(radius <= range + EPSILON);
+		assert((apex - center).Length() <= radius + EPSILON);
+		
+		//Everything the light reaches is either the apex, or inside the cap at its range.
+		float halfAngle = acosf(cutoffs[i]);
+		for(int j = 0; j <= NUM_ANGLE_STEPS; j++)
+		{
+			float angle = halfAngle * j / NUM_ANGLE_STEPS;
+			
+			for(int k = 0; k < NUM_AROUND_STEPS; k++)
+			{
+				float around = 2.0f * MATH_PI * k / NUM_AROUND_STEPS;
+				Vector3f spread = side * cosf(around) + up * sinf(around);
+				Vector3f point = apex + (direction * cosf(angle) + spread * sinf(angle)) * range;
+				
+				assert((point - center).Length() <= radius * (1.0f + EPSILON));
+			}
+		}
+	}
+}
+
+bool SpotLight::AddToLightClusters(LightClusters* clusters) const
+{
+	//The clustered pass has no shadow maps, so shadowed spot lights keep their own pass.
+	if(GetShadowInfo().GetShadowMapSizeAsPowerOf2() != 0)
+	{
+		return false;
+	}
+	
+	const Attenuation& attenuation = GetAttenuation();
+	
+	clusters->AddSpotLight(GetTransform().GetTransformedPos(), GetRange(), GetColor(), GetIntensity(), 
+		Vector3f(attenuation.GetConstant(), attenuation.GetLinear(), attenuation.GetExponent()),
+		GetTransform().GetTransformedRot().GetForward(), m_cutoff);
+	return true;
+}
+
+void SpotLight::RenderDeferred(RenderingEngine& renderingEngine) const
+{
+	renderingEngine.RenderDeferredLight(*this);
+}
@@ -23,6 +23,8 @@
 #include "../core/entityComponent.h"
 
 class CoreEngine;
+class LightClusters;
+class ShadowCascades;
 
 class ShadowCameraTransform
 {
@@ -41,13 +43,18 @@ private:
 class ShadowInfo
 {
 public:
-	ShadowInfo(const Matrix4f& projection = Matrix4f().InitIdentity(), bool flipFaces = false, int shadowMapSizeAsPowerOf2 = 0, float shadowSoftness = 1.0f, float lightBleedReductionAmount = 0.2f, float minVariance = 0.00002f) :
+	//The shadow map is kept across frames until the shadow camera moves further than
+	//cacheMoveThreshold, or something it can see changes. Lights with more than one
+	//cascade have a shadow map of this size for each, and ignore the projection.
+	ShadowInfo(const Matrix4f& projection = Matrix4f().InitIdentity(), bool flipFaces = false, int shadowMapSizeAsPowerOf2 = 0, float shadowSoftness = 1.0f, float lightBleedReductionAmount = 0.2f, float minVariance = 0.00002f, float cacheMoveThreshold = 0.0f, int numCascades = 1) :
 		m_projection(projection),
 		m_flipFaces(flipFaces),
 		m_shadowMapSizeAsPowerOf2(shadowMapSizeAsPowerOf2),
 		m_shadowSoftness(shadowSoftness),
 		m_lightBleedReductionAmount(lightBleedReductionAmount),
-		m_minVariance(minVariance) {}
+		m_minVariance(minVariance),
+		m_cacheMoveThreshold(cacheMoveThreshold),
+		m_numCascades(numCascades) {}
 		
 	inline const Matrix4f& GetProjection()      const { return m_projection; }
 	inline bool GetFlipFaces()                  const { return m_flipFaces; }
@@ -55,6 +62,8 @@ public:
 	inline float GetShadowSoftness()            const { return m_shadowSoftness; }
 	inline float GetMinVariance()               const { return m_minVariance; }
 	inline float GetLightBleedReductionAmount() const { return m_lightBleedReductionAmount; }
+	inline float GetCacheMoveThreshold()        const { return m_cacheMoveThreshold; }
+	inline int GetNumCascades()                 const { return m_numCascades; }
 protected:
 private:
 	Matrix4f m_projection;
@@ -63,6 +72,8 @@ private:
 	float m_shadowSoftness;
 	float m_lightBleedReductionAmount;
 	float m_minVariance;
+	float m_cacheMoveThreshold;
+	int m_numCascades;
 };
 
 class BaseLight : public EntityComponent
@@ -76,6 +87,24 @@ public:
 	
 	virtual ShadowCameraTransform CalcShadowCameraTransform(const Vector3f& mainCameraPos, const Quaternion& mainCameraRot) const;
 	virtual void AddToEngine(CoreEngine* engine) const;	
+	virtual void AddToRenderQueue(RenderQueue& queue) const {}
+	
+	//Fits the light's cascades around the main camera's view. Only called for lights
+	//whose ShadowInfo has more than one cascade.
+	virtual void CalcShadowCascades(const Matrix4f& mainCameraProjection, const Vector3f& mainCameraPos, const Quaternion& mainCameraRot, 
+	                                ShadowCascades* cascades) const {}
+	
+	//Finds a sphere around everything the light can reach. Returns false if the light
+	//reaches everywhere, in which case the sphere is left unchanged.
+	virtual bool CalcBoundingSphere(Vector3f* center, float* radius) const { return false; }
+	
+	//Lights that can be shaded by the clustered forward pass add themselves and return
+	//true. The rest are drawn with a pass of their own shader.
+	virtual bool AddToLightClusters(LightClusters* clusters) const { return false; }
+	
+	//Passes the light back to the overload of RenderingEngine::RenderDeferredLight
+	//for its type, which applies it to the G-buffer.
+	virtual void RenderDeferred(RenderingEngine& renderingEngine) const {}
 	
 	inline const Vector3f& GetColor()        const { return m_color; }
 	inline const float GetIntensity()        const { return m_intensity; }
@@ -93,14 +122,22 @@ private:
 class DirectionalLight : public BaseLight
 {
 public:
+	//With more than one cascade, shadows reach as far as shadowArea from the camera, and
+	//cascadeSplitLambda picks how the view is split between them (see ShadowCascades::Fit).
+	//Cascades need OpenGL 3.0, and there's only one without it.
 	DirectionalLight(const Vector3f& color = Vector3f(0,0,0), float intensity = 0, int shadowMapSizeAsPowerOf2 = 0, 
-	                 float shadowArea = 80.0f, float shadowSoftness = 1.0f, float lightBleedReductionAmount = 0.2f, float minVariance = 0.00002f);
+	                 float shadowArea = 80.0f, float shadowSoftness = 1.0f, float lightBleedReductionAmount = 0.2f, float minVariance = 0.00002f,
+	                 int numShadowCascades = 1, float cascadeSplitLambda = 0.75f);
 	                 
 	virtual ShadowCameraTransform CalcShadowCameraTransform(const Vector3f& mainCameraPos, const Quaternion& mainCameraRot) const;
+	virtual void CalcShadowCascades(const Matrix4f& mainCameraProjection, const Vector3f& mainCameraPos, const Quaternion& mainCameraRot, 
+	                                ShadowCascades* cascades) const;
+	virtual void RenderDeferred(RenderingEngine& renderingEngine) const;
 	
 	inline float GetHalfShadowArea() const { return m_halfShadowArea; }
 private:
 	float m_halfShadowArea;
+	float m_cascadeSplitLambda;
 };
 
 class Attenuation
@@ -126,6 +163,10 @@ public:
 	PointLight(const Vector3f& color = Vector3f(0,0,0), float intensity = 0, const Attenuation& atten = Attenuation(), 
 	           const Shader& shader = Shader("forward-point"));
 	           
+	virtual bool CalcBoundingSphere(Vector3f* center, float* radius) const;
+	virtual bool AddToLightClusters(LightClusters* clusters) const;
+	virtual void RenderDeferred(RenderingEngine& renderingEngine) const;
+	
 	inline const Attenuation& GetAttenuation() const { return m_attenuation; }
 	inline const float GetRange()              const { return m_range; }
 private:
@@ -139,7 +180,19 @@ public:
 	SpotLight(const Vector3f& color = Vector3f(0,0,0), float intensity = 0, const Attenuation& atten = Attenuation(), float viewAngle = ToRadians(170.0f),
 			  int shadowMapSizeAsPowerOf2 = 0, float shadowSoftness = 1.0f, float lightBleedReductionAmount = 0.2f, float minVariance = 0.00002f);
 			  
+	virtual bool CalcBoundingSphere(Vector3f* center, float* radius) const;
+	virtual bool AddToLightClusters(LightClusters* clusters) const;
+	virtual void RenderDeferred(RenderingEngine& renderingEngine) const;
+	
 	inline float GetCutoff() const { return m_cutoff; }
+	
+	//Finds a sphere around the cone reaching range from apex along direction, whose
+	//edges are at cutoff, the cosine of half its angle.
+	static void CalcConeBoundingSphere(const Vector3f& apex, const Vector3f& direction, float range, float cutoff, 
+	                                   Vector3f* center, float* radius);
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
 private:
 	float m_cutoff;
 };
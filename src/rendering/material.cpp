@@ -19,6 +19,13 @@
 #include <cassert>
 
 std::map<std::string, MaterialData*> Material::s_resourceMap;
+int MaterialData::s_numMaterialData = 0;
+
+MemoryPool& MaterialData::GetMemoryPool()
+{
+	static MemoryPool* pool = new MemoryPool("MaterialData", sizeof(MaterialData));
+	return *pool;
+}
 
 Material::Material(const std::string& materialName) :
 	m_materialName(materialName)
@@ -25,7 +25,19 @@
 class MaterialData : public ReferenceCounter, public MappedValues
 {
 public:
+	MaterialData() :
+		m_id(s_numMaterialData++) {}
+	
+	static void* operator new(size_t size)                 { return GetMemoryPool().Allocate(size); }
+	static void operator delete(void* object, size_t size) { GetMemoryPool().Free(object, size); }
+	
+	inline int GetId() const { return m_id; }
 private:
+	static int s_numMaterialData;
+	
+	int m_id; //Unique per MaterialData; used to group draws of the same material
+	
+	static MemoryPool& GetMemoryPool();
 };
 
 class Material
@@ -46,6 +58,12 @@ public:
 	inline const Vector3f& GetVector3f(const std::string& name) const { return m_materialData->GetVector3f(name); }
 	inline float GetFloat(const std::string& name)              const { return m_materialData->GetFloat(name); }
 	inline const Texture& GetTexture(const std::string& name)   const { return m_materialData->GetTexture(name); }
+	
+	inline const Vector3f& GetVector3f(int id) const { return m_materialData->GetVector3f(id); }
+	inline float GetFloat(int id)              const { return m_materialData->GetFloat(id); }
+	inline const Texture& GetTexture(int id)   const { return m_materialData->GetTexture(id); }
+	
+	inline int GetId() const { return m_materialData->GetId(); }
 protected:
 private:
 	static std::map<std::string, MaterialData*> s_resourceMap;
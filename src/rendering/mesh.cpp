@@ -15,6 +15,11 @@
  */
 
 #include "mesh.h"
+#include "glState.h"
+#include "meshOptimizer.h"
+#include "meshSimplifier.h"
+#include "../core/assetLoader.h"
+#include "../core/mappedFile.h"
 
 #include "../core/profiling.h"
 
@@ -23,12 +28,50 @@
 
 #include <vector>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+const float IndexedModel::MAX_LOD_ERROR = 0.02f;
+
+static const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+//Packed meshes are cached next to the file they were imported from, with this appended to its name.
+static const char* MESH_CACHE_EXTENSION = ".meshcache";
+
 std::map<std::string, MeshData*> Mesh::s_resourceMap;
+int Mesh::s_vertexFormatFlags = VertexFormat::COMPACT;
+int MeshData::s_numMeshData = 0;
+
+//Carried from Mesh::LoadAsync to a loader thread and back.
+class MeshLoadRequest
+{
+public:
+	MeshLoadRequest(const Mesh& mesh, const std::string& fileName, int vertexFormatFlags) :
+		m_mesh(mesh),
+		m_fileName(fileName),
+		m_vertexFormatFlags(vertexFormatFlags),
+		m_isCached(false) {}
+	
+	Mesh        m_mesh;      //Keeps the mesh's data alive until it's uploaded
+	std::string m_fileName;
+	int         m_vertexFormatFlags;
+	MappedFile  m_cacheFile; //Stays mapped until the mesh is uploaded, so it's never copied
+	PackedMesh  m_packedMesh;
+	bool        m_isCached;
+};
+
+static const IndexedModel& GetPlaceholderModel();
+static void PrintLoaded(const std::string& fileName, const MeshData& meshData, bool isCached);
+
+MemoryPool& MeshData::GetMemoryPool()
+{
+	static MemoryPool* pool = new MemoryPool("MeshData", sizeof(MeshData));
+	return *pool;
+}
 
 bool IndexedModel::IsValid() const
 {
@@ -85,6 +128,89 @@ IndexedModel IndexedModel::Finalize()
 	return *this;
 }
 
+void IndexedModel::Optimize()
+{
+	std::vector<unsigned int> clusters;
+	std::vector<unsigned int> remap;
+	
+	MeshOptimizer::OptimizeVertexCache(&m_indices, m_positions.size(), &clusters);
+	MeshOptimizer::OptimizeOverdraw(&m_indices, m_positions, clusters);
+	MeshOptimizer::OptimizeVertexFetch(&m_indices, m_positions.size(), &remap);
+	
+	MeshOptimizer::Remap(&m_positions, remap);
+	MeshOptimizer::Remap(&m_texCoords, remap);
+	MeshOptimizer::Remap(&m_normals, remap);
+	MeshOptimizer::Remap(&m_tangents, remap);
+	
+	for(unsigned int i = 0; i < m_lodIndices.size(); i++)
+	{
+		for(unsigned int j = 0; j < m_lodIndices[i].size(); j++)
+		{
+			m_lodIndices[i][j] = remap[m_lodIndices[i][j]];
+		}
+	}
+}
+
+void IndexedModel::GenerateLODs()
+{
+	m_lodIndices.clear();
+	m_lodErrors.clear();
+	
+	Vector3f center;
+	Vector3f extents;
+	float radius = 0.0f;
+	CalcBounds(&center, &extents, &radius);
+	
+	if(radius == 0.0f)
+		return;
+	
+	//Each level is simplified from the last, so their errors add up.
+	std::vector<unsigned int> indices = m_indices;
+	float error = 0.0f;
+	
+	for(int i = 1; i < MAX_LODS; i++)
+	{
+		unsigned int targetIndexCount = indices.size() / 6 * 3;
+		if(targetIndexCount < MIN_LOD_TRIANGLES * 3)
+			break;
+		
+		unsigned int numIndices = indices.size();
+		error += MeshSimplifier::Simplify(&indices, m_positions, targetIndexCount, (MAX_LOD_ERROR - error / radius) * radius);
+		
+		//A level that barely simplified costs memory without saving much drawing.
+		if(indices.size() > numIndices * 3 / 4)
+			break;
+		
+		MeshOptimizer::OptimizeVertexCache(&indices, m_positions.size());
+		m_lodIndices.push_back(indices);
+		m_lodErrors.push_back(error / radius);
+	}
+}
+
+void IndexedModel::CalcBounds(Vector3f* center, Vector3f* extents, float* radius) const
+{
+	if(m_positions.empty())
+		return;
+	
+	Vector3f minExtents = m_positions[0];
+	Vector3f maxExtents = m_positions[0];
+	
+	for(unsigned int i = 1; i < m_positions.size(); i++)
+	{
+		minExtents = Vector3f(minExtents.Min(m_positions[i]));
+		maxExtents = Vector3f(maxExtents.Max(m_positions[i]));
+	}
+	
+	*center = (minExtents + maxExtents) / 2.0f;
+	*extents = (maxExtents - minExtents) / 2.0f;
+	*radius = 0.0f;
+	
+	for(unsigned int i = 0; i < m_positions.size(); i++)
+	{
+		*radius = std::max(*radius, (m_positions[i] - *center).Length());
+	}
+}
+
 void IndexedModel::AddFace(unsigned int vertIndex0, unsigned int vertIndex1, unsigned int vertIndex2)
 {
 	m_indices.push_back(vertIndex0);
@@ -168,60 +294,117 @@ void IndexedModel::CalcTangents()
 }
 
 
-MeshData::MeshData(const IndexedModel& model) : 
+MeshData::MeshData(const PackedMesh& packedMesh, bool isLoaded) : 
 	ReferenceCounter(),
-	m_drawCount(model.GetIndices().size())
+	m_id(s_numMeshData++),
+	m_isLoaded(isLoaded)
 {
-	if(!model.IsValid())
-	{
-		std::cout << "Error: Invalid mesh! Must have same number of positions, texCoords, normals, and tangents! "
-			<< "(Maybe you forgot to Finalize() your IndexedModel?)" << std::endl;
-		assert(0 != 0);
-	}
+	InitBuffers(packedMesh);
+}
+
+MeshData::~MeshData() 
+{	
+	FreeBuffers();
+}
+
+void MeshData::SetData(const PackedMesh& packedMesh)
+{
+	FreeBuffers();
+	InitBuffers(packedMesh);
+	m_isLoaded = true;
+}
+
+void MeshData::InitBuffers(const PackedMesh& packedMesh)
+{
+	m_vertexFormat = packedMesh.GetVertexFormat();
+	m_indexType = packedMesh.GetIndexSize() == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	m_lods = packedMesh.GetLODs();
+	m_numBytes = packedMesh.GetVertexDataSize() + packedMesh.GetIndexDataSize();
+	m_numUnpackedBytes = packedMesh.GetNumUnpackedBytes();
+	m_boundsCenter = packedMesh.GetBoundsCenter();
+	m_boundsRadius = packedMesh.GetBoundsRadius();
+	m_boundsExtents = packedMesh.GetBoundsExtents();
+	
 	glGenVertexArrays(1, &m_vertexArrayObject);
-	glBindVertexArray(m_vertexArrayObject);
+	GLState::BindVertexArray(m_vertexArrayObject);
 
 	glGenBuffers(NUM_BUFFERS, m_vertexArrayBuffers);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vertexArrayBuffers[POSITION_VB]);
-	glBufferData(GL_ARRAY_BUFFER, model.GetPositions().size() * sizeof(model.GetPositions()[0]), &model.GetPositions()[0], GL_STATIC_DRAW);
-	
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	
-	glBindBuffer(GL_ARRAY_BUFFER, m_vertexArrayBuffers[TEXCOORD_VB]);
-	glBufferData(GL_ARRAY_BUFFER, model.GetTexCoords().size() * sizeof(model.GetTexCoords()[0]), &model.GetTexCoords()[0], GL_STATIC_DRAW);
-	
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	
-	glBindBuffer(GL_ARRAY_BUFFER, m_vertexArrayBuffers[NORMAL_VB]);
-	glBufferData(GL_ARRAY_BUFFER, model.GetNormals().size() * sizeof(model.GetNormals()[0]), &model.GetNormals()[0], GL_STATIC_DRAW);
 	
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexArrayBuffers[VERTEX_VB]);
+	glBufferData(GL_ARRAY_BUFFER, packedMesh.GetVertexDataSize(), packedMesh.GetVertexData(), GL_STATIC_DRAW);
+	m_vertexFormat.SetAttribPointers();
 	
-	glBindBuffer(GL_ARRAY_BUFFER, m_vertexArrayBuffers[TANGENT_VB]);
-	glBufferData(GL_ARRAY_BUFFER, model.GetTangents().size() * sizeof(model.GetTangents()[0]), &model.GetTangents()[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vertexArrayBuffers[INDEX_VB]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedMesh.GetIndexDataSize(), packedMesh.GetIndexData(), GL_STATIC_DRAW);
 	
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	m_occluderPositions.clear();
+	m_occluderIndices.clear();
 	
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vertexArrayBuffers[INDEX_VB]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.GetIndices().size() * sizeof(model.GetIndices()[0]), &model.GetIndices()[0], GL_STATIC_DRAW);
+	//Detailed meshes would cost the occlusion culler more to rasterize than they save.
+	//Positions are always the first attribute, as floats.
+	unsigned int numIndices = m_lods[0].m_count;
+	if(numIndices / 3 <= MAX_OCCLUDER_TRIANGLES)
+	{
+		const unsigned char* vertices = packedMesh.GetVertexData();
+		const unsigned char* indices = packedMesh.GetIndexData();
+		
+		m_occluderPositions.resize(packedMesh.GetNumVertices());
+		for(unsigned int i = 0; i < m_occluderPositions.size(); i++)
+		{
+			memcpy(&m_occluderPositions[i], vertices + i * m_vertexFormat.GetStride(), sizeof(Vector3f));
+		}
+		
+		m_occluderIndices.resize(numIndices);
+		for(unsigned int i = 0; i < numIndices; i++)
+		{
+			if(m_indexType == GL_UNSIGNED_SHORT)
+			{
+				unsigned short index;
+				memcpy(&index, indices + i * sizeof(index), sizeof(index));
+				m_occluderIndices[i] = index;
+			}
+			else
+			{
+				memcpy(&m_occluderIndices[i], indices + i * sizeof(unsigned int), sizeof(unsigned int));
+			}
+		}
+	}
 }
 
-MeshData::~MeshData() 
-{	
+void MeshData::FreeBuffers()
+{
 	glDeleteBuffers(NUM_BUFFERS, m_vertexArrayBuffers);
 	glDeleteVertexArrays(1, &m_vertexArrayObject);
+	GLState::OnVertexArrayDeleted(m_vertexArrayObject);
+}
+
+void MeshData::Draw(int lod) const
+{
+	GLState::BindVertexArray(m_vertexArrayObject);
+	
+	#if PROFILING_DISABLE_MESH_DRAWING == 0
+		glDrawElements(GL_TRIANGLES, m_lods[lod].m_count, m_indexType, (const GLvoid*)m_lods[lod].m_offset);
+	#endif
 }
 
-void MeshData::Draw() const
+void MeshData::DrawInstanced(GLuint instanceBuffer, int firstInstance, int numInstances, int lod) const
 {
-	glBindVertexArray(m_vertexArrayObject);
+	GLState::BindVertexArray(m_vertexArrayObject);
+	
+	//GL 3.2 has no base instance, so the matrix attributes are pointed at the
+	//first instance of every batch instead.
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for(int i = 0; i < 4; i++)
+	{
+		size_t offset = firstInstance * sizeof(Matrix4f) + i * sizeof(Vector4f);
+		
+		glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + i);
+		glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(Matrix4f), (const GLvoid*)offset);
+		glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + i, 1);
+	}
 	
 	#if PROFILING_DISABLE_MESH_DRAWING == 0
-		glDrawElements(GL_TRIANGLES, m_drawCount, GL_UNSIGNED_INT, 0);
+		glDrawElementsInstanced(GL_TRIANGLES, m_lods[lod].m_count, m_indexType, (const GLvoid*)m_lods[lod].m_offset, numInstances);
 	#endif
 }
 
@@ -237,7 +420,10 @@ Mesh::Mesh(const std::string& meshName, const IndexedModel& model) :
 	}
 	else
 	{
-		m_meshData = new MeshData(model);
+		PackedMesh packedMesh;
+		packedMesh.Pack(model, s_vertexFormatFlags);
+		
+		m_meshData = new MeshData(packedMesh);
 		s_resourceMap.insert(std::pair<std::string, MeshData*>(meshName, m_meshData));
 	}
 }
@@ -254,54 +440,137 @@ Mesh::Mesh(const std::string& fileName) :
 	}
 	else
 	{
-		Assimp::Importer importer;
-		
-		const aiScene* scene = importer.ReadFile(("./res/models/" + fileName).c_str(), 
-		                                         aiProcess_Triangulate |
-		                                         aiProcess_GenSmoothNormals | 
-		                                         aiProcess_FlipUVs |
-		                                         aiProcess_CalcTangentSpace);
+		MappedFile cacheFile;
+		PackedMesh packedMesh;
+		bool isCached = ReadFile(fileName, s_vertexFormatFlags, &cacheFile, &packedMesh);
 		
-		if(!scene)
-		{
-			std::cout << "Mesh load failed!: " << fileName << std::endl;
-			assert(0 == 0);
-		}
-		
-		const aiMesh* model = scene->mMeshes[0];
+		m_meshData = new MeshData(packedMesh);
+		s_resourceMap.insert(std::pair<std::string, MeshData*>(fileName, m_meshData));
 		
-		std::vector<Vector3f> positions;
-		std::vector<Vector2f> texCoords;
-		std::vector<Vector3f> normals;
-		std::vector<Vector3f> tangents;
-		std::vector<unsigned int> indices;
-
-		const aiVector3D aiZeroVector(0.0f, 0.0f, 0.0f);
-		for(unsigned int i = 0; i < model->mNumVertices; i++) 
-		{
-			const aiVector3D pos = model->mVertices[i];
-			const aiVector3D normal = model->mNormals[i];
-			const aiVector3D texCoord = model->HasTextureCoords(0) ? model->mTextureCoords[0][i] : aiZeroVector;
-			const aiVector3D tangent = model->mTangents[i];
-
-			positions.push_back(Vector3f(pos.x, pos.y, pos.z));
-			texCoords.push_back(Vector2f(texCoord.x, texCoord.y));
-			normals.push_back(Vector3f(normal.x, normal.y, normal.z));
-			tangents.push_back(Vector3f(tangent.x, tangent.y, tangent.z));
-		}
+		PrintLoaded(fileName, *m_meshData, isCached);
+	}
+}
 
-		for(unsigned int i = 0; i < model->mNumFaces; i++)
-		{
-			const aiFace& face = model->mFaces[i];
-			assert(face.mNumIndices == 3);
-			indices.push_back(face.mIndices[0]);
-			indices.push_back(face.mIndices[1]);
-			indices.push_back(face.mIndices[2]);
-		}
-		
-		m_meshData = new MeshData(IndexedModel(indices, positions, texCoords, normals, tangents));
-		s_resourceMap.insert(std::pair<std::string, MeshData*>(fileName, m_meshData));
+Mesh::Mesh(MeshData* meshData, const std::string& fileName) :
+	m_fileName(fileName),
+	m_meshData(meshData) {}
+
+Mesh Mesh::LoadAsync(const std::string& fileName)
+{
+	//Meshes already loaded, or on their way, are shared as usual.
+	if(s_resourceMap.find(fileName) != s_resourceMap.end())
+	{
+		return Mesh(fileName);
+	}
+	
+	PackedMesh placeholder;
+	placeholder.Pack(GetPlaceholderModel(), s_vertexFormatFlags);
+	
+	MeshData* meshData = new MeshData(placeholder, false);
+	s_resourceMap.insert(std::pair<std::string, MeshData*>(fileName, meshData));
+	
+	Mesh result(meshData, fileName);
+	AssetLoader::GetAssetLoader().Load(LoadFile, UploadFile, new MeshLoadRequest(result, fileName, s_vertexFormatFlags));
+	return result;
+}
+
+bool Mesh::ReadFile(const std::string& fileName, int vertexFormatFlags, MappedFile* cacheFile, PackedMesh* packedMesh)
+{
+	std::string path = "./res/models/" + fileName;
+	std::string cachePath = path + MESH_CACHE_EXTENSION;
+	
+	MappedFile sourceFile;
+	sourceFile.Open(path);
+	unsigned long long sourceHash = PackedMesh::Hash(sourceFile.GetData(), sourceFile.GetSize());
+	sourceFile.Close();
+	
+	//The cache stays mapped until it's uploaded, so it's never copied.
+	if(cacheFile->Open(cachePath) && packedMesh->Load(*cacheFile, sourceHash, IMPORT_FLAGS, vertexFormatFlags))
+	{
+		return true;
+	}
+	
+	cacheFile->Close();
+	packedMesh->Pack(Import(fileName), vertexFormatFlags);
+	
+	if(!packedMesh->Save(cachePath, sourceHash, IMPORT_FLAGS))
+	{
+		std::cout << "Warning: Couldn't write mesh cache " << cachePath << std::endl;
+	}
+	
+	return false;
+}
+
+void Mesh::LoadFile(void* request)
+{
+	MeshLoadRequest* meshRequest = (MeshLoadRequest*)request;
+	meshRequest->m_isCached = ReadFile(meshRequest->m_fileName, meshRequest->m_vertexFormatFlags, 
+		&meshRequest->m_cacheFile, &meshRequest->m_packedMesh);
+}
+
+void Mesh::UploadFile(void* request)
+{
+	MeshLoadRequest* meshRequest = (MeshLoadRequest*)request;
+	MeshData* meshData = meshRequest->m_mesh.m_meshData;
+	
+	meshData->SetData(meshRequest->m_packedMesh);
+	PrintLoaded(meshRequest->m_fileName, *meshData, meshRequest->m_isCached);
+	
+	delete meshRequest;
+}
+
+IndexedModel Mesh::Import(const std::string& fileName)
+{
+	Assimp::Importer importer;
+	
+	const aiScene* scene = importer.ReadFile(("./res/models/" + fileName).c_str(), IMPORT_FLAGS);
+	
+	if(!scene)
+	{
+		std::cout << "Mesh load failed!: " << fileName << std::endl;
+		assert(0 == 0);
+	}
+	
+	const aiMesh* model = scene->mMeshes[0];
+	
+	std::vector<Vector3f> positions;
+	std::vector<Vector2f> texCoords;
+	std::vector<Vector3f> normals;
+	std::vector<Vector3f> tangents;
+	std::vector<unsigned int> indices;
+
+	const aiVector3D aiZeroVector(0.0f, 0.0f, 0.0f);
+	for(unsigned int i = 0; i < model->mNumVertices; i++) 
+	{
+		const aiVector3D pos = model->mVertices[i];
+		const aiVector3D normal = model->mNormals[i];
+		const aiVector3D texCoord = model->HasTextureCoords(0) ? model->mTextureCoords[0][i] : aiZeroVector;
+		const aiVector3D tangent = model->mTangents[i];
+
+		positions.push_back(Vector3f(pos.x, pos.y, pos.z));
+		texCoords.push_back(Vector2f(texCoord.x, texCoord.y));
+		normals.push_back(Vector3f(normal.x, normal.y, normal.z));
+		tangents.push_back(Vector3f(tangent.x, tangent.y, tangent.z));
 	}
+
+	for(unsigned int i = 0; i < model->mNumFaces; i++)
+	{
+		const aiFace& face = model->mFaces[i];
+		assert(face.mNumIndices == 3);
+		indices.push_back(face.mIndices[0]);
+		indices.push_back(face.mIndices[1]);
+		indices.push_back(face.mIndices[2]);
+	}
+	
+	IndexedModel indexedModel(indices, positions, texCoords, normals, tangents);
+	indexedModel.Optimize();
+	indexedModel.GenerateLODs();
+	
+	std::cout << "Optimized mesh " << fileName << ": ACMR " 
+	          << MeshOptimizer::CalcACMR(indices, positions.size()) << " -> " << MeshOptimizer::CalcACMR(indexedModel.GetIndices(), positions.size()) << ", ATVR " 
+	          << MeshOptimizer::CalcATVR(indices, positions.size()) << " -> " << MeshOptimizer::CalcATVR(indexedModel.GetIndices(), positions.size()) << std::endl;
+	
+	return indexedModel;
 }
 
 Mesh::Mesh(const Mesh& mesh) :
@@ -324,7 +593,65 @@ Mesh::~Mesh()
 	}
 }
 
-void Mesh::Draw() const
+void Mesh::Draw(int lod) const
+{
+	m_meshData->Draw(lod);
+}
+
+void Mesh::DrawInstanced(GLuint instanceBuffer, int firstInstance, int numInstances, int lod) const
+{
+	m_meshData->DrawInstanced(instanceBuffer, firstInstance, numInstances, lod);
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static const IndexedModel& GetPlaceholderModel()
+{
+	//Built once and kept, since every mesh loading behind it shares it.
+	static IndexedModel* model = 0;
+	if(model)
+	{
+		return *model;
+	}
+	
+	//A 2x2x2 cube, with separate vertices for each face so its edges stay sharp.
+	model = new IndexedModel();
+	for(int axis = 0; axis < 3; axis++)
+	{
+		for(int side = -1; side <= 1; side += 2)
+		{
+			Vector3f normal(0.0f, 0.0f, 0.0f);
+			Vector3f u(0.0f, 0.0f, 0.0f);
+			Vector3f v(0.0f, 0.0f, 0.0f);
+			normal[axis] = (float)side;
+			u[(axis + 1) % 3] = (float)side;
+			v[(axis + 2) % 3] = 1.0f;
+			
+			unsigned int first = (unsigned int)model->GetPositions().size();
+			for(int corner = 0; corner < 4; corner++)
+			{
+				float a = (corner & 1) ? 1.0f : -1.0f;
+				float b = (corner & 2) ? 1.0f : -1.0f;
+				
+				model->AddVertex(normal + u * a + v * b);
+				model->AddTexCoord((a + 1.0f) * 0.5f, (b + 1.0f) * 0.5f);
+				model->AddNormal(normal);
+			}
+			
+			//u x v points along the normal, so these face outwards.
+			model->AddFace(first, first + 1, first + 3);
+			model->AddFace(first, first + 3, first + 2);
+		}
+	}
+	
+	model->Finalize();
+	return *model;
+}
+
+static void PrintLoaded(const std::string& fileName, const MeshData& meshData, bool isCached)
 {
-	m_meshData->Draw();
+	std::cout << "Loaded mesh " << fileName << (isCached ? " from cache: " : ": ") << meshData.GetNumBytes() << " bytes, " 
+	          << (meshData.GetNumUnpackedBytes() - meshData.GetNumBytes()) << " bytes saved, " 
+	          << meshData.GetNumLODs() << " levels of detail" << std::endl;
 }
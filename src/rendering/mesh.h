@@ -19,15 +19,27 @@
 
 #include "../core/math3d.h"
 #include "../core/referenceCounter.h"
+#include "../core/memoryPool.h"
+#include "packedMesh.h"
 
 #include <string>
 #include <vector>
 #include <map>
 #include <GL/glew.h>
+class MappedFile;
 
 class IndexedModel
 {
 public:
+	//Levels of detail, including the full mesh.
+	static const int MAX_LODS = 4;
+	
+	//Meshes are only simplified while each level keeps at least this many triangles.
+	static const unsigned int MIN_LOD_TRIANGLES = 64;
+	
+	//How far a level's surface may be from the full mesh's, as a fraction of its bounding radius.
+	static const float MAX_LOD_ERROR;
+	
 	IndexedModel() {}
 	IndexedModel(const std::vector<unsigned int> indices, const std::vector<Vector3f>& positions, const std::vector<Vector2f>& texCoords,
 		const std::vector<Vector3f>& normals = std::vector<Vector3f>(), const std::vector<Vector3f>& tangents = std::vector<Vector3f>()) :
@@ -42,6 +54,18 @@ public:
 	void CalcTangents();
 
 	IndexedModel Finalize();
+	
+	//Reorders the triangles and vertices so they're drawn faster, without changing
+	//what's drawn. See MeshOptimizer.
+	void Optimize();
+	
+	//Simplifies the mesh into coarser levels of detail, each with about half the
+	//triangles of the one before, over the same vertices. See MeshSimplifier.
+	void GenerateLODs();
+	
+	//The sphere is centered on the middle of the bounding box, which is not the
+	//tightest fit but is cheap and good enough for culling and sorting.
+	void CalcBounds(Vector3f* center, Vector3f* extents, float* radius) const;
 
 	void AddVertex(const Vector3f& vert);
 	inline void AddVertex(float x, float y, float z) { AddVertex(Vector3f(x, y, z)); }
@@ -62,41 +86,99 @@ public:
 	inline const std::vector<Vector2f>& GetTexCoords()   const { return m_texCoords; }
 	inline const std::vector<Vector3f>& GetNormals()     const { return m_normals; }
 	inline const std::vector<Vector3f>& GetTangents()    const { return m_tangents; }
+	
+	//The indices of each level after the full mesh, and how far its surface is from
+	//the full mesh's, as a fraction of the bounding radius.
+	inline const std::vector<std::vector<unsigned int> >& GetLODIndices() const { return m_lodIndices; }
+	inline const std::vector<float>& GetLODErrors()                       const { return m_lodErrors; }
 private:
 	std::vector<unsigned int> m_indices;
     std::vector<Vector3f> m_positions;
     std::vector<Vector2f> m_texCoords;
     std::vector<Vector3f> m_normals;
     std::vector<Vector3f> m_tangents;  
+	std::vector<std::vector<unsigned int> > m_lodIndices;
+	std::vector<float> m_lodErrors;
 };
 
 class MeshData : public ReferenceCounter
 {
 public:
-	MeshData(const IndexedModel& model);
+	//Uploads the packed buffers, which can be let go of afterwards. Data created with
+	//isLoaded false is a placeholder, until SetData replaces it.
+	MeshData(const PackedMesh& packedMesh, bool isLoaded = true);
 	virtual ~MeshData();
 	
-	void Draw() const;
+	//Replaces the buffers, bounds and levels of detail, keeping the id.
+	void SetData(const PackedMesh& packedMesh);
+	
+	static void* operator new(size_t size)                 { return GetMemoryPool().Allocate(size); }
+	static void operator delete(void* object, size_t size) { GetMemoryPool().Free(object, size); }
+	
+	//Attribute locations taken by the per-instance world matrix, one per column.
+	static const int INSTANCE_MATRIX_LOCATION = 4;
+	
+	//Meshes with at most this many triangles keep a copy of their positions and indices
+	//on the CPU, so they can be used as occluders.
+	static const unsigned int MAX_OCCLUDER_TRIANGLES = 4096;
+	
+	void Draw(int lod = 0) const;
+	void DrawInstanced(GLuint instanceBuffer, int firstInstance, int numInstances, int lod = 0) const;
+	
+	inline int GetId()                        const { return m_id; }
+	inline int GetNumLODs()                   const { return (int)m_lods.size(); }
+	inline int GetNumTriangles(int lod)       const { return m_lods[lod].m_count / 3; }
+	inline float GetLODError(int lod)         const { return m_lods[lod].m_error; }
+	inline const Vector3f& GetBoundsCenter()  const { return m_boundsCenter; }
+	inline float GetBoundsRadius()            const { return m_boundsRadius; }
+	inline const Vector3f& GetBoundsExtents() const { return m_boundsExtents; }
+	inline const VertexFormat& GetVertexFormat() const { return m_vertexFormat; }
+	inline GLenum GetIndexType()              const { return m_indexType; }
+	inline bool IsLoaded()                    const { return m_isLoaded; }
+	
+	//Bytes of vertex and index data on the GPU, and what they would take as
+	//separate float attributes with 32-bit indices.
+	inline long long GetNumBytes()            const { return m_numBytes; }
+	inline long long GetNumUnpackedBytes()    const { return m_numUnpackedBytes; }
+	
+	inline bool IsOccluder()                                     const { return !m_occluderIndices.empty(); }
+	inline const std::vector<Vector3f>& GetOccluderPositions()   const { return m_occluderPositions; }
+	inline const std::vector<unsigned int>& GetOccluderIndices() const { return m_occluderIndices; }
 protected:	
 private:
 	MeshData(MeshData& other) {}
 	void operator=(MeshData& other) {}
+	
+	static MemoryPool& GetMemoryPool();
+	
 
 	enum
 	{
-		POSITION_VB,
-		TEXCOORD_VB,
-		NORMAL_VB,
-		TANGENT_VB,
-		
+		VERTEX_VB,
 		INDEX_VB,
 		
 		NUM_BUFFERS
 	};
 	
+	static int s_numMeshData;
+	
+	void InitBuffers(const PackedMesh& packedMesh);
+	void FreeBuffers();
+	
 	GLuint m_vertexArrayObject;
 	GLuint m_vertexArrayBuffers[NUM_BUFFERS];
-	int m_drawCount;
+	VertexFormat m_vertexFormat;
+	GLenum m_indexType;
+	std::vector<PackedMesh::LOD> m_lods;
+	long long m_numBytes;
+	long long m_numUnpackedBytes;
+	int m_id;                //Unique per MeshData; used to group draws of the same mesh
+	Vector3f m_boundsCenter;  //Center of both the bounding sphere and box, in model space
+	float m_boundsRadius;
+	Vector3f m_boundsExtents; //Half the size of the bounding box on each axis
+	std::vector<Vector3f> m_occluderPositions;
+	std::vector<unsigned int> m_occluderIndices;
+	bool m_isLoaded;
 };
 
 class Mesh
@@ -106,11 +188,56 @@ public:
 	Mesh(const std::string& meshName, const IndexedModel& model);
 	Mesh(const Mesh& mesh);
 	virtual ~Mesh();
+	
+	//Returns at once with a placeholder cube, which switches to the model once the
+	//AssetLoader has read or imported it and it's been uploaded. The bounds and levels
+	//of detail switch along with it.
+	static Mesh LoadAsync(const std::string& fileName);
 
-	void Draw() const;
+	//Meshes loaded from file have coarser levels of detail, numbered from 0 for the
+	//full mesh. The error is how far a level's surface may be from the full mesh's,
+	//as a fraction of the bounding radius.
+	void Draw(int lod = 0) const;
+	
+	//Draws numInstances copies of the mesh, reading world matrices from instanceBuffer
+	//starting at firstInstance. Only shaders built with INSTANCED_BUILD use them.
+	void DrawInstanced(GLuint instanceBuffer, int firstInstance, int numInstances, int lod = 0) const;
+	
+	//Sets the VertexFormat flags meshes created from now on will use.
+	static void SetVertexFormat(int flags) { s_vertexFormatFlags = flags; }
+	static int GetVertexFormat()           { return s_vertexFormatFlags; }
+	
+	inline int GetId()                        const { return m_meshData->GetId(); }
+	inline int GetNumLODs()                   const { return m_meshData->GetNumLODs(); }
+	inline int GetNumTriangles(int lod = 0)   const { return m_meshData->GetNumTriangles(lod); }
+	inline float GetLODError(int lod)         const { return m_meshData->GetLODError(lod); }
+	inline const Vector3f& GetBoundsCenter()  const { return m_meshData->GetBoundsCenter(); }
+	inline float GetBoundsRadius()            const { return m_meshData->GetBoundsRadius(); }
+	inline const Vector3f& GetBoundsExtents() const { return m_meshData->GetBoundsExtents(); }
+	inline bool IsLoaded()                    const { return m_meshData->IsLoaded(); }
+	
+	inline bool IsOccluder()                                     const { return m_meshData->IsOccluder(); }
+	inline const std::vector<Vector3f>& GetOccluderPositions()   const { return m_meshData->GetOccluderPositions(); }
+	inline const std::vector<unsigned int>& GetOccluderIndices() const { return m_meshData->GetOccluderIndices(); }
 protected:
 private:
 	static std::map<std::string, MeshData*> s_resourceMap;
+	static int s_vertexFormatFlags;
+	
+	//Reads a model with Assimp, and optimizes it and generates its levels of detail.
+	static IndexedModel Import(const std::string& fileName);
+	
+	//Loads the file's cache into cacheFile if it's up to date, or imports it and saves
+	//a new cache otherwise. Returns whether the cache was used. Touches no GL state or
+	//shared data, so loader threads can call it.
+	static bool ReadFile(const std::string& fileName, int vertexFormatFlags, MappedFile* cacheFile, PackedMesh* packedMesh);
+	
+	//Run by the AssetLoader for LoadAsync; the first on a loader thread, the second on the GL thread.
+	static void LoadFile(void* request);
+	static void UploadFile(void* request);
+	
+	//Takes over the reference the data was created with.
+	Mesh(MeshData* meshData, const std::string& fileName);
 
 	std::string m_fileName;
 	MeshData* m_meshData;
@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "meshOptimizer.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+const float MeshOptimizer::OVERDRAW_THRESHOLD = 1.05f;
+
+static Vector3f CalcTriangleNormal(const std::vector<Vector3f>& positions, const unsigned int* triangle);
+
+//Where a cluster would be drawn relative to the others, for sorting.
+class OverdrawCluster
+{
+public:
+	OverdrawCluster(unsigned int start, unsigned int end, float sortKey) :
+		m_start(start),
+		m_end(end),
+		m_sortKey(sortKey) {}
+	
+	//Outward facing clusters come first.
+	inline bool operator<(const OverdrawCluster& r) const { return m_sortKey > r.m_sortKey; }
+	
+	unsigned int m_start;
+	unsigned int m_end;
+	float m_sortKey;
+};
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>* indices, unsigned int numVertices, std::vector<unsigned int>* clusters)
+{
+	const unsigned int numTriangles = indices->size() / 3;
+	const std::vector<unsigned int>& input = *indices;
+	
+	if(clusters)
+	{
+		clusters->clear();
+		clusters->push_back(0);
+	}
+	
+	if(numTriangles == 0)
+		return;
+	
+	//The triangles using each vertex, packed into one array.
+	std::vector<unsigned int> liveTriangles(numVertices, 0);
+	for(unsigned int i = 0; i < input.size(); i++)
+	{
+		liveTriangles[input[i]]++;
+	}
+	
+	std::vector<unsigned int> adjacencyOffsets(numVertices + 1, 0);
+	for(unsigned int i = 0; i < numVertices; i++)
+	{
+		adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveTriangles[i];
+	}
+	
+	std::vector<unsigned int> adjacency(adjacencyOffsets[numVertices]);
+	std::vector<unsigned int> adjacencyCounts(numVertices, 0);
+	for(unsigned int i = 0; i < input.size(); i++)
+	{
+		unsigned int vertex = input[i];
+		adjacency[adjacencyOffsets[vertex] + adjacencyCounts[vertex]++] = i / 3;
+	}
+	
+	//A vertex is in the cache if fewer than VERTEX_CACHE_SIZE vertices were
+	//transformed since it was.
+	std::vector<unsigned int> cacheTimes(numVertices, 0);
+	unsigned int timeStamp = VERTEX_CACHE_SIZE + 1;
+	
+	std::vector<bool> isEmitted(numTriangles, false);
+	std::vector<unsigned int> deadEnds;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> result;
+	result.reserve(input.size());
+	
+	unsigned int cursor = 0;
+	int fanVertex = 0;
+	
+	while(fanVertex >= 0)
+	{
+		//Emits every remaining triangle around the fan vertex.
+		candidates.clear();
+		for(unsigned int i = adjacencyOffsets[fanVertex]; i < adjacencyOffsets[fanVertex + 1]; i++)
+		{
+			unsigned int triangle = adjacency[i];
+			if(isEmitted[triangle])
+				continue;
+			
+			for(int j = 0; j < 3; j++)
+			{
+				unsigned int vertex = input[triangle * 3 + j];
+				result.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				
+				if(timeStamp - cacheTimes[vertex] > (unsigned int)VERTEX_CACHE_SIZE)
+				{
+					cacheTimes[vertex] = timeStamp++;
+				}
+			}
+			
+			isEmitted[triangle] = true;
+		}
+		
+		//The next fan is around the oldest candidate still in the cache once its
+		//triangles are emitted, since it's the next to be evicted.
+		fanVertex = -1;
+		int bestPriority = -1;
+		for(unsigned int i = 0; i < candidates.size(); i++)
+		{
+			unsigned int vertex = candidates[i];
+			if(liveTriangles[vertex] == 0)
+				continue;
+			
+			int priority = 0;
+			if(timeStamp - cacheTimes[vertex] + 2 * liveTriangles[vertex] <= (unsigned int)VERTEX_CACHE_SIZE)
+			{
+				priority = timeStamp - cacheTimes[vertex];
+			}
+			
+			if(priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanVertex = vertex;
+			}
+		}
+		
+		if(fanVertex >= 0)
+			continue;
+		
+		//Nothing nearby is left, so this starts a new cluster, from a recently used
+		//vertex if one still has triangles, or from the next unused part of the mesh.
+		while(!deadEnds.empty() && fanVertex < 0)
+		{
+			unsigned int vertex = deadEnds.back();
+			deadEnds.pop_back();
+			
+			if(liveTriangles[vertex] > 0)
+				fanVertex = vertex;
+		}
+		
+		while(cursor < numVertices && fanVertex < 0)
+		{
+			if(liveTriangles[cursor] > 0)
+				fanVertex = cursor;
+			
+			cursor++;
+		}
+		
+		if(fanVertex >= 0 && clusters && result.size() / 3 != clusters->back())
+		{
+			clusters->push_back(result.size() / 3);
+		}
+	}
+	
+	indices->swap(result);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>* indices, const std::vector<Vector3f>& positions, 
+                                     const std::vector<unsigned int>& clusters, float threshold)
+{
+	const unsigned int numTriangles = indices->size() / 3;
+	const std::vector<unsigned int>& input = *indices;
+	
+	if(numTriangles == 0)
+		return;
+	
+	const float inputACMR = CalcACMR(input, positions.size());
+	
+	//Clusters that are already cheap are split further, since smaller clusters can be
+	//sorted more finely. The cache is assumed to start empty in each cluster.
+	std::vector<unsigned int> splitClusters;
+	std::vector<unsigned int> cacheTimes(positions.size(), 0);
+	unsigned int timeStamp = VERTEX_CACHE_SIZE + 1;
+	
+	for(unsigned int i = 0; i < clusters.size(); i++)
+	{
+		unsigned int start = clusters[i];
+		unsigned int end = i + 1 < clusters.size() ? clusters[i + 1] : numTriangles;
+		unsigned int numMisses = 0;
+		
+		splitClusters.push_back(start);
+		timeStamp += VERTEX_CACHE_SIZE + 1;
+		
+		for(unsigned int triangle = start; triangle < end; triangle++)
+		{
+			for(int j = 0; j < 3; j++)
+			{
+				unsigned int vertex = input[triangle * 3 + j];
+				if(timeStamp - cacheTimes[vertex] > (unsigned int)VERTEX_CACHE_SIZE)
+				{
+					cacheTimes[vertex] = timeStamp++;
+					numMisses++;
+				}
+			}
+			
+			unsigned int numClusterTriangles = triangle + 1 - splitClusters.back();
+			if(triangle + 1 < end && numMisses <= threshold * inputACMR * numClusterTriangles)
+			{
+				splitClusters.push_back(triangle + 1);
+				timeStamp += VERTEX_CACHE_SIZE + 1;
+				numMisses = 0;
+			}
+		}
+	}
+	
+	//Clusters are weighted by area, which a cross product's length already is.
+	Vector3f meshCenter(0.0f, 0.0f, 0.0f);
+	float meshArea = 0.0f;
+	for(unsigned int i = 0; i < numTriangles; i++)
+	{
+		const unsigned int* triangle = &input[i * 3];
+		float area = CalcTriangleNormal(positions, triangle).Length();
+		
+		meshCenter += (positions[triangle[0]] + positions[triangle[1]] + positions[triangle[2]]) * area;
+		meshArea += area;
+	}
+	
+	if(meshArea > 0.0f)
+		meshCenter = meshCenter / (meshArea * 3.0f);
+	
+	std::vector<OverdrawCluster> sortedClusters;
+	for(unsigned int i = 0; i < splitClusters.size(); i++)
+	{
+		unsigned int start = splitClusters[i];
+		unsigned int end = i + 1 < splitClusters.size() ? splitClusters[i + 1] : numTriangles;
+		
+		Vector3f center(0.0f, 0.0f, 0.0f);
+		Vector3f normal(0.0f, 0.0f, 0.0f);
+		float area = 0.0f;
+		
+		for(unsigned int triangle = start; triangle < end; triangle++)
+		{
+			Vector3f triangleNormal = CalcTriangleNormal(positions, &input[triangle * 3]);
+			float triangleArea = triangleNormal.Length();
+			
+			center += (positions[input[triangle * 3]] + positions[input[triangle * 3 + 1]] + positions[input[triangle * 3 + 2]]) * triangleArea;
+			normal += triangleNormal;
+			area += triangleArea;
+		}
+		
+		float sortKey = 0.0f;
+		float normalLength = normal.Length();
+		if(area > 0.0f && normalLength > 0.0f)
+		{
+			center = center / (area * 3.0f);
+			sortKey = (center - meshCenter).Dot(normal / normalLength);
+		}
+		
+		sortedClusters.push_back(OverdrawCluster(start, end, sortKey));
+	}
+	
+	std::stable_sort(sortedClusters.begin(), sortedClusters.end());
+	
+	std::vector<unsigned int> result;
+	result.reserve(input.size());
+	for(unsigned int i = 0; i < sortedClusters.size(); i++)
+	{
+		result.insert(result.end(), input.begin() + sortedClusters[i].m_start * 3, input.begin() + sortedClusters[i].m_end * 3);
+	}
+	
+	if(CalcACMR(result, positions.size()) <= threshold * inputACMR)
+	{
+		indices->swap(result);
+	}
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<unsigned int>* indices, unsigned int numVertices, std::vector<unsigned int>* remap)
+{
+	const unsigned int UNUSED = (unsigned int)-1;
+	
+	remap->assign(numVertices, UNUSED);
+	unsigned int numUsed = 0;
+	
+	for(unsigned int i = 0; i < indices->size(); i++)
+	{
+		unsigned int& index = (*indices)[i];
+		if((*remap)[index] == UNUSED)
+		{
+			(*remap)[index] = numUsed++;
+		}
+		
+		index = (*remap)[index];
+	}
+	
+	for(unsigned int i = 0; i < numVertices; i++)
+	{
+		if((*remap)[i] == UNUSED)
+		{
+			(*remap)[i] = numUsed++;
+		}
+	}
+}
+
+float MeshOptimizer::CalcACMR(const std::vector<unsigned int>& indices, unsigned int numVertices, int cacheSize)
+{
+	if(indices.empty())
+		return 0.0f;
+	
+	return (float)CountCacheMisses(indices, numVertices, cacheSize) / (float)(indices.size() / 3);
+}
+
+float MeshOptimizer::CalcATVR(const std::vector<unsigned int>& indices, unsigned int numVertices, int cacheSize)
+{
+	if(numVertices == 0)
+		return 0.0f;
+	
+	return (float)CountCacheMisses(indices, numVertices, cacheSize) / (float)numVertices;
+}
+
+unsigned int MeshOptimizer::CountCacheMisses(const std::vector<unsigned int>& indices, unsigned int numVertices, int cacheSize)
+{
+	std::vector<unsigned int> cacheTimes(numVertices, 0);
+	unsigned int timeStamp = cacheSize + 1;
+	unsigned int numMisses = 0;
+	
+	for(unsigned int i = 0; i < indices.size(); i++)
+	{
+		if(timeStamp - cacheTimes[indices[i]] > (unsigned int)cacheSize)
+		{
+			cacheTimes[indices[i]] = timeStamp++;
+			numMisses++;
+		}
+	}
+	
+	return numMisses;
+}
+
+void MeshOptimizer::Test()
+{
+	//A grid of quads, with its triangles shuffled as a poor importer might leave them.
+	const unsigned int GRID_SIZE = 32;
+	const unsigned int numVertices = (GRID_SIZE + 1) * (GRID_SIZE + 1);
+	
+	std::vector<Vector3f> positions;
+	for(unsigned int y = 0; y <= GRID_SIZE; y++)
+	{
+		for(unsigned int x = 0; x <= GRID_SIZE; x++)
+		{
+			positions.push_back(Vector3f((float)x, (float)y, 0.0f));
+		}
+	}
+	
+	std::vector<unsigned int> triangles;
+	for(unsigned int y = 0; y < GRID_SIZE; y++)
+	{
+		for(unsigned int x = 0; x < GRID_SIZE; x++)
+		{
+			unsigned int corner = y * (GRID_SIZE + 1) + x;
+			unsigned int quad[6] = { corner, corner + 1, corner + GRID_SIZE + 1, corner + 1, corner + GRID_SIZE + 2, corner + GRID_SIZE + 1 };
+			triangles.insert(triangles.end(), quad, quad + 6);
+		}
+	}
+	
+	srand(17);
+	std::vector<unsigned int> indices;
+	std::vector<unsigned int> order(triangles.size() / 3);
+	for(unsigned int i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	
+	for(unsigned int i = order.size() - 1; i > 0; i--)
+	{
+		std::swap(order[i], order[rand() % (i + 1)]);
+	}
+	
+	for(unsigned int i = 0; i < order.size(); i++)
+	{
+		indices.insert(indices.end(), triangles.begin() + order[i] * 3, triangles.begin() + order[i] * 3 + 3);
+	}
+	
+	float shuffledACMR = CalcACMR(indices, numVertices);
+	assert(shuffledACMR > 2.0f);
+	assert(fabs(CalcATVR(indices, numVertices) - shuffledACMR * (GRID_SIZE * GRID_SIZE * 2) / numVertices) < 0.001f);
+	
+	//Every triangle is kept, with its winding.
+	std::vector<unsigned int> clusters;
+	std::vector<unsigned int> cacheIndices = indices;
+	OptimizeVertexCache(&cacheIndices, numVertices, &clusters);
+	assert(cacheIndices.size() == indices.size());
+	assert(!clusters.empty() && clusters[0] == 0);
+	
+	for(unsigned int i = 0; i < cacheIndices.size(); i += 3)
+	{
+		bool isFound = false;
+		for(unsigned int j = 0; j < indices.size() && !isFound; j += 3)
+		{
+			for(int k = 0; k < 3 && !isFound; k++)
+			{
+				isFound = cacheIndices[i] == indices[j + k] && cacheIndices[i + 1] == indices[j + (k + 1) % 3] 
+					&& cacheIndices[i + 2] == indices[j + (k + 2) % 3];
+			}
+		}
+		
+		assert(isFound);
+	}
+	
+	float cacheACMR = CalcACMR(cacheIndices, numVertices);
+	assert(cacheACMR < 0.8f);
+	assert(CalcATVR(cacheIndices, numVertices) < 1.6f);
+	
+	//A flat grid has nothing to sort, so the order can only get as much worse as allowed.
+	std::vector<unsigned int> overdrawIndices = cacheIndices;
+	OptimizeOverdraw(&overdrawIndices, positions, clusters);
+	assert(overdrawIndices.size() == cacheIndices.size());
+	assert(CalcACMR(overdrawIndices, numVertices) <= cacheACMR * OVERDRAW_THRESHOLD);
+	
+	//Two separate quads facing +z. The one in front of the mesh's middle faces outward
+	//and is drawn first, even though it came second.
+	Vector3f quadPositions[] = { Vector3f(0, 0, -1), Vector3f(1, 0, -1), Vector3f(0, 1, -1), Vector3f(1, 1, -1),
+	                             Vector3f(0, 0,  1), Vector3f(1, 0,  1), Vector3f(0, 1,  1), Vector3f(1, 1,  1) };
+	unsigned int quadIndices[] = { 0, 1, 2, 1, 3, 2, 4, 5, 6, 5, 7, 6 };
+	std::vector<Vector3f> twoQuadPositions(quadPositions, quadPositions + 8);
+	std::vector<unsigned int> twoQuads(quadIndices, quadIndices + 12);
+	
+	OptimizeVertexCache(&twoQuads, 8, &clusters);
+	assert(clusters.size() == 2 && clusters[1] == 2);
+	assert(twoQuads[0] < 4);
+	
+	OptimizeOverdraw(&twoQuads, twoQuadPositions, clusters);
+	for(unsigned int i = 0; i < 6; i++)
+	{
+		assert(twoQuads[i] >= 4 && twoQuads[i + 6] < 4);
+	}
+	
+	//Vertices are renumbered in the order they're first used, which doesn't change
+	//what's drawn or how well it caches.
+	std::vector<unsigned int> fetchIndices = overdrawIndices;
+	std::vector<unsigned int> remap;
+	OptimizeVertexFetch(&fetchIndices, numVertices + 1, &remap);
+	assert(remap.size() == numVertices + 1 && remap[numVertices] == numVertices);
+	
+	unsigned int maxIndex = 0;
+	for(unsigned int i = 0; i < fetchIndices.size(); i++)
+	{
+		assert(fetchIndices[i] <= maxIndex + 1);
+		assert(fetchIndices[i] == remap[overdrawIndices[i]]);
+		maxIndex = std::max(maxIndex, fetchIndices[i]);
+	}
+	
+	assert(CalcACMR(fetchIndices, numVertices) == CalcACMR(overdrawIndices, numVertices));
+	
+	std::vector<Vector3f> remappedPositions = positions;
+	remappedPositions.push_back(Vector3f(-1.0f, -1.0f, -1.0f));
+	Remap(&remappedPositions, remap);
+	assert(remappedPositions[fetchIndices[0]] == positions[overdrawIndices[0]]);
+	assert(remappedPositions[numVertices] == Vector3f(-1.0f, -1.0f, -1.0f));
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static Vector3f CalcTriangleNormal(const std::vector<Vector3f>& positions, const unsigned int* triangle)
+{
+	Vector3f edge1 = positions[triangle[1]] - positions[triangle[0]];
+	Vector3f edge2 = positions[triangle[2]] - positions[triangle[0]];
+	
+	return edge1.Cross(edge2);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include "../core/math3d.h"
+#include <vector>
+
+//Reorders a triangle list at import time, so the GPU does less work drawing the
+//same geometry. The passes are meant to run in order:
+//
+//OptimizeVertexCache reorders triangles with Tipsify, so vertices are reused while
+//they're still in the post-transform cache. It also splits the result into clusters
+//wherever it had to jump to a new part of the mesh.
+//
+//OptimizeOverdraw sorts those clusters so the ones facing away from the middle of
+//the mesh, which tend to hide the rest, are drawn first. It gives up if that would
+//cost too much cache efficiency.
+//
+//OptimizeVertexFetch renumbers vertices in the order they're first used, so the
+//vertex buffer is read mostly front to back.
+//
+//ACMR is the average number of vertices transformed per triangle, and ATVR the
+//average number of times each vertex is transformed. ATVR is 1 at best, and ACMR
+//approaches 0.5 on large regular grids.
+class MeshOptimizer
+{
+public:
+	static const int VERTEX_CACHE_SIZE = 16;
+	
+	//How much worse than the vertex cache order OptimizeOverdraw may make the ACMR.
+	static const float OVERDRAW_THRESHOLD;
+	
+	//The clusters are the indices of the first triangle of each, starting with 0.
+	static void OptimizeVertexCache(std::vector<unsigned int>* indices, unsigned int numVertices, std::vector<unsigned int>* clusters = 0);
+	static void OptimizeOverdraw(std::vector<unsigned int>* indices, const std::vector<Vector3f>& positions, 
+	                             const std::vector<unsigned int>& clusters, float threshold = OVERDRAW_THRESHOLD);
+	
+	//Rewrites the indices, and sets remap[oldVertex] to each vertex's new position.
+	//Unused vertices are kept, after all the used ones.
+	static void OptimizeVertexFetch(std::vector<unsigned int>* indices, unsigned int numVertices, std::vector<unsigned int>* remap);
+	
+	//Simulates a FIFO cache of cacheSize vertices.
+	static float CalcACMR(const std::vector<unsigned int>& indices, unsigned int numVertices, int cacheSize = VERTEX_CACHE_SIZE);
+	static float CalcATVR(const std::vector<unsigned int>& indices, unsigned int numVertices, int cacheSize = VERTEX_CACHE_SIZE);
+	
+	//Moves elements so that values[remap[i]] is what values[i] was.
+	template<class T>
+	static void Remap(std::vector<T>* values, const std::vector<unsigned int>& remap)
+	{
+		std::vector<T> result(values->size());
+		for(unsigned int i = 0; i < values->size(); i++)
+		{
+			result[remap[i]] = (*values)[i];
+		}
+		
+		values->swap(result);
+	}
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	static unsigned int CountCacheMisses(const std::vector<unsigned int>& indices, unsigned int numVertices, int cacheSize);
+};
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "meshSimplifier.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+//The sum of area weighted squared distances to a set of planes, as the symmetric
+//matrix of the plane equations, along with the total area.
+class Quadric
+{
+public:
+	Quadric() 
+	{
+		for(int i = 0; i < 10; i++)
+			m_terms[i] = 0.0;
+		
+		m_weight = 0.0;
+	}
+	
+	//The plane through the point with the unit normal.
+	Quadric(const Vector3f& normal, const Vector3f& point, double weight)
+	{
+		double a = normal.GetX();
+		double b = normal.GetY();
+		double c = normal.GetZ();
+		double d = -(a * point.GetX() + b * point.GetY() + c * point.GetZ());
+		
+		m_terms[0] = a * a * weight; m_terms[1] = a * b * weight; m_terms[2] = a * c * weight; m_terms[3] = a * d * weight;
+		m_terms[4] = b * b * weight; m_terms[5] = b * c * weight; m_terms[6] = b * d * weight;
+		m_terms[7] = c * c * weight; m_terms[8] = c * d * weight;
+		m_terms[9] = d * d * weight;
+		m_weight = weight;
+	}
+	
+	inline Quadric& operator+=(const Quadric& r)
+	{
+		for(int i = 0; i < 10; i++)
+			m_terms[i] += r.m_terms[i];
+		
+		m_weight += r.m_weight;
+		return *this;
+	}
+	
+	//The average squared distance from the point to the planes.
+	double Evaluate(const Vector3f& point) const
+	{
+		double x = point.GetX();
+		double y = point.GetY();
+		double z = point.GetZ();
+		
+		double result = m_terms[0] * x * x + 2 * m_terms[1] * x * y + 2 * m_terms[2] * x * z + 2 * m_terms[3] * x
+		              + m_terms[4] * y * y + 2 * m_terms[5] * y * z + 2 * m_terms[6] * y
+		              + m_terms[7] * z * z + 2 * m_terms[8] * z
+		              + m_terms[9];
+		
+		return m_weight > 0.0 ? std::max(result / m_weight, 0.0) : 0.0;
+	}
+private:
+	double m_terms[10];
+	double m_weight;
+};
+
+//Moving one vertex onto another, and what it costs.
+class EdgeCollapse
+{
+public:
+	EdgeCollapse(unsigned int from, unsigned int to, double cost) :
+		m_from(from),
+		m_to(to),
+		m_cost(cost) {}
+	
+	inline bool operator<(const EdgeCollapse& r) const { return m_cost < r.m_cost; }
+	
+	unsigned int m_from;
+	unsigned int m_to;
+	double m_cost;
+};
+
+//A triangle whose normal turns further than this from where it was would nearly fold over.
+static const float MIN_COLLAPSE_NORMAL_DOT = 0.25f;
+
+static Vector3f CalcTriangleNormal(const Vector3f& p0, const Vector3f& p1, const Vector3f& p2);
+static bool IsPositionLess(const std::vector<Vector3f>* positions, unsigned int a, unsigned int b);
+
+class PositionLess
+{
+public:
+	PositionLess(const std::vector<Vector3f>& positions) : m_positions(&positions) {}
+	inline bool operator()(unsigned int a, unsigned int b) const { return IsPositionLess(m_positions, a, b); }
+private:
+	const std::vector<Vector3f>* m_positions;
+};
+
+float MeshSimplifier::Simplify(std::vector<unsigned int>* indices, const std::vector<Vector3f>& positions, 
+                               unsigned int targetIndexCount, float maxError)
+{
+	const unsigned int numVertices = positions.size();
+	std::vector<unsigned int>& result = *indices;
+	
+	std::vector<bool> isLocked;
+	FindLockedVertices(result, positions, &isLocked);
+	
+	std::vector<Quadric> quadrics(numVertices);
+	for(unsigned int i = 0; i < result.size(); i += 3)
+	{
+		const Vector3f& p0 = positions[result[i]];
+		Vector3f normal = CalcTriangleNormal(p0, positions[result[i + 1]], positions[result[i + 2]]);
+		float area = normal.Length();
+		
+		if(area == 0.0f)
+			continue;
+		
+		Quadric quadric(normal / area, p0, area);
+		for(int j = 0; j < 3; j++)
+		{
+			quadrics[result[i + j]] += quadric;
+		}
+	}
+	
+	double maxCost = (double)maxError * (double)maxError;
+	double reachedCost = 0.0;
+	
+	std::vector<unsigned int> adjacencyOffsets;
+	std::vector<unsigned int> adjacency;
+	std::vector<EdgeCollapse> collapses;
+	std::vector<unsigned int> remap(numVertices);
+	std::vector<bool> isTouched(numVertices);
+	
+	//Each pass does the cheapest collapses that don't share any triangles, so they
+	//can't invalidate each other's checks, then rebuilds the index list.
+	while(result.size() > targetIndexCount)
+	{
+		adjacencyOffsets.assign(numVertices + 1, 0);
+		for(unsigned int i = 0; i < result.size(); i++)
+		{
+			adjacencyOffsets[result[i] + 1]++;
+		}
+		
+		for(unsigned int i = 0; i < numVertices; i++)
+		{
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		}
+		
+		adjacency.resize(result.size());
+		std::vector<unsigned int> adjacencyCounts(numVertices, 0);
+		for(unsigned int i = 0; i < result.size(); i++)
+		{
+			adjacency[adjacencyOffsets[result[i]] + adjacencyCounts[result[i]]++] = i / 3;
+		}
+		
+		collapses.clear();
+		for(unsigned int i = 0; i < result.size(); i += 3)
+		{
+			for(int j = 0; j < 3; j++)
+			{
+				unsigned int a = result[i + j];
+				unsigned int b = result[i + (j + 1) % 3];
+				
+				if(!isLocked[a])
+					collapses.push_back(EdgeCollapse(a, b, quadrics[a].Evaluate(positions[b])));
+				if(!isLocked[b])
+					collapses.push_back(EdgeCollapse(b, a, quadrics[b].Evaluate(positions[a])));
+			}
+		}
+		
+		std::sort(collapses.begin(), collapses.end());
+		
+		for(unsigned int i = 0; i < numVertices; i++)
+		{
+			remap[i] = i;
+		}
+		
+		isTouched.assign(numVertices, false);
+		unsigned int numTriangles = result.size() / 3;
+		unsigned int numCollapses = 0;
+		
+		for(unsigned int i = 0; i < collapses.size() && numTriangles * 3 > targetIndexCount; i++)
+		{
+			const EdgeCollapse& collapse = collapses[i];
+			if(collapse.m_cost > maxCost)
+				break;
+			
+			if(isTouched[collapse.m_from] || isTouched[collapse.m_to])
+				continue;
+			
+			//The triangles around the moved vertex that don't contain the edge are
+			//stretched, and mustn't flip or fold over.
+			bool isValid = true;
+			unsigned int numRemoved = 0;
+			for(unsigned int j = adjacencyOffsets[collapse.m_from]; j < adjacencyOffsets[collapse.m_from + 1] && isValid; j++)
+			{
+				const unsigned int* triangle = &result[adjacency[j] * 3];
+				if(triangle[0] == collapse.m_to || triangle[1] == collapse.m_to || triangle[2] == collapse.m_to)
+				{
+					numRemoved++;
+					continue;
+				}
+				
+				Vector3f moved[3];
+				for(int k = 0; k < 3; k++)
+				{
+					moved[k] = positions[triangle[k] == collapse.m_from ? collapse.m_to : triangle[k]];
+				}
+				
+				Vector3f oldNormal = CalcTriangleNormal(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]]);
+				Vector3f newNormal = CalcTriangleNormal(moved[0], moved[1], moved[2]);
+				
+				isValid = oldNormal.Dot(newNormal) > MIN_COLLAPSE_NORMAL_DOT * oldNormal.Length() * newNormal.Length();
+			}
+			
+			if(!isValid)
+				continue;
+			
+			for(unsigned int j = adjacencyOffsets[collapse.m_from]; j < adjacencyOffsets[collapse.m_from + 1]; j++)
+			{
+				const unsigned int* triangle = &result[adjacency[j] * 3];
+				for(int k = 0; k < 3; k++)
+				{
+					isTouched[triangle[k]] = true;
+				}
+			}
+			
+			remap[collapse.m_from] = collapse.m_to;
+			quadrics[collapse.m_to] += quadrics[collapse.m_from];
+			reachedCost = std::max(reachedCost, collapse.m_cost);
+			numTriangles -= std::min(numRemoved, numTriangles);
+			numCollapses++;
+		}
+		
+		if(numCollapses == 0)
+			break;
+		
+		unsigned int numIndices = 0;
+		for(unsigned int i = 0; i < result.size(); i += 3)
+		{
+			unsigned int a = remap[result[i]];
+			unsigned int b = remap[result[i + 1]];
+			unsigned int c = remap[result[i + 2]];
+			
+			if(a != b && b != c && c != a)
+			{
+				result[numIndices++] = a;
+				result[numIndices++] = b;
+				result[numIndices++] = c;
+			}
+		}
+		
+		result.resize(numIndices);
+	}
+	
+	return (float)sqrt(reachedCost);
+}
+
+void MeshSimplifier::FindLockedVertices(const std::vector<unsigned int>& indices, const std::vector<Vector3f>& positions, 
+                                        std::vector<bool>* isLocked)
+{
+	const unsigned int numVertices = positions.size();
+	
+	//Vertices at the same position are grouped, and a group of more than one is a seam.
+	std::vector<unsigned int> sorted(numVertices);
+	for(unsigned int i = 0; i < numVertices; i++)
+	{
+		sorted[i] = i;
+	}
+	
+	std::sort(sorted.begin(), sorted.end(), PositionLess(positions));
+	
+	std::vector<unsigned int> groups(numVertices);
+	std::vector<bool> isGroupLocked;
+	for(unsigned int i = 0; i < numVertices; i++)
+	{
+		if(i == 0 || positions[sorted[i]] != positions[sorted[i - 1]])
+		{
+			isGroupLocked.push_back(false);
+		}
+		else
+		{
+			isGroupLocked.back() = true;
+		}
+		
+		groups[sorted[i]] = isGroupLocked.size() - 1;
+	}
+	
+	//Edges between groups are shared by exactly two triangles inside a closed surface.
+	//Any other count is a border or a non-manifold edge.
+	std::vector<unsigned long long> edges;
+	edges.reserve(indices.size());
+	for(unsigned int i = 0; i < indices.size(); i += 3)
+	{
+		for(int j = 0; j < 3; j++)
+		{
+			unsigned long long a = groups[indices[i + j]];
+			unsigned long long b = groups[indices[i + (j + 1) % 3]];
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	}
+	
+	std::sort(edges.begin(), edges.end());
+	
+	for(unsigned int i = 0; i < edges.size(); )
+	{
+		unsigned int end = i;
+		while(end < edges.size() && edges[end] == edges[i])
+			end++;
+		
+		if(end - i != 2)
+		{
+			isGroupLocked[(unsigned int)(edges[i] >> 32)] = true;
+			isGroupLocked[(unsigned int)(edges[i] & 0xFFFFFFFF)] = true;
+		}
+		
+		i = end;
+	}
+	
+	isLocked->resize(numVertices);
+	for(unsigned int i = 0; i < numVertices; i++)
+	{
+		(*isLocked)[i] = isGroupLocked[groups[i]];
+	}
+}
+
+void MeshSimplifier::Test()
+{
+	//A flat grid, with a UV seam down the middle column: the vertices there are
+	//duplicated, and the triangles on the right use the copies.
+	const unsigned int GRID_SIZE = 16;
+	const unsigned int SEAM_COLUMN = GRID_SIZE / 2;
+	
+	std::vector<Vector3f> positions;
+	for(unsigned int y = 0; y <= GRID_SIZE; y++)
+	{
+		for(unsigned int x = 0; x <= GRID_SIZE; x++)
+		{
+			positions.push_back(Vector3f((float)x, (float)y, 0.0f));
+		}
+	}
+	
+	const unsigned int seamStart = positions.size();
+	for(unsigned int y = 0; y <= GRID_SIZE; y++)
+	{
+		positions.push_back(Vector3f((float)SEAM_COLUMN, (float)y, 0.0f));
+	}
+	
+	std::vector<unsigned int> indices;
+	for(unsigned int y = 0; y < GRID_SIZE; y++)
+	{
+		for(unsigned int x = 0; x < GRID_SIZE; x++)
+		{
+			unsigned int corners[4];
+			for(int i = 0; i < 4; i++)
+			{
+				unsigned int cornerX = x + (i & 1);
+				unsigned int cornerY = y + (i >> 1);
+				
+				if(cornerX == SEAM_COLUMN && x == SEAM_COLUMN)
+					corners[i] = seamStart + cornerY;
+				else
+					corners[i] = cornerY * (GRID_SIZE + 1) + cornerX;
+			}
+			
+			unsigned int quad[6] = { corners[0], corners[1], corners[2], corners[1], corners[3], corners[2] };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	
+	const unsigned int numIndices = indices.size();
+	
+	//Interior vertices of a plane collapse for free, but the outline and seam stay.
+	std::vector<unsigned int> simplified = indices;
+	float error = MeshSimplifier::Simplify(&simplified, positions, 0, 0.001f);
+	assert(error < 0.001f);
+	assert(simplified.size() < numIndices / 4);
+	assert(simplified.size() % 3 == 0);
+	
+	std::vector<bool> isUsed(positions.size(), false);
+	for(unsigned int i = 0; i < simplified.size(); i++)
+	{
+		isUsed[simplified[i]] = true;
+	}
+	
+	for(unsigned int i = 0; i <= GRID_SIZE; i++)
+	{
+		assert(isUsed[i]);                                        //Bottom border
+		assert(isUsed[GRID_SIZE * (GRID_SIZE + 1) + i]);          //Top border
+		assert(isUsed[i * (GRID_SIZE + 1) + SEAM_COLUMN]);        //Seam, left side
+		assert(isUsed[seamStart + i]);                            //Seam, right side
+	}
+	
+	//The remaining triangles still face the same way, and cover the same area.
+	float area = 0.0f;
+	for(unsigned int i = 0; i < simplified.size(); i += 3)
+	{
+		Vector3f normal = CalcTriangleNormal(positions[simplified[i]], positions[simplified[i + 1]], positions[simplified[i + 2]]);
+		assert(normal.GetZ() > 0.0f);
+		area += normal.Length() / 2.0f;
+	}
+	
+	assert(fabs(area - GRID_SIZE * GRID_SIZE) < 0.001f);
+	
+	//The target stops simplification early.
+	simplified = indices;
+	MeshSimplifier::Simplify(&simplified, positions, numIndices / 2, 0.001f);
+	assert(simplified.size() <= numIndices / 2 && simplified.size() > numIndices / 4);
+	
+	//Bumps are kept when they're larger than the error allowed.
+	std::vector<Vector3f> bumpyPositions = positions;
+	for(unsigned int i = 0; i < bumpyPositions.size(); i++)
+	{
+		float x = bumpyPositions[i].GetX();
+		float y = bumpyPositions[i].GetY();
+		bumpyPositions[i].SetZ(((int)x % 2) * ((int)y % 2) * 0.5f);
+	}
+	
+	simplified = indices;
+	error = MeshSimplifier::Simplify(&simplified, bumpyPositions, 0, 0.01f);
+	assert(error <= 0.01f);
+	assert(simplified.size() == numIndices);
+	
+	simplified = indices;
+	error = MeshSimplifier::Simplify(&simplified, bumpyPositions, 0, 1.0f);
+	assert(error > 0.01f && error <= 1.0f);
+	assert(simplified.size() < numIndices / 2);
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static Vector3f CalcTriangleNormal(const Vector3f& p0, const Vector3f& p1, const Vector3f& p2)
+{
+	return (p1 - p0).Cross(p2 - p0);
+}
+
+static bool IsPositionLess(const std::vector<Vector3f>* positions, unsigned int a, unsigned int b)
+{
+	const Vector3f& pa = (*positions)[a];
+	const Vector3f& pb = (*positions)[b];
+	
+	if(pa.GetX() != pb.GetX()) return pa.GetX() < pb.GetX();
+	if(pa.GetY() != pb.GetY()) return pa.GetY() < pb.GetY();
+	return pa.GetZ() < pb.GetZ();
+}
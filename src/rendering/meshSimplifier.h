@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include "../core/math3d.h"
+#include <vector>
+
+//Removes triangles from a mesh by collapsing edges, for generating levels of detail.
+//
+//Each vertex keeps a quadric, the sum of the squared distances to the planes of the
+//triangles around it, weighted by their area. An edge collapse moves one vertex onto
+//the other, costing the first vertex's quadric at the new position, and the cheapest
+//collapses are done first. Vertices are only ever moved onto existing vertices, so a
+//simplified mesh is just a new index list over the same vertex buffer.
+//
+//Vertices that share a position with another vertex lie on a UV or normal seam, and
+//are never moved, nor are vertices on the open borders of the mesh. The seams and
+//outline of the mesh stay exactly where they were.
+class MeshSimplifier
+{
+public:
+	//Collapses edges until at most targetIndexCount indices are left, or until the next
+	//collapse would move the surface further than maxError. Returns the furthest
+	//distance any collapse moved the surface, in the positions' units.
+	static float Simplify(std::vector<unsigned int>* indices, const std::vector<Vector3f>& positions, 
+	                      unsigned int targetIndexCount, float maxError);
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	//Marks vertices on seams and borders, which can't be moved.
+	static void FindLockedVertices(const std::vector<unsigned int>& indices, const std::vector<Vector3f>& positions, 
+	                               std::vector<bool>* isLocked);
+};
+
+#endif // MESHSIMPLIFIER_H
@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "occlusionCuller.h"
+#include "../core/jobSystem.h"
+#include "../core/profiling.h"
+#include "../staticLibs/simdaccel.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static void TransformToClip(const Matrix4f& matrix, const Vector3f& position, float* clip);
+static int ClipToNearPlane(const float* in, int numIn, float* out);
+
+OcclusionCuller::OcclusionCuller()
+{
+	for(int i = 0; i < NUM_LEVELS; i++)
+	{
+		m_levels[i].resize(GetLevelWidth(i) * GetLevelHeight(i), 1.0f);
+	}
+}
+
+void OcclusionCuller::Begin(const Matrix4f& viewProjection)
+{
+	m_viewProjection = viewProjection;
+	m_triangles.clear();
+	
+	for(int i = 0; i < NUM_TILES_X * NUM_TILES_Y; i++)
+	{
+		m_tileBins[i].clear();
+	}
+	
+	std::fill(m_levels[0].begin(), m_levels[0].end(), 1.0f);
+}
+
+void OcclusionCuller::AddOccluder(const std::vector<Vector3f>& positions, const std::vector<unsigned int>& indices, const Matrix4f& worldMatrix)
+{
+	Matrix4f worldViewProjection = m_viewProjection * worldMatrix;
+	
+	m_clipPositions.resize(positions.size() * 4);
+	for(unsigned int i = 0; i < positions.size(); i++)
+	{
+		TransformToClip(worldViewProjection, positions[i], &m_clipPositions[i * 4]);
+	}
+	
+	for(unsigned int i = 0; i + 2 < indices.size(); i += 3)
+	{
+		float triangle[3 * 4];
+		for(int j = 0; j < 3; j++)
+		{
+			const float* clip = &m_clipPositions[indices[i + j] * 4];
+			std::copy(clip, clip + 4, triangle + j * 4);
+		}
+		
+		//Clipping at the near plane keeps walls the camera is right next to, which hide the most.
+		float polygon[4 * 4];
+		int numVertices = ClipToNearPlane(triangle, 3, polygon);
+		
+		Vector3f screen[4];
+		for(int j = 0; j < numVertices; j++)
+		{
+			const float* clip = polygon + j * 4;
+			float invW = 1.0f / clip[3];
+			
+			screen[j] = Vector3f((clip[0] * invW * 0.5f + 0.5f) * WIDTH, (clip[1] * invW * 0.5f + 0.5f) * HEIGHT, clip[2] * invW);
+		}
+		
+		for(int j = 2; j < numVertices; j++)
+		{
+			AddTriangle(screen[0], screen[j - 1], screen[j]);
+		}
+	}
+}
+
+void OcclusionCuller::AddTriangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2)
+{
+	float area = (v1.GetX() - v0.GetX()) * (v2.GetY() - v0.GetY()) - (v2.GetX() - v0.GetX()) * (v1.GetY() - v0.GetY());
+	
+	//Edge on triangles don't cover anything.
+	if(fabs(area) < 1e-6f)
+		return;
+	
+	float minX = std::min(v0.GetX(), std::min(v1.GetX(), v2.GetX()));
+	float minY = std::min(v0.GetY(), std::min(v1.GetY(), v2.GetY()));
+	float maxX = std::max(v0.GetX(), std::max(v1.GetX(), v2.GetX()));
+	float maxY = std::max(v0.GetY(), std::max(v1.GetY(), v2.GetY()));
+	
+	if(maxX < 0.0f || maxY < 0.0f || minX > (float)WIDTH || minY > (float)HEIGHT)
+		return;
+	
+	Triangle triangle;
+	triangle.m_minX = (int)std::max(0.0f, floor(minX));
+	triangle.m_minY = (int)std::max(0.0f, floor(minY));
+	triangle.m_maxX = (int)std::min((float)(WIDTH - 1), ceil(maxX));
+	triangle.m_maxY = (int)std::min((float)(HEIGHT - 1), ceil(maxY));
+	
+	//Both windings are drawn, so open meshes like walls hide things from either side.
+	//Edge functions are scaled to be distances in pixels, and positive inside. Divided
+	//by the area instead, they're the weights of each vertex's depth.
+	const Vector3f* vertices[3] = { &v0, &v1, &v2 };
+	float invArea = 1.0f / area;
+	float sign = area < 0.0f ? -1.0f : 1.0f;
+	
+	triangle.m_depthA = 0.0f;
+	triangle.m_depthB = 0.0f;
+	triangle.m_depthC = 0.0f;
+	
+	for(int i = 0; i < 3; i++)
+	{
+		const Vector3f& a = *vertices[(i + 1) % 3];
+		const Vector3f& b = *vertices[(i + 2) % 3];
+		float z = vertices[i]->GetZ();
+		
+		float edgeA = a.GetY() - b.GetY();
+		float edgeB = b.GetX() - a.GetX();
+		float edgeC = -(edgeA * a.GetX() + edgeB * a.GetY());
+		float invLength = sign / sqrtf(edgeA * edgeA + edgeB * edgeB);
+		
+		triangle.m_edgeA[i] = edgeA * invLength;
+		triangle.m_edgeB[i] = edgeB * invLength;
+		triangle.m_edgeC[i] = edgeC * invLength;
+		
+		triangle.m_depthA += edgeA * invArea * z;
+		triangle.m_depthB += edgeB * invArea * z;
+		triangle.m_depthC += edgeC * invArea * z;
+	}
+	
+	int index = (int)m_triangles.size();
+	m_triangles.push_back(triangle);
+	
+	for(int y = triangle.m_minY / TILE_HEIGHT; y <= triangle.m_maxY / TILE_HEIGHT; y++)
+	{
+		for(int x = triangle.m_minX / TILE_WIDTH; x <= triangle.m_maxX / TILE_WIDTH; x++)
+		{
+			m_tileBins[y * NUM_TILES_X + x].push_back(index);
+		}
+	}
+}
+
+void OcclusionCuller::Finish(JobSystem* jobSystem)
+{
+	//Tiles only write to their own pixels, so they can be rasterized in any order.
+	if(jobSystem)
+	{
+		jobSystem->ParallelFor(RasterizeTiles, this, NUM_TILES_X * NUM_TILES_Y);
+	}
+	else
+	{
+		RasterizeTiles(this, 0, NUM_TILES_X * NUM_TILES_Y);
+	}
+	
+	BuildPyramid();
+}
+
+void OcclusionCuller::RasterizeTiles(void* data, int start, int end)
+{
+	OcclusionCuller* culler = (OcclusionCuller*)data;
+	
+	for(int i = start; i < end; i++)
+	{
+		culler->RasterizeTile(i);
+	}
+}
+
+void OcclusionCuller::RasterizeTile(int tile)
+{
+	static const SIMD4f PIXEL_CENTERS(0.5f, 1.5f, 2.5f, 3.5f);
+	
+	//Pixels exactly on an edge shared by two triangles can round to outside both, which
+	//would leave holes along the diagonals of every quad.
+	static const SIMD4f EDGE_TOLERANCE(-0.01f);
+	
+	int tileX = (tile % NUM_TILES_X) * TILE_WIDTH;
+	int tileY = (tile / NUM_TILES_X) * TILE_HEIGHT;
+	float* depthBuffer = &m_levels[0][0];
+	const std::vector<int>& bin = m_tileBins[tile];
+	
+	for(unsigned int i = 0; i < bin.size(); i++)
+	{
+		const Triangle& triangle = m_triangles[bin[i]];
+		
+		//Rows start on a multiple of 4, so groups never cross into the next tile.
+		int minX = std::max(triangle.m_minX, tileX) & ~3;
+		int maxX = std::min(triangle.m_maxX, tileX + TILE_WIDTH - 1);
+		int minY = std::max(triangle.m_minY, tileY);
+		int maxY = std::min(triangle.m_maxY, tileY + TILE_HEIGHT - 1);
+		
+		SIMD4f edgeA0(triangle.m_edgeA[0]), edgeA1(triangle.m_edgeA[1]), edgeA2(triangle.m_edgeA[2]);
+		SIMD4f depthA(triangle.m_depthA);
+		
+		for(int y = minY; y <= maxY; y++)
+		{
+			float centerY = (float)y + 0.5f;
+			SIMD4f rowEdge0(triangle.m_edgeB[0] * centerY + triangle.m_edgeC[0]);
+			SIMD4f rowEdge1(triangle.m_edgeB[1] * centerY + triangle.m_edgeC[1]);
+			SIMD4f rowEdge2(triangle.m_edgeB[2] * centerY + triangle.m_edgeC[2]);
+			SIMD4f rowDepth(triangle.m_depthB * centerY + triangle.m_depthC);
+			
+			float* row = depthBuffer + y * WIDTH;
+			
+			for(int x = minX; x <= maxX; x += 4)
+			{
+				SIMD4f centerX = SIMD4f((float)x) + PIXEL_CENTERS;
+				SIMD4f inside = ((edgeA0 * centerX + rowEdge0) >= EDGE_TOLERANCE) & 
+				                ((edgeA1 * centerX + rowEdge1) >= EDGE_TOLERANCE) & 
+				                ((edgeA2 * centerX + rowEdge2) >= EDGE_TOLERANCE);
+				
+				SIMD4f depth = depthA * centerX + rowDepth;
+				SIMD4f current;
+				current.Set(row + x);
+				inside.Pick(depth.Min(current), current).Get(row + x);
+			}
+		}
+	}
+}
+
+void OcclusionCuller::BuildPyramid()
+{
+	for(int level = 1; level < NUM_LEVELS; level++)
+	{
+		const std::vector<float>& source = m_levels[level - 1];
+		std::vector<float>& dest = m_levels[level];
+		int sourceWidth = GetLevelWidth(level - 1);
+		int sourceHeight = GetLevelHeight(level - 1);
+		int width = GetLevelWidth(level);
+		int height = GetLevelHeight(level);
+		
+		for(int y = 0; y < height; y++)
+		{
+			int y0 = y * 2;
+			int y1 = std::min(y0 + 1, sourceHeight - 1);
+			
+			for(int x = 0; x < width; x++)
+			{
+				int x0 = x * 2;
+				int x1 = std::min(x0 + 1, sourceWidth - 1);
+				
+				dest[y * width + x] = std::max(std::max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]), 
+				                               std::max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::IsAABBVisible(const Vector3f& center, const Vector3f& extents) const
+{
+	float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	
+	for(int i = 0; i < 8; i++)
+	{
+		Vector3f corner(center.GetX() + ((i & 1) ? extents.GetX() : -extents.GetX()),
+		                center.GetY() + ((i & 2) ? extents.GetY() : -extents.GetY()),
+		                center.GetZ() + ((i & 4) ? extents.GetZ() : -extents.GetZ()));
+		
+		float clip[4];
+		TransformToClip(m_viewProjection, corner, clip);
+		
+		if(clip[2] < -clip[3] || clip[3] <= 0.0f)
+			return true;
+		
+		float invW = 1.0f / clip[3];
+		minX = std::min(minX, clip[0] * invW);
+		maxX = std::max(maxX, clip[0] * invW);
+		minY = std::min(minY, clip[1] * invW);
+		maxY = std::max(maxY, clip[1] * invW);
+		minZ = std::min(minZ, clip[2] * invW);
+	}
+	
+	int x0 = std::max(0, (int)floor((minX * 0.5f + 0.5f) * WIDTH));
+	int y0 = std::max(0, (int)floor((minY * 0.5f + 0.5f) * HEIGHT));
+	int x1 = std::min(WIDTH - 1, (int)floor((maxX * 0.5f + 0.5f) * WIDTH));
+	int y1 = std::min(HEIGHT - 1, (int)floor((maxY * 0.5f + 0.5f) * HEIGHT));
+	
+	//Off the screen is for frustum culling to decide.
+	if(x0 > x1 || y0 > y1)
+		return true;
+	
+	int size = std::max(x1 - x0, y1 - y0) + 1;
+	int level = 0;
+	while(level < NUM_LEVELS - 1 && (size >> level) > 2)
+	{
+		level++;
+	}
+	
+	const std::vector<float>& depths = m_levels[level];
+	int width = GetLevelWidth(level);
+	
+	for(int y = y0 >> level; y <= y1 >> level; y++)
+	{
+		for(int x = x0 >> level; x <= x1 >> level; x++)
+		{
+			if(minZ <= depths[y * width + x])
+				return true;
+		}
+	}
+	
+	return false;
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static void TransformToClip(const Matrix4f& matrix, const Vector3f& position, float* clip)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		clip[i] = matrix[0][i] * position.GetX() + matrix[1][i] * position.GetY() + matrix[2][i] * position.GetZ() + matrix[3][i];
+	}
+}
+
+//Keeps the part of the polygon where z >= -w, and returns how many vertices are left.
+//A triangle can gain one vertex, so out needs room for four.
+static int ClipToNearPlane(const float* in, int numIn, float* out)
+{
+	int numOut = 0;
+	
+	for(int i = 0; i < numIn; i++)
+	{
+		const float* current = in + i * 4;
+		const float* next = in + ((i + 1) % numIn) * 4;
+		float currentDistance = current[2] + current[3];
+		float nextDistance = next[2] + next[3];
+		
+		if(currentDistance >= 0.0f)
+		{
+			std::copy(current, current + 4, out + numOut * 4);
+			numOut++;
+		}
+		
+		if((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+		{
+			float t = currentDistance / (currentDistance - nextDistance);
+			
+			for(int j = 0; j < 4; j++)
+			{
+				out[numOut * 4 + j] = current[j] + (next[j] - current[j]) * t;
+			}
+			
+			numOut++;
+		}
+	}
+	
+	return numOut;
+}
+
+static void AddQuad(std::vector<Vector3f>* positions, std::vector<unsigned int>* indices, 
+                    const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, const Vector3f& v3)
+{
+	unsigned int start = (unsigned int)positions->size();
+	positions->push_back(v0);
+	positions->push_back(v1);
+	positions->push_back(v2);
+	positions->push_back(v3);
+	
+	unsigned int quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+	for(int i = 0; i < 6; i++)
+	{
+		indices->push_back(start + quadIndices[i]);
+	}
+}
+
+void OcclusionCuller::Test()
+{
+	//Looking down +Z from the origin, with the same aspect ratio as the depth buffer.
+	Matrix4f viewProjection = Matrix4f().InitPerspective(ToRadians(90.0f), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
+	Matrix4f identity = Matrix4f().InitIdentity();
+	
+	std::vector<Vector3f> positions;
+	std::vector<unsigned int> indices;
+	AddQuad(&positions, &indices, Vector3f(-5, -5, 10), Vector3f(-5, 5, 10), Vector3f(5, 5, 10), Vector3f(5, -5, 10));
+	
+	OcclusionCuller culler;
+	culler.Begin(viewProjection);
+	culler.AddOccluder(positions, indices, identity);
+	culler.Finish();
+	assert(culler.GetNumTriangles() == 2);
+	
+	//Behind the wall, in front of it, beside it, and only partly behind it.
+	assert(!culler.IsAABBVisible(Vector3f(0, 0, 20), Vector3f(1, 1, 1)));
+	assert(culler.IsAABBVisible(Vector3f(0, 0, 5), Vector3f(1, 1, 1)));
+	assert(culler.IsAABBVisible(Vector3f(30, 0, 20), Vector3f(1, 1, 1)));
+	assert(culler.IsAABBVisible(Vector3f(10, 0, 20), Vector3f(2, 2, 2)));
+	
+	//Boxes around the camera reach past the near plane.
+	assert(culler.IsAABBVisible(Vector3f(0, 0, 0), Vector3f(1, 1, 1)));
+	
+	//Moving the wall with its world matrix moves what it hides.
+	culler.Begin(viewProjection);
+	culler.AddOccluder(positions, indices, Matrix4f().InitTranslation(Vector3f(30, 0, 10)));
+	culler.Finish();
+	assert(culler.IsAABBVisible(Vector3f(0, 0, 20), Vector3f(1, 1, 1)));
+	assert(!culler.IsAABBVisible(Vector3f(60, 0, 40), Vector3f(1, 1, 1)));
+	
+	//A floor sloping up through the near plane still hides what's behind it.
+	positions.clear();
+	indices.clear();
+	AddQuad(&positions, &indices, Vector3f(-50, -10, -5), Vector3f(-50, 10, 15), Vector3f(50, 10, 15), Vector3f(50, -10, -5));
+	
+	culler.Begin(viewProjection);
+	culler.AddOccluder(positions, indices, identity);
+	culler.Finish();
+	assert(!culler.IsAABBVisible(Vector3f(0, 0, 30), Vector3f(1, 1, 1)));
+	assert(culler.IsAABBVisible(Vector3f(0, 0, 3), Vector3f(0.5f, 0.5f, 0.5f)));
+	
+	//Occluders entirely behind the camera hide nothing.
+	positions.clear();
+	indices.clear();
+	AddQuad(&positions, &indices, Vector3f(-5, -5, -10), Vector3f(-5, 5, -10), Vector3f(5, 5, -10), Vector3f(5, -5, -10));
+	
+	culler.Begin(viewProjection);
+	culler.AddOccluder(positions, indices, identity);
+	culler.Finish();
+	assert(culler.GetNumTriangles() == 0);
+	assert(culler.IsAABBVisible(Vector3f(0, 0, 20), Vector3f(1, 1, 1)));
+	
+	//Rasterizing the tiles on a JobSystem gives the same depths as on one thread.
+	positions.clear();
+	indices.clear();
+	srand(7);
+	for(int i = 0; i < 50; i++)
+	{
+		Vector3f corner((float)(rand() % 40 - 20), (float)(rand() % 20 - 10), (float)(rand() % 50 + 5));
+		AddQuad(&positions, &indices, corner, corner + Vector3f(0, 3, 1), corner + Vector3f(4, 3, 2), corner + Vector3f(4, 0, 1));
+	}
+	
+	OcclusionCuller parallelCuller;
+	JobSystem jobSystem(3);
+	
+	culler.Begin(viewProjection);
+	culler.AddOccluder(positions, indices, identity);
+	culler.Finish();
+	parallelCuller.Begin(viewProjection);
+	parallelCuller.AddOccluder(positions, indices, identity);
+	parallelCuller.Finish(&jobSystem);
+	
+	for(int y = 0; y < HEIGHT; y++)
+	{
+		for(int x = 0; x < WIDTH; x++)
+		{
+			assert(culler.GetDepth(x, y) == parallelCuller.GetDepth(x, y));
+		}
+	}
+}
+
+void OcclusionCuller::Benchmark(int numOccluders)
+{
+	static const int NUM_ITERATIONS = 50;
+	static const int NUM_BOXES = 10000;
+	
+	Matrix4f viewProjection = Matrix4f().InitPerspective(ToRadians(70.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+	Matrix4f identity = Matrix4f().InitIdentity();
+	
+	//Walls scattered in front of the camera, like the rooms of an indoor level.
+	std::vector<Vector3f> positions;
+	std::vector<unsigned int> indices;
+	srand(19);
+	for(int i = 0; i < numOccluders; i++)
+	{
+		Vector3f corner((float)(rand() % 120 - 60), -5.0f, (float)(rand() % 100 + 5));
+		float width = (float)(rand() % 10 + 2);
+		
+		if(rand() % 2)
+			AddQuad(&positions, &indices, corner, corner + Vector3f(0, 10, 0), corner + Vector3f(width, 10, 0), corner + Vector3f(width, 0, 0));
+		else
+			AddQuad(&positions, &indices, corner, corner + Vector3f(0, 10, 0), corner + Vector3f(0, 10, width), corner + Vector3f(0, 0, width));
+	}
+	
+	std::vector<Vector3f> boxCenters;
+	for(int i = 0; i < NUM_BOXES; i++)
+	{
+		boxCenters.push_back(Vector3f((float)(rand() % 120 - 60), (float)(rand() % 10 - 5), (float)(rand() % 100 + 5)));
+	}
+	
+	OcclusionCuller culler;
+	JobSystem jobSystem;
+	ProfileTimer serialTimer;
+	ProfileTimer parallelTimer;
+	ProfileTimer testTimer;
+	int numOccluded = 0;
+	
+	for(int i = 0; i < NUM_ITERATIONS; i++)
+	{
+		serialTimer.StartInvocation();
+		culler.Begin(viewProjection);
+		culler.AddOccluder(positions, indices, identity);
+		culler.Finish();
+		serialTimer.StopInvocation();
+		
+		parallelTimer.StartInvocation();
+		culler.Begin(viewProjection);
+		culler.AddOccluder(positions, indices, identity);
+		culler.Finish(&jobSystem);
+		parallelTimer.StopInvocation();
+		
+		numOccluded = 0;
+		testTimer.StartInvocation();
+		for(int j = 0; j < NUM_BOXES; j++)
+		{
+			numOccluded += culler.IsAABBVisible(boxCenters[j], Vector3f(0.5f, 0.5f, 0.5f)) ? 0 : 1;
+		}
+		testTimer.StopInvocation();
+	}
+	
+	printf("Occlusion culling benchmark, %d walls:\n", numOccluders);
+	printf("OcclusionCuller, 1 thread:              %f ms\n", serialTimer.GetTimeAndReset());
+	printf("OcclusionCuller, %d threads:             %f ms\n", jobSystem.GetNumThreads(), parallelTimer.GetTimeAndReset());
+	printf("Testing %d boxes:                    %f ms\n", NUM_BOXES, testTimer.GetTimeAndReset());
+	printf("Boxes occluded:                         %d\n\n", numOccluded);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include "../core/math3d.h"
+#include <vector>
+class JobSystem;
+
+//Culls what's hidden behind large meshes on the CPU, before it reaches the render queue.
+//
+//A few large occluders are rasterized into a small depth buffer, which is then reduced
+//into a pyramid where each texel holds the farthest depth of the four below it. A box
+//is hidden if, at the level where its screen rectangle covers at most a few texels,
+//its nearest point is behind every texel it touches. Depths are NDC z, so nearer is
+//smaller and the buffer starts out at 1 everywhere.
+//
+//The screen is split into tiles, which each rasterize the triangles binned to them, so
+//they can be spread over a JobSystem. Rows are filled four pixels at a time with SIMD.
+//Nothing is read back from the GPU, so occluded packets never cost a draw call.
+class OcclusionCuller
+{
+public:
+	static const int WIDTH = 256;
+	static const int HEIGHT = 128;
+	static const int TILE_WIDTH = 64;  //Must be a multiple of 4
+	static const int TILE_HEIGHT = 32;
+	static const int NUM_TILES_X = WIDTH / TILE_WIDTH;
+	static const int NUM_TILES_Y = HEIGHT / TILE_HEIGHT;
+	static const int NUM_LEVELS = 9;   //Down to 1x1 from WIDTH
+	
+	OcclusionCuller();
+	
+	//Clears the depth buffer, and starts taking occluders for a camera with this view projection.
+	void Begin(const Matrix4f& viewProjection);
+	
+	//Sets up the mesh's triangles, which are drawn when Finish is called.
+	void AddOccluder(const std::vector<Vector3f>& positions, const std::vector<unsigned int>& indices, const Matrix4f& worldMatrix);
+	
+	//Rasterizes the occluders, on the jobSystem's threads if there is one, and builds the pyramid.
+	void Finish(JobSystem* jobSystem = 0);
+	
+	//Whether any of the box might be seen past the occluders. Boxes that reach in front
+	//of the near plane always can.
+	bool IsAABBVisible(const Vector3f& center, const Vector3f& extents) const;
+	
+	inline const Matrix4f& GetViewProjection() const { return m_viewProjection; }
+	inline int GetNumTriangles()               const { return (int)m_triangles.size(); }
+	
+	//The nearest occluder depth at a pixel, where y = 0 is the bottom of the screen.
+	inline float GetDepth(int x, int y)        const { return m_levels[0][y * WIDTH + x]; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+	/** Prints the time taken to rasterize numOccluders walls, on one thread and on a JobSystem, and to test boxes against them */
+	static void Benchmark(int numOccluders);
+protected:
+private:
+	//Edge functions are positive inside the triangle, and depth is a plane over the screen.
+	class Triangle
+	{
+	public:
+		float m_edgeA[3];
+		float m_edgeB[3];
+		float m_edgeC[3];
+		float m_depthA;
+		float m_depthB;
+		float m_depthC;
+		int   m_minX;
+		int   m_minY;
+		int   m_maxX;
+		int   m_maxY;
+	};
+	
+	Matrix4f                       m_viewProjection;
+	std::vector<Triangle>          m_triangles;
+	std::vector<int>               m_tileBins[NUM_TILES_X * NUM_TILES_Y];
+	std::vector<float>             m_levels[NUM_LEVELS];
+	std::vector<float>             m_clipPositions;   //The current occluder's vertices, four floats each
+	
+	//Takes vertices in screen space, with x and y in pixels and z as NDC depth.
+	void AddTriangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2);
+	void RasterizeTile(int tile);
+	void BuildPyramid();
+	
+	static void RasterizeTiles(void* data, int start, int end);
+	
+	inline int GetLevelWidth(int level)  const { return (WIDTH >> level) > 0 ? (WIDTH >> level) : 1; }
+	inline int GetLevelHeight(int level) const { return (HEIGHT >> level) > 0 ? (HEIGHT >> level) : 1; }
+};
+
+#endif // OCCLUSIONCULLER_H
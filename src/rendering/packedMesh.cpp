@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "packedMesh.h"
+#include "mesh.h"
+#include "../core/mappedFile.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+//Each buffer in a cache file starts on this many bytes, which also keeps them
+//aligned in memory since files are mapped at page boundaries.
+static const size_t CACHE_ALIGNMENT = 16;
+
+static const char CACHE_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+
+//The start of a cache file, followed by the vertex and index buffers.
+class PackedMeshHeader
+{
+public:
+	//Everything is zeroed, padding included, so the same mesh always saves the same bytes.
+	PackedMeshHeader() :
+		m_version(0),
+		m_sourceHash(0),
+		m_importFlags(0),
+		m_requestedFormatFlags(0),
+		m_formatFlags(0),
+		m_numVertices(0),
+		m_indexSize(0),
+		m_numLODs(0),
+		m_vertexDataSize(0),
+		m_indexDataSize(0),
+		m_numUnpackedBytes(0),
+		m_boundsRadius(0.0f),
+		m_padding(0)
+	{
+		for(int i = 0; i < 4; i++)
+		{
+			m_magic[i] = 0;
+		}
+		
+		for(int i = 0; i < 3; i++)
+		{
+			m_boundsCenter[i] = 0.0f;
+			m_boundsExtents[i] = 0.0f;
+		}
+	}
+	
+	char               m_magic[4];
+	unsigned int       m_version;
+	unsigned long long m_sourceHash;
+	unsigned int       m_importFlags;
+	int                m_requestedFormatFlags;
+	int                m_formatFlags;
+	unsigned int       m_numVertices;
+	unsigned int       m_indexSize;
+	unsigned int       m_numLODs;
+	unsigned long long m_vertexDataSize;
+	unsigned long long m_indexDataSize;
+	unsigned long long m_numUnpackedBytes;
+	float              m_boundsCenter[3];
+	float              m_boundsExtents[3];
+	float              m_boundsRadius;
+	unsigned int       m_padding;        //Spelled out so it gets zeroed too
+	PackedMesh::LOD    m_lods[IndexedModel::MAX_LODS];
+};
+
+static size_t AlignUp(size_t size, size_t alignment);
+static bool WritePadded(FILE* file, const void* data, size_t size, size_t alignment);
+
+PackedMesh::PackedMesh() :
+	m_requestedFormatFlags(0),
+	m_numVertices(0),
+	m_indexSize(sizeof(unsigned short)),
+	m_boundsCenter(0.0f, 0.0f, 0.0f),
+	m_boundsRadius(0.0f),
+	m_boundsExtents(0.0f, 0.0f, 0.0f),
+	m_numUnpackedBytes(0),
+	m_mappedVertexData(0),
+	m_mappedVertexDataSize(0),
+	m_mappedIndexData(0),
+	m_mappedIndexDataSize(0) {}
+
+void PackedMesh::Pack(const IndexedModel& model, int vertexFormatFlags)
+{
+	if(!model.IsValid())
+	{
+		std::cout << "Error: Invalid mesh! Must have same number of positions, texCoords, normals, and tangents! "
+			<< "(Maybe you forgot to Finalize() your IndexedModel?)" << std::endl;
+		assert(0 != 0);
+	}
+	
+	m_vertexFormat = VertexFormat::Choose(vertexFormatFlags, model.GetTexCoords());
+	m_requestedFormatFlags = vertexFormatFlags;
+	m_numVertices = model.GetPositions().size();
+	m_indexSize = m_numVertices <= MAX_SHORT_INDEX_VERTICES ? sizeof(unsigned short) : sizeof(unsigned int);
+	m_mappedVertexData = 0;
+	m_mappedIndexData = 0;
+	
+	m_vertexFormat.Pack(model.GetPositions(), model.GetTexCoords(), model.GetNormals(), model.GetTangents(), &m_vertexStorage);
+	
+	//Every level of detail shares one index buffer, one after the other.
+	std::vector<unsigned int> indices = model.GetIndices();
+	m_lods.clear();
+	m_lods.push_back(LOD(0, indices.size(), 0.0f));
+	
+	for(unsigned int i = 0; i < model.GetLODIndices().size(); i++)
+	{
+		const std::vector<unsigned int>& lodIndices = model.GetLODIndices()[i];
+		m_lods.push_back(LOD(indices.size() * m_indexSize, lodIndices.size(), model.GetLODErrors()[i]));
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+	}
+	
+	m_indexStorage.resize(indices.size() * m_indexSize);
+	for(unsigned int i = 0; i < indices.size(); i++)
+	{
+		if(m_indexSize == sizeof(unsigned short))
+		{
+			unsigned short index = (unsigned short)indices[i];
+			memcpy(&m_indexStorage[i * m_indexSize], &index, sizeof(index));
+		}
+		else
+		{
+			memcpy(&m_indexStorage[i * m_indexSize], &indices[i], sizeof(indices[i]));
+		}
+	}
+	
+	model.CalcBounds(&m_boundsCenter, &m_boundsExtents, &m_boundsRadius);
+	m_numUnpackedBytes = (unsigned long long)m_numVertices * VertexFormat::GetUnpackedStride() + 
+		model.GetIndices().size() * sizeof(unsigned int);
+}
+
+bool PackedMesh::Save(const std::string& fileName, unsigned long long sourceHash, unsigned int importFlags) const
+{
+	PackedMeshHeader header;
+	memcpy(header.m_magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.m_version = VERSION;
+	header.m_sourceHash = sourceHash;
+	header.m_importFlags = importFlags;
+	header.m_requestedFormatFlags = m_requestedFormatFlags;
+	header.m_formatFlags = m_vertexFormat.GetFlags();
+	header.m_numVertices = m_numVertices;
+	header.m_indexSize = m_indexSize;
+	header.m_numLODs = m_lods.size();
+	header.m_vertexDataSize = GetVertexDataSize();
+	header.m_indexDataSize = GetIndexDataSize();
+	header.m_numUnpackedBytes = m_numUnpackedBytes;
+	header.m_boundsRadius = m_boundsRadius;
+	
+	for(int i = 0; i < 3; i++)
+	{
+		header.m_boundsCenter[i] = m_boundsCenter[i];
+		header.m_boundsExtents[i] = m_boundsExtents[i];
+	}
+	
+	for(unsigned int i = 0; i < m_lods.size() && i < (unsigned int)IndexedModel::MAX_LODS; i++)
+	{
+		header.m_lods[i] = m_lods[i];
+	}
+	
+	FILE* file = fopen(fileName.c_str(), "wb");
+	if(!file)
+		return false;
+	
+	bool isWritten = WritePadded(file, &header, sizeof(header), CACHE_ALIGNMENT) &&
+	                 WritePadded(file, GetVertexData(), GetVertexDataSize(), CACHE_ALIGNMENT) &&
+	                 WritePadded(file, GetIndexData(), GetIndexDataSize(), 1);
+	
+	isWritten = fclose(file) == 0 && isWritten;
+	
+	//A partial file would fail to load anyway, but there's no use keeping it.
+	if(!isWritten)
+		remove(fileName.c_str());
+	
+	return isWritten;
+}
+
+bool PackedMesh::Load(const MappedFile& file, unsigned long long sourceHash, unsigned int importFlags, int vertexFormatFlags)
+{
+	PackedMeshHeader header;
+	if(file.GetSize() < sizeof(header))
+		return false;
+	
+	memcpy(&header, file.GetData(), sizeof(header));
+	
+	if(memcmp(header.m_magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.m_version != VERSION ||
+	   header.m_sourceHash != sourceHash || header.m_importFlags != importFlags || 
+	   header.m_requestedFormatFlags != vertexFormatFlags)
+	{
+		return false;
+	}
+	
+	//The driver might not support the format the cache was written in any more.
+	VertexFormat vertexFormat(header.m_formatFlags);
+	if(vertexFormat.GetFlags() != header.m_formatFlags)
+		return false;
+	
+	size_t vertexOffset = AlignUp(sizeof(header), CACHE_ALIGNMENT);
+	size_t indexOffset = vertexOffset + AlignUp((size_t)header.m_vertexDataSize, CACHE_ALIGNMENT);
+	
+	if(header.m_numLODs == 0 || header.m_numLODs > (unsigned int)IndexedModel::MAX_LODS ||
+	   (header.m_indexSize != sizeof(unsigned short) && header.m_indexSize != sizeof(unsigned int)) ||
+	   header.m_vertexDataSize != (unsigned long long)header.m_numVertices * vertexFormat.GetStride() ||
+	   indexOffset + header.m_indexDataSize > file.GetSize())
+	{
+		return false;
+	}
+	
+	for(unsigned int i = 0; i < header.m_numLODs; i++)
+	{
+		if(header.m_lods[i].m_offset + (unsigned long long)header.m_lods[i].m_count * header.m_indexSize > header.m_indexDataSize)
+			return false;
+	}
+	
+	m_vertexFormat = vertexFormat;
+	m_requestedFormatFlags = header.m_requestedFormatFlags;
+	m_numVertices = header.m_numVertices;
+	m_indexSize = header.m_indexSize;
+	m_lods.assign(header.m_lods, header.m_lods + header.m_numLODs);
+	m_boundsCenter = Vector3f(header.m_boundsCenter[0], header.m_boundsCenter[1], header.m_boundsCenter[2]);
+	m_boundsExtents = Vector3f(header.m_boundsExtents[0], header.m_boundsExtents[1], header.m_boundsExtents[2]);
+	m_boundsRadius = header.m_boundsRadius;
+	m_numUnpackedBytes = header.m_numUnpackedBytes;
+	
+	m_vertexStorage.clear();
+	m_indexStorage.clear();
+	m_mappedVertexData = file.GetData() + vertexOffset;
+	m_mappedVertexDataSize = (size_t)header.m_vertexDataSize;
+	m_mappedIndexData = file.GetData() + indexOffset;
+	m_mappedIndexDataSize = (size_t)header.m_indexDataSize;
+	
+	return true;
+}
+
+unsigned long long PackedMesh::Hash(const unsigned char* data, size_t size)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	
+	return hash;
+}
+
+void PackedMesh::Test()
+{
+	assert(Hash(0, 0) == 0xcbf29ce484222325ULL);
+	assert(Hash((const unsigned char*)"a", 1) == 0xaf63dc4c8601ec8cULL);
+	
+	//A quad with a coarser level that's just one of its triangles.
+	IndexedModel model;
+	model.AddVertex(0, 0, 0); model.AddVertex(1, 0, 0); model.AddVertex(0, 1, 0); model.AddVertex(1, 1, 0);
+	model.AddTexCoord(0, 0); model.AddTexCoord(1, 0); model.AddTexCoord(0, 1); model.AddTexCoord(1, 1);
+	model.AddFace(0, 1, 2);
+	model.AddFace(1, 3, 2);
+	model = model.Finalize();
+	
+	PackedMesh packedMesh;
+	packedMesh.Pack(model, VertexFormat::COMPACT);
+	assert(packedMesh.GetIndexSize() == sizeof(unsigned short));
+	assert(packedMesh.GetIndexDataSize() == 6 * sizeof(unsigned short));
+	assert(packedMesh.GetVertexDataSize() == 4 * (size_t)packedMesh.GetVertexFormat().GetStride());
+	assert(packedMesh.GetLODs().size() == 1 && packedMesh.GetLODs()[0].m_count == 6);
+	assert(packedMesh.GetBoundsCenter() == Vector3f(0.5f, 0.5f, 0.0f));
+	
+	const char* fileName = "packedMeshTest.tmp";
+	bool isSaved = packedMesh.Save(fileName, 1234, 5);
+	assert(isSaved);
+	
+	//Loading only checks the header, and points into the file.
+	MappedFile file;
+	bool isOpen = file.Open(fileName);
+	assert(isOpen);
+	
+	PackedMesh loadedMesh;
+	bool isLoaded = loadedMesh.Load(file, 1234, 5, VertexFormat::COMPACT);
+	assert(isLoaded);
+	assert(loadedMesh.GetVertexData() > file.GetData() && loadedMesh.GetIndexData() < file.GetData() + file.GetSize());
+	assert((size_t)loadedMesh.GetVertexData() % CACHE_ALIGNMENT == 0);
+	assert(loadedMesh.GetVertexFormat().GetFlags() == packedMesh.GetVertexFormat().GetFlags());
+	assert(loadedMesh.GetNumVertices() == 4 && loadedMesh.GetIndexSize() == sizeof(unsigned short));
+	assert(loadedMesh.GetVertexDataSize() == packedMesh.GetVertexDataSize());
+	assert(memcmp(loadedMesh.GetVertexData(), packedMesh.GetVertexData(), packedMesh.GetVertexDataSize()) == 0);
+	assert(loadedMesh.GetIndexDataSize() == packedMesh.GetIndexDataSize());
+	assert(memcmp(loadedMesh.GetIndexData(), packedMesh.GetIndexData(), packedMesh.GetIndexDataSize()) == 0);
+	assert(loadedMesh.GetLODs().size() == 1 && loadedMesh.GetLODs()[0].m_count == 6);
+	assert(loadedMesh.GetBoundsCenter() == packedMesh.GetBoundsCenter());
+	assert(loadedMesh.GetBoundsRadius() == packedMesh.GetBoundsRadius());
+	assert(loadedMesh.GetNumUnpackedBytes() == packedMesh.GetNumUnpackedBytes());
+	
+	//Any difference in the key means the cache is stale.
+	bool isHashStale = !loadedMesh.Load(file, 1235, 5, VertexFormat::COMPACT);
+	bool isFlagsStale = !loadedMesh.Load(file, 1234, 6, VertexFormat::COMPACT);
+	bool isFormatStale = !loadedMesh.Load(file, 1234, 5, 0);
+	assert(isHashStale && isFlagsStale && isFormatStale);
+	
+	//So does a file that was cut short.
+	std::vector<unsigned char> contents(file.GetData(), file.GetData() + file.GetSize());
+	file.Close();
+	
+	FILE* truncated = contents.size() > 2 ? fopen(fileName, "wb") : 0;
+	if(truncated)
+	{
+		fwrite(&contents[0], 1, contents.size() - 2, truncated);
+		fclose(truncated);
+		
+		isOpen = file.Open(fileName);
+		isLoaded = loadedMesh.Load(file, 1234, 5, VertexFormat::COMPACT);
+		assert(isOpen && !isLoaded);
+		file.Close();
+	}
+	
+	remove(fileName);
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static size_t AlignUp(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+static bool WritePadded(FILE* file, const void* data, size_t size, size_t alignment)
+{
+	static const unsigned char padding[CACHE_ALIGNMENT] = { 0 };
+	size_t paddingSize = AlignUp(size, alignment) - size;
+	
+	return (size == 0 || fwrite(data, 1, size, file) == size) && 
+	       (paddingSize == 0 || fwrite(padding, 1, paddingSize, file) == paddingSize);
+}
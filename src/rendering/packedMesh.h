@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PACKEDMESH_H
+#define PACKEDMESH_H
+
+#include "vertexFormat.h"
+#include <string>
+#include <vector>
+class IndexedModel;
+class MappedFile;
+
+//A mesh's vertex and index buffers exactly as they're uploaded, along with its
+//bounds and levels of detail.
+//
+//Packed meshes are saved in a binary cache next to the file they were imported
+//from, keyed by a hash of that file and the flags it was imported with. Loading one
+//maps the cache file and points straight into it, so its buffers are handed to GL
+//without being parsed or copied. The cache is laid out for the machine that wrote
+//it, and is rebuilt whenever the key, VERSION, or the vertex formats the driver
+//supports don't match.
+class PackedMesh
+{
+public:
+	//Bump whenever the file layout, or the import steps before packing, change.
+	static const unsigned int VERSION = 1;
+	
+	//Meshes with at most this many vertices use 16-bit indices.
+	static const unsigned int MAX_SHORT_INDEX_VERTICES = 65536;
+	
+	//A level of detail, as a range of the index buffer.
+	class LOD
+	{
+	public:
+		LOD() :
+			m_offset(0),
+			m_count(0),
+			m_error(0.0f) {}
+		LOD(unsigned long long offset, unsigned int count, float error) :
+			m_offset(offset),
+			m_count(count),
+			m_error(error) {}
+		
+		unsigned long long m_offset; //In bytes
+		unsigned int m_count;
+		float m_error;               //As a fraction of the bounding radius
+	};
+	
+	PackedMesh();
+	
+	//Packs the model in the most compact format the flags allow, with its indices as
+	//small as its vertex count allows.
+	void Pack(const IndexedModel& model, int vertexFormatFlags);
+	
+	bool Save(const std::string& fileName, unsigned long long sourceHash, unsigned int importFlags) const;
+	
+	//Returns false if the file isn't a cache for this key. The file must stay open for
+	//as long as this is used.
+	bool Load(const MappedFile& file, unsigned long long sourceHash, unsigned int importFlags, int vertexFormatFlags);
+	
+	inline const VertexFormat& GetVertexFormat() const { return m_vertexFormat; }
+	inline unsigned int GetNumVertices()         const { return m_numVertices; }
+	inline unsigned int GetIndexSize()           const { return m_indexSize; } //2 or 4 bytes
+	inline const std::vector<LOD>& GetLODs()     const { return m_lods; }
+	inline const Vector3f& GetBoundsCenter()     const { return m_boundsCenter; }
+	inline float GetBoundsRadius()               const { return m_boundsRadius; }
+	inline const Vector3f& GetBoundsExtents()    const { return m_boundsExtents; }
+	
+	//Bytes the mesh would take as separate float attributes with 32-bit indices.
+	inline unsigned long long GetNumUnpackedBytes() const { return m_numUnpackedBytes; }
+	
+	inline const unsigned char* GetVertexData()  const { return m_mappedVertexData ? m_mappedVertexData : (m_vertexStorage.empty() ? 0 : &m_vertexStorage[0]); }
+	inline const unsigned char* GetIndexData()   const { return m_mappedIndexData ? m_mappedIndexData : (m_indexStorage.empty() ? 0 : &m_indexStorage[0]); }
+	inline size_t GetVertexDataSize()            const { return m_mappedVertexData ? m_mappedVertexDataSize : m_vertexStorage.size(); }
+	inline size_t GetIndexDataSize()             const { return m_mappedIndexData ? m_mappedIndexDataSize : m_indexStorage.size(); }
+	
+	//64-bit FNV-1a, for keying caches by their source file.
+	static unsigned long long Hash(const unsigned char* data, size_t size);
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	VertexFormat               m_vertexFormat;
+	int                        m_requestedFormatFlags;
+	unsigned int               m_numVertices;
+	unsigned int               m_indexSize;
+	std::vector<LOD>           m_lods;
+	Vector3f                   m_boundsCenter;
+	float                      m_boundsRadius;
+	Vector3f                   m_boundsExtents;
+	unsigned long long         m_numUnpackedBytes;
+	
+	//Packed meshes own their buffers, and loaded ones point into the mapped file.
+	std::vector<unsigned char> m_vertexStorage;
+	std::vector<unsigned char> m_indexStorage;
+	const unsigned char*       m_mappedVertexData;
+	size_t                     m_mappedVertexDataSize;
+	const unsigned char*       m_mappedIndexData;
+	size_t                     m_mappedIndexDataSize;
+};
+
+#endif // PACKEDMESH_H
@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "renderQueue.h"
+#include "camera.h"
+#include "shader.h"
+#include "frustum.h"
+#include "boundingVolumeHierarchy.h"
+#include "occlusionCuller.h"
+#include "../core/entityComponent.h"
+#include "../core/profiling.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cstring>
+#include <cmath>
+
+//Bits of the sort key given to each field, from most to least significant.
+static const int MATERIAL_BITS = 20;
+static const int MESH_BITS = 18;
+static const int LOD_BITS = 2;
+static const int DEPTH_BITS = 24;
+
+//How much of the screen, in half screen heights, a level of detail's error may cover.
+//About a pixel at 1080p.
+static const float MAX_LOD_SCREEN_ERROR = 0.002f;
+
+//How far below the maximum error a coarser level must be before it's chosen.
+static const float LOD_HYSTERESIS = 0.25f;
+
+static inline int GetKeyLOD(unsigned long long sortKey)
+{
+	return (int)(sortKey >> DEPTH_BITS) & ((1 << LOD_BITS) - 1);
+}
+
+static bool IntersectsSphere(const RenderPacket& packet, const Vector3f& center, float radius)
+{
+	Vector3f closest = Vector3f(Vector3f(center.Max(packet.GetBoundsMin())).Min(packet.GetBoundsMax()));
+	return (closest - center).LengthSq() <= radius * radius;
+}
+
+void RenderPacket::UpdateBounds()
+{
+	const Matrix4f& worldMatrix = m_transform->GetTransformation();
+	const Vector3f& extents = m_mesh->GetBoundsExtents();
+	
+	m_boundsCenter = Vector3f(worldMatrix.Transform(m_mesh->GetBoundsCenter()));
+	
+	//The largest axis scale keeps the sphere conservative under non-uniform scaling.
+	float maxScale = 0.0f;
+	for(int i = 0; i < 3; i++)
+	{
+		float scale = Vector3f(worldMatrix[i][0], worldMatrix[i][1], worldMatrix[i][2]).Length();
+		maxScale = std::max(maxScale, scale);
+	}
+	
+	m_boundsRadius = m_mesh->GetBoundsRadius() * maxScale;
+	
+	//The box around the rotated and scaled box reaches as far on each world axis
+	//as the absolute values of that row of the matrix allow.
+	m_boundsExtents = Vector3f(
+		fabs(worldMatrix[0][0]) * extents.GetX() + fabs(worldMatrix[1][0]) * extents.GetY() + fabs(worldMatrix[2][0]) * extents.GetZ(),
+		fabs(worldMatrix[0][1]) * extents.GetX() + fabs(worldMatrix[1][1]) * extents.GetY() + fabs(worldMatrix[2][1]) * extents.GetZ(),
+		fabs(worldMatrix[0][2]) * extents.GetX() + fabs(worldMatrix[1][2]) * extents.GetY() + fabs(worldMatrix[2][2]) * extents.GetZ());
+}
+
+RenderQueue::~RenderQueue()
+{
+	if(m_instanceBuffer) glDeleteBuffers(1, &m_instanceBuffer);
+}
+
+void RenderQueue::Clear()
+{
+	//The vectors keep their memory, so a steady scene doesn't allocate here.
+	m_packets.clear();
+	m_components.clear();
+	m_centerX.clear();
+	m_centerY.clear();
+	m_centerZ.clear();
+	m_extentX.clear();
+	m_extentY.clear();
+	m_extentZ.clear();
+	
+	//The frame arena was reset since the last frame, so the view's vectors must let
+	//go of the memory they had rather than reuse it.
+	std::vector<KeyedPacket, FrameAllocator<KeyedPacket> >().swap(m_viewPackets);
+	std::vector<Matrix4f, FrameAllocator<Matrix4f> >().swap(m_instanceMatrices);
+	std::vector<RenderBatch, FrameAllocator<RenderBatch> >().swap(m_batches);
+	m_isViewValid = false;
+	m_numDrawCalls = 0;
+	m_numTriangles = 0;
+	m_numVisible = 0;
+	m_numCulled = 0;
+	m_numOccluded = 0;
+}
+
+void RenderQueue::AddMesh(const Mesh& mesh, const Material& material, const Transform& transform)
+{
+	m_packets.push_back(RenderPacket(mesh, material, transform));
+	
+	RenderPacket& packet = m_packets.back();
+	packet.UpdateBounds();
+	
+	m_centerX.push_back(packet.GetBoundsCenter().GetX());
+	m_centerY.push_back(packet.GetBoundsCenter().GetY());
+	m_centerZ.push_back(packet.GetBoundsCenter().GetZ());
+	m_extentX.push_back(packet.GetBoundsExtents().GetX());
+	m_extentY.push_back(packet.GetBoundsExtents().GetY());
+	m_extentZ.push_back(packet.GetBoundsExtents().GetZ());
+}
+
+void RenderQueue::AddComponent(const EntityComponent& component)
+{
+	m_components.push_back(&component);
+}
+
+void RenderQueue::SetView(const Camera& camera, bool useNearPlane, bool hasSphere, const Vector3f& sphereCenter, float sphereRadius, 
+                          int lodBias)
+{
+	Matrix4f viewProjection = camera.GetViewProjection();
+	
+	if(m_isViewValid && m_viewUsesNearPlane == useNearPlane && m_viewHasSphere == hasSphere && m_viewLODBias == lodBias &&
+	   (!hasSphere || (m_viewSphereCenter == sphereCenter && m_viewSphereRadius == sphereRadius)) &&
+	   memcmp(&viewProjection, &m_viewProjection, sizeof(Matrix4f)) == 0)
+	{
+		return;
+	}
+	
+	m_viewProjection = viewProjection;
+	m_viewUsesNearPlane = useNearPlane;
+	m_viewHasSphere = hasSphere;
+	m_viewSphereCenter = sphereCenter;
+	m_viewSphereRadius = sphereRadius;
+	m_viewLODBias = lodBias;
+	m_isViewValid = true;
+	
+	Vector3f eyePos = camera.GetTransform().GetTransformedPos();
+	const Camera& lodCamera = m_lodCamera ? *m_lodCamera : camera;
+	m_viewLODEyePos = lodCamera.GetTransform().GetTransformedPos();
+	m_viewLODScale = lodCamera.GetProjection()[1][1];
+	int numPackets = (int)m_packets.size();
+	m_visible.resize(numPackets);
+	m_treeResults.clear();
+	m_viewPackets.clear();
+	m_numViewOccluded = 0;
+	
+	//The occlusion culler's depths are only meaningful from the camera they were rasterized from.
+	const OcclusionCuller* occlusionCuller = 0;
+	#if PROFILING_DISABLE_OCCLUSION_CULLING == 0
+		if(m_occlusionCuller && memcmp(&viewProjection, &m_occlusionCuller->GetViewProjection(), sizeof(Matrix4f)) == 0)
+		{
+			occlusionCuller = m_occlusionCuller;
+		}
+	#endif
+	
+	#if PROFILING_DISABLE_FRUSTUM_CULLING == 0
+		Frustum frustum(viewProjection, useNearPlane);
+		if(numPackets != 0)
+		{
+			frustum.CullAABBs(&m_centerX[0], &m_centerY[0], &m_centerZ[0], 
+				&m_extentX[0], &m_extentY[0], &m_extentZ[0], numPackets, &m_visible[0]);
+		}
+		
+		//A small sphere finds far fewer packets in the tree than the frustum does, so
+		//it's queried first and its results are checked against the frustum after.
+		if(m_sceneTree && hasSphere)
+		{
+			m_sceneTree->QuerySphere(sphereCenter, sphereRadius, &m_treeResults);
+			
+			int numResults = 0;
+			for(unsigned int i = 0; i < m_treeResults.size(); i++)
+			{
+				const RenderPacket& packet = *(const RenderPacket*)m_treeResults[i];
+				
+				if(frustum.IntersectsAABB(packet.GetBoundsCenter(), packet.GetBoundsExtents()))
+				{
+					m_treeResults[numResults++] = m_treeResults[i];
+				}
+			}
+			
+			m_treeResults.resize(numResults);
+		}
+		else if(m_sceneTree)
+		{
+			m_sceneTree->QueryFrustum(frustum, &m_treeResults);
+		}
+	#else
+		std::fill(m_visible.begin(), m_visible.end(), 1);
+		
+		if(m_sceneTree)
+		{
+			m_sceneTree->QueryAll(&m_treeResults);
+		}
+	#endif
+	
+	for(int i = 0; i < numPackets; i++)
+	{
+		if(m_visible[i] && (!hasSphere || IntersectsSphere(m_packets[i], sphereCenter, sphereRadius)))
+		{
+			AddToView(m_packets[i], eyePos, occlusionCuller);
+		}
+	}
+	
+	//Tree leaves are enlarged, so packets the tree finds can still be just outside the sphere.
+	for(unsigned int i = 0; i < m_treeResults.size(); i++)
+	{
+		const RenderPacket& packet = *(const RenderPacket*)m_treeResults[i];
+		
+		if(!hasSphere || IntersectsSphere(packet, sphereCenter, sphereRadius))
+		{
+			AddToView(packet, eyePos, occlusionCuller);
+		}
+	}
+	
+	std::sort(m_viewPackets.begin(), m_viewPackets.end());
+	m_numViewVisible = (int)m_viewPackets.size();
+	
+	m_instanceMatrices.clear();
+	m_batches.clear();
+	
+	for(int i = 0; i < m_numViewVisible; i++)
+	{
+		const RenderPacket& packet = *m_viewPackets[i].second;
+		
+		//The sort key keeps packets with the same material and mesh together.
+		AddToBatches(&m_batches, i, packet.GetMaterial().GetId(), packet.GetMesh().GetId(), GetKeyLOD(m_viewPackets[i].first));
+		m_instanceMatrices.push_back(packet.GetWorldMatrix());
+	}
+	
+	if(m_instanceMatrices.empty())
+		return;
+	
+	if(m_instanceBuffer == 0)
+		glGenBuffers(1, &m_instanceBuffer);
+	
+	//Respecifying the whole buffer lets the driver hand back fresh memory instead
+	//of waiting on draws from earlier passes that still read the old matrices.
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_instanceMatrices.size() * sizeof(Matrix4f), &m_instanceMatrices[0], GL_STREAM_DRAW);
+}
+
+void RenderQueue::AddToView(const RenderPacket& packet, const Vector3f& eyePos, const OcclusionCuller* occlusionCuller)
+{
+	if(occlusionCuller && !occlusionCuller->IsAABBVisible(packet.GetBoundsCenter(), packet.GetBoundsExtents()))
+	{
+		m_numViewOccluded++;
+		return;
+	}
+	
+	float distance = (packet.GetBoundsCenter() - eyePos).Length();
+	unsigned long long sortKey = CalcSortKey(packet.GetMaterial().GetId(), packet.GetMesh().GetId(), SelectLOD(packet), distance);
+	
+	m_viewPackets.push_back(std::make_pair(sortKey, &packet));
+}
+
+unsigned long long RenderQueue::CalcSortKey(int materialId, int meshId, int lod, float distance)
+{
+	//Non-negative floats sort the same way as their bit patterns, so the top
+	//bits of the distance make a usable fixed point depth.
+	unsigned int distanceBits;
+	memcpy(&distanceBits, &distance, sizeof(distanceBits));
+	
+	unsigned long long materialField = (unsigned long long)materialId & ((1 << MATERIAL_BITS) - 1);
+	unsigned long long meshField = (unsigned long long)meshId & ((1 << MESH_BITS) - 1);
+	unsigned long long lodField = (unsigned long long)lod & ((1 << LOD_BITS) - 1);
+	unsigned long long depthField = distanceBits >> (32 - DEPTH_BITS);
+	
+	return (materialField << (MESH_BITS + LOD_BITS + DEPTH_BITS)) | (meshField << (LOD_BITS + DEPTH_BITS)) | 
+		(lodField << DEPTH_BITS) | depthField;
+}
+
+void RenderQueue::AddToBatches(BatchList* batches, int instance, int materialId, int meshId, int lod)
+{
+	//The full ids are compared, since ones that were truncated in the key can sort next to each other.
+	if(!batches->empty() && batches->back().CanAdd(materialId, meshId, lod))
+	{
+		batches->back().AddInstance();
+	}
+	else
+	{
+		batches->push_back(RenderBatch(instance, 1, materialId, meshId, lod));
+	}
+}
+
+int RenderQueue::SelectLOD(const RenderPacket& packet) const
+{
+	const Mesh& mesh = packet.GetMesh();
+	int numLODs = std::min(mesh.GetNumLODs(), 1 << LOD_BITS);
+	int lod = std::min(packet.GetLOD(), numLODs - 1);
+	
+	#if PROFILING_DISABLE_MESH_LODS == 0
+		//The error is relative to the bounding radius, so this is how large one unit of it looks.
+		float distance = std::max((packet.GetBoundsCenter() - m_viewLODEyePos).Length(), packet.GetBoundsRadius());
+		float screenSize = packet.GetBoundsRadius() * m_viewLODScale / distance;
+		
+		while(lod > 0 && mesh.GetLODError(lod) * screenSize > MAX_LOD_SCREEN_ERROR)
+		{
+			lod--;
+		}
+		
+		while(lod + 1 < numLODs && mesh.GetLODError(lod + 1) * screenSize <= MAX_LOD_SCREEN_ERROR * (1.0f - LOD_HYSTERESIS))
+		{
+			lod++;
+		}
+	#else
+		lod = 0;
+	#endif
+	
+	packet.SetLOD(lod);
+	return std::min(lod + m_viewLODBias, numLODs - 1);
+}
+
+void RenderQueue::Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera, bool isDepthClamped, 
+                         int lodBias)
+{
+	SetView(camera, !isDepthClamped, false, Vector3f(0.0f, 0.0f, 0.0f), 0.0f, lodBias);
+	Draw(shader, renderingEngine, camera);
+}
+
+void RenderQueue::RenderInSphere(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera, 
+                                 const Vector3f& center, float radius)
+{
+	SetView(camera, true, true, center, radius, 0);
+	Draw(shader, renderingEngine, camera);
+}
+
+void RenderQueue::Draw(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera)
+{
+	int numPackets = (int)m_packets.size() + (m_sceneTree ? m_sceneTree->GetNumLeaves() : 0);
+	m_numVisible += m_numViewVisible;
+	m_numCulled += numPackets - m_numViewVisible;
+	m_numOccluded += m_numViewOccluded;
+	
+	#if PROFILING_DISABLE_INSTANCING == 0
+	const Shader& instancedShader = shader.GetInstancedShader();
+	
+	if(instancedShader.IsInstanced())
+	{
+		instancedShader.Bind();
+		
+		for(unsigned int i = 0; i < m_batches.size(); i++)
+		{
+			const RenderBatch& batch = m_batches[i];
+			const RenderPacket& packet = *m_viewPackets[batch.GetFirstInstance()].second;
+			int lod = batch.GetLOD();
+			
+			//Only the world matrix differs within a batch, and that comes from the instance buffer.
+			instancedShader.UpdateUniforms(packet.GetTransform(), packet.GetMaterial(), renderingEngine, camera);
+			packet.GetMesh().DrawInstanced(m_instanceBuffer, batch.GetFirstInstance(), batch.GetNumInstances(), lod);
+			m_numDrawCalls++;
+			m_numTriangles += packet.GetMesh().GetNumTriangles(lod) * batch.GetNumInstances();
+		}
+	}
+	else
+	#endif
+	{
+		shader.Bind();
+		
+		for(unsigned int i = 0; i < m_viewPackets.size(); i++)
+		{
+			const RenderPacket& packet = *m_viewPackets[i].second;
+			int lod = GetKeyLOD(m_viewPackets[i].first);
+			
+			shader.UpdateUniforms(packet.GetTransform(), packet.GetMaterial(), renderingEngine, camera);
+			packet.GetMesh().Draw(lod);
+			m_numDrawCalls++;
+			m_numTriangles += packet.GetMesh().GetNumTriangles(lod);
+		}
+	}
+	
+	for(unsigned int i = 0; i < m_components.size(); i++)
+	{
+		m_components[i]->Render(shader, renderingEngine, camera);
+	}
+}
+
+void RenderQueue::Test()
+{
+	//Each field lands in its own slot.
+	unsigned long long key = CalcSortKey(5, 7, 3, 0.0f);
+	assert((key >> (MESH_BITS + LOD_BITS + DEPTH_BITS)) == 5);
+	assert(((key >> (LOD_BITS + DEPTH_BITS)) & ((1 << MESH_BITS) - 1)) == 7);
+	assert(GetKeyLOD(key) == 3);
+	assert((key & ((1 << DEPTH_BITS) - 1)) == 0);
+	
+	//Values too wide for their field are truncated instead of spilling into the next one.
+	assert(CalcSortKey((1 << MATERIAL_BITS) + 5, (1 << MESH_BITS) + 7, (1 << LOD_BITS) + 3, 0.0f) == key);
+	assert((CalcSortKey(0, 0, 0, FLT_MAX) >> DEPTH_BITS) == 0);
+	assert((CalcSortKey((1 << MATERIAL_BITS) - 1, 0, 0, 0.0f) >> (MESH_BITS + LOD_BITS + DEPTH_BITS)) == (1 << MATERIAL_BITS) - 1);
+	
+	//Within a material and mesh, nearer packets sort first.
+	float distances[] = { 0.0f, 0.05f, 0.5f, 1.0f, 2.0f, 10.0f, 100.0f, 1000.0f };
+	for(unsigned int i = 1; i < sizeof(distances) / sizeof(distances[0]); i++)
+	{
+		assert(CalcSortKey(3, 4, 1, distances[i - 1]) < CalcSortKey(3, 4, 1, distances[i]));
+	}
+	
+	//But material comes before mesh, and mesh before depth.
+	assert(CalcSortKey(1, 9, 0, 1000.0f) < CalcSortKey(2, 0, 0, 1.0f));
+	assert(CalcSortKey(1, 1, 0, 1000.0f) < CalcSortKey(1, 2, 0, 1.0f));
+	
+	//Consecutive instances with the same material, mesh and level of detail share a batch.
+	//Ones that only matched after truncation don't.
+	int instances[][3] = 
+	{ 
+		{ 1, 1, 0 }, { 1, 1, 0 }, { 1, 1, 0 }, { 1, 2, 0 }, { 1, 2, 1 }, 
+		{ 2, 2, 1 }, { 2, 2, 1 }, { 1, 1, 0 }, { (1 << MATERIAL_BITS) + 1, 1, 0 } 
+	};
+	
+	BatchList batches;
+	for(int i = 0; i < (int)(sizeof(instances) / sizeof(instances[0])); i++)
+	{
+		AddToBatches(&batches, i, instances[i][0], instances[i][1], instances[i][2]);
+	}
+	
+	int firstInstances[] = { 0, 3, 4, 5, 7, 8 };
+	int numInstances[] = { 3, 1, 1, 2, 1, 1 };
+	
+	assert(batches.size() == 6);
+	for(unsigned int i = 0; i < batches.size(); i++)
+	{
+		assert(batches[i].GetFirstInstance() == firstInstances[i]);
+		assert(batches[i].GetNumInstances() == numInstances[i]);
+	}
+	
+	assert(batches[2].GetLOD() == 1);
+}
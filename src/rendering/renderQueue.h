@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "mesh.h"
+#include "material.h"
+#include "../core/transform.h"
+#include "../core/frameArena.h"
+#include <utility>
+#include <vector>
+class BoundingVolumeHierarchy;
+class Camera;
+class EntityComponent;
+class OcclusionCuller;
+class RenderingEngine;
+class Shader;
+
+//Everything needed to draw one mesh, along with its bounds in world space.
+class RenderPacket
+{
+public:
+	RenderPacket() :
+		m_mesh(0),
+		m_material(0),
+		m_transform(0),
+		m_boundsCenter(0.0f, 0.0f, 0.0f),
+		m_boundsRadius(0.0f),
+		m_boundsExtents(0.0f, 0.0f, 0.0f),
+		m_sceneTreeHandle(-1),
+		m_lod(0) {}
+	RenderPacket(const Mesh& mesh, const Material& material, const Transform& transform) :
+		m_mesh(&mesh),
+		m_material(&material),
+		m_transform(&transform),
+		m_boundsCenter(0.0f, 0.0f, 0.0f),
+		m_boundsRadius(0.0f),
+		m_boundsExtents(0.0f, 0.0f, 0.0f),
+		m_sceneTreeHandle(-1),
+		m_lod(0) {}
+	
+	//Recalculates the world bounds from the mesh's bounds and the current world matrix.
+	void UpdateBounds();
+	
+	inline const Mesh& GetMesh()               const { return *m_mesh; }
+	inline const Material& GetMaterial()       const { return *m_material; }
+	inline const Transform& GetTransform()     const { return *m_transform; }
+	inline const Matrix4f& GetWorldMatrix()    const { return m_transform->GetTransformation(); }
+	inline const Vector3f& GetBoundsCenter()   const { return m_boundsCenter; }
+	inline float GetBoundsRadius()             const { return m_boundsRadius; }
+	inline const Vector3f& GetBoundsExtents()  const { return m_boundsExtents; }
+	inline Vector3f GetBoundsMin()             const { return m_boundsCenter - m_boundsExtents; }
+	inline Vector3f GetBoundsMax()             const { return m_boundsCenter + m_boundsExtents; }
+	
+	//The packet's handle in the RenderingEngine's scene tree, or -1 if it isn't in one.
+	inline int GetSceneTreeHandle()            const { return m_sceneTreeHandle; }
+	inline void SetSceneTreeHandle(int handle)       { m_sceneTreeHandle = handle; }
+	
+	//The level of detail last chosen for the mesh, which the next choice starts from.
+	inline int GetLOD()                        const { return m_lod; }
+	inline void SetLOD(int lod)                const { m_lod = lod; }
+private:
+	const Mesh*        m_mesh;
+	const Material*    m_material;
+	const Transform*   m_transform;
+	Vector3f           m_boundsCenter;  //Shared by the bounding sphere and box
+	float              m_boundsRadius;
+	Vector3f           m_boundsExtents; //Half the size of the bounding box on each axis
+	int                m_sceneTreeHandle;
+	mutable int        m_lod;           //Only remembered so choices don't flicker
+};
+
+//A run of visible packets that share a mesh, material and level of detail, and so
+//can be drawn with a single instanced draw call.
+class RenderBatch
+{
+public:
+	RenderBatch(int firstInstance, int numInstances, int materialId, int meshId, int lod) :
+		m_firstInstance(firstInstance),
+		m_numInstances(numInstances),
+		m_materialId(materialId),
+		m_meshId(meshId),
+		m_lod(lod) {}
+	
+	inline int GetFirstInstance() const { return m_firstInstance; }
+	inline int GetNumInstances()  const { return m_numInstances; }
+	inline int GetLOD()           const { return m_lod; }
+	
+	inline bool CanAdd(int materialId, int meshId, int lod) const { return materialId == m_materialId && meshId == m_meshId && lod == m_lod; }
+	inline void AddInstance() { m_numInstances++; }
+private:
+	int m_firstInstance;
+	int m_numInstances;
+	int m_materialId;
+	int m_meshId;
+	int m_lod;
+};
+
+//The RenderQueue collects what the scene draws once per frame, so every render
+//pass can draw from the same list instead of walking the Entity tree again.
+//
+//Most meshes live in the RenderingEngine's scene tree rather than being added each
+//frame. Each pass queries the tree with its camera's frustum, or with the sphere a
+//light reaches, so its cost follows what it can see. Meshes added with AddMesh are
+//culled one by one.
+//
+//What a view can see is sorted by material (and so by textures), then by mesh, then
+//front to back from that view's camera. Shaders aren't part of the key because each
+//pass draws everything with a single shader. The world matrices of the sorted packets
+//go into one instance buffer, and packets sharing a mesh and material are batched.
+//Passes whose shader has an instanced build then draw each batch with one call.
+//Consecutive passes from the same camera reuse the result.
+//
+//Views from the same camera as the OcclusionCuller, if one is set, also skip packets
+//it finds hidden behind its occluders.
+//
+//Each packet's level of detail is the coarsest whose error covers less than
+//MAX_LOD_SCREEN_ERROR of the screen, seen from the LOD camera. A packet only moves
+//to a coarser level once it's comfortably below that, so it doesn't flicker between
+//two levels at the boundary. Passes can ask for levels coarser than that, such as
+//shadow maps, where the detail is rarely noticed.
+//
+//Components that draw something other than a single mesh are queued as they are,
+//and have their Render function called in every pass after the packets are drawn.
+class RenderQueue
+{
+public:
+	RenderQueue() :
+		m_sceneTree(0),
+		m_occlusionCuller(0),
+		m_instanceBuffer(0),
+		m_isViewValid(false),
+		m_viewUsesNearPlane(false),
+		m_viewHasSphere(false),
+		m_viewSphereCenter(0.0f, 0.0f, 0.0f),
+		m_viewSphereRadius(0.0f),
+		m_lodCamera(0),
+		m_viewLODBias(0),
+		m_viewLODEyePos(0.0f, 0.0f, 0.0f),
+		m_viewLODScale(0.0f),
+		m_numViewVisible(0),
+		m_numViewOccluded(0),
+		m_numDrawCalls(0),
+		m_numTriangles(0),
+		m_numVisible(0),
+		m_numCulled(0),
+		m_numOccluded(0) {}
+	virtual ~RenderQueue();
+	
+	void Clear();
+	void AddMesh(const Mesh& mesh, const Material& material, const Transform& transform);
+	void AddComponent(const EntityComponent& component);
+	
+	//The tree's user data must be RenderPackets.
+	inline void SetSceneTree(const BoundingVolumeHierarchy* sceneTree) { m_sceneTree = sceneTree; }
+	
+	//The culler must have finished for this frame before anything is rendered, or be 0.
+	inline void SetOcclusionCuller(const OcclusionCuller* occlusionCuller) { m_occlusionCuller = occlusionCuller; m_isViewValid = false; }
+	
+	//Levels of detail are chosen from this camera, usually the main one, in every pass.
+	//Without one, each pass uses its own camera.
+	inline void SetLODCamera(const Camera* camera) { m_lodCamera = camera; m_isViewValid = false; }
+	
+	//Passes that clamp depth still draw objects in front of the near plane, so they
+	//aren't culled against it. Meshes are drawn lodBias levels coarser than usual.
+	void Render(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera, bool isDepthClamped = false, 
+	            int lodBias = 0);
+	
+	//Only draws packets that touch the sphere as well as the camera's frustum, for
+	//passes such as lights that can't affect anything outside it.
+	void RenderInSphere(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera, 
+	                    const Vector3f& center, float radius);
+	
+	//Whether anything was added this frame rather than coming from the scene tree.
+	inline bool HasUntrackedContent()              const { return !m_packets.empty() || !m_components.empty(); }
+	
+	//Totals over every pass since the last Clear.
+	inline int GetNumDrawCalls()                   const { return m_numDrawCalls; }
+	inline int GetNumTriangles()                   const { return m_numTriangles; }
+	inline int GetNumVisible()                     const { return m_numVisible; }
+	inline int GetNumCulled()                      const { return m_numCulled; }
+	inline int GetNumOccluded()                    const { return m_numOccluded; } //Included in GetNumCulled
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	std::vector<RenderPacket>           m_packets;
+	std::vector<const EntityComponent*> m_components;
+	const BoundingVolumeHierarchy*      m_sceneTree;
+	const OcclusionCuller*              m_occlusionCuller;
+	
+	//World bounds of the added packets, one array per axis so they can be culled with SIMD.
+	std::vector<float>                  m_centerX;
+	std::vector<float>                  m_centerY;
+	std::vector<float>                  m_centerZ;
+	std::vector<float>                  m_extentX;
+	std::vector<float>                  m_extentY;
+	std::vector<float>                  m_extentZ;
+	std::vector<unsigned char>          m_visible;
+	
+	//What the current view draws, sorted, with each packet's sort key. All but the
+	//tree results live in the frame arena, and are started over by Clear every frame.
+	typedef std::pair<unsigned long long, const RenderPacket*> KeyedPacket;
+	typedef std::vector<RenderBatch, FrameAllocator<RenderBatch> > BatchList;
+	std::vector<void*>                                     m_treeResults;
+	std::vector<KeyedPacket, FrameAllocator<KeyedPacket> > m_viewPackets;
+	std::vector<Matrix4f, FrameAllocator<Matrix4f> >       m_instanceMatrices;
+	BatchList                                              m_batches;
+	GLuint                              m_instanceBuffer;
+	
+	Matrix4f                            m_viewProjection;
+	bool                                m_isViewValid;
+	bool                                m_viewUsesNearPlane;
+	bool                                m_viewHasSphere;
+	Vector3f                            m_viewSphereCenter;
+	float                               m_viewSphereRadius;
+	const Camera*                       m_lodCamera;
+	int                                 m_viewLODBias;
+	Vector3f                            m_viewLODEyePos;
+	float                               m_viewLODScale;  //Converts world sizes at distance 1 into half screen heights
+	int                                 m_numViewVisible;
+	int                                 m_numViewOccluded;
+	
+	int                                 m_numDrawCalls;
+	int                                 m_numTriangles;
+	int                                 m_numVisible;
+	int                                 m_numCulled;
+	int                                 m_numOccluded;
+	
+	void SetView(const Camera& camera, bool useNearPlane, bool hasSphere, const Vector3f& sphereCenter, float sphereRadius, 
+	             int lodBias);
+	void Draw(const Shader& shader, const RenderingEngine& renderingEngine, const Camera& camera);
+	void AddToView(const RenderPacket& packet, const Vector3f& eyePos, const OcclusionCuller* occlusionCuller);
+	int SelectLOD(const RenderPacket& packet) const;
+	
+	//Packs the ids, level of detail and distance from the camera into a key that sorts
+	//by material, then mesh, then level of detail, then front to back. Ids wider than
+	//their field are truncated, so they can share a key with another id.
+	static unsigned long long CalcSortKey(int materialId, int meshId, int lod, float distance);
+	
+	//Adds the next sorted instance to the last batch if it can be drawn with it, or starts a new one.
+	static void AddToBatches(BatchList* batches, int instance, int materialId, int meshId, int lod);
+	
+	RenderQueue(const RenderQueue& other) {}
+	void operator=(const RenderQueue& other) {}
+};
+
+#endif // RENDERQUEUE_H
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "renderTargetPool.h"
+
+#include <cassert>
+
+Texture RenderTargetPool::Acquire(int width, int height, GLenum internalFormat, GLenum format, GLfloat filter)
+{
+	for(unsigned int i = 0; i < m_entries.size(); i++)
+	{
+		Entry& entry = m_entries[i];
+		
+		if(!entry.m_isAcquired && entry.m_target.GetWidth() == width && entry.m_target.GetHeight() == height &&
+			entry.m_internalFormat == internalFormat && entry.m_format == format && entry.m_filter == filter)
+		{
+			entry.m_isAcquired = true;
+			return entry.m_target;
+		}
+	}
+	
+	Texture target(width, height, 0, GL_TEXTURE_2D, filter, internalFormat, format, true, GL_COLOR_ATTACHMENT0);
+	m_entries.push_back(Entry(target, internalFormat, format, filter));
+	return target;
+}
+
+void RenderTargetPool::Release(const Texture& target)
+{
+	for(unsigned int i = 0; i < m_entries.size(); i++)
+	{
+		if(m_entries[i].m_target == target)
+		{
+			assert(m_entries[i].m_isAcquired);
+			m_entries[i].m_isAcquired = false;
+			return;
+		}
+	}
+	
+	assert(false);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef RENDERTARGETPOOL_H
+#define RENDERTARGETPOOL_H
+
+#include "texture.h"
+#include <vector>
+
+//Render targets that are only needed for part of a frame, such as the intermediate
+//targets of a blur. Each is made the first time one of its size and format is asked
+//for, and is handed out again to later passes once it's released.
+class RenderTargetPool
+{
+public:
+	RenderTargetPool() {}
+	
+	//A target nothing else has acquired, which has to be released once it's drawn from.
+	//Its contents are whatever the last pass to use it left behind.
+	Texture Acquire(int width, int height, GLenum internalFormat, GLenum format, GLfloat filter = GL_LINEAR);
+	void Release(const Texture& target);
+	
+	inline int GetNumTargets() const { return (int)m_entries.size(); }
+protected:
+private:
+	class Entry
+	{
+	public:
+		Entry(const Texture& target, GLenum internalFormat, GLenum format, GLfloat filter) :
+			m_target(target),
+			m_internalFormat(internalFormat),
+			m_format(format),
+			m_filter(filter),
+			m_isAcquired(true) {}
+		
+		Texture m_target;
+		GLenum  m_internalFormat;
+		GLenum  m_format;
+		GLfloat m_filter;
+		bool    m_isAcquired;
+	};
+	
+	std::vector<Entry> m_entries;
+	
+	RenderTargetPool(const RenderTargetPool& other) {}
+	void operator=(const RenderTargetPool& other) {}
+};
+
+#endif // RENDERTARGETPOOL_H
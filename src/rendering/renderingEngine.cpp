@@ -18,11 +18,16 @@
 #include "window.h"
 #include "mesh.h"
 #include "shader.h"
+#include "glState.h"
+#include "frustum.h"
 
 #include "../core/entity.h"
 
 #include <GL/glew.h>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <functional>
 
 const Matrix4f RenderingEngine::BIAS_MATRIX = Matrix4f().InitScale(Vector3f(0.5, 0.5, 0.5)) * Matrix4f().InitTranslation(Vector3f(1.0, 1.0, 1.0));
 //Should construct a Matrix like this:
@@ -37,23 +42,125 @@ const Matrix4f RenderingEngine::BIAS_MATRIX = Matrix4f().InitScale(Vector3f(0.5,
 //
 //This matrix will convert 3D coordinates from the range (-1, 1) to the range (0, 1).
 
-RenderingEngine::RenderingEngine(const Window& window) :
+//Ids of the values the engine sets or reads itself every frame.
+static const int DISPLAY_TEXTURE = PropertyTable::GetId("displayTexture");
+static const int FILTER_TEXTURE = PropertyTable::GetId("filterTexture");
+static const int SHADOW_MAP = PropertyTable::GetId("shadowMap");
+static const int SHADOW_MAP_REGION = PropertyTable::GetId("shadowMapRegion");
+static const int BLUR_SCALE = PropertyTable::GetId("blurScale");
+static const int SHADOW_VARIANCE_MIN = PropertyTable::GetId("shadowVarianceMin");
+static const int SHADOW_LIGHT_BLEEDING_REDUCTION = PropertyTable::GetId("shadowLightBleedingReduction");
+static const int FILTER_LAYER = PropertyTable::GetId("filterLayer");
+static const int FXAA_ASPECT_DISTORTION = PropertyTable::GetId("fxaaAspectDistortion");
+static const int INVERSE_FILTER_TEXTURE_SIZE = PropertyTable::GetId("inverseFilterTextureSize");
+static const int CLUSTER_LIGHTS = PropertyTable::GetId("clusterLights");
+static const int CLUSTER_DATA = PropertyTable::GetId("clusterData");
+static const int CLUSTER_GRID = PropertyTable::GetId("clusterGrid");
+static const int CLUSTER_DEPTH = PropertyTable::GetId("clusterDepth");
+static const int CLUSTER_SCREEN = PropertyTable::GetId("clusterScreen");
+static const int CLUSTER_VIEW_FORWARD = PropertyTable::GetId("clusterViewForward");
+static const int DEFERRED_EYE_POS = PropertyTable::GetId("deferredEyePos");
+static const int DEFERRED_VIEW_RIGHT = PropertyTable::GetId("deferredViewRight");
+static const int DEFERRED_VIEW_UP = PropertyTable::GetId("deferredViewUp");
+static const int DEFERRED_VIEW_FORWARD = PropertyTable::GetId("deferredViewForward");
+static const int DEFERRED_DEPTH = PropertyTable::GetId("deferredDepth");
+static const int DEFERRED_VOLUME_SPREAD = PropertyTable::GetId("deferredVolumeSpread");
+
+static const int SHADOW_CASCADE_SCALES[ShadowCascades::MAX_CASCADES] = 
+{ 
+	PropertyTable::GetId("shadowCascadeScale0"), PropertyTable::GetId("shadowCascadeScale1"), 
+	PropertyTable::GetId("shadowCascadeScale2"), PropertyTable::GetId("shadowCascadeScale3")
+};
+
+static const int SHADOW_CASCADE_OFFSETS[ShadowCascades::MAX_CASCADES] = 
+{ 
+	PropertyTable::GetId("shadowCascadeOffset0"), PropertyTable::GetId("shadowCascadeOffset1"), 
+	PropertyTable::GetId("shadowCascadeOffset2"), PropertyTable::GetId("shadowCascadeOffset3")
+};
+
+//The G-buffer's textures. Lighting is accumulated into the last color attachment.
+enum
+{
+	GBUFFER_ALBEDO,
+	GBUFFER_NORMAL,
+	GBUFFER_MATERIAL,
+	GBUFFER_LIGHTING,
+	GBUFFER_DEPTH,
+	NUM_GBUFFER_TEXTURES
+};
+
+static const GLenum GBUFFER_DRAW_BUFFERS[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+
+//Spot lights wider than this are drawn with a sphere volume, since their cone would be nearly flat.
+static const float MIN_CONE_VOLUME_CUTOFF = 0.2f;
+
+//Occluders are the largest meshes on screen, measured by their bounding radius over
+//their distance. Smaller ones rarely hide enough to be worth rasterizing.
+static const int MAX_OCCLUDERS = 16;
+static const float MIN_OCCLUDER_SCREEN_SIZE = 0.1f;
+
+static IndexedModel CreateSphereVolume(int numSegments, int numRings);
+static IndexedModel CreateConeVolume(int numSegments);
+static IndexedModel CreateScreenQuad();
+
+RenderingEngine::RenderingEngine(const Window& window, RenderPath renderPath) :
 	m_plane(Mesh("plane.obj")),
 	m_window(&window),
 	m_tempTarget(window.GetWidth(), window.GetHeight(), 0, GL_TEXTURE_2D, GL_NEAREST, GL_RGBA, GL_RGBA, false, GL_COLOR_ATTACHMENT0),
 	m_planeMaterial("renderingEngine_filterPlane", m_tempTarget, 1, 8),
+	m_shadowAtlas(MAX_SHADOW_ATLAS_SIZE_AS_POWER_OF_2),
 	m_defaultShader("forward-ambient"),
 	m_shadowMapShader("shadowMapGenerator"),
 	m_nullFilter("filter-null"),
 	m_gausBlurFilter("filter-gausBlur7x1"),
 	m_fxaaFilter("filter-fxaa"),
 	m_altCameraTransform(Vector3f(0,0,0), Quaternion(Vector3f(0,1,0),ToRadians(180.0f))),
-	m_altCamera(Matrix4f().InitIdentity(), &m_altCameraTransform)
+	m_altCamera(Matrix4f().InitIdentity(), &m_altCameraTransform),
+	m_movedSceneTreeLock(0),
+	m_gausBlurArrayFilter(0),
+	m_jobSystem(0),
+	m_isOcclusionCullingEnabled(true),
+	m_shadowLODBias(1),
+	m_clusteredShader(0),
+	m_isClusteredLightingEnabled(false),
+	m_renderPath(GLEW_VERSION_3_0 ? renderPath : RENDER_PATH_FORWARD),
+	m_gbufferShader(0),
+	m_deferredStencilShader(0),
+	m_deferredDirectionalShader(0),
+	m_deferredDirectionalCascadedShader(0),
+	m_deferredPointShader(0),
+	m_deferredSpotShader(0),
+	m_sphereVolume(0),
+	m_coneVolume(0),
+	m_screenQuad(0)
 {
+	m_renderQueue.SetSceneTree(&m_sceneTree);
+	
+	//Shadow cascades are array textures, which need GL 3.0.
+	if(GLEW_VERSION_3_0)
+	{
+		m_gausBlurArrayFilter = new Shader("filter-gausBlur7x1Array");
+	}
+	
+	//The cluster grid is read from buffer textures, which need GL 3.1.
+	#if PROFILING_DISABLE_CLUSTERED_LIGHTING == 0
+		if(m_renderPath == RENDER_PATH_FORWARD && GLEW_VERSION_3_1)
+		{
+			m_clusteredShader = new Shader("forward-clustered");
+			m_isClusteredLightingEnabled = true;
+		}
+	#endif
+	
 	SetSamplerSlot("diffuse",   0);
 	SetSamplerSlot("normalMap", 1);
 	SetSamplerSlot("dispMap",   2);
 	SetSamplerSlot("shadowMap", 3);
+	SetSamplerSlot("clusterLights", 4);
+	SetSamplerSlot("clusterData", 5);
+	SetSamplerSlot("gbufferAlbedo", 6);
+	SetSamplerSlot("gbufferNormal", 7);
+	SetSamplerSlot("gbufferMaterial", 8);
+	SetSamplerSlot("gbufferDepth", 9);
 	
 	SetSamplerSlot("filterTexture", 0);
 	
@@ -64,14 +171,21 @@ RenderingEngine::RenderingEngine(const Window& window) :
 	SetFloat("fxaaReduceMul", 1.0f/8.0f);
 	SetFloat("fxaaAspectDistortion", 150.0f);
 
-	SetTexture("displayTexture", Texture(m_window->GetWidth(), m_window->GetHeight(), 0, GL_TEXTURE_2D, GL_LINEAR, GL_RGBA, GL_RGBA, true, GL_COLOR_ATTACHMENT0));
+	if(m_renderPath == RENDER_PATH_DEFERRED)
+	{
+		InitDeferred();
+	}
+	else
+	{
+		SetTexture("displayTexture", Texture(m_window->GetWidth(), m_window->GetHeight(), 0, GL_TEXTURE_2D, GL_LINEAR, GL_RGBA, GL_RGBA, true, GL_COLOR_ATTACHMENT0));
+	}
 
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
 	glFrontFace(GL_CW);
-	glCullFace(GL_BACK);
-	glEnable(GL_CULL_FACE);
-	glEnable(GL_DEPTH_TEST);
+	GLState::CullFace(GL_BACK);
+	GLState::SetEnabled(GL_CULL_FACE, true);
+	GLState::SetEnabled(GL_DEPTH_TEST, true);
 	//glEnable(GL_DEPTH_CLAMP);
 	//glEnable(GL_MULTISAMPLE);
 	//glEnable(GL_FRAMEBUFFER_SRGB);
@@ -81,31 +195,308 @@ RenderingEngine::RenderingEngine(const Window& window) :
 	m_planeTransform.Rotate(Quaternion(Vector3f(1,0,0), ToRadians(90.0f)));
 	m_planeTransform.Rotate(Quaternion(Vector3f(0,0,1), ToRadians(180.0f)));
 	
-	for(int i = 0; i < NUM_SHADOW_MAPS; i++)
+	//Lights without shadows still sample a shadow map, which never shadows anything.
+	m_noShadowMap = Texture(2, 2, 0, GL_TEXTURE_2D, GL_LINEAR, GL_RG32F, GL_RGBA, true, GL_COLOR_ATTACHMENT0);
+	m_noShadowMap.BindAsRenderTarget();
+	glClearColor(1.0f,1.0f,0.0f,0.0f);
+	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	glClearColor(0.0f,0.0f,0.0f,0.0f);
+	
+	m_lightMatrix = Matrix4f().InitScale(Vector3f(0,0,0));	
+}
+
+RenderingEngine::~RenderingEngine()
+{
+	//Packets can outlive the engine, and mustn't try to remove themselves from it afterwards.
+	std::vector<void*> packets;
+	m_sceneTree.QueryAll(&packets);
+	
+	for(unsigned int i = 0; i < packets.size(); i++)
 	{
-		int shadowMapSize = 1 << (i + 1);
-		m_shadowMaps[i] = Texture(shadowMapSize, shadowMapSize, 0, GL_TEXTURE_2D, GL_LINEAR, GL_RG32F, GL_RGBA, true, GL_COLOR_ATTACHMENT0);
-		m_shadowMapTempTargets[i] = Texture(shadowMapSize, shadowMapSize, 0, GL_TEXTURE_2D, GL_LINEAR, GL_RG32F, GL_RGBA, true, GL_COLOR_ATTACHMENT0);
+		((RenderPacket*)packets[i])->SetSceneTreeHandle(BoundingVolumeHierarchy::INVALID_HANDLE);
 	}
 	
-	m_lightMatrix = Matrix4f().InitScale(Vector3f(0,0,0));	
+	if(m_gausBlurArrayFilter) delete m_gausBlurArrayFilter;
+	if(m_clusteredShader) delete m_clusteredShader;
+	if(m_gbufferShader) delete m_gbufferShader;
+	if(m_deferredStencilShader) delete m_deferredStencilShader;
+	if(m_deferredDirectionalShader) delete m_deferredDirectionalShader;
+	if(m_deferredDirectionalCascadedShader) delete m_deferredDirectionalCascadedShader;
+	if(m_deferredPointShader) delete m_deferredPointShader;
+	if(m_deferredSpotShader) delete m_deferredSpotShader;
+	if(m_sphereVolume) delete m_sphereVolume;
+	if(m_coneVolume) delete m_coneVolume;
+	if(m_screenQuad) delete m_screenQuad;
+}
+
+void RenderingEngine::InitDeferred()
+{
+	GLfloat filters[NUM_GBUFFER_TEXTURES] = { GL_NEAREST, GL_NEAREST, GL_NEAREST, GL_LINEAR, GL_NEAREST };
+	GLenum internalFormats[NUM_GBUFFER_TEXTURES] = { GL_RGBA, GL_RGBA16F, GL_RGBA16F, GL_RGBA, GL_DEPTH24_STENCIL8 };
+	GLenum formats[NUM_GBUFFER_TEXTURES] = { GL_RGBA, GL_RGBA, GL_RGBA, GL_RGBA, GL_DEPTH_STENCIL };
+	GLenum attachments[NUM_GBUFFER_TEXTURES] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, 
+	                                             GL_COLOR_ATTACHMENT3, GL_DEPTH_STENCIL_ATTACHMENT };
+	
+	m_gbuffer = Texture(m_window->GetWidth(), m_window->GetHeight(), NUM_GBUFFER_TEXTURES, GL_TEXTURE_2D, 
+		filters, internalFormats, formats, true, attachments);
+	
+	SetTexture("gbufferAlbedo", m_gbuffer.GetAttachment(GBUFFER_ALBEDO));
+	SetTexture("gbufferNormal", m_gbuffer.GetAttachment(GBUFFER_NORMAL));
+	SetTexture("gbufferMaterial", m_gbuffer.GetAttachment(GBUFFER_MATERIAL));
+	SetTexture("gbufferDepth", m_gbuffer.GetAttachment(GBUFFER_DEPTH));
+	SetTexture("displayTexture", m_gbuffer.GetAttachment(GBUFFER_LIGHTING));
+	SetFloat("deferredVolumeSpread", 1.0f);
+	
+	m_gbufferShader = new Shader("deferred-geometry");
+	m_deferredStencilShader = new Shader("deferred-stencil");
+	m_deferredDirectionalShader = new Shader("deferred-directional");
+	m_deferredDirectionalCascadedShader = new Shader("deferred-directional-cascaded");
+	m_deferredPointShader = new Shader("deferred-point");
+	m_deferredSpotShader = new Shader("deferred-spot");
+	
+	m_sphereVolume = new Mesh("renderingEngine_sphereVolume", CreateSphereVolume(16, 8));
+	m_coneVolume = new Mesh("renderingEngine_coneVolume", CreateConeVolume(16));
+	m_screenQuad = new Mesh("renderingEngine_screenQuad", CreateScreenQuad());
+}
+
+void RenderingEngine::AddToSceneTree(RenderPacket* packet)
+{
+	assert(packet->GetSceneTreeHandle() == BoundingVolumeHierarchy::INVALID_HANDLE);
+	
+	packet->UpdateBounds();
+	packet->SetSceneTreeHandle(m_sceneTree.Insert(packet->GetBoundsMin(), packet->GetBoundsMax(), packet));
+	
+	m_changedBounds.push_back(packet->GetBoundsMin());
+	m_changedBounds.push_back(packet->GetBoundsMax());
+}
+
+void RenderingEngine::RemoveFromSceneTree(RenderPacket* packet)
+{
+	int handle = packet->GetSceneTreeHandle();
+	
+	//The handle can be reused by the next insert, so it mustn't be left in the moved list.
+	SDL_AtomicLock(&m_movedSceneTreeLock);
+	m_movedSceneTreeHandles.erase(std::remove(m_movedSceneTreeHandles.begin(), m_movedSceneTreeHandles.end(), handle), 
+		m_movedSceneTreeHandles.end());
+	SDL_AtomicUnlock(&m_movedSceneTreeLock);
+	
+	m_changedBounds.push_back(packet->GetBoundsMin());
+	m_changedBounds.push_back(packet->GetBoundsMax());
+	
+	m_sceneTree.Remove(handle);
+	packet->SetSceneTreeHandle(BoundingVolumeHierarchy::INVALID_HANDLE);
+}
+
+void RenderingEngine::OnSceneTreePacketMoved(const RenderPacket& packet)
+{
+	SDL_AtomicLock(&m_movedSceneTreeLock);
+	m_movedSceneTreeHandles.push_back(packet.GetSceneTreeHandle());
+	SDL_AtomicUnlock(&m_movedSceneTreeLock);
+}
+
+void RenderingEngine::OnAssetsUploaded()
+{
+	std::vector<void*> packets;
+	m_sceneTree.QueryAll(&packets);
+	
+	for(unsigned int i = 0; i < packets.size(); i++)
+	{
+		OnSceneTreePacketMoved(*(const RenderPacket*)packets[i]);
+	}
+	
+	m_shadowMapCache.InvalidateAll();
+}
+
+void RenderingEngine::UpdateSceneTree()
+{
+	//A packet can be reported more than once if its world matrix was read in between.
+	std::sort(m_movedSceneTreeHandles.begin(), m_movedSceneTreeHandles.end());
+	m_movedSceneTreeHandles.erase(std::unique(m_movedSceneTreeHandles.begin(), m_movedSceneTreeHandles.end()), 
+		m_movedSceneTreeHandles.end());
+	
+	for(unsigned int i = 0; i < m_movedSceneTreeHandles.size(); i++)
+	{
+		int handle = m_movedSceneTreeHandles[i];
+		RenderPacket* packet = (RenderPacket*)m_sceneTree.GetUserData(handle);
+		
+		//Shadows can change both where the packet was and where it is now.
+		m_changedBounds.push_back(packet->GetBoundsMin());
+		m_changedBounds.push_back(packet->GetBoundsMax());
+		
+		packet->UpdateBounds();
+		m_sceneTree.Move(handle, packet->GetBoundsMin(), packet->GetBoundsMax());
+		
+		m_changedBounds.push_back(packet->GetBoundsMin());
+		m_changedBounds.push_back(packet->GetBoundsMax());
+	}
+	
+	m_movedSceneTreeHandles.clear();
+	
+	//Inserting one at a time builds a worse tree than building it all at once, so
+	//it's rebuilt once enough of it has been inserted that way, like after loading.
+	if(m_sceneTree.GetNumInsertedSinceRebuild() > m_sceneTree.GetNumLeaves() / 4)
+	{
+		m_sceneTree.Rebuild();
+	}
+}
+
+void RenderingEngine::InvalidateShadowMaps()
+{
+	#if PROFILING_DISABLE_SHADOW_MAP_CACHE == 0
+		//Meshes queued each frame aren't tracked, so there's no telling whether they moved.
+		if(m_renderQueue.HasUntrackedContent())
+		{
+			m_shadowMapCache.InvalidateAll();
+		}
+		
+		for(unsigned int i = 0; i < m_changedBounds.size(); i += 2)
+		{
+			m_shadowMapCache.InvalidateAABB(m_changedBounds[i], m_changedBounds[i + 1]);
+		}
+	#else
+		m_shadowMapCache.InvalidateAll();
+	#endif
+	
+	m_changedBounds.clear();
+}
+
+void RenderingEngine::UpdateOcclusionCuller()
+{
+	#if PROFILING_DISABLE_OCCLUSION_CULLING == 0
+		if(!m_isOcclusionCullingEnabled)
+		{
+			m_renderQueue.SetOcclusionCuller(0);
+			return;
+		}
+		
+		m_occlusionProfileTimer.StartInvocation();
+		
+		Matrix4f viewProjection = m_mainCamera->GetViewProjection();
+		Vector3f eyePos = m_mainCamera->GetTransform().GetTransformedPos();
+		
+		m_occluderQueryResults.clear();
+		m_occluders.clear();
+		m_sceneTree.QueryFrustum(Frustum(viewProjection), &m_occluderQueryResults);
+		
+		for(unsigned int i = 0; i < m_occluderQueryResults.size(); i++)
+		{
+			const RenderPacket& packet = *(const RenderPacket*)m_occluderQueryResults[i];
+			if(!packet.GetMesh().IsOccluder())
+				continue;
+			
+			//Meshes the camera is inside, like the rooms of a level, cover the whole screen.
+			float distance = std::max((packet.GetBoundsCenter() - eyePos).Length(), packet.GetBoundsRadius());
+			float screenSize = packet.GetBoundsRadius() / distance;
+			
+			if(screenSize >= MIN_OCCLUDER_SCREEN_SIZE)
+			{
+				m_occluders.push_back(std::make_pair(screenSize, &packet));
+			}
+		}
+		
+		int numOccluders = std::min((int)m_occluders.size(), MAX_OCCLUDERS);
+		std::partial_sort(m_occluders.begin(), m_occluders.begin() + numOccluders, m_occluders.end(), 
+			std::greater<std::pair<float, const RenderPacket*> >());
+		
+		m_occlusionCuller.Begin(viewProjection);
+		for(int i = 0; i < numOccluders; i++)
+		{
+			const RenderPacket& packet = *m_occluders[i].second;
+			m_occlusionCuller.AddOccluder(packet.GetMesh().GetOccluderPositions(), packet.GetMesh().GetOccluderIndices(), 
+				packet.GetWorldMatrix());
+		}
+		
+		m_occlusionCuller.Finish(m_jobSystem);
+		m_renderQueue.SetOcclusionCuller(&m_occlusionCuller);
+		
+		m_occlusionProfileTimer.StopInvocation();
+	#endif
 }
 
-void RenderingEngine::BlurShadowMap(int shadowMapIndex, float blurAmount)
+void RenderingEngine::SetSamplerSlot(const std::string& name, unsigned int value)
 {
-	SetVector3f("blurScale", Vector3f(blurAmount/(m_shadowMaps[shadowMapIndex].GetWidth()), 0.0f, 0.0f));
-	ApplyFilter(m_gausBlurFilter, m_shadowMaps[shadowMapIndex], &m_shadowMapTempTargets[shadowMapIndex]);
+	int id = PropertyTable::GetId(name);
+	
+	if(id >= (int)m_samplerSlots.size())
+	{
+		m_samplerSlots.resize(id + 1, 0);
+	}
+	
+	m_samplerSlots[id] = value;
+}
+
+bool RenderingEngine::CalcScissorRect(const Vector3f& center, float radius, GLint* rect) const
+{
+	const Texture& target = GetTexture(DISPLAY_TEXTURE);
+	return CalcScissorRect(m_mainCamera->GetViewProjection(), target.GetWidth(), target.GetHeight(), center, radius, rect);
+}
+
+bool RenderingEngine::CalcScissorRect(const Matrix4f& viewProjection, int width, int height, 
+                                      const Vector3f& center, float radius, GLint* rect)
+{
+	if(!Frustum(viewProjection).IntersectsSphere(center, radius))
+	{
+		return false;
+	}
+	
+	//The rectangle is the screen space bounds of the corners of the box around the
+	//sphere. If any corner is behind the camera the projection isn't bounded, so the
+	//whole screen is used instead.
+	float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+	bool isBehindCamera = false;
+	
+	for(int i = 0; i < 8 && !isBehindCamera; i++)
+	{
+		Vector4f corner(center.GetX() + ((i & 1) ? radius : -radius), 
+		                center.GetY() + ((i & 2) ? radius : -radius),
+		                center.GetZ() + ((i & 4) ? radius : -radius), 1.0f);
+		Vector4f clip = Vector4f(viewProjection.Transform(corner));
+		
+		if(clip.GetW() <= 0.0f)
+		{
+			isBehindCamera = true;
+			break;
+		}
+		
+		minX = std::min(minX, clip.GetX() / clip.GetW());
+		minY = std::min(minY, clip.GetY() / clip.GetW());
+		maxX = std::max(maxX, clip.GetX() / clip.GetW());
+		maxY = std::max(maxY, clip.GetY() / clip.GetW());
+	}
+	
+	if(isBehindCamera)
+	{
+		minX = -1.0f; minY = -1.0f; maxX = 1.0f; maxY = 1.0f;
+	}
+	
+	minX = Clamp(minX, -1.0f, 1.0f); maxX = Clamp(maxX, -1.0f, 1.0f);
+	minY = Clamp(minY, -1.0f, 1.0f); maxY = Clamp(maxY, -1.0f, 1.0f);
 	
-	SetVector3f("blurScale", Vector3f(0.0f, blurAmount/(m_shadowMaps[shadowMapIndex].GetHeight()), 0.0f));
-	ApplyFilter(m_gausBlurFilter, m_shadowMapTempTargets[shadowMapIndex], &m_shadowMaps[shadowMapIndex]); 
+	rect[0] = (GLint)floor((minX * 0.5f + 0.5f) * width);
+	rect[1] = (GLint)floor((minY * 0.5f + 0.5f) * height);
+	rect[2] = (GLint)ceil((maxX * 0.5f + 0.5f) * width) - rect[0];
+	rect[3] = (GLint)ceil((maxY * 0.5f + 0.5f) * height) - rect[1];
+	
+	return rect[2] > 0 && rect[3] > 0;
+}
 
-//	SetVector3f("inverseFilterTextureSize", Vector3f(blurAmount/m_shadowMaps[shadowMapIndex].GetWidth(), blurAmount/m_shadowMaps[shadowMapIndex].GetHeight(), 0.0f));
-//	ApplyFilter(m_fxaaFilter, m_shadowMaps[shadowMapIndex], &m_shadowMapTempTargets[shadowMapIndex]);
-//	
-//	ApplyFilter(m_nullFilter, m_shadowMapTempTargets[shadowMapIndex], &m_shadowMaps[shadowMapIndex]);
+void RenderingEngine::BlurShadowMap(const Texture& shadowMap, int layer, const Texture& dest, const GLint* destRect, float blurAmount)
+{
+	//Array textures are read from a layer at a time by a filter of their own.
+	const Shader& firstFilter = shadowMap.GetNumLayers() > 1 ? *m_gausBlurArrayFilter : m_gausBlurFilter;
+	Texture tempTarget = m_renderTargetPool.Acquire(shadowMap.GetWidth(), shadowMap.GetHeight(), GL_RG32F, GL_RGBA);
+	
+	SetFloat(FILTER_LAYER, (float)layer);
+	SetVector3f(BLUR_SCALE, Vector3f(blurAmount/(shadowMap.GetWidth()), 0.0f, 0.0f));
+	ApplyFilter(firstFilter, shadowMap, &tempTarget);
+	
+	SetVector3f(BLUR_SCALE, Vector3f(0.0f, blurAmount/(shadowMap.GetHeight()), 0.0f));
+	ApplyFilter(m_gausBlurFilter, tempTarget, &dest, destRect); 
+	
+	m_renderTargetPool.Release(tempTarget);
 }
 
-void RenderingEngine::ApplyFilter(const Shader& filter, const Texture& source, const Texture* dest)
+void RenderingEngine::ApplyFilter(const Shader& filter, const Texture& source, const Texture* dest, const GLint* destRect)
 {
 	assert(&source != dest);
 	if(dest == 0)
@@ -117,7 +508,12 @@ void RenderingEngine::ApplyFilter(const Shader& filter, const Texture& source, c
 		dest->BindAsRenderTarget();
 	}
 	
-	SetTexture("filterTexture", source);
+	if(destRect)
+	{
+		GLState::Viewport(destRect[0], destRect[1], destRect[2], destRect[3]);
+	}
+	
+	SetTexture(FILTER_TEXTURE, source);
 	
 	m_altCamera.SetProjection(Matrix4f().InitIdentity());
 	m_altCamera.GetTransform()->SetPos(Vector3f(0,0,0));
@@ -132,110 +528,668 @@ void RenderingEngine::ApplyFilter(const Shader& filter, const Texture& source, c
 	m_plane.Draw();
 	
 //	m_mainCamera = temp;
-	SetTexture("filterTexture", 0);
+	SetTexture(FILTER_TEXTURE, 0);
 }
 
-void RenderingEngine::Render(const Entity& object)
+void RenderingEngine::RenderClusteredLights()
 {
-	m_renderProfileTimer.StartInvocation();
-	GetTexture("displayTexture").BindAsRenderTarget();
-	//m_window->BindAsRenderTarget();
-	//m_tempTarget->BindAsRenderTarget();
+	m_lightClusters.Build(m_mainCamera->GetView(), m_mainCamera->GetProjection());
+	m_lightClusters.Upload();
+	
+	const Texture& displayTexture = GetTexture(DISPLAY_TEXTURE);
+	m_samplerBuffers.Set(CLUSTER_LIGHTS, m_lightClusters.GetLightTexture());
+	m_samplerBuffers.Set(CLUSTER_DATA, m_lightClusters.GetClusterTexture());
+	SetVector3f(CLUSTER_GRID, Vector3f((float)LightClusters::NUM_TILES_X, (float)LightClusters::NUM_TILES_Y, (float)LightClusters::NUM_SLICES));
+	SetVector3f(CLUSTER_DEPTH, Vector3f(m_lightClusters.GetNear(), m_lightClusters.GetSlicesPerLogDepth(), 0.0f));
+	SetVector3f(CLUSTER_SCREEN, Vector3f((float)LightClusters::NUM_TILES_X/(float)displayTexture.GetWidth(), 
+	                                     (float)LightClusters::NUM_TILES_Y/(float)displayTexture.GetHeight(), 0.0f));
+	SetVector3f(CLUSTER_VIEW_FORWARD, m_mainCamera->GetTransform().GetTransformedRot().GetForward());
+	
+	GLState::SetEnabled(GL_BLEND, true);
+	GLState::BlendFunc(GL_ONE, GL_ONE);
+	GLState::DepthMask(false);
+	GLState::DepthFunc(GL_EQUAL);
+	
+	m_renderQueue.Render(*m_clusteredShader, *this, *m_mainCamera);
+	
+	GLState::DepthMask(true);
+	GLState::DepthFunc(GL_LESS);
+	GLState::SetEnabled(GL_BLEND, false);
+}
 
-	glClearColor(0.0f,0.0f,0.0f,0.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	object.RenderAll(m_defaultShader, *this, *m_mainCamera);
+const Texture& RenderingEngine::GetShadowCascadeMap(const ShadowInfo& shadowInfo)
+{
+	int shadowMapSize = 1 << shadowInfo.GetShadowMapSizeAsPowerOf2();
+	int numLayers = shadowInfo.GetNumCascades();
 	
-	for(unsigned int i = 0; i < m_lights.size(); i++)
+	std::map<const BaseLight*, Texture>::iterator it = m_shadowCascadeMaps.find(m_activeLight);
+	if(it != m_shadowCascadeMaps.end())
 	{
-		m_activeLight = m_lights[i];
-		ShadowInfo shadowInfo = m_activeLight->GetShadowInfo();
-		
-		int shadowMapIndex = 0;
-		if(shadowInfo.GetShadowMapSizeAsPowerOf2() != 0)
-			shadowMapIndex = shadowInfo.GetShadowMapSizeAsPowerOf2() - 1;
+		if(it->second.GetWidth() == shadowMapSize && it->second.GetNumLayers() == numLayers)
+		{
+			return it->second;
+		}
 		
-		assert(shadowMapIndex >= 0 && shadowMapIndex < NUM_SHADOW_MAPS);
+		m_shadowCascadeMaps.erase(it);
+	}
+	
+	//Made the first time the light is seen, and again if its size changes.
+	for(int i = 0; i < numLayers; i++)
+	{
+		m_shadowMapCache.Invalidate(m_shadowMapCache.GetEntry(m_activeLight, i));
+	}
+	
+	GLfloat filter = GL_LINEAR;
+	GLenum internalFormat = GL_RG32F;
+	GLenum format = GL_RGBA;
+	GLenum attachment = GL_COLOR_ATTACHMENT0;
+	
+	Texture shadowMap(shadowMapSize, shadowMapSize, 1, GL_TEXTURE_2D_ARRAY, &filter, &internalFormat, &format, true, &attachment, numLayers);
+	return m_shadowCascadeMaps.insert(std::pair<const BaseLight*, Texture>(m_activeLight, shadowMap)).first->second;
+}
+
+ShadowAtlas::Region RenderingEngine::AcquireShadowAtlasRegion(const ShadowInfo& shadowInfo)
+{
+	ShadowAtlas::Region region;
+	if(m_shadowAtlas.Acquire(m_activeLight, shadowInfo.GetShadowMapSizeAsPowerOf2(), &region))
+	{
+		m_shadowMapCache.Invalidate(m_shadowMapCache.GetEntry(m_activeLight));
+	}
+	
+	//Regions keep their place when the atlas grows, but the new texture starts out empty.
+	int atlasSize = m_shadowAtlas.GetSize();
+	if(m_shadowAtlasTexture.GetWidth() != atlasSize)
+	{
+		m_shadowAtlasTexture = Texture(atlasSize, atlasSize, 0, GL_TEXTURE_2D, GL_LINEAR, GL_RG32F, GL_RGBA, true, GL_COLOR_ATTACHMENT0);
+		m_shadowMapCache.InvalidateAll();
+	}
+	
+	return region;
+}
+
+Matrix4f RenderingEngine::DrawShadowCasters(const Texture& target, const ShadowInfo& shadowInfo, const Matrix4f& projection, 
+                                            const Vector3f& pos, const Quaternion& rot)
+{
+	target.BindAsRenderTarget();
+	glClearColor(1.0f,1.0f,0.0f,0.0f);
+	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	
+	m_altCamera.SetProjection(projection);
+	m_altCamera.GetTransform()->SetPos(pos);
+	m_altCamera.GetTransform()->SetRot(rot);
+	
+	bool flipFaces = shadowInfo.GetFlipFaces();
+	
+//	const Camera* temp = m_mainCamera;
+//	m_mainCamera = m_altCamera;
+	
+	if(flipFaces)
+	{
+		GLState::CullFace(GL_FRONT);
+	}
+	
+	GLState::SetEnabled(GL_DEPTH_CLAMP, true);
+	m_renderQueue.Render(m_shadowMapShader, *this, m_altCamera, true, m_shadowLODBias);
+	GLState::SetEnabled(GL_DEPTH_CLAMP, false);
+	
+	if(flipFaces) 
+	{
+		GLState::CullFace(GL_BACK);
+	}
+	
+//	m_mainCamera = temp;
+	
+	return m_altCamera.GetViewProjection();
+}
+
+void RenderingEngine::RenderShadowMap()
+{
+	ShadowInfo shadowInfo = m_activeLight->GetShadowInfo();
+	
+	if(shadowInfo.GetShadowMapSizeAsPowerOf2() == 0)
+	{
+		SetTexture(SHADOW_MAP, m_noShadowMap);
+		m_lightMatrix = Matrix4f().InitScale(Vector3f(0,0,0));
+		SetFloat(SHADOW_VARIANCE_MIN, 0.00002f);
+		SetFloat(SHADOW_LIGHT_BLEEDING_REDUCTION, 0.0f);
+		return;
+	}
+	
+	SetFloat(SHADOW_VARIANCE_MIN, shadowInfo.GetMinVariance());
+	SetFloat(SHADOW_LIGHT_BLEEDING_REDUCTION, shadowInfo.GetLightBleedReductionAmount());
+	
+	//Cascades keep an array texture of their own, and every other light keeps a region of the shadow atlas.
+	if(shadowInfo.GetNumCascades() > 1)
+	{
+		const Texture& shadowMap = GetShadowCascadeMap(shadowInfo);
+		SetTexture(SHADOW_MAP, shadowMap);
+		RenderShadowCascades(shadowMap, shadowInfo);
+		return;
+	}
+	
+	ShadowAtlas::Region region = AcquireShadowAtlasRegion(shadowInfo);
+	SetTexture(SHADOW_MAP, m_shadowAtlasTexture);
+	
+	//Inset by half a texel, so filtering never reads from the neighbouring regions.
+	float atlasSize = (float)m_shadowAtlas.GetSize();
+	SetVector3f(SHADOW_MAP_REGION, Vector3f((region.GetX() + 0.5f)/atlasSize, (region.GetY() + 0.5f)/atlasSize, 
+		(region.GetSize() - 1)/atlasSize));
+	
+	int cacheEntry = m_shadowMapCache.GetEntry(m_activeLight);
+	ShadowCameraTransform shadowCameraTransform = m_activeLight->CalcShadowCameraTransform(m_mainCamera->GetTransform().GetTransformedPos(), 
+		m_mainCamera->GetTransform().GetTransformedRot());
+	
+	if(m_shadowMapCache.Lookup(cacheEntry, shadowInfo.GetProjection(), shadowCameraTransform.GetPos(), shadowCameraTransform.GetRot(), 
+		shadowInfo.GetCacheMoveThreshold()))
+	{
+		m_lightMatrix = m_shadowMapCache.GetLightMatrix(cacheEntry);
+		return;
+	}
+	
+	//Casters are drawn into a target of the region's size, which is then blurred or copied into the region.
+	Texture casterTarget = m_renderTargetPool.Acquire(region.GetSize(), region.GetSize(), GL_RG32F, GL_RGBA);
+	Matrix4f viewProjection = DrawShadowCasters(casterTarget, shadowInfo, shadowInfo.GetProjection(), 
+		shadowCameraTransform.GetPos(), shadowCameraTransform.GetRot());
+	m_lightMatrix = BIAS_MATRIX * viewProjection;
+	
+	GLint regionRect[4] = { region.GetX(), region.GetY(), region.GetSize(), region.GetSize() };
+	float shadowSoftness = shadowInfo.GetShadowSoftness();
+	if(shadowSoftness != 0)
+	{
+		BlurShadowMap(casterTarget, 0, m_shadowAtlasTexture, regionRect, shadowSoftness);
+	}
+	else
+	{
+		ApplyFilter(m_nullFilter, casterTarget, &m_shadowAtlasTexture, regionRect);
+	}
+	
+	m_renderTargetPool.Release(casterTarget);
+	
+	m_shadowMapCache.Update(cacheEntry, shadowInfo.GetProjection(), shadowCameraTransform.GetPos(), shadowCameraTransform.GetRot(), 
+		viewProjection, m_lightMatrix);
+}
+
+void RenderingEngine::RenderShadowCascades(const Texture& shadowMap, const ShadowInfo& shadowInfo)
+{
+	const Quaternion& lightRot = m_activeLight->GetTransform().GetTransformedRot();
+	
+	ShadowCascades cascades;
+	m_activeLight->CalcShadowCascades(m_mainCamera->GetProjection(), m_mainCamera->GetTransform().GetTransformedPos(), 
+		m_mainCamera->GetTransform().GetTransformedRot(), &cascades);
+	
+	//Each cascade is cached on its own, and only culls casters against its own frustum.
+	//Far cascades move less often as the camera does, so they are rendered again less often.
+	for(int i = 0; i < ShadowCascades::MAX_CASCADES; i++)
+	{
+		if(i >= cascades.GetNumCascades())
+		{
+			SetVector3f(SHADOW_CASCADE_SCALES[i], Vector3f(0.0f, 0.0f, 0.0f));
+			SetVector3f(SHADOW_CASCADE_OFFSETS[i], Vector3f(-1.0f, -1.0f, -1.0f));
+			continue;
+		}
 		
-		SetTexture("shadowMap", m_shadowMaps[shadowMapIndex]);
-		m_shadowMaps[shadowMapIndex].BindAsRenderTarget();
-		glClearColor(1.0f,1.0f,0.0f,0.0f);
-		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+		int cacheEntry = m_shadowMapCache.GetEntry(m_activeLight, i);
+		Matrix4f projection = cascades.GetProjection(i);
+		Matrix4f cascadeLightMatrix;
 		
-		if(shadowInfo.GetShadowMapSizeAsPowerOf2() != 0)
+		if(m_shadowMapCache.Lookup(cacheEntry, projection, cascades.GetCenter(i), lightRot, cascades.GetMoveThreshold(i)))
 		{
-			m_altCamera.SetProjection(shadowInfo.GetProjection());
-			ShadowCameraTransform shadowCameraTransform = m_activeLight->CalcShadowCameraTransform(m_mainCamera->GetTransform().GetTransformedPos(), 
-				m_mainCamera->GetTransform().GetTransformedRot());
-			m_altCamera.GetTransform()->SetPos(shadowCameraTransform.GetPos());
-			m_altCamera.GetTransform()->SetRot(shadowCameraTransform.GetRot());
-			
-			m_lightMatrix = BIAS_MATRIX * m_altCamera.GetViewProjection();
-			
-			SetFloat("shadowVarianceMin", shadowInfo.GetMinVariance());
-			SetFloat("shadowLightBleedingReduction", shadowInfo.GetLightBleedReductionAmount());
-			bool flipFaces = shadowInfo.GetFlipFaces();
-			
-//			const Camera* temp = m_mainCamera;
-//			m_mainCamera = m_altCamera;
-			
-			if(flipFaces)
-			{
-				glCullFace(GL_FRONT);
-			}
-			
-			glEnable(GL_DEPTH_CLAMP);
-			object.RenderAll(m_shadowMapShader, *this, m_altCamera);
-			glDisable(GL_DEPTH_CLAMP);
+			cascadeLightMatrix = m_shadowMapCache.GetLightMatrix(cacheEntry);
+		}
+		else
+		{
+			Matrix4f viewProjection = DrawShadowCasters(shadowMap.GetLayer(i), shadowInfo, projection, cascades.GetCenter(i), lightRot);
+			cascadeLightMatrix = BIAS_MATRIX * viewProjection;
 			
-			if(flipFaces) 
+			float shadowSoftness = shadowInfo.GetShadowSoftness();
+			if(shadowSoftness != 0)
 			{
-				glCullFace(GL_BACK);
+				BlurShadowMap(shadowMap, i, shadowMap.GetLayer(i), 0, shadowSoftness);
 			}
 			
-//			m_mainCamera = temp;
-			
-			float shadowSoftness = shadowInfo.GetShadowSoftness();
-			if(shadowSoftness != 0)
+			m_shadowMapCache.Update(cacheEntry, projection, cascades.GetCenter(i), lightRot, viewProjection, cascadeLightMatrix);
+		}
+		
+		Vector3f scale, offset;
+		ShadowCascades::CalcScaleAndOffset(cascadeLightMatrix, lightRot, &scale, &offset);
+		SetVector3f(SHADOW_CASCADE_SCALES[i], scale);
+		SetVector3f(SHADOW_CASCADE_OFFSETS[i], offset);
+	}
+	
+	//The light shaders look cascades up from positions relative to the light's rotation.
+	m_lightMatrix = lightRot.Conjugate().ToRotationMatrix();
+}
+
+void RenderingEngine::RenderForward()
+{
+	GetTexture(DISPLAY_TEXTURE).BindAsRenderTarget();
+	//m_window->BindAsRenderTarget();
+	//m_tempTarget->BindAsRenderTarget();
+
+	glClearColor(0.0f,0.0f,0.0f,0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	m_renderQueue.Render(m_defaultShader, *this, *m_mainCamera);
+	
+	//Lights the cluster grid can't represent, such as shadowed ones, still get a pass each.
+	m_unclusteredLights.clear();
+	if(m_isClusteredLightingEnabled)
+	{
+		m_lightClusters.Clear();
+		for(unsigned int i = 0; i < m_lights.size(); i++)
+		{
+			if(!m_lights[i]->AddToLightClusters(&m_lightClusters))
 			{
-				BlurShadowMap(shadowMapIndex, shadowSoftness);
+				m_unclusteredLights.push_back(m_lights[i]);
 			}
 		}
-		else
+		
+		if(m_lightClusters.GetNumLights() != 0)
 		{
-			m_lightMatrix = Matrix4f().InitScale(Vector3f(0,0,0));
-			SetFloat("shadowVarianceMin", 0.00002f);
-			SetFloat("shadowLightBleedingReduction", 0.0f);
+			RenderClusteredLights();
 		}
+	}
+	else
+	{
+		m_unclusteredLights = m_lights;
+	}
 	
-		GetTexture("displayTexture").BindAsRenderTarget();
+	for(unsigned int i = 0; i < m_unclusteredLights.size(); i++)
+	{
+		m_activeLight = m_unclusteredLights[i];
+		
+		//Lights that can't reach anything on screen don't need their shadow map or their pass.
+		Vector3f lightCenter;
+		float lightRadius;
+		GLint scissorRect[4];
+		bool isLightBounded = m_activeLight->CalcBoundingSphere(&lightCenter, &lightRadius);
+		
+		#if PROFILING_DISABLE_LIGHT_CULLING != 0
+			isLightBounded = false;
+		#endif
+		
+		if(isLightBounded && !CalcScissorRect(lightCenter, lightRadius, scissorRect))
+		{
+			continue;
+		}
+		
+		RenderShadowMap();
+		
+		GetTexture(DISPLAY_TEXTURE).BindAsRenderTarget();
 		//m_window->BindAsRenderTarget();
 		
-//		glEnable(GL_SCISSOR_TEST);
-//		TODO: Make use of scissor test to limit light area
-//		glScissor(0, 0, 100, 100);
+		GLState::SetEnabled(GL_BLEND, true);
+		GLState::BlendFunc(GL_ONE, GL_ONE);
+		GLState::DepthMask(false);
+		GLState::DepthFunc(GL_EQUAL);
 		
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_ONE, GL_ONE);
-		glDepthMask(GL_FALSE);
-		glDepthFunc(GL_EQUAL);
-
-		object.RenderAll(m_activeLight->GetShader(), *this, *m_mainCamera);
+		if(isLightBounded)
+		{
+			GLState::SetEnabled(GL_SCISSOR_TEST, true);
+			GLState::Scissor(scissorRect[0], scissorRect[1], scissorRect[2], scissorRect[3]);
+			m_renderQueue.RenderInSphere(m_activeLight->GetShader(), *this, *m_mainCamera, lightCenter, lightRadius);
+			GLState::SetEnabled(GL_SCISSOR_TEST, false);
+		}
+		else
+		{
+			m_renderQueue.Render(m_activeLight->GetShader(), *this, *m_mainCamera);
+		}
 		
-		glDepthMask(GL_TRUE);
-		glDepthFunc(GL_LESS);
-		glDisable(GL_BLEND);
+		GLState::DepthMask(true);
+		GLState::DepthFunc(GL_LESS);
+		GLState::SetEnabled(GL_BLEND, false);
+	}
+}
+
+void RenderingEngine::RenderDeferred()
+{
+	//The geometry pass writes every surface's attributes once, and starts the
+	//lighting off with the ambient term.
+	m_gbuffer.BindAsRenderTarget();
+	glDrawBuffers(4, GBUFFER_DRAW_BUFFERS);
+	
+	glClearColor(0.0f,0.0f,0.0f,0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	m_renderQueue.Render(*m_gbufferShader, *this, *m_mainCamera);
+	
+	//Lets the light shaders rebuild world positions from the depth buffer.
+	const Matrix4f& projection = m_mainCamera->GetProjection();
+	const Quaternion& cameraRot = m_mainCamera->GetTransform().GetTransformedRot();
+	
+	SetVector3f(DEFERRED_EYE_POS, m_mainCamera->GetTransform().GetTransformedPos());
+	SetVector3f(DEFERRED_VIEW_RIGHT, cameraRot.GetRight() / projection[0][0]);
+	SetVector3f(DEFERRED_VIEW_UP, cameraRot.GetUp() / projection[1][1]);
+	SetVector3f(DEFERRED_VIEW_FORWARD, cameraRot.GetForward());
+	SetVector3f(DEFERRED_DEPTH, Vector3f(projection[2][2], projection[3][2], 0.0f));
+	
+	for(unsigned int i = 0; i < m_lights.size(); i++)
+	{
+		m_activeLight = m_lights[i];
+		m_activeLight->RenderDeferred(*this);
+	}
+}
+
+void RenderingEngine::RenderDeferredLight(const DirectionalLight& light)
+{
+	RenderShadowMap();
+	DrawDeferredLight(light.GetShadowInfo().GetNumCascades() > 1 ? *m_deferredDirectionalCascadedShader : *m_deferredDirectionalShader, 0);
+}
+
+void RenderingEngine::RenderDeferredLight(const PointLight& light)
+{
+	Vector3f lightCenter;
+	float lightRadius;
+	GLint scissorRect[4];
+	
+	light.CalcBoundingSphere(&lightCenter, &lightRadius);
+	if(!CalcScissorRect(lightCenter, lightRadius, scissorRect))
+	{
+		return;
+	}
+	
+	RenderShadowMap();
+	
+	//The light matrix is only right for shadowed lights when it's drawn without a model transform.
+	if(light.GetShadowInfo().GetShadowMapSizeAsPowerOf2() != 0)
+	{
+		DrawDeferredLight(*m_deferredPointShader, scissorRect);
+		return;
+	}
+	
+	m_lightVolumeTransform.SetPos(lightCenter);
+	m_lightVolumeTransform.SetRot(Quaternion(0,0,0,1));
+	m_lightVolumeTransform.SetScale(lightRadius);
+	DrawDeferredLightVolume(*m_deferredPointShader, *m_sphereVolume, 1.0f, scissorRect);
+}
+
+void RenderingEngine::RenderDeferredLight(const SpotLight& light)
+{
+	Vector3f lightCenter;
+	float lightRadius;
+	GLint scissorRect[4];
+	
+	light.CalcBoundingSphere(&lightCenter, &lightRadius);
+	if(!CalcScissorRect(lightCenter, lightRadius, scissorRect))
+	{
+		return;
+	}
+	
+	RenderShadowMap();
+	
+	if(light.GetShadowInfo().GetShadowMapSizeAsPowerOf2() != 0)
+	{
+		DrawDeferredLight(*m_deferredSpotShader, scissorRect);
+	}
+	else if(light.GetCutoff() >= MIN_CONE_VOLUME_CUTOFF)
+	{
+		float cutoff = light.GetCutoff();
 		
-//		glDisable(GL_SCISSOR_TEST);
+		m_lightVolumeTransform.SetPos(light.GetTransform().GetTransformedPos());
+		m_lightVolumeTransform.SetRot(light.GetTransform().GetTransformedRot());
+		m_lightVolumeTransform.SetScale(light.GetRange());
+		DrawDeferredLightVolume(*m_deferredSpotShader, *m_coneVolume, sqrtf(1.0f - cutoff * cutoff) / cutoff, scissorRect);
+	}
+	else
+	{
+		m_lightVolumeTransform.SetPos(lightCenter);
+		m_lightVolumeTransform.SetRot(Quaternion(0,0,0,1));
+		m_lightVolumeTransform.SetScale(lightRadius);
+		DrawDeferredLightVolume(*m_deferredSpotShader, *m_sphereVolume, 1.0f, scissorRect);
+	}
+}
+
+void RenderingEngine::DrawDeferredLight(const Shader& shader, const GLint* scissorRect)
+{
+	m_gbuffer.BindAsRenderTarget();
+	glDrawBuffer(GBUFFER_DRAW_BUFFERS[GBUFFER_LIGHTING]);
+	
+	if(scissorRect)
+	{
+		GLState::SetEnabled(GL_SCISSOR_TEST, true);
+		GLState::Scissor(scissorRect[0], scissorRect[1], scissorRect[2], scissorRect[3]);
+	}
+	
+	GLState::SetEnabled(GL_DEPTH_TEST, false);
+	GLState::SetEnabled(GL_CULL_FACE, false);
+	GLState::SetEnabled(GL_BLEND, true);
+	GLState::BlendFunc(GL_ONE, GL_ONE);
+	
+	//The quad is already in clip space, so it's drawn with an identity camera.
+	m_altCamera.SetProjection(Matrix4f().InitIdentity());
+	m_altCamera.GetTransform()->SetPos(Vector3f(0,0,0));
+	m_altCamera.GetTransform()->SetRot(Quaternion(0,0,0,1));
+	
+	SetFloat(DEFERRED_VOLUME_SPREAD, 1.0f);
+	shader.Bind();
+	shader.UpdateUniforms(m_screenQuadTransform, m_planeMaterial, *this, m_altCamera);
+	m_screenQuad->Draw();
+	
+	GLState::SetEnabled(GL_BLEND, false);
+	GLState::SetEnabled(GL_CULL_FACE, true);
+	GLState::SetEnabled(GL_DEPTH_TEST, true);
+	GLState::SetEnabled(GL_SCISSOR_TEST, false);
+}
+
+void RenderingEngine::DrawDeferredLightVolume(const Shader& shader, const Mesh& volume, float spread, const GLint* scissorRect)
+{
+	m_gbuffer.BindAsRenderTarget();
+	SetFloat(DEFERRED_VOLUME_SPREAD, spread);
+	
+	if(scissorRect)
+	{
+		GLState::SetEnabled(GL_SCISSOR_TEST, true);
+		GLState::Scissor(scissorRect[0], scissorRect[1], scissorRect[2], scissorRect[3]);
 	}
 	
-	float displayTextureAspect = (float)GetTexture("displayTexture").GetWidth()/(float)GetTexture("displayTexture").GetHeight();
-	float displayTextureHeightAdditive = displayTextureAspect * GetFloat("fxaaAspectDistortion");
-	SetVector3f("inverseFilterTextureSize", Vector3f(1.0f/(float)GetTexture("displayTexture").GetWidth(), 
-	                                                 1.0f/((float)GetTexture("displayTexture").GetHeight() + displayTextureHeightAdditive), 0.0f));
+	glClear(GL_STENCIL_BUFFER_BIT);
+	
+	//Stencil pass: each pixel counts the volume's back faces behind its surface, minus
+	//the front faces behind it. Only surfaces inside the volume are left with a non-zero
+	//count, and that holds with the camera inside the volume too.
+	glDrawBuffer(GL_NONE);
+	GLState::SetEnabled(GL_STENCIL_TEST, true);
+	GLState::SetEnabled(GL_CULL_FACE, false);
+	GLState::SetEnabled(GL_DEPTH_CLAMP, true);
+	GLState::DepthMask(false);
+	GLState::StencilFunc(GL_ALWAYS, 0, 0xFF);
+	GLState::StencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+	GLState::StencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+	
+	m_deferredStencilShader->Bind();
+	m_deferredStencilShader->UpdateUniforms(m_lightVolumeTransform, m_planeMaterial, *this, *m_mainCamera);
+	volume.Draw();
+	
+	//Light pass: back faces only, so each pixel is lit once even if the camera's inside.
+	glDrawBuffer(GBUFFER_DRAW_BUFFERS[GBUFFER_LIGHTING]);
+	GLState::StencilFunc(GL_NOTEQUAL, 0, 0xFF);
+	GLState::SetEnabled(GL_DEPTH_TEST, false);
+	GLState::SetEnabled(GL_CULL_FACE, true);
+	GLState::CullFace(GL_FRONT);
+	GLState::SetEnabled(GL_BLEND, true);
+	GLState::BlendFunc(GL_ONE, GL_ONE);
+	
+	shader.Bind();
+	shader.UpdateUniforms(m_lightVolumeTransform, m_planeMaterial, *this, *m_mainCamera);
+	volume.Draw();
+	
+	GLState::SetEnabled(GL_BLEND, false);
+	GLState::CullFace(GL_BACK);
+	GLState::SetEnabled(GL_DEPTH_TEST, true);
+	GLState::SetEnabled(GL_DEPTH_CLAMP, false);
+	GLState::DepthMask(true);
+	GLState::SetEnabled(GL_STENCIL_TEST, false);
+	GLState::SetEnabled(GL_SCISSOR_TEST, false);
+}
+
+void RenderingEngine::Render(const Entity& object)
+{
+	m_renderProfileTimer.StartInvocation();
+	
+	UpdateSceneTree();
+	
+	//Every pass below draws from the same queue, so it's only gathered once.
+	m_renderQueue.Clear();
+	m_renderQueue.SetLODCamera(m_mainCamera);
+	object.AddToRenderQueueAll(m_renderQueue);
+	InvalidateShadowMaps();
+	m_shadowAtlas.NextFrame();
+	UpdateOcclusionCuller();
+	
+	if(m_renderPath == RENDER_PATH_DEFERRED)
+	{
+		RenderDeferred();
+	}
+	else
+	{
+		RenderForward();
+	}
+	
+	float displayTextureAspect = (float)GetTexture(DISPLAY_TEXTURE).GetWidth()/(float)GetTexture(DISPLAY_TEXTURE).GetHeight();
+	float displayTextureHeightAdditive = displayTextureAspect * GetFloat(FXAA_ASPECT_DISTORTION);
+	SetVector3f(INVERSE_FILTER_TEXTURE_SIZE, Vector3f(1.0f/(float)GetTexture(DISPLAY_TEXTURE).GetWidth(), 
+	                                               1.0f/((float)GetTexture(DISPLAY_TEXTURE).GetHeight() + displayTextureHeightAdditive), 0.0f));
 	m_renderProfileTimer.StopInvocation();
 	
 	m_windowSyncProfileTimer.StartInvocation();
-	ApplyFilter(m_fxaaFilter, GetTexture("displayTexture"), 0);
+	ApplyFilter(m_fxaaFilter, GetTexture(DISPLAY_TEXTURE), 0);
 	m_windowSyncProfileTimer.StopInvocation();
 }
+
+void RenderingEngine::Test()
+{
+	//A camera at the origin looking down +Z, onto an 800x600 target.
+	static const int WIDTH = 800;
+	static const int HEIGHT = 600;
+	Matrix4f viewProjection = Matrix4f().InitPerspective(ToRadians(70.0f), (float)WIDTH / (float)HEIGHT, 0.1f, 1000.0f);
+	GLint rect[4];
+	
+	//A small light in the middle of the view gets a small rectangle around the middle of the screen.
+	bool isVisible = CalcScissorRect(viewProjection, WIDTH, HEIGHT, Vector3f(0.0f, 0.0f, 10.0f), 1.0f, rect);
+	assert(isVisible);
+	assert(rect[0] > 0 && rect[1] > 0 && rect[0] + rect[2] < WIDTH && rect[1] + rect[3] < HEIGHT);
+	assert(rect[0] < WIDTH / 2 && rect[0] + rect[2] > WIDTH / 2);
+	assert(rect[1] < HEIGHT / 2 && rect[1] + rect[3] > HEIGHT / 2);
+	
+	//One hanging off the right and top edges is clamped to the viewport.
+	isVisible = CalcScissorRect(viewProjection, WIDTH, HEIGHT, Vector3f(8.0f, 6.0f, 10.0f), 3.0f, rect);
+	assert(isVisible);
+	assert(rect[0] > 0 && rect[1] > 0);
+	assert(rect[0] + rect[2] == WIDTH && rect[1] + rect[3] == HEIGHT);
+	
+	//With the camera inside the light, or the light reaching behind the camera, the 
+	//projection isn't bounded and the whole screen is used.
+	Vector3f unboundedCenters[] = { Vector3f(0.0f, 0.0f, 0.5f), Vector3f(0.0f, 0.0f, -1.0f) };
+	float unboundedRadii[] = { 2.0f, 1.5f };
+	
+	for(int i = 0; i < 2; i++)
+	{
+		isVisible = CalcScissorRect(viewProjection, WIDTH, HEIGHT, unboundedCenters[i], unboundedRadii[i], rect);
+		assert(isVisible);
+		assert(rect[0] == 0 && rect[1] == 0 && rect[2] == WIDTH && rect[3] == HEIGHT);
+	}
+	
+	//A light entirely behind the camera can't be seen at all.
+	isVisible = CalcScissorRect(viewProjection, WIDTH, HEIGHT, Vector3f(0.0f, 0.0f, -10.0f), 1.0f, rect);
+	assert(!isVisible);
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+
+//Adds a face that's clockwise seen from outside the convex volume around interiorPoint,
+//so that front and back faces can be told apart like any other mesh's.
+static void AddOutwardFace(IndexedModel* model, const Vector3f& interiorPoint, unsigned int i0, unsigned int i1, unsigned int i2)
+{
+	const std::vector<Vector3f>& positions = model->GetPositions();
+	Vector3f normal = (positions[i1] - positions[i0]).Cross(positions[i2] - positions[i0]);
+	
+	if(normal.Dot(positions[i0] - interiorPoint) >= 0.0f)
+		model->AddFace(i0, i1, i2);
+	else
+		model->AddFace(i0, i2, i1);
+}
+
+//A unit sphere. Its faces are pushed out so the whole sphere is inside them.
+static IndexedModel CreateSphereVolume(int numSegments, int numRings)
+{
+	IndexedModel model;
+	float radius = 1.0f / (cosf(MATH_PI / numSegments) * cosf(MATH_PI / (2 * numRings)));
+	
+	model.AddVertex(0.0f, radius, 0.0f);  model.AddTexCoord(0.0f, 0.0f);
+	model.AddVertex(0.0f, -radius, 0.0f); model.AddTexCoord(0.0f, 0.0f);
+	
+	for(int ring = 1; ring < numRings; ring++)
+	{
+		float theta = MATH_PI * ring / numRings;
+		
+		for(int segment = 0; segment < numSegments; segment++)
+		{
+			float phi = 2.0f * MATH_PI * segment / numSegments;
+			model.AddVertex(radius * sinf(theta) * cosf(phi), radius * cosf(theta), radius * sinf(theta) * sinf(phi));
+			model.AddTexCoord(0.0f, 0.0f);
+		}
+	}
+	
+	for(int segment = 0; segment < numSegments; segment++)
+	{
+		int next = (segment + 1) % numSegments;
+		int lastRing = 2 + (numRings - 2) * numSegments;
+		
+		AddOutwardFace(&model, Vector3f(0,0,0), 0, 2 + segment, 2 + next);
+		AddOutwardFace(&model, Vector3f(0,0,0), 1, lastRing + segment, lastRing + next);
+		
+		for(int ring = 0; ring < numRings - 2; ring++)
+		{
+			int top = 2 + ring * numSegments;
+			int bottom = top + numSegments;
+			
+			AddOutwardFace(&model, Vector3f(0,0,0), top + segment, bottom + segment, bottom + next);
+			AddOutwardFace(&model, Vector3f(0,0,0), top + segment, bottom + next, top + next);
+		}
+	}
+	
+	return model.Finalize();
+}
+
+//A cone with its apex at the origin, opening along +Z to a base of radius 1 at Z = 1.
+//The vertex shader widens it to each light's cutoff.
+static IndexedModel CreateConeVolume(int numSegments)
+{
+	IndexedModel model;
+	float radius = 1.0f / cosf(MATH_PI / numSegments);
+	Vector3f interiorPoint(0.0f, 0.0f, 0.5f);
+	
+	model.AddVertex(0.0f, 0.0f, 0.0f); model.AddTexCoord(0.0f, 0.0f);
+	model.AddVertex(0.0f, 0.0f, 1.0f); model.AddTexCoord(0.0f, 0.0f);
+	
+	for(int segment = 0; segment < numSegments; segment++)
+	{
+		float phi = 2.0f * MATH_PI * segment / numSegments;
+		model.AddVertex(radius * cosf(phi), radius * sinf(phi), 1.0f);
+		model.AddTexCoord(0.0f, 0.0f);
+	}
+	
+	for(int segment = 0; segment < numSegments; segment++)
+	{
+		int next = (segment + 1) % numSegments;
+		
+		AddOutwardFace(&model, interiorPoint, 0, 2 + segment, 2 + next);
+		AddOutwardFace(&model, interiorPoint, 1, 2 + next, 2 + segment);
+	}
+	
+	return model.Finalize();
+}
+
+//Covers the screen when drawn with an identity view projection.
+static IndexedModel CreateScreenQuad()
+{
+	IndexedModel model;
+	
+	model.AddVertex(-1.0f, -1.0f, 0.0f); model.AddTexCoord(0.0f, 0.0f);
+	model.AddVertex(1.0f, -1.0f, 0.0f);  model.AddTexCoord(1.0f, 0.0f);
+	model.AddVertex(-1.0f, 1.0f, 0.0f);  model.AddTexCoord(0.0f, 1.0f);
+	model.AddVertex(1.0f, 1.0f, 0.0f);   model.AddTexCoord(1.0f, 1.0f);
+	model.AddFace(0, 2, 1); model.AddFace(1, 2, 3);
+	
+	return model.Finalize();
+}
@@ -17,10 +17,18 @@
 #ifndef RENDERINGENGINE_H
 #define RENDERINGENGINE_H
 
+#include "boundingVolumeHierarchy.h"
 #include "camera.h"
+#include "lightClusters.h"
 #include "lighting.h"
 #include "material.h"
 #include "mesh.h"
+#include "occlusionCuller.h"
+#include "renderQueue.h"
+#include "renderTargetPool.h"
+#include "shadowAtlas.h"
+#include "shadowCascades.h"
+#include "shadowMapCache.h"
 #include "window.h"
 
 #include "../core/mappedValues.h"
@@ -29,18 +37,64 @@
 #include <vector>
 #include <map>
 class Entity;
+class JobSystem;
 
 class RenderingEngine : public MappedValues
 {
 public:
-	RenderingEngine(const Window& window);
-	virtual ~RenderingEngine() {}
+	enum RenderPath
+	{
+		RENDER_PATH_FORWARD,
+		RENDER_PATH_DEFERRED  //Needs OpenGL 3.0, and falls back to forward without it
+	};
+	
+	RenderingEngine(const Window& window, RenderPath renderPath = RENDER_PATH_FORWARD);
+	virtual ~RenderingEngine();
 	
 	void Render(const Entity& object);
 	
 	inline void AddLight(const BaseLight& light) { m_lights.push_back(&light); }
 	inline void SetMainCamera(const Camera& camera) { m_mainCamera = &camera; }
 	
+	//Packets in the scene tree are drawn every frame until they are removed, without
+	//being added to the RenderQueue. Their owner must keep them alive until then.
+	void AddToSceneTree(RenderPacket* packet);
+	void RemoveFromSceneTree(RenderPacket* packet);
+	
+	//Safe to call from any thread. The packet's bounds are updated before the next frame is drawn.
+	void OnSceneTreePacketMoved(const RenderPacket& packet);
+	
+	//Meshes and textures swapped in for their placeholders change both the bounds of
+	//whatever uses them and what shadows look like.
+	void OnAssetsUploaded();
+	
+	//Every packet in the scene, for culling and region queries. The user data is the RenderPacket.
+	inline const BoundingVolumeHierarchy& GetSceneTree() const { return m_sceneTree; }
+	
+	inline RenderPath GetRenderPath() const { return m_renderPath; }
+	
+	//Work such as occlusion culling is spread over the jobSystem's threads. Optional.
+	inline void SetJobSystem(JobSystem* jobSystem) { m_jobSystem = jobSystem; }
+	
+	//Skips drawing meshes hidden behind the largest meshes on screen from the main camera.
+	inline void SetOcclusionCulling(bool enabled)     { m_isOcclusionCullingEnabled = enabled; }
+	inline bool IsOcclusionCullingEnabled()     const { return m_isOcclusionCullingEnabled; }
+	
+	//How many levels of detail coarser than the main view shadow maps draw meshes at.
+	inline void SetShadowLODBias(int bias)            { m_shadowLODBias = bias; }
+	inline int GetShadowLODBias()               const { return m_shadowLODBias; }
+	
+	//Applies a light to the G-buffer when the deferred path is used. Lights call the
+	//overload for their own type from BaseLight::RenderDeferred.
+	void RenderDeferredLight(const DirectionalLight& light);
+	void RenderDeferredLight(const PointLight& light);
+	void RenderDeferredLight(const SpotLight& light);
+	
+	//Shades unshadowed point and spot lights in one clustered forward pass instead of a
+	//pass each. Has no effect on the deferred path, or where buffer textures aren't supported.
+	inline void SetClusteredLighting(bool enabled)    { m_isClusteredLightingEnabled = enabled && m_clusteredShader; }
+	inline bool IsClusteredLightingEnabled()    const { return m_isClusteredLightingEnabled; }
+	
 	virtual void UpdateUniformStruct(const Transform& transform, const Material& material, const Shader& shader, 
 		const std::string& uniformName, const std::string& uniformType) const
 	{
@@ -50,25 +104,61 @@ public:
 	inline double DisplayRenderTime(double dividend) { return m_renderProfileTimer.DisplayAndReset("Render Time: ", dividend); }
 	inline double DisplayWindowSyncTime(double dividend) { return m_windowSyncProfileTimer.DisplayAndReset("Window Sync Time: ", dividend); }
 	
+	//Part of the render time.
+	inline double DisplayOcclusionCullingTime(double dividend) { return m_occlusionProfileTimer.DisplayAndReset("Occlusion Culling Time: ", dividend); }
+	
+	//Totals for the last frame, over every pass.
+	inline int GetNumDrawCalls()       const { return m_renderQueue.GetNumDrawCalls(); }
+	inline int GetNumTriangles()       const { return m_renderQueue.GetNumTriangles(); }
+	inline int GetNumVisiblePackets()  const { return m_renderQueue.GetNumVisible(); }
+	inline int GetNumCulledPackets()   const { return m_renderQueue.GetNumCulled(); }
+	inline int GetNumOccludedPackets() const { return m_renderQueue.GetNumOccluded(); }
+	
+	//Shadow maps reused from an earlier frame and rendered again, since ResetShadowMapCounters.
+	inline int GetNumShadowMapsCached()   const { return m_shadowMapCache.GetNumHits(); }
+	inline int GetNumShadowMapsRendered() const { return m_shadowMapCache.GetNumMisses(); }
+	inline void ResetShadowMapCounters()        { m_shadowMapCache.ResetCounters(); }
+	
 	inline const BaseLight& GetActiveLight()                           const { return *m_activeLight; }
-	inline unsigned int GetSamplerSlot(const std::string& samplerName) const { return m_samplerMap.find(samplerName)->second; }
+	inline unsigned int GetSamplerSlot(int samplerId)                  const 
+	{ 
+		return (samplerId >= 0 && samplerId < (int)m_samplerSlots.size()) ? m_samplerSlots[samplerId] : 0; 
+	}
+	
+	inline unsigned int GetSamplerSlot(const std::string& samplerName) const { return GetSamplerSlot(PropertyTable::FindId(samplerName)); }
+	
+	inline GLuint GetSamplerBuffer(int id)                             const 
+	{ 
+		const GLuint* texture = m_samplerBuffers.Get(id);
+		return texture ? *texture : 0;
+	}
+	
 	inline const Matrix4f& GetLightMatrix()                            const { return m_lightMatrix; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
 protected:
-	inline void SetSamplerSlot(const std::string& name, unsigned int value) { m_samplerMap[name] = value; }
+	void SetSamplerSlot(const std::string& name, unsigned int value);
 private:
-	static const int NUM_SHADOW_MAPS = 10;
+	static const int MAX_SHADOW_ATLAS_SIZE_AS_POWER_OF_2 = 11;
 	static const Matrix4f BIAS_MATRIX;
 
 	ProfileTimer                        m_renderProfileTimer;
 	ProfileTimer                        m_windowSyncProfileTimer;
+	ProfileTimer                        m_occlusionProfileTimer;
 	Transform                           m_planeTransform;
 	Mesh                                m_plane;
 	
 	const Window*                       m_window;
 	Texture                             m_tempTarget;
 	Material                            m_planeMaterial;
-	Texture                             m_shadowMaps[NUM_SHADOW_MAPS];
-	Texture                             m_shadowMapTempTargets[NUM_SHADOW_MAPS];
+	Texture                             m_noShadowMap;
+	Texture                             m_shadowAtlasTexture;
+	ShadowAtlas                         m_shadowAtlas;
+	std::map<const BaseLight*, Texture> m_shadowCascadeMaps;
+	RenderTargetPool                    m_renderTargetPool;
+	ShadowMapCache                      m_shadowMapCache;
+	std::vector<Vector3f>               m_changedBounds;    //Min and max of each box that changed since the last frame
 	
 	Shader                              m_defaultShader;
 	Shader                              m_shadowMapShader;
@@ -82,12 +172,82 @@ private:
 	const Camera*                       m_mainCamera;
 	const BaseLight*                    m_activeLight;
 	std::vector<const BaseLight*>       m_lights;
-	std::map<std::string, unsigned int> m_samplerMap;
+	RenderQueue                         m_renderQueue;
+	BoundingVolumeHierarchy             m_sceneTree;
+	std::vector<int>                    m_movedSceneTreeHandles;
+	SDL_SpinLock                        m_movedSceneTreeLock;
+	Shader*                             m_gausBlurArrayFilter; //Only created where array textures are supported
+	std::vector<unsigned int>           m_samplerSlots; //Indexed by PropertyTable id
+	PropertyArray<GLuint>               m_samplerBuffers;
+	JobSystem*                          m_jobSystem;
+	
+	OcclusionCuller                     m_occlusionCuller;
+	bool                                m_isOcclusionCullingEnabled;
+	std::vector<void*>                  m_occluderQueryResults;
+	std::vector<std::pair<float, const RenderPacket*> > m_occluders; //Each with how much of the screen it covers
+	int                                 m_shadowLODBias;
+	
+	LightClusters                       m_lightClusters;
+	Shader*                             m_clusteredShader;
+	bool                                m_isClusteredLightingEnabled;
+	std::vector<const BaseLight*>       m_unclusteredLights;
+	
+	//Everything below is only created for the deferred path.
+	RenderPath                          m_renderPath;
+	Texture                             m_gbuffer;
+	Shader*                             m_gbufferShader;
+	Shader*                             m_deferredStencilShader;
+	Shader*                             m_deferredDirectionalShader;
+	Shader*                             m_deferredDirectionalCascadedShader;
+	Shader*                             m_deferredPointShader;
+	Shader*                             m_deferredSpotShader;
+	Mesh*                               m_sphereVolume;
+	Mesh*                               m_coneVolume;
+	Mesh*                               m_screenQuad;
+	Transform                           m_lightVolumeTransform;
+	Transform                           m_screenQuadTransform;
+	
+	void UpdateSceneTree();
+	void InvalidateShadowMaps();
+	
+	//Rasterizes the main camera's largest visible meshes into the occlusion culler.
+	void UpdateOcclusionCuller();
+	void InitDeferred();
+	void RenderForward();
+	void RenderDeferred();
+	
+	//Binds the active light's shadow map, rendering it first unless it's still cached.
+	void RenderShadowMap();
+	void RenderShadowCascades(const Texture& shadowMap, const ShadowInfo& shadowInfo);
+	const Texture& GetShadowCascadeMap(const ShadowInfo& shadowInfo);
+	
+	//Finds the active light's region of the shadow atlas, making the atlas texture bigger if the atlas grew.
+	ShadowAtlas::Region AcquireShadowAtlasRegion(const ShadowInfo& shadowInfo);
+	
+	//Renders the shadow casters into target from a shadow camera, and returns its view projection.
+	Matrix4f DrawShadowCasters(const Texture& target, const ShadowInfo& shadowInfo, const Matrix4f& projection, 
+	                           const Vector3f& pos, const Quaternion& rot);
+	
+	//Deferred light passes, either over the whole screen or over the pixels whose
+	//surfaces are inside the light volume. Both are limited to scissorRect if it's given.
+	void DrawDeferredLight(const Shader& shader, const GLint* scissorRect);
+	void DrawDeferredLightVolume(const Shader& shader, const Mesh& volume, float spread, const GLint* scissorRect);
+	
+	//Finds the part of the screen the sphere covers, as x, y, width and height in pixels.
+	//Returns false if the sphere can't be seen at all.
+	bool CalcScissorRect(const Vector3f& center, float radius, GLint* rect) const;
+	static bool CalcScissorRect(const Matrix4f& viewProjection, int width, int height, 
+	                            const Vector3f& center, float radius, GLint* rect);
+	void RenderClusteredLights();
+	
+	//Blurs one layer of shadowMap into dest, which can be that same layer.
+	void BlurShadowMap(const Texture& shadowMap, int layer, const Texture& dest, const GLint* destRect, float blurAmount);
 	
-	void BlurShadowMap(int shadowMapIndex, float blurAmount);
-	void ApplyFilter(const Shader& filter, const Texture& source, const Texture* dest);
+	//Draws source through the filter to all of dest, or to the x, y, width and height in destRect if it's given.
+	void ApplyFilter(const Shader& filter, const Texture& source, const Texture* dest, const GLint* destRect = 0);
 	
 	RenderingEngine(const RenderingEngine& other) :
+		m_shadowAtlas(0),
 		m_altCamera(Matrix4f(),0){}
 	void operator=(const RenderingEngine& other) {}
 };
@@ -17,6 +17,7 @@
 #include "shader.h"
 #include "lighting.h"
 #include "renderingEngine.h"
+#include "glState.h"
 
 #include "../core/profiling.h"
 #include "../core/util.h"
@@ -44,11 +45,13 @@ static std::vector<UniformStruct> FindUniformStructs(const std::string& shaderTe
 static std::string FindUniformStructName(const std::string& structStartToOpeningBrace);
 static std::vector<TypedData> FindUniformStructComponents(const std::string& openingBraceToClosingBrace);
 static std::string LoadShader(const std::string& fileName);
+static int FindUniformLocation(const std::map<std::string, unsigned int>& uniformMap, const std::string& uniformName);
 
 //--------------------------------------------------------------------------------
 // Constructors/Destructors
 //--------------------------------------------------------------------------------
-ShaderData::ShaderData(const std::string& fileName)
+ShaderData::ShaderData(const std::string& fileName, bool isInstanced) :
+	m_isInstanced(isInstanced)
 {
 	std::string actualFileName = fileName;
 	#if PROFILING_DISABLE_SHADING != 0
@@ -108,15 +111,21 @@ ShaderData::ShaderData(const std::string& fileName)
 	}
     
 	std::string shaderText = LoadShader(actualFileName + ".glsl");
+	m_supportsInstancing = shaderText.find("INSTANCED_BUILD") != std::string::npos;
+	
+	std::string header = "#version " + s_glslVersion + "\n#define GLSL_VERSION " + s_glslVersion + "\n";
+	if(m_isInstanced)
+		header += "#define INSTANCED_BUILD\n";
 
-	std::string vertexShaderText = "#version " + s_glslVersion + "\n#define VS_BUILD\n#define GLSL_VERSION " + s_glslVersion + "\n" + shaderText;
-	std::string fragmentShaderText = "#version " + s_glslVersion + "\n#define FS_BUILD\n#define GLSL_VERSION " + s_glslVersion + "\n" + shaderText;
+	std::string vertexShaderText = header + "#define VS_BUILD\n" + shaderText;
+	std::string fragmentShaderText = header + "#define FS_BUILD\n" + shaderText;
     
     AddVertexShader(vertexShaderText);
 	AddFragmentShader(fragmentShaderText);
 	
 	std::string attributeKeyword = "attribute";
 	AddAllAttributes(vertexShaderText, attributeKeyword);
+	AddAllFragOutputs(fragmentShaderText);
 	
 	CompileShader();
 	
@@ -131,13 +140,16 @@ ShaderData::~ShaderData()
 		glDeleteShader(*it);
 	}
 	glDeleteProgram(m_program);
+	GLState::OnProgramDeleted(m_program);
 }
 
-Shader::Shader(const std::string& fileName)
+Shader::Shader(const std::string& fileName, bool isInstanced) :
+	m_instancedShader(0)
 {
-	m_fileName = fileName;
+	//Both builds of a file are shared resources, so they need different keys.
+	m_fileName = isInstanced ? fileName + "#instanced" : fileName;
 
-	std::map<std::string, ShaderData*>::const_iterator it = s_resourceMap.find(fileName);
+	std::map<std::string, ShaderData*>::const_iterator it = s_resourceMap.find(m_fileName);
 	if(it != s_resourceMap.end())
 	{
 		m_shaderData = it->second;
@@ -145,20 +157,23 @@ Shader::Shader(const std::string& fileName)
 	}
 	else
 	{
-		m_shaderData = new ShaderData(fileName);
-		s_resourceMap.insert(std::pair<std::string, ShaderData*>(fileName, m_shaderData));
+		m_shaderData = new ShaderData(fileName, isInstanced);
+		s_resourceMap.insert(std::pair<std::string, ShaderData*>(m_fileName, m_shaderData));
 	}
 }
 
 Shader::Shader(const Shader& other) :
 	m_shaderData(other.m_shaderData),
-	m_fileName(other.m_fileName)
+	m_fileName(other.m_fileName),
+	m_instancedShader(0)
 {
 	m_shaderData->AddReference();
 }
 
 Shader::~Shader()
 {
+	if(m_instancedShader) delete m_instancedShader;
+	
 	if(m_shaderData && m_shaderData->RemoveReference())
 	{
 		if(m_fileName.length() > 0)
@@ -173,74 +188,114 @@ Shader::~Shader()
 //--------------------------------------------------------------------------------
 void Shader::Bind() const
 {
-	glUseProgram(m_shaderData->GetProgram());
+	GLState::UseProgram(m_shaderData->GetProgram());
+}
+
+const Shader& Shader::GetInstancedShader() const
+{
+	if(m_shaderData->IsInstanced() || !m_shaderData->SupportsInstancing())
+		return *this;
+	
+	if(m_instancedShader == 0)
+		m_instancedShader = new Shader(m_fileName, true);
+	
+	return *m_instancedShader;
+}
+
+static inline void SetGLUniformVector3f(int location, const Vector3f& value)
+{
+	glUniform3f(location, value.GetX(), value.GetY(), value.GetZ());
+}
+
+//Sets a uniform whose value is stored by id in a MappedValues-like object,
+//which is either the rendering engine or a material.
+template<class T>
+static void SetMappedUniform(const UniformBinding& binding, const T& values, const RenderingEngine& renderingEngine)
+{
+	switch(binding.GetType())
+	{
+	case UniformBinding::TYPE_SAMPLER2D:
+	{
+		int samplerSlot = renderingEngine.GetSamplerSlot(binding.GetValueId());
+		values.GetTexture(binding.GetValueId()).Bind(samplerSlot);
+		glUniform1i(binding.GetLocation(), samplerSlot);
+		break;
+	}
+	case UniformBinding::TYPE_VECTOR3F:
+	{
+		SetGLUniformVector3f(binding.GetLocation(), values.GetVector3f(binding.GetValueId()));
+		break;
+	}
+	case UniformBinding::TYPE_FLOAT:
+		glUniform1f(binding.GetLocation(), values.GetFloat(binding.GetValueId()));
+		break;
+	default:
+		break;
+	}
 }
 
 void Shader::UpdateUniforms(const Transform& transform, const Material& material, const RenderingEngine& renderingEngine, const Camera& camera) const
 {
-	Matrix4f worldMatrix = transform.GetTransformation();
+	//Instanced builds apply each instance's world matrix themselves, so transform
+	//uniforms are given in world space instead.
+	static const Matrix4f IDENTITY = Matrix4f().InitIdentity();
+	const Matrix4f& worldMatrix = m_shaderData->IsInstanced() ? IDENTITY : transform.GetTransformation();
 	Matrix4f projectedMatrix = camera.GetViewProjection() * worldMatrix;
+	const std::vector<UniformBinding>& bindings = m_shaderData->GetUniformBindings();
 	
-	for(unsigned int i = 0; i < m_shaderData->GetUniformNames().size(); i++)
+	for(unsigned int i = 0; i < bindings.size(); i++)
 	{
-		std::string uniformName = m_shaderData->GetUniformNames()[i];
-		std::string uniformType = m_shaderData->GetUniformTypes()[i];
+		const UniformBinding& binding = bindings[i];
 		
-		if(uniformName.substr(0, 2) == "R_")
+		switch(binding.GetSource())
 		{
-			std::string unprefixedName = uniformName.substr(2, uniformName.length());
-			
-			if(unprefixedName == "lightMatrix")
-				SetUniformMatrix4f(uniformName, renderingEngine.GetLightMatrix() * worldMatrix);
-			else if(uniformType == "sampler2D")
+		case UniformBinding::SOURCE_TRANSFORM:
+			if(binding.GetType() == UniformBinding::TYPE_MVP_MATRIX)
+				glUniformMatrix4fv(binding.GetLocation(), 1, GL_FALSE, &(projectedMatrix[0][0]));
+			else if(binding.GetType() == UniformBinding::TYPE_MODEL_MATRIX)
+				glUniformMatrix4fv(binding.GetLocation(), 1, GL_FALSE, &(worldMatrix[0][0]));
+			else
+			{
+				Matrix4f lightMatrix = renderingEngine.GetLightMatrix() * worldMatrix;
+				glUniformMatrix4fv(binding.GetLocation(), 1, GL_FALSE, &(lightMatrix[0][0]));
+			}
+			break;
+		case UniformBinding::SOURCE_CAMERA:
+			SetGLUniformVector3f(binding.GetLocation(), camera.GetTransform().GetTransformedPos());
+			break;
+		case UniformBinding::SOURCE_ENGINE:
+			if(binding.GetType() == UniformBinding::TYPE_SAMPLER_BUFFER)
 			{
-				int samplerSlot = renderingEngine.GetSamplerSlot(unprefixedName);
-				renderingEngine.GetTexture(unprefixedName).Bind(samplerSlot);
-				SetUniformi(uniformName, samplerSlot);
+				int samplerSlot = renderingEngine.GetSamplerSlot(binding.GetValueId());
+				GLState::BindTexture(samplerSlot, GL_TEXTURE_BUFFER, renderingEngine.GetSamplerBuffer(binding.GetValueId()));
+				glUniform1i(binding.GetLocation(), samplerSlot);
 			}
-			else if(uniformType == "vec3")
-				SetUniformVector3f(uniformName, renderingEngine.GetVector3f(unprefixedName));
-			else if(uniformType == "float")
-				SetUniformf(uniformName, renderingEngine.GetFloat(unprefixedName));
-			else if(uniformType == "DirectionalLight")
-				SetUniformDirectionalLight(uniformName, *(const DirectionalLight*)&renderingEngine.GetActiveLight());
-			else if(uniformType == "PointLight")
-				SetUniformPointLight(uniformName, *(const PointLight*)&renderingEngine.GetActiveLight());
-			else if(uniformType == "SpotLight")
-				SetUniformSpotLight(uniformName, *(const SpotLight*)&renderingEngine.GetActiveLight());
 			else
-				renderingEngine.UpdateUniformStruct(transform, material, *this, uniformName, uniformType);
-		}
-		else if(uniformType == "sampler2D")
-		{
-			int samplerSlot = renderingEngine.GetSamplerSlot(uniformName);
-			material.GetTexture(uniformName).Bind(samplerSlot);
-			SetUniformi(uniformName, samplerSlot);
-		}
-		else if(uniformName.substr(0, 2) == "T_")
-		{
-			if(uniformName == "T_MVP")
-				SetUniformMatrix4f(uniformName, projectedMatrix);
-			else if(uniformName == "T_model")
-				SetUniformMatrix4f(uniformName, worldMatrix);
+			{
+				SetMappedUniform(binding, renderingEngine, renderingEngine);
+			}
+			break;
+		case UniformBinding::SOURCE_MATERIAL:
+			SetMappedUniform(binding, material, renderingEngine);
+			break;
+		case UniformBinding::SOURCE_LIGHT:
+			if(binding.GetType() == UniformBinding::TYPE_DIRECTIONAL_LIGHT)
+				SetUniformDirectionalLight(binding, *(const DirectionalLight*)&renderingEngine.GetActiveLight());
+			else if(binding.GetType() == UniformBinding::TYPE_POINT_LIGHT)
+				SetUniformPointLight(binding, *(const PointLight*)&renderingEngine.GetActiveLight());
 			else
-				throw "Invalid Transform Uniform: " + uniformName;
-		}
-		else if(uniformName.substr(0, 2) == "C_")
-		{
-			if(uniformName == "C_eyePos")
-				SetUniformVector3f(uniformName, camera.GetTransform().GetTransformedPos());
+				SetUniformSpotLight(binding, *(const SpotLight*)&renderingEngine.GetActiveLight());
+			break;
+		case UniformBinding::SOURCE_ENGINE_STRUCT:
+			renderingEngine.UpdateUniformStruct(transform, material, *this, binding.GetName(), binding.GetGLSLType());
+			break;
+		case UniformBinding::SOURCE_INVALID:
+			if(binding.GetName().compare(0, 2, "T_") == 0)
+				throw "Invalid Transform Uniform: " + binding.GetName();
+			else if(binding.GetName().compare(0, 2, "C_") == 0)
+				throw "Invalid Camera Uniform: " + binding.GetName();
 			else
-				throw "Invalid Camera Uniform: " + uniformName;
-		}
-		else
-		{
-			if(uniformType == "vec3")
-				SetUniformVector3f(uniformName, material.GetVector3f(uniformName));
-			else if(uniformType == "float")
-				SetUniformf(uniformName, material.GetFloat(uniformName));
-			else
-				throw uniformType + " is not supported by the Material class";
+				throw binding.GetGLSLType() + " is not supported by the Material class";
 		}
 	}
 }
@@ -265,35 +320,53 @@ void Shader::SetUniformMatrix4f(const std::string& uniformName, const Matrix4f&
 	glUniformMatrix4fv(m_shaderData->GetUniformMap().at(uniformName), 1, GL_FALSE, &(value[0][0]));
 }
 
-void Shader::SetUniformDirectionalLight(const std::string& uniformName, const DirectionalLight& directionalLight) const
+//Member locations are stored in the order of these names, which the SetUniform*Light
+//functions below rely on.
+static const char* const DIRECTIONAL_LIGHT_MEMBERS[] = 
+{ 
+	".direction", ".base.color", ".base.intensity" 
+};
+
+static const char* const POINT_LIGHT_MEMBERS[] = 
+{ 
+	".base.color", ".base.intensity", ".atten.constant", ".atten.linear", ".atten.exponent", ".position", ".range" 
+};
+
+static const char* const SPOT_LIGHT_MEMBERS[] = 
+{ 
+	".pointLight.base.color", ".pointLight.base.intensity", ".pointLight.atten.constant", ".pointLight.atten.linear", 
+	".pointLight.atten.exponent", ".pointLight.position", ".pointLight.range", ".direction", ".cutoff" 
+};
+
+void Shader::SetUniformDirectionalLight(const UniformBinding& binding, const DirectionalLight& directionalLight) const
 {
-	SetUniformVector3f(uniformName + ".direction", directionalLight.GetTransform().GetTransformedRot().GetForward());
-	SetUniformVector3f(uniformName + ".base.color", directionalLight.GetColor());
-	SetUniformf(uniformName + ".base.intensity", directionalLight.GetIntensity());
+	SetGLUniformVector3f(binding.GetMemberLocation(0), directionalLight.GetTransform().GetTransformedRot().GetForward());
+	SetGLUniformVector3f(binding.GetMemberLocation(1), directionalLight.GetColor());
+	glUniform1f(binding.GetMemberLocation(2), directionalLight.GetIntensity());
 }
 
-void Shader::SetUniformPointLight(const std::string& uniformName, const PointLight& pointLight) const
+void Shader::SetUniformPointLight(const UniformBinding& binding, const PointLight& pointLight) const
 {
-	SetUniformVector3f(uniformName + ".base.color", pointLight.GetColor());
-	SetUniformf(uniformName + ".base.intensity", pointLight.GetIntensity());
-	SetUniformf(uniformName + ".atten.constant", pointLight.GetAttenuation().GetConstant());
-	SetUniformf(uniformName + ".atten.linear", pointLight.GetAttenuation().GetLinear());
-	SetUniformf(uniformName + ".atten.exponent", pointLight.GetAttenuation().GetExponent());
-	SetUniformVector3f(uniformName + ".position", pointLight.GetTransform().GetTransformedPos());
-	SetUniformf(uniformName + ".range", pointLight.GetRange());
+	SetGLUniformVector3f(binding.GetMemberLocation(0), pointLight.GetColor());
+	glUniform1f(binding.GetMemberLocation(1), pointLight.GetIntensity());
+	glUniform1f(binding.GetMemberLocation(2), pointLight.GetAttenuation().GetConstant());
+	glUniform1f(binding.GetMemberLocation(3), pointLight.GetAttenuation().GetLinear());
+	glUniform1f(binding.GetMemberLocation(4), pointLight.GetAttenuation().GetExponent());
+	SetGLUniformVector3f(binding.GetMemberLocation(5), pointLight.GetTransform().GetTransformedPos());
+	glUniform1f(binding.GetMemberLocation(6), pointLight.GetRange());
 }
 
-void Shader::SetUniformSpotLight(const std::string& uniformName, const SpotLight& spotLight) const
+void Shader::SetUniformSpotLight(const UniformBinding& binding, const SpotLight& spotLight) const
 {
-	SetUniformVector3f(uniformName + ".pointLight.base.color", spotLight.GetColor());
-	SetUniformf(uniformName + ".pointLight.base.intensity", spotLight.GetIntensity());
-	SetUniformf(uniformName + ".pointLight.atten.constant", spotLight.GetAttenuation().GetConstant());
-	SetUniformf(uniformName + ".pointLight.atten.linear", spotLight.GetAttenuation().GetLinear());
-	SetUniformf(uniformName + ".pointLight.atten.exponent", spotLight.GetAttenuation().GetExponent());
-	SetUniformVector3f(uniformName + ".pointLight.position", spotLight.GetTransform().GetTransformedPos());
-	SetUniformf(uniformName + ".pointLight.range", spotLight.GetRange());
-	SetUniformVector3f(uniformName + ".direction", spotLight.GetTransform().GetTransformedRot().GetForward());
-	SetUniformf(uniformName + ".cutoff", spotLight.GetCutoff());
+	SetGLUniformVector3f(binding.GetMemberLocation(0), spotLight.GetColor());
+	glUniform1f(binding.GetMemberLocation(1), spotLight.GetIntensity());
+	glUniform1f(binding.GetMemberLocation(2), spotLight.GetAttenuation().GetConstant());
+	glUniform1f(binding.GetMemberLocation(3), spotLight.GetAttenuation().GetLinear());
+	glUniform1f(binding.GetMemberLocation(4), spotLight.GetAttenuation().GetExponent());
+	SetGLUniformVector3f(binding.GetMemberLocation(5), spotLight.GetTransform().GetTransformedPos());
+	glUniform1f(binding.GetMemberLocation(6), spotLight.GetRange());
+	SetGLUniformVector3f(binding.GetMemberLocation(7), spotLight.GetTransform().GetTransformedRot().GetForward());
+	glUniform1f(binding.GetMemberLocation(8), spotLight.GetCutoff());
 }
 
 void ShaderData::AddVertexShader(const std::string& text)
@@ -371,14 +444,51 @@ void ShaderData::AddAllAttributes(const std::string& vertexShaderText, const std
 			
 			begin = attributeLine.find(" ");
 			std::string attributeName = attributeLine.substr(begin + 1);
-				
-			glBindAttribLocation(m_program, currentAttribLocation, attributeName.c_str());
-			currentAttribLocation++;
+			
+			//The instance matrix goes where MeshData puts it, wherever it's declared.
+			if(attributeName == "instanceModel")
+			{
+				glBindAttribLocation(m_program, MeshData::INSTANCE_MATRIX_LOCATION, attributeName.c_str());
+			}
+			else
+			{
+				glBindAttribLocation(m_program, currentAttribLocation, attributeName.c_str());
+				currentAttribLocation++;
+			}
 		}
 		attributeLocation = vertexShaderText.find(attributeKeyword, attributeLocation + attributeKeyword.length());
 	}
 }
 
+void ShaderData::AddAllFragOutputs(const std::string& fragmentShaderText)
+{
+	//Before GLSL 1.50 outputs are written to gl_FragData, which needs no binding.
+	if(s_supportedOpenGLLevel < 320)
+		return;
+	
+	static const std::string OUTPUT_KEY = "DeclareFragOutput(";
+	
+	size_t outputLocation = fragmentShaderText.find(OUTPUT_KEY);
+	while(outputLocation != std::string::npos)
+	{
+		size_t lastLineEnd = fragmentShaderText.rfind("\n", outputLocation);
+		bool isMacro = lastLineEnd != std::string::npos && 
+			fragmentShaderText.substr(lastLineEnd, outputLocation - lastLineEnd).find("#") != std::string::npos;
+		
+		size_t begin = outputLocation + OUTPUT_KEY.length();
+		size_t end = fragmentShaderText.find_first_not_of("0123456789", begin);
+		
+		//Every output declared with a number is bound to the draw buffer of that number.
+		if(!isMacro && end != begin && end != std::string::npos)
+		{
+			std::string locationNumber = fragmentShaderText.substr(begin, end - begin);
+			glBindFragDataLocation(m_program, atoi(locationNumber.c_str()), ("outputLocation" + locationNumber).c_str());
+		}
+		
+		outputLocation = fragmentShaderText.find(OUTPUT_KEY, begin);
+	}
+}
+
 void ShaderData::AddShaderUniforms(const std::string& shaderText)
 {
 	static const std::string UNIFORM_KEY = "uniform";
@@ -411,6 +521,7 @@ void ShaderData::AddShaderUniforms(const std::string& shaderText)
 			m_uniformNames.push_back(uniformName);
 			m_uniformTypes.push_back(uniformType);
 			AddUniform(uniformName, uniformType, structs);
+			m_uniformBindings.push_back(UniformBinding::Create(uniformName, uniformType, m_uniformMap));
 		}
 		uniformLocation = shaderText.find(UNIFORM_KEY, uniformLocation + UNIFORM_KEY.length());
 	}
@@ -437,11 +548,187 @@ void ShaderData::AddUniform(const std::string& uniformName, const std::string& u
 
 	unsigned int location = glGetUniformLocation(m_program, uniformName.c_str());
 
-	assert(location != INVALID_VALUE);
+	//Instanced builds leave out the uniforms the instance attributes replace.
+	assert(location != INVALID_VALUE || m_isInstanced);
 
 	m_uniformMap.insert(std::pair<std::string, unsigned int>(uniformName, location));
 }
 
+UniformBinding UniformBinding::Create(const std::string& uniformName, const std::string& uniformType, 
+                                     const std::map<std::string, unsigned int>& uniformMap)
+{
+	//Uniforms that exist only as struct members have no location of their own.
+	int location = FindUniformLocation(uniformMap, uniformName);
+	
+	UniformBinding::Source source = UniformBinding::SOURCE_INVALID;
+	UniformBinding::Type type = UniformBinding::TYPE_OTHER;
+	std::string key = uniformName;
+	
+	//Textures bind to their own target, so array textures are bound the same way.
+	if(uniformType == "sampler2D" || uniformType == "sampler2DArray")
+		type = UniformBinding::TYPE_SAMPLER2D;
+	else if(uniformType == "samplerBuffer" || uniformType == "usamplerBuffer" || uniformType == "isamplerBuffer")
+		type = UniformBinding::TYPE_SAMPLER_BUFFER;
+	else if(uniformType == "vec3")
+		type = UniformBinding::TYPE_VECTOR3F;
+	else if(uniformType == "float")
+		type = UniformBinding::TYPE_FLOAT;
+	
+	//The checks follow the same order UpdateUniforms has always used to pick a source.
+	if(uniformName.compare(0, 2, "R_") == 0)
+	{
+		key = uniformName.substr(2);
+		source = UniformBinding::SOURCE_ENGINE;
+		
+		if(key == "lightMatrix")
+		{
+			source = UniformBinding::SOURCE_TRANSFORM;
+			type = UniformBinding::TYPE_LIGHT_MATRIX;
+		}
+		else if(uniformType == "DirectionalLight")
+		{
+			source = UniformBinding::SOURCE_LIGHT;
+			type = UniformBinding::TYPE_DIRECTIONAL_LIGHT;
+		}
+		else if(uniformType == "PointLight")
+		{
+			source = UniformBinding::SOURCE_LIGHT;
+			type = UniformBinding::TYPE_POINT_LIGHT;
+		}
+		else if(uniformType == "SpotLight")
+		{
+			source = UniformBinding::SOURCE_LIGHT;
+			type = UniformBinding::TYPE_SPOT_LIGHT;
+		}
+		else if(type == UniformBinding::TYPE_OTHER)
+		{
+			source = UniformBinding::SOURCE_ENGINE_STRUCT;
+		}
+	}
+	else if(type == UniformBinding::TYPE_SAMPLER2D)
+	{
+		source = UniformBinding::SOURCE_MATERIAL;
+	}
+	else if(uniformName.compare(0, 2, "T_") == 0)
+	{
+		if(uniformName == "T_MVP")
+		{
+			source = UniformBinding::SOURCE_TRANSFORM;
+			type = UniformBinding::TYPE_MVP_MATRIX;
+		}
+		else if(uniformName == "T_model")
+		{
+			source = UniformBinding::SOURCE_TRANSFORM;
+			type = UniformBinding::TYPE_MODEL_MATRIX;
+		}
+	}
+	else if(uniformName.compare(0, 2, "C_") == 0)
+	{
+		if(uniformName == "C_eyePos")
+		{
+			source = UniformBinding::SOURCE_CAMERA;
+			type = UniformBinding::TYPE_EYE_POS;
+		}
+	}
+	else if(type == UniformBinding::TYPE_VECTOR3F || type == UniformBinding::TYPE_FLOAT)
+	{
+		source = UniformBinding::SOURCE_MATERIAL;
+	}
+	
+	//Invalid uniforms are kept, so the error is still raised when the shader is used,
+	//just as it was before uniforms were resolved up front.
+	UniformBinding binding(source, type, location, PropertyTable::GetId(key), uniformName, uniformType);
+	
+	if(type == UniformBinding::TYPE_DIRECTIONAL_LIGHT)
+		binding.SetMemberLocations(uniformMap, DIRECTIONAL_LIGHT_MEMBERS, ARRAY_SIZE_IN_ELEMENTS(DIRECTIONAL_LIGHT_MEMBERS));
+	else if(type == UniformBinding::TYPE_POINT_LIGHT)
+		binding.SetMemberLocations(uniformMap, POINT_LIGHT_MEMBERS, ARRAY_SIZE_IN_ELEMENTS(POINT_LIGHT_MEMBERS));
+	else if(type == UniformBinding::TYPE_SPOT_LIGHT)
+		binding.SetMemberLocations(uniformMap, SPOT_LIGHT_MEMBERS, ARRAY_SIZE_IN_ELEMENTS(SPOT_LIGHT_MEMBERS));
+	
+	return binding;
+}
+
+void UniformBinding::SetMemberLocations(const std::map<std::string, unsigned int>& uniformMap, const char* const* memberNames, int numMembers)
+{
+	assert(numMembers <= MAX_MEMBERS);
+	
+	for(int i = 0; i < numMembers; i++)
+	{
+		m_memberLocations[i] = FindUniformLocation(uniformMap, m_name + memberNames[i]);
+	}
+}
+
+void UniformBinding::Test()
+{
+	//Locations as a shader's uniform map would hold them. The point light is only
+	//there through its members, and one of those was compiled out.
+	std::map<std::string, unsigned int> uniformMap;
+	const char* const names[] = 
+	{ 
+		"T_MVP", "T_model", "C_eyePos", "R_ambient", "R_lightMatrix", "R_shadowMap", "R_filterData", "diffuse", 
+		"specularIntensity", "T_unknown", "C_unknown", "someMatrix"
+	};
+	
+	for(unsigned int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(names); i++)
+	{
+		uniformMap[names[i]] = i;
+	}
+	
+	for(unsigned int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(POINT_LIGHT_MEMBERS) - 1; i++)
+	{
+		uniformMap[std::string("R_pointLight") + POINT_LIGHT_MEMBERS[i]] = 100 + i;
+	}
+	
+	//Each uniform comes from the source its prefix and type name, at its own location.
+	const char* const types[] = 
+	{ 
+		"mat4", "mat4", "vec3", "vec3", "mat4", "sampler2D", "mat4", "sampler2D", 
+		"float", "mat4", "vec3", "mat4" 
+	};
+	const Source sources[] = 
+	{ 
+		SOURCE_TRANSFORM, SOURCE_TRANSFORM, SOURCE_CAMERA, SOURCE_ENGINE, SOURCE_TRANSFORM, SOURCE_ENGINE, SOURCE_ENGINE_STRUCT, SOURCE_MATERIAL, 
+		SOURCE_MATERIAL, SOURCE_INVALID, SOURCE_INVALID, SOURCE_INVALID 
+	};
+	const Type bindingTypes[] = 
+	{ 
+		TYPE_MVP_MATRIX, TYPE_MODEL_MATRIX, TYPE_EYE_POS, TYPE_VECTOR3F, TYPE_LIGHT_MATRIX, TYPE_SAMPLER2D, TYPE_OTHER, TYPE_SAMPLER2D, 
+		TYPE_FLOAT, TYPE_OTHER, TYPE_VECTOR3F, TYPE_OTHER 
+	};
+	
+	for(unsigned int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(names); i++)
+	{
+		UniformBinding binding = Create(names[i], types[i], uniformMap);
+		assert(binding.GetSource() == sources[i]);
+		assert(binding.GetType() == bindingTypes[i]);
+		assert(binding.GetLocation() == (int)i);
+		assert(binding.GetName() == names[i] && binding.GetGLSLType() == types[i]);
+	}
+	
+	//Engine values are looked up without their prefix, and material values with their whole name.
+	assert(Create("R_ambient", "vec3", uniformMap).GetValueId() == PropertyTable::GetId("ambient"));
+	assert(Create("diffuse", "sampler2D", uniformMap).GetValueId() == PropertyTable::GetId("diffuse"));
+	
+	//A light has no location of its own, but finds each of its members. Members that
+	//aren't in the map get -1, which GL ignores.
+	UniformBinding light = Create("R_pointLight", "PointLight", uniformMap);
+	assert(light.GetSource() == SOURCE_LIGHT && light.GetType() == TYPE_POINT_LIGHT);
+	assert(light.GetLocation() == -1);
+	
+	int numMembers = (int)ARRAY_SIZE_IN_ELEMENTS(POINT_LIGHT_MEMBERS);
+	for(int i = 0; i < numMembers - 1; i++)
+	{
+		assert(light.GetMemberLocation(i) == 100 + i);
+	}
+	
+	assert(light.GetMemberLocation(numMembers - 1) == -1);
+	
+	//Uniforms missing from the map altogether are still bound, with location -1.
+	UniformBinding missing = Create("unknownColor", "vec3", uniformMap);
+	assert(missing.GetSource() == SOURCE_MATERIAL && missing.GetLocation() == -1);
+}
+
 void ShaderData::CompileShader() const
 {
     glLinkProgram(m_program);
@@ -587,3 +874,9 @@ static std::vector<UniformStruct> FindUniformStructs(const std::string& shaderTe
 
 	return result;
 }
+
+static int FindUniformLocation(const std::map<std::string, unsigned int>& uniformMap, const std::string& uniformName)
+{
+	std::map<std::string, unsigned int>::const_iterator it = uniformMap.find(uniformName);
+	return it != uniformMap.end() ? (int)it->second : -1;
+}
@@ -60,17 +60,93 @@ private:
 	std::vector<TypedData> m_memberNames;
 };
 
+//Everything UpdateUniforms needs to set one uniform, worked out once when the
+//shader is loaded: where the value comes from, what kind of value it is, and
+//which GL locations it's written to.
+class UniformBinding
+{
+public:
+	enum Source
+	{
+		SOURCE_TRANSFORM,
+		SOURCE_CAMERA,
+		SOURCE_ENGINE,
+		SOURCE_MATERIAL,
+		SOURCE_LIGHT,         //The rendering engine's active light
+		SOURCE_ENGINE_STRUCT, //Handled by RenderingEngine::UpdateUniformStruct
+		SOURCE_INVALID
+	};
+	
+	enum Type
+	{
+		TYPE_FLOAT,
+		TYPE_VECTOR3F,
+		TYPE_SAMPLER2D,
+		TYPE_SAMPLER_BUFFER,
+		TYPE_MODEL_MATRIX,
+		TYPE_MVP_MATRIX,
+		TYPE_LIGHT_MATRIX,
+		TYPE_EYE_POS,
+		TYPE_DIRECTIONAL_LIGHT,
+		TYPE_POINT_LIGHT,
+		TYPE_SPOT_LIGHT,
+		TYPE_OTHER
+	};
+	
+	static const int MAX_MEMBERS = 9; //Enough for every member of a SpotLight
+	
+	UniformBinding(Source source, Type type, int location, int valueId, const std::string& name, const std::string& glslType) :
+		m_source(source),
+		m_type(type),
+		m_location(location),
+		m_valueId(valueId),
+		m_name(name),
+		m_glslType(glslType) {}
+	
+	inline Source GetSource()                  const { return m_source; }
+	inline Type GetType()                      const { return m_type; }
+	inline int GetLocation()                   const { return m_location; }
+	inline int GetMemberLocation(int index)    const { return m_memberLocations[index]; }
+	inline int GetValueId()                    const { return m_valueId; }
+	inline const std::string& GetName()        const { return m_name; }
+	inline const std::string& GetGLSLType()    const { return m_glslType; }
+	
+	inline void SetMemberLocation(int index, int location) { m_memberLocations[index] = location; }
+	
+	//Works out where a uniform's value comes from, and finds its location, and those of
+	//its members if it's a light, in uniformMap. Uniforms nothing provides get
+	//SOURCE_INVALID, and names missing from the map get location -1.
+	static UniformBinding Create(const std::string& uniformName, const std::string& uniformType, 
+	                             const std::map<std::string, unsigned int>& uniformMap);
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+private:
+	void SetMemberLocations(const std::map<std::string, unsigned int>& uniformMap, const char* const* memberNames, int numMembers);
+	
+	Source      m_source;
+	Type        m_type;
+	int         m_location;
+	int         m_memberLocations[MAX_MEMBERS];
+	int         m_valueId;  //PropertyTable id of the name without its prefix
+	std::string m_name;
+	std::string m_glslType;
+};
+
 class ShaderData : public ReferenceCounter
 {
 public:
-	ShaderData(const std::string& fileName);
+	ShaderData(const std::string& fileName, bool isInstanced = false);
 	virtual ~ShaderData();
 	
 	inline int GetProgram()                                           const { return m_program; }
+	inline bool IsInstanced()                                         const { return m_isInstanced; }
+	inline bool SupportsInstancing()                                  const { return m_supportsInstancing; }
 	inline const std::vector<int>& GetShaders()                       const { return m_shaders; }
 	inline const std::vector<std::string>& GetUniformNames()          const { return m_uniformNames; }
 	inline const std::vector<std::string>& GetUniformTypes()          const { return m_uniformTypes; }
 	inline const std::map<std::string, unsigned int>& GetUniformMap() const { return m_uniformMap; }
+	inline const std::vector<UniformBinding>& GetUniformBindings()    const { return m_uniformBindings; }
 private:
 	void AddVertexShader(const std::string& text);
 	void AddGeometryShader(const std::string& text);
@@ -78,6 +154,7 @@ private:
 	void AddProgram(const std::string& text, int type);
 	
 	void AddAllAttributes(const std::string& vertexShaderText, const std::string& attributeKeyword);
+	void AddAllFragOutputs(const std::string& fragmentShaderText);
 	void AddShaderUniforms(const std::string& shaderText);
 	void AddUniform(const std::string& uniformName, const std::string& uniformType, const std::vector<UniformStruct>& structs);
 	void CompileShader() const;
@@ -85,20 +162,28 @@ private:
 	static int s_supportedOpenGLLevel;
 	static std::string s_glslVersion;
 	int m_program;
+	bool m_isInstanced;        //Built with INSTANCED_BUILD defined
+	bool m_supportsInstancing; //The source has an INSTANCED_BUILD path at all
 	std::vector<int>                    m_shaders;
 	std::vector<std::string>            m_uniformNames;
 	std::vector<std::string>            m_uniformTypes;
 	std::map<std::string, unsigned int> m_uniformMap;
+	std::vector<UniformBinding>         m_uniformBindings;
 };
 
 class Shader
 {
 public:
-	Shader(const std::string& fileName = "basicShader");
+	Shader(const std::string& fileName = "basicShader", bool isInstanced = false);
 	Shader(const Shader& other);
 	virtual ~Shader();
 
 	void Bind() const;
+	
+	//The same shader built to take world matrices per instance, for shaders whose
+	//source supports it. Shaders that don't just return themselves.
+	const Shader& GetInstancedShader() const;
+	inline bool IsInstanced() const { return m_shaderData->IsInstanced(); }
 	virtual void UpdateUniforms(const Transform& transform, const Material& material, const RenderingEngine& renderingEngine, const Camera& camera) const;
 
 	void SetUniformi(const std::string& uniformName, int value) const;
@@ -109,12 +194,13 @@ protected:
 private:
 	static std::map<std::string, ShaderData*> s_resourceMap;
 
-	ShaderData* m_shaderData;
-	std::string m_fileName;
+	ShaderData*    m_shaderData;
+	std::string    m_fileName;
+	mutable Shader* m_instancedShader; //Created the first time it's asked for
 	
-	void SetUniformDirectionalLight(const std::string& uniformName, const DirectionalLight& value) const;
-	void SetUniformPointLight(const std::string& uniformName, const PointLight& value) const;
-	void SetUniformSpotLight(const std::string& uniformName, const SpotLight& value) const;
+	void SetUniformDirectionalLight(const UniformBinding& binding, const DirectionalLight& value) const;
+	void SetUniformPointLight(const UniformBinding& binding, const PointLight& value) const;
+	void SetUniformSpotLight(const UniformBinding& binding, const SpotLight& value) const;
 	
 	void operator=(const Shader& other) {}
 };
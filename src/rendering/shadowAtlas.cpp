@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "shadowAtlas.h"
+
+#include <cassert>
+
+bool ShadowAtlas::Acquire(const void* owner, int sizeAsPowerOf2, Region* region)
+{
+	assert(sizeAsPowerOf2 >= 0 && sizeAsPowerOf2 <= m_maxSizeAsPowerOf2);
+	
+	std::map<const void*, Region>::iterator it = m_regions.find(owner);
+	if(it != m_regions.end())
+	{
+		if(it->second.m_sizeAsPowerOf2 == sizeAsPowerOf2)
+		{
+			it->second.m_lastUsedFrame = m_frame;
+			*region = it->second;
+			return false;
+		}
+		
+		Release(owner);
+	}
+	
+	if(m_sizeAsPowerOf2 < 0)
+	{
+		m_sizeAsPowerOf2 = sizeAsPowerOf2;
+		m_freeBlocks[m_sizeAsPowerOf2].push_back(Block(0, 0));
+	}
+	
+	//Regions that weren't needed this frame go first, since the lights that were
+	//needed will most likely be needed again next frame.
+	Block block;
+	while(!AllocateBlock(sizeAsPowerOf2, &block))
+	{
+		if(EvictOldest(owner, false))
+			continue;
+		
+		if(m_sizeAsPowerOf2 < m_maxSizeAsPowerOf2)
+		{
+			Grow();
+			continue;
+		}
+		
+		bool isEvicted = EvictOldest(owner, true);
+		assert(isEvicted);
+		(void)isEvicted;
+	}
+	
+	Region result(block.m_x, block.m_y, sizeAsPowerOf2);
+	result.m_lastUsedFrame = m_frame;
+	m_regions.insert(std::pair<const void*, Region>(owner, result));
+	
+	*region = result;
+	return true;
+}
+
+void ShadowAtlas::Release(const void* owner)
+{
+	std::map<const void*, Region>::iterator it = m_regions.find(owner);
+	if(it == m_regions.end())
+		return;
+	
+	FreeBlock(it->second.m_sizeAsPowerOf2, Block(it->second.m_x, it->second.m_y));
+	m_regions.erase(it);
+}
+
+bool ShadowAtlas::AllocateBlock(int sizeAsPowerOf2, Block* result)
+{
+	if(m_sizeAsPowerOf2 < sizeAsPowerOf2)
+		return false;
+	
+	//Takes the smallest free block that's big enough, and splits it down to size.
+	int level = sizeAsPowerOf2;
+	while(level <= m_sizeAsPowerOf2 && m_freeBlocks[level].empty())
+		level++;
+	
+	if(level > m_sizeAsPowerOf2)
+		return false;
+	
+	Block block = m_freeBlocks[level].back();
+	m_freeBlocks[level].pop_back();
+	
+	while(level > sizeAsPowerOf2)
+	{
+		level--;
+		int childSize = 1 << level;
+		
+		m_freeBlocks[level].push_back(Block(block.m_x + childSize, block.m_y));
+		m_freeBlocks[level].push_back(Block(block.m_x, block.m_y + childSize));
+		m_freeBlocks[level].push_back(Block(block.m_x + childSize, block.m_y + childSize));
+	}
+	
+	*result = block;
+	return true;
+}
+
+void ShadowAtlas::FreeBlock(int sizeAsPowerOf2, const Block& block)
+{
+	//Once all four quarters of a square are free, it's freed as a whole instead.
+	if(sizeAsPowerOf2 < m_sizeAsPowerOf2)
+	{
+		int parentMask = ~((2 << sizeAsPowerOf2) - 1);
+		Block parent(block.m_x & parentMask, block.m_y & parentMask);
+		std::vector<Block>& freeBlocks = m_freeBlocks[sizeAsPowerOf2];
+		
+		int siblingIndices[3];
+		int numSiblings = 0;
+		
+		for(unsigned int i = 0; i < freeBlocks.size() && numSiblings < 3; i++)
+		{
+			if((freeBlocks[i].m_x & parentMask) == parent.m_x && (freeBlocks[i].m_y & parentMask) == parent.m_y)
+				siblingIndices[numSiblings++] = (int)i;
+		}
+		
+		if(numSiblings == 3)
+		{
+			//Removed from the back so the remaining indices stay valid.
+			for(int i = 2; i >= 0; i--)
+			{
+				freeBlocks[siblingIndices[i]] = freeBlocks.back();
+				freeBlocks.pop_back();
+			}
+			
+			FreeBlock(sizeAsPowerOf2 + 1, parent);
+			return;
+		}
+	}
+	
+	m_freeBlocks[sizeAsPowerOf2].push_back(block);
+}
+
+void ShadowAtlas::Grow()
+{
+	//The old atlas becomes the new one's first quarter, so every region keeps its place.
+	int oldSize = 1 << m_sizeAsPowerOf2;
+	int oldSizeAsPowerOf2 = m_sizeAsPowerOf2;
+	m_sizeAsPowerOf2++;
+	
+	FreeBlock(oldSizeAsPowerOf2, Block(oldSize, 0));
+	FreeBlock(oldSizeAsPowerOf2, Block(0, oldSize));
+	FreeBlock(oldSizeAsPowerOf2, Block(oldSize, oldSize));
+}
+
+bool ShadowAtlas::EvictOldest(const void* owner, bool allowCurrentFrame)
+{
+	std::map<const void*, Region>::iterator oldest = m_regions.end();
+	
+	for(std::map<const void*, Region>::iterator it = m_regions.begin(); it != m_regions.end(); ++it)
+	{
+		if(it->first == owner || (!allowCurrentFrame && it->second.m_lastUsedFrame == m_frame))
+			continue;
+		
+		if(oldest == m_regions.end() || it->second.m_lastUsedFrame < oldest->second.m_lastUsedFrame)
+			oldest = it;
+	}
+	
+	if(oldest == m_regions.end())
+		return false;
+	
+	Release(oldest->first);
+	return true;
+}
+
+void ShadowAtlas::Test()
+{
+	int lights[9] = { 0 };
+	ShadowAtlas::Region regions[9];
+	
+	//The atlas starts as big as the first region, and grows to fit the ones after it.
+	ShadowAtlas atlas(4);
+	assert(atlas.GetSize() == 0);
+	assert(atlas.Acquire(&lights[0], 3, &regions[0]));
+	assert(atlas.GetSize() == 8);
+	assert(atlas.Acquire(&lights[1], 2, &regions[1]));
+	assert(atlas.GetSize() == 16);
+	assert(atlas.Acquire(&lights[2], 2, &regions[2]));
+	assert(atlas.GetSize() == 16);
+	
+	//Reacquiring keeps the same region.
+	ShadowAtlas::Region region;
+	assert(!atlas.Acquire(&lights[0], 3, &region));
+	assert(region.GetX() == regions[0].GetX() && region.GetY() == regions[0].GetY());
+	
+	//Regions never overlap, and stay inside the atlas.
+	for(int i = 0; i < 3; i++)
+	{
+		assert(regions[i].GetX() >= 0 && regions[i].GetX() + regions[i].GetSize() <= atlas.GetSize());
+		assert(regions[i].GetY() >= 0 && regions[i].GetY() + regions[i].GetSize() <= atlas.GetSize());
+		
+		for(int j = 0; j < i; j++)
+		{
+			bool isApart = regions[i].GetX() >= regions[j].GetX() + regions[j].GetSize() ||
+			               regions[j].GetX() >= regions[i].GetX() + regions[i].GetSize() ||
+			               regions[i].GetY() >= regions[j].GetY() + regions[j].GetSize() ||
+			               regions[j].GetY() >= regions[i].GetY() + regions[i].GetSize();
+			assert(isApart);
+		}
+	}
+	
+	//Once it's at its maximum size, the regions not used this frame make room first.
+	atlas.NextFrame();
+	assert(!atlas.Acquire(&lights[0], 3, &region));
+	assert(!atlas.Acquire(&lights[1], 2, &region));
+	assert(atlas.Acquire(&lights[3], 3, &regions[3]));
+	assert(atlas.Acquire(&lights[4], 3, &regions[4]));
+	assert(atlas.Acquire(&lights[5], 2, &regions[5]));
+	assert(atlas.Acquire(&lights[6], 2, &regions[6]));
+	assert(atlas.GetNumRegions() == 7);
+	assert(atlas.Acquire(&lights[7], 2, &regions[7]));
+	assert(atlas.GetSize() == 16);
+	assert(atlas.GetNumRegions() == 7);
+	assert(regions[7].GetX() == regions[2].GetX() && regions[7].GetY() == regions[2].GetY());
+	
+	//With nothing unused left, regions used this frame are taken back too.
+	assert(atlas.Acquire(&lights[8], 4, &regions[8]));
+	assert(atlas.GetNumRegions() == 1);
+	assert(regions[8].GetX() == 0 && regions[8].GetY() == 0);
+	
+	//Freed quarters merge back together, so the whole atlas can be used again.
+	atlas.Release(&lights[8]);
+	for(int i = 0; i < 4; i++)
+	{
+		assert(atlas.Acquire(&lights[i], 2, &regions[i]));
+	}
+	for(int i = 0; i < 4; i++)
+	{
+		atlas.Release(&lights[i]);
+	}
+	assert(atlas.GetNumRegions() == 0);
+	assert(atlas.Acquire(&lights[0], 4, &regions[0]));
+	
+	//Changing a light's size gives it a new region.
+	assert(atlas.Acquire(&lights[0], 3, &regions[0]));
+	assert(atlas.GetNumRegions() == 1);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SHADOWATLAS_H
+#define SHADOWATLAS_H
+
+#include <map>
+#include <vector>
+
+//Hands out square regions of one large shadow map texture to the lights that need
+//them, so lights only take up the space their own shadow map needs.
+//
+//Region sizes are powers of two, and are split out of larger free squares and merged
+//back into them like a quadtree. The atlas starts out as big as the first region, and
+//doubles when the lights used since the last NextFrame don't fit. Past its maximum
+//size, or to make room for a light, regions that haven't been used for longest are
+//taken back. Their lights get new regions, which have to be rendered again, the next
+//time they need one.
+class ShadowAtlas
+{
+public:
+	class Region
+	{
+	public:
+		Region(int x = 0, int y = 0, int sizeAsPowerOf2 = 0) :
+			m_x(x),
+			m_y(y),
+			m_sizeAsPowerOf2(sizeAsPowerOf2),
+			m_lastUsedFrame(0) {}
+		
+		inline int GetX()              const { return m_x; }
+		inline int GetY()              const { return m_y; }
+		inline int GetSize()           const { return 1 << m_sizeAsPowerOf2; }
+		inline int GetSizeAsPowerOf2() const { return m_sizeAsPowerOf2; }
+	private:
+		int m_x;
+		int m_y;
+		int m_sizeAsPowerOf2;
+		int m_lastUsedFrame;
+		
+		friend class ShadowAtlas;
+	};
+	
+	ShadowAtlas(int maxSizeAsPowerOf2) :
+		m_sizeAsPowerOf2(-1),
+		m_maxSizeAsPowerOf2(maxSizeAsPowerOf2),
+		m_frame(0),
+		m_freeBlocks(maxSizeAsPowerOf2 + 1) {}
+	
+	//Finds the owner's region, giving it a new one if it has none of this size. Returns
+	//true if the region is new, in which case its contents have to be rendered again.
+	bool Acquire(const void* owner, int sizeAsPowerOf2, Region* region);
+	void Release(const void* owner);
+	
+	//Regions acquired before this are the first to be taken back when space is needed.
+	inline void NextFrame() { m_frame++; }
+	
+	//The size of the texture the regions are in, which is 0 until the first is acquired.
+	inline int GetSize()           const { return m_sizeAsPowerOf2 < 0 ? 0 : 1 << m_sizeAsPowerOf2; }
+	inline int GetNumRegions()     const { return (int)m_regions.size(); }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	//A free square, identified by its corner. Its size is the level of the list it's in.
+	class Block
+	{
+	public:
+		Block(int x = 0, int y = 0) :
+			m_x(x),
+			m_y(y) {}
+		
+		int m_x;
+		int m_y;
+	};
+	
+	int                                   m_sizeAsPowerOf2;
+	int                                   m_maxSizeAsPowerOf2;
+	int                                   m_frame;
+	std::vector<std::vector<Block> >      m_freeBlocks; //Indexed by size as a power of 2
+	std::map<const void*, Region>         m_regions;
+	
+	bool AllocateBlock(int sizeAsPowerOf2, Block* result);
+	void FreeBlock(int sizeAsPowerOf2, const Block& block);
+	void Grow();
+	
+	//Frees the region that was used longest ago, other than the owner's. Regions used
+	//this frame are only freed if allowCurrentFrame is set. Returns false if none could be.
+	bool EvictOldest(const void* owner, bool allowCurrentFrame);
+};
+
+#endif // SHADOWATLAS_H
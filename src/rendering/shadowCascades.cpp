@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "shadowCascades.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+void ShadowCascades::Fit(const Matrix4f& cameraProjection, const Vector3f& cameraPos, const Quaternion& cameraRot, const Quaternion& lightRot,
+                         int numCascades, float shadowDistance, float splitLambda, int shadowMapSize, float padding)
+{
+	assert(numCascades > 0 && numCascades <= MAX_CASCADES);
+	m_numCascades = numCascades;
+	
+	//The projection maps view depth z to normalized depth A + B/z when it's a perspective
+	//one, and A * z + B when it's orthographic.
+	float depthA = cameraProjection[2][2];
+	float depthB = cameraProjection[3][2];
+	bool isPerspective = cameraProjection[2][3] != 0.0f;
+	
+	float nearDist = isPerspective ? depthB / (-1.0f - depthA) : (-1.0f - depthB) / depthA;
+	float farDist  = isPerspective ? depthB / (1.0f - depthA)  : (1.0f - depthB) / depthA;
+	farDist = std::min(farDist, shadowDistance);
+	
+	//How far the corners of the view are from its center line at depth 1, or at any
+	//depth for an orthographic view.
+	float cornerX = 1.0f / cameraProjection[0][0];
+	float cornerY = 1.0f / cameraProjection[1][1];
+	float cornerSlope = sqrtf(cornerX * cornerX + cornerY * cornerY);
+	
+	Quaternion lightRotInverse = lightRot.Conjugate();
+	float sliceStart = nearDist;
+	
+	for(int i = 0; i < numCascades; i++)
+	{
+		//The practical split scheme blends logarithmic splits, which give every cascade
+		//the same texels per pixel on screen, with even ones, which waste fewer on the
+		//first few meters.
+		float fraction = (float)(i + 1) / (float)numCascades;
+		float logSplit = nearDist * powf(farDist / nearDist, fraction);
+		float evenSplit = nearDist + (farDist - nearDist) * fraction;
+		float sliceEnd = splitLambda * logSplit + (1.0f - splitLambda) * evenSplit;
+		
+		if(i == numCascades - 1)
+			sliceEnd = farDist;
+		
+		//The smallest sphere around the slice is centered on the view's center line,
+		//where its nearest and furthest corners are the same distance away.
+		float startRadius = isPerspective ? sliceStart * cornerSlope : cornerSlope;
+		float endRadius = isPerspective ? sliceEnd * cornerSlope : cornerSlope;
+		float centerDist = ((sliceEnd * sliceEnd + endRadius * endRadius) - (sliceStart * sliceStart + startRadius * startRadius)) / 
+			(2.0f * (sliceEnd - sliceStart));
+		centerDist = Clamp(centerDist, sliceStart, sliceEnd);
+		
+		float radius = std::max(sqrtf(startRadius * startRadius + (centerDist - sliceStart) * (centerDist - sliceStart)), 
+		                        sqrtf(endRadius * endRadius + (sliceEnd - centerDist) * (sliceEnd - centerDist)));
+		
+		float halfSize = radius * (1.0f + padding);
+		float worldTexelSize = (halfSize * 2.0f) / (float)shadowMapSize;
+		
+		Vector3f lightSpaceCenter = (cameraPos + cameraRot.GetForward() * centerDist).Rotate(lightRotInverse);
+		lightSpaceCenter.SetX(worldTexelSize * floor(lightSpaceCenter.GetX() / worldTexelSize));
+		lightSpaceCenter.SetY(worldTexelSize * floor(lightSpaceCenter.GetY() / worldTexelSize));
+		
+		m_splitDistances[i] = sliceEnd;
+		m_centers[i] = lightSpaceCenter.Rotate(lightRot);
+		m_halfSizes[i] = halfSize;
+		
+		//Snapping can move the center up to a texel diagonally away from the slice's.
+		m_moveThresholds[i] = std::max(radius * padding - worldTexelSize * 2.0f, 0.0f);
+		
+		sliceStart = sliceEnd;
+	}
+}
+
+void ShadowCascades::CalcScaleAndOffset(const Matrix4f& lightMatrix, const Quaternion& lightRot, Vector3f* scale, Vector3f* offset)
+{
+	//Every cascade is an orthographic view along the light's rotation, so once that's
+	//undone all that's left is a scale and offset on each axis.
+	Matrix4f lightSpaceMatrix = lightMatrix * lightRot.ToRotationMatrix();
+	
+	*scale = Vector3f(lightSpaceMatrix[0][0], lightSpaceMatrix[1][1], lightSpaceMatrix[2][2]);
+	*offset = Vector3f(lightSpaceMatrix[3][0], lightSpaceMatrix[3][1], lightSpaceMatrix[3][2]);
+}
+
+void ShadowCascades::Test()
+{
+	Matrix4f projection = Matrix4f().InitPerspective(ToRadians(70.0f), 16.0f/9.0f, 0.1f, 1000.0f);
+	Quaternion cameraRot(Vector3f(0, 1, 0), ToRadians(30.0f));
+	Quaternion lightRot(Vector3f(1, 0, 0), ToRadians(60.0f));
+	Vector3f cameraPos(3.0f, 2.0f, -5.0f);
+	
+	ShadowCascades cascades;
+	cascades.Fit(projection, cameraPos, cameraRot, lightRot, 4, 80.0f, 0.75f, 512, 0.125f);
+	assert(cascades.GetNumCascades() == 4);
+	assert(fabs(cascades.GetSplitDistance(3) - 80.0f) < 0.001f);
+	
+	float tanHalfFovY = tanf(ToRadians(35.0f));
+	float tanHalfFovX = tanHalfFovY * 16.0f/9.0f;
+	float sliceStart = 0.1f;
+	
+	for(int i = 0; i < 4; i++)
+	{
+		//Splits are in order, and cascades grow with them.
+		float sliceEnd = cascades.GetSplitDistance(i);
+		assert(sliceEnd > sliceStart);
+		assert(i == 0 || cascades.GetHalfSize(i) > cascades.GetHalfSize(i - 1));
+		assert(cascades.GetMoveThreshold(i) > 0.0f);
+		
+		//Every corner of the slice is inside the cascade's cube, with room to move.
+		Quaternion lightRotInverse = lightRot.Conjugate();
+		Vector3f lightSpaceCenter = cascades.GetCenter(i).Rotate(lightRotInverse);
+		
+		for(int j = 0; j < 8; j++)
+		{
+			float dist = (j & 4) ? sliceEnd : sliceStart;
+			Vector3f corner = cameraPos + cameraRot.GetForward() * dist + 
+				cameraRot.GetRight() * (dist * tanHalfFovX * ((j & 1) ? 1.0f : -1.0f)) + 
+				cameraRot.GetUp() * (dist * tanHalfFovY * ((j & 2) ? 1.0f : -1.0f));
+			Vector3f offset = corner.Rotate(lightRotInverse) - lightSpaceCenter;
+			
+			float maxOffset = cascades.GetHalfSize(i) - cascades.GetMoveThreshold(i);
+			assert(fabs(offset.GetX()) <= maxOffset && fabs(offset.GetY()) <= maxOffset && fabs(offset.GetZ()) <= maxOffset);
+		}
+		
+		sliceStart = sliceEnd;
+	}
+	
+	//Cascades only move by whole texels, so shadow edges stay put as the camera moves.
+	for(int i = 0; i < 4; i++)
+	{
+		float texelSize = cascades.GetHalfSize(i) * 2.0f / 512.0f;
+		Vector3f lightSpaceCenter = cascades.GetCenter(i).Rotate(lightRot.Conjugate());
+		
+		float texelsX = lightSpaceCenter.GetX() / texelSize;
+		float texelsY = lightSpaceCenter.GetY() / texelSize;
+		assert(fabs(texelsX - floor(texelsX + 0.5f)) < 0.01f);
+		assert(fabs(texelsY - floor(texelsY + 0.5f)) < 0.01f);
+	}
+	
+	//The scale and offset give the same shadow map coordinates as the light matrix.
+	Matrix4f lightView = lightRot.Conjugate().ToRotationMatrix() * Matrix4f().InitTranslation(cascades.GetCenter(2) * -1);
+	Matrix4f lightMatrix = cascades.GetProjection(2) * lightView;
+	
+	Vector3f scale, offset;
+	CalcScaleAndOffset(lightMatrix, lightRot, &scale, &offset);
+	
+	Vector3f worldPos(7.0f, -3.0f, 12.0f);
+	Vector3f expected = Vector3f(lightMatrix.Transform(worldPos));
+	Vector3f lightSpacePos = worldPos.Rotate(lightRot.Conjugate());
+	Vector3f actual(lightSpacePos.GetX() * scale.GetX() + offset.GetX(), 
+	                lightSpacePos.GetY() * scale.GetY() + offset.GetY(), 
+	                lightSpacePos.GetZ() * scale.GetZ() + offset.GetZ());
+	assert((expected - actual).Length() < 0.001f);
+}
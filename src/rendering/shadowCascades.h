@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SHADOWCASCADES_H
+#define SHADOWCASCADES_H
+
+#include "../core/math3d.h"
+
+//Splits the main camera's view into slices by distance, and fits a square shadow map,
+//or cascade, around each one. Nearby slices are short, so their cascades cover a small
+//area in a lot of detail, while far away slices get the same number of texels spread
+//over a much larger area.
+//
+//Each cascade is a cube around its slice's bounding sphere, which doesn't change size
+//as the camera turns. Its center is snapped to its own texel grid, so shadow edges
+//don't crawl as the camera moves.
+class ShadowCascades
+{
+public:
+	static const int MAX_CASCADES = 4;
+	
+	ShadowCascades() :
+		m_numCascades(0) {}
+	
+	//Fits numCascades cascades up to shadowDistance from the camera, or its far plane if
+	//that's nearer. splitLambda picks the split scheme, from evenly spaced slices at 0 to
+	//slices growing by the same ratio at 1. Cascades are padded by padding times their
+	//slice's radius, and can move that far before the slice stops fitting inside them.
+	void Fit(const Matrix4f& cameraProjection, const Vector3f& cameraPos, const Quaternion& cameraRot, const Quaternion& lightRot,
+	         int numCascades, float shadowDistance, float splitLambda, int shadowMapSize, float padding);
+	
+	inline int GetNumCascades()                     const { return m_numCascades; }
+	inline float GetSplitDistance(int cascade)      const { return m_splitDistances[cascade]; } //Where its slice ends
+	inline const Vector3f& GetCenter(int cascade)   const { return m_centers[cascade]; }
+	inline float GetHalfSize(int cascade)           const { return m_halfSizes[cascade]; }
+	inline float GetMoveThreshold(int cascade)      const { return m_moveThresholds[cascade]; }
+	
+	//The cascade's orthographic projection, looking down the light's direction from its center.
+	inline Matrix4f GetProjection(int cascade) const
+	{
+		float halfSize = m_halfSizes[cascade];
+		return Matrix4f().InitOrthographic(-halfSize, halfSize, -halfSize, halfSize, -halfSize, halfSize);
+	}
+	
+	//Splits a cascade's light matrix into a scale and offset, so its shadow map coordinates
+	//and depth are found from a position relative to the light's rotation as pos * scale + offset.
+	//All of a light's cascades can then be looked up from one light space position.
+	static void CalcScaleAndOffset(const Matrix4f& lightMatrix, const Quaternion& lightRot, Vector3f* scale, Vector3f* offset);
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	int      m_numCascades;
+	float    m_splitDistances[MAX_CASCADES];
+	Vector3f m_centers[MAX_CASCADES];
+	float    m_halfSizes[MAX_CASCADES];
+	float    m_moveThresholds[MAX_CASCADES];
+};
+
+#endif // SHADOWCASCADES_H
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "shadowMapCache.h"
+
+#include <cassert>
+
+static bool MatricesEqual(const Matrix4f& a, const Matrix4f& b);
+
+int ShadowMapCache::GetEntry(const void* light, int layer)
+{
+	std::pair<const void*, int> key(light, layer);
+	std::map<std::pair<const void*, int>, int>::const_iterator it = m_entryIndices.find(key);
+	if(it != m_entryIndices.end())
+	{
+		return it->second;
+	}
+	
+	int entry = (int)m_entries.size();
+	m_entries.push_back(Entry());
+	m_entryIndices.insert(std::pair<std::pair<const void*, int>, int>(key, entry));
+	
+	return entry;
+}
+
+bool ShadowMapCache::Lookup(int entry, const Matrix4f& projection, const Vector3f& pos, const Quaternion& rot, float moveThreshold)
+{
+	const Entry& cached = m_entries[entry];
+	bool isHit = cached.m_isValid && cached.m_rot == rot && MatricesEqual(cached.m_projection, projection) && 
+		(cached.m_pos == pos || (cached.m_pos - pos).LengthSq() < moveThreshold * moveThreshold);
+	
+	if(isHit)
+		m_numHits++;
+	else
+		m_numMisses++;
+	
+	return isHit;
+}
+
+void ShadowMapCache::Update(int entry, const Matrix4f& projection, const Vector3f& pos, const Quaternion& rot, 
+                            const Matrix4f& viewProjection, const Matrix4f& lightMatrix)
+{
+	Entry& cached = m_entries[entry];
+	
+	cached.m_projection = projection;
+	cached.m_pos = pos;
+	cached.m_rot = rot;
+	cached.m_frustum = Frustum(viewProjection, false);
+	cached.m_lightMatrix = lightMatrix;
+	cached.m_isValid = true;
+}
+
+void ShadowMapCache::InvalidateAABB(const Vector3f& boundsMin, const Vector3f& boundsMax)
+{
+	Vector3f center = (boundsMin + boundsMax) / 2.0f;
+	Vector3f extents = (boundsMax - boundsMin) / 2.0f;
+	
+	for(unsigned int i = 0; i < m_entries.size(); i++)
+	{
+		if(m_entries[i].m_isValid && m_entries[i].m_frustum.IntersectsAABB(center, extents))
+		{
+			m_entries[i].m_isValid = false;
+		}
+	}
+}
+
+void ShadowMapCache::InvalidateAll()
+{
+	for(unsigned int i = 0; i < m_entries.size(); i++)
+	{
+		m_entries[i].m_isValid = false;
+	}
+}
+
+void ShadowMapCache::Test()
+{
+	int lightA = 0;
+	int lightB = 0;
+	
+	ShadowMapCache cache;
+	int entryA = cache.GetEntry(&lightA);
+	int entryB = cache.GetEntry(&lightB);
+	assert(entryA != entryB);
+	assert(cache.GetEntry(&lightA) == entryA);
+	assert(cache.GetEntry(&lightA, 1) != entryA && cache.GetEntry(&lightA, 1) != entryB);
+	assert(cache.GetNumEntries() == 3);
+	
+	//Both shadow cameras look down +Z from the origin, and see from -10 to 10 on each axis.
+	Matrix4f viewProjection = Matrix4f().InitOrthographic(-10.0f, 10.0f, -10.0f, 10.0f, -10.0f, 10.0f);
+	Vector3f pos(0.0f, 0.0f, 0.0f);
+	Quaternion rot(0.0f, 0.0f, 0.0f, 1.0f);
+	
+	//Nothing is cached until it's been rendered.
+	assert(!cache.Lookup(entryA, viewProjection, pos, rot, 0.0f));
+	cache.Update(entryA, viewProjection, pos, rot, viewProjection, viewProjection);
+	cache.Update(entryB, viewProjection, pos, rot, viewProjection, viewProjection);
+	assert(cache.Lookup(entryA, viewProjection, pos, rot, 0.0f));
+	
+	//The shadow camera moving or turning needs a new shadow map, unless it stays
+	//within the threshold.
+	assert(!cache.Lookup(entryA, viewProjection, Vector3f(0.5f, 0.0f, 0.0f), rot, 0.0f));
+	assert(cache.Lookup(entryA, viewProjection, Vector3f(0.5f, 0.0f, 0.0f), rot, 1.0f));
+	assert(!cache.Lookup(entryA, viewProjection, Vector3f(1.5f, 0.0f, 0.0f), rot, 1.0f));
+	assert(!cache.Lookup(entryA, viewProjection, pos, Quaternion(Vector3f(0, 1, 0), 0.1f), 1.0f));
+	assert(!cache.Lookup(entryA, Matrix4f().InitIdentity(), pos, rot, 1.0f));
+	
+	assert(cache.GetNumHits() == 2);
+	assert(cache.GetNumMisses() == 5);
+	cache.ResetCounters();
+	assert(cache.GetNumHits() == 0 && cache.GetNumMisses() == 0);
+	
+	//Changes outside the shadow camera's frustum don't matter.
+	cache.InvalidateAABB(Vector3f(20.0f, 20.0f, 20.0f), Vector3f(21.0f, 21.0f, 21.0f));
+	assert(cache.Lookup(entryA, viewProjection, pos, rot, 0.0f));
+	assert(cache.Lookup(entryB, viewProjection, pos, rot, 0.0f));
+	
+	//Changes inside it do, for every light that can see them.
+	cache.InvalidateAABB(Vector3f(-1.0f, -1.0f, 2.0f), Vector3f(1.0f, 1.0f, 3.0f));
+	assert(!cache.Lookup(entryA, viewProjection, pos, rot, 0.0f));
+	assert(!cache.Lookup(entryB, viewProjection, pos, rot, 0.0f));
+	
+	cache.Update(entryA, viewProjection, pos, rot, viewProjection, viewProjection);
+	cache.InvalidateAll();
+	assert(!cache.Lookup(entryA, viewProjection, pos, rot, 0.0f));
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+
+static bool MatricesEqual(const Matrix4f& a, const Matrix4f& b)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		for(int j = 0; j < 4; j++)
+		{
+			if(a[i][j] != b[i][j])
+			{
+				return false;
+			}
+		}
+	}
+	
+	return true;
+}
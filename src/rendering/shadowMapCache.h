@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SHADOWMAPCACHE_H
+#define SHADOWMAPCACHE_H
+
+#include "frustum.h"
+#include "../core/math3d.h"
+#include <map>
+#include <vector>
+
+//Keeps track of which lights' shadow maps are still up to date, so they can be kept
+//across frames instead of being rendered and blurred again every frame.
+//
+//A shadow map goes out of date when it would be rendered from a different shadow
+//camera, or when anything inside the shadow camera's frustum changes. Lights whose
+//shadow camera follows the main camera can give a threshold it has to move past
+//first, since their shadow map covers more than the main camera can see.
+//
+//The cache only holds the bookkeeping, and the owner keeps the textures. Lights with
+//several shadow maps, such as cascades, have an entry for each layer.
+class ShadowMapCache
+{
+public:
+	ShadowMapCache() :
+		m_numHits(0),
+		m_numMisses(0) {}
+	
+	//Finds the entry for one of the light's layers, adding one that isn't valid the first time it's seen.
+	int GetEntry(const void* light, int layer = 0);
+	
+	//Whether the entry's shadow map can be used as it is from a shadow camera with this
+	//projection at pos and rot, counting towards the hit rate.
+	bool Lookup(int entry, const Matrix4f& projection, const Vector3f& pos, const Quaternion& rot, float moveThreshold);
+	
+	//Records that the entry's shadow map has just been rendered with this shadow camera.
+	void Update(int entry, const Matrix4f& projection, const Vector3f& pos, const Quaternion& rot, 
+	            const Matrix4f& viewProjection, const Matrix4f& lightMatrix);
+	
+	//Invalidates every shadow map whose shadow camera could see something in the box.
+	void InvalidateAABB(const Vector3f& boundsMin, const Vector3f& boundsMax);
+	void InvalidateAll();
+	inline void Invalidate(int entry)                      { m_entries[entry].m_isValid = false; }
+	
+	inline const Matrix4f& GetLightMatrix(int entry) const { return m_entries[entry].m_lightMatrix; }
+	inline int GetNumEntries()                       const { return (int)m_entries.size(); }
+	
+	//Lookups since the last ResetCounters.
+	inline int GetNumHits()                          const { return m_numHits; }
+	inline int GetNumMisses()                        const { return m_numMisses; }
+	inline void ResetCounters()                            { m_numHits = 0; m_numMisses = 0; }
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	class Entry
+	{
+	public:
+		Entry() :
+			m_frustum(Matrix4f().InitIdentity()),
+			m_isValid(false) {}
+		
+		Matrix4f   m_projection;
+		Vector3f   m_pos;
+		Quaternion m_rot;
+		Frustum    m_frustum;     //The shadow camera's, without its near plane as shadow passes clamp depth
+		Matrix4f   m_lightMatrix; //What the shadow map is sampled with
+		bool       m_isValid;
+	};
+	
+	std::map<std::pair<const void*, int>, int> m_entryIndices;
+	std::vector<Entry>                         m_entries;
+	int                                        m_numHits;
+	int                                        m_numMisses;
+};
+
+#endif // SHADOWMAPCACHE_H
@@ -15,7 +15,9 @@
  */
 
 #include "texture.h"
+#include "glState.h"
 
+#include "../core/assetLoader.h"
 #include "../core/math3d.h"
 #include "../core/profiling.h"
 
@@ -24,14 +26,66 @@
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <vector>
 
 std::map<std::string, TextureData*> Texture::s_resourceMap;
 
-TextureData::TextureData(GLenum textureTarget, int width, int height, int numTextures, unsigned char** data, GLfloat* filters, GLenum* internalFormat, GLenum* format, bool clamp, GLenum* attachments)
+//An image textures show while their own pixels are loading.
+class PlaceholderImage
 {
+public:
+	PlaceholderImage() :
+		m_width(0),
+		m_height(0) {}
+	
+	int m_width;
+	int m_height;
+	std::vector<unsigned char> m_pixels; //RGBA
+};
+
+//Carried from Texture::LoadAsync to a loader thread and back.
+class TextureLoadRequest
+{
+public:
+	TextureLoadRequest(const Texture& texture, const std::string& fileName, GLfloat filter, GLenum internalFormat, GLenum format, bool clamp) :
+		m_texture(texture),
+		m_fileName(fileName),
+		m_filter(filter),
+		m_internalFormat(internalFormat),
+		m_format(format),
+		m_clamp(clamp),
+		m_width(0),
+		m_height(0),
+		m_data(0) {}
+	
+	Texture        m_texture; //Keeps the texture's data alive until it's uploaded
+	std::string    m_fileName;
+	GLfloat        m_filter;
+	GLenum         m_internalFormat;
+	GLenum         m_format;
+	bool           m_clamp;
+	int            m_width;
+	int            m_height;
+	unsigned char* m_data;    //Decoded on the loader thread, and freed once uploaded
+};
+
+static const PlaceholderImage& GetPlaceholderImage(const std::string& fileName);
+
+MemoryPool& TextureData::GetMemoryPool()
+{
+	static MemoryPool* pool = new MemoryPool("TextureData", sizeof(TextureData));
+	return *pool;
+}
+
+TextureData::TextureData(GLenum textureTarget, int width, int height, int numTextures, unsigned char** data, GLfloat* filters, GLenum* internalFormat, GLenum* format, bool clamp, GLenum* attachments, int numLayers, bool isLoaded) :
+	m_isLoaded(isLoaded)
+{
+	assert(numLayers == 1 || textureTarget == GL_TEXTURE_2D_ARRAY);
+	
 	m_textureID = new GLuint[numTextures];
 	m_textureTarget = textureTarget;
 	m_numTextures = numTextures;
+	m_numLayers = numLayers;
 	
 	#if PROFILING_SET_2x2_TEXTURE == 0
 		m_width = width;
@@ -40,19 +94,34 @@ TextureData::TextureData(GLenum textureTarget, int width, int height, int numTex
 		m_width = 2;
 		m_height = 2;
 	#endif
-	m_frameBuffer = 0;
+	m_frameBuffers = new GLuint[numLayers];
 	m_renderBuffer = 0;
 	
+	for(int i = 0; i < numLayers; i++)
+	{
+		m_frameBuffers[i] = 0;
+	}
+	
 	InitTextures(data, filters, internalFormat, format, clamp);
 	InitRenderTargets(attachments);
 }
 
 TextureData::~TextureData()
 {
-	if(*m_textureID) glDeleteTextures(m_numTextures, m_textureID);
-	if(m_frameBuffer) glDeleteFramebuffers(1, &m_frameBuffer);
+	if(*m_textureID) 
+	{
+		glDeleteTextures(m_numTextures, m_textureID);
+		GLState::OnTexturesDeleted(m_numTextures, m_textureID);
+	}
+	if(*m_frameBuffers) 
+	{
+		glDeleteFramebuffers(m_numLayers, m_frameBuffers);
+		for(int i = 0; i < m_numLayers; i++)
+			GLState::OnFramebufferDeleted(m_frameBuffers[i]);
+	}
 	if(m_renderBuffer) glDeleteRenderbuffers(1, &m_renderBuffer);
 	if(m_textureID) delete[] m_textureID;
+	if(m_frameBuffers) delete[] m_frameBuffers;
 }
 
 void TextureData::InitTextures(unsigned char** data, GLfloat* filters, GLenum* internalFormat, GLenum* format, bool clamp)
@@ -60,7 +129,7 @@ void TextureData::InitTextures(unsigned char** data, GLfloat* filters, GLenum* i
 	glGenTextures(m_numTextures, m_textureID);
 	for(int i = 0; i < m_numTextures; i++)
 	{
-		glBindTexture(m_textureTarget, m_textureID[i]);
+		GLState::BindTexture(GLState::GetActiveTextureUnit(), m_textureTarget, m_textureID[i]);
 			
 		glTexParameterf(m_textureTarget, GL_TEXTURE_MIN_FILTER, filters[i]);
 		glTexParameterf(m_textureTarget, GL_TEXTURE_MAG_FILTER, filters[i]);
@@ -71,7 +140,12 @@ void TextureData::InitTextures(unsigned char** data, GLfloat* filters, GLenum* i
 			glTexParameterf(m_textureTarget, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		}
 		
-		glTexImage2D(m_textureTarget, 0, internalFormat[i], m_width, m_height, 0, format[i], GL_UNSIGNED_BYTE, data[i]);
+		//Packed depth and stencil can only be specified with the matching packed type.
+		GLenum type = format[i] == GL_DEPTH_STENCIL ? GL_UNSIGNED_INT_24_8 : GL_UNSIGNED_BYTE;
+		if(m_textureTarget == GL_TEXTURE_2D_ARRAY)
+			glTexImage3D(m_textureTarget, 0, internalFormat[i], m_width, m_height, m_numLayers, 0, format[i], type, data[i]);
+		else
+			glTexImage2D(m_textureTarget, 0, internalFormat[i], m_width, m_height, 0, format[i], type, data[i]);
 		
 		if(filters[i] == GL_NEAREST_MIPMAP_NEAREST ||
 			filters[i] == GL_NEAREST_MIPMAP_LINEAR ||
@@ -91,6 +165,23 @@ void TextureData::InitTextures(unsigned char** data, GLfloat* filters, GLenum* i
 	}
 }
 
+void TextureData::SetData(int width, int height, unsigned char* data, GLfloat filter, GLenum internalFormat, GLenum format, bool clamp)
+{
+	assert(m_numTextures == 1 && m_numLayers == 1 && *m_frameBuffers == 0);
+	
+	//Every image the texture has had is replaced, so it's simplest to start over with a new one.
+	glDeleteTextures(m_numTextures, m_textureID);
+	GLState::OnTexturesDeleted(m_numTextures, m_textureID);
+	
+	#if PROFILING_SET_2x2_TEXTURE == 0
+		m_width = width;
+		m_height = height;
+	#endif
+	
+	InitTextures(&data, &filter, &internalFormat, &format, clamp);
+	m_isLoaded = true;
+}
+
 void TextureData::InitRenderTargets(GLenum* attachments)
 {
 	if(attachments == 0)
@@ -99,74 +190,87 @@ void TextureData::InitRenderTargets(GLenum* attachments)
 	GLenum drawBuffers[32];      //32 is the max number of bound textures in OpenGL
 	assert(m_numTextures <= 32); //Assert to be sure no buffer overrun should occur
 
-	bool hasDepth = false;
-	for(int i = 0; i < m_numTextures; i++)
+	//Every layer gets a framebuffer of its own, and they all share one depth buffer.
+	for(int layer = 0; layer < m_numLayers; layer++)
 	{
-		if(attachments[i] == GL_DEPTH_ATTACHMENT)
+		bool hasDepth = false;
+		for(int i = 0; i < m_numTextures; i++)
 		{
-			drawBuffers[i] = GL_NONE;
-			hasDepth = true;
+			if(attachments[i] == GL_DEPTH_ATTACHMENT || attachments[i] == GL_DEPTH_STENCIL_ATTACHMENT)
+			{
+				drawBuffers[i] = GL_NONE;
+				hasDepth = true;
+			}
+			else
+				drawBuffers[i] = attachments[i];
+		
+			if(attachments[i] == GL_NONE)
+				continue;
+			
+			if(m_frameBuffers[layer] == 0)
+			{
+				glGenFramebuffers(1, &m_frameBuffers[layer]);
+				GLState::BindFramebuffer(m_frameBuffers[layer]);
+			}
+			
+			if(m_textureTarget == GL_TEXTURE_2D_ARRAY)
+				glFramebufferTextureLayer(GL_FRAMEBUFFER, attachments[i], m_textureID[i], 0, layer);
+			else
+				glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], m_textureTarget, m_textureID[i], 0);
 		}
-		else
-			drawBuffers[i] = attachments[i];
-	
-		if(attachments[i] == GL_NONE)
-			continue;
 		
-		if(m_frameBuffer == 0)
+		if(m_frameBuffers[layer] == 0)
+			return;
+		
+		if(!hasDepth)
 		{
-			glGenFramebuffers(1, &m_frameBuffer);
-			glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+			if(m_renderBuffer == 0)
+			{
+				glGenRenderbuffers(1, &m_renderBuffer);
+				glBindRenderbuffer(GL_RENDERBUFFER, m_renderBuffer);
+				glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, m_width, m_height);
+			}
+			
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderBuffer);
 		}
 		
-		glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], m_textureTarget, m_textureID[i], 0);
-	}
-	
-	if(m_frameBuffer == 0)
-		return;
-	
-	if(!hasDepth)
-	{
-		glGenRenderbuffers(1, &m_renderBuffer);
-		glBindRenderbuffer(GL_RENDERBUFFER, m_renderBuffer);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, m_width, m_height);
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderBuffer);
-	}
-	
-	glDrawBuffers(m_numTextures, drawBuffers);
-	
-	//glDrawBuffer(GL_NONE);
-	//glReadBuffer(GL_NONE);
-	
-	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-	{
-		std::cerr << "Framebuffer creation failed!" << std::endl;
-		assert(false);
+		glDrawBuffers(m_numTextures, drawBuffers);
+		
+		//glDrawBuffer(GL_NONE);
+		//glReadBuffer(GL_NONE);
+		
+		if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr << "Framebuffer creation failed!" << std::endl;
+			assert(false);
+		}
 	}
 	
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(0);
 }
 
-void TextureData::Bind(int textureNum) const
+void TextureData::Bind(unsigned int unit, int textureNum) const
 {
-	glBindTexture(m_textureTarget, m_textureID[textureNum]);
+	GLState::BindTexture(unit, m_textureTarget, m_textureID[textureNum]);
 }
 
-void TextureData::BindAsRenderTarget() const
+void TextureData::BindAsRenderTarget(int layer) const
 {
-	glBindTexture(GL_TEXTURE_2D,0);
-	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+	GLState::BindTexture(GLState::GetActiveTextureUnit(), GL_TEXTURE_2D, 0);
+	GLState::BindFramebuffer(m_frameBuffers[layer]);
 	
 	#if PROFILING_SET_1x1_VIEWPORT == 0
-		glViewport(0, 0, m_width, m_height);
+		GLState::Viewport(0, 0, m_width, m_height);
 	#else
-		glViewport(0, 0, 1, 1);
+		GLState::Viewport(0, 0, 1, 1);
 	#endif
 }
 
 Texture::Texture(const std::string& fileName, GLenum textureTarget, GLfloat filter, GLenum internalFormat, GLenum format, bool clamp, GLenum attachment)
 {
  	m_fileName = fileName;
+	m_textureNum = 0;
+	m_layer = 0;
 
 	std::map<std::string, TextureData*>::const_iterator it = s_resourceMap.find(fileName);
 	if(it != s_resourceMap.end())
@@ -194,11 +298,83 @@ Texture::Texture(const std::string& fileName, GLenum textureTarget, GLfloat filt
 Texture::Texture(int width, int height, unsigned char* data, GLenum textureTarget, GLfloat filter, GLenum internalFormat, GLenum format, bool clamp, GLenum attachment)
 {
 	m_fileName = "";
+	m_textureNum = 0;
+	m_layer = 0;
 	m_textureData = new TextureData(textureTarget, width, height, 1, &data, &filter, &internalFormat, &format, clamp, &attachment);
 }
 
+Texture::Texture(int width, int height, int numTextures, GLenum textureTarget, GLfloat* filters, GLenum* internalFormats, GLenum* formats, bool clamp, GLenum* attachments, int numLayers)
+{
+	std::vector<unsigned char*> data(numTextures, (unsigned char*)0);
+	
+	m_fileName = "";
+	m_textureNum = 0;
+	m_layer = 0;
+	m_textureData = new TextureData(textureTarget, width, height, numTextures, &data[0], filters, internalFormats, formats, clamp, attachments, numLayers);
+}
+
+Texture::Texture(TextureData* textureData, const std::string& fileName) :
+	m_textureData(textureData),
+	m_textureNum(0),
+	m_layer(0),
+	m_fileName(fileName) {}
+
+Texture Texture::LoadAsync(const std::string& fileName, const std::string& placeholderFileName, GLfloat filter, GLenum internalFormat, GLenum format, bool clamp)
+{
+	//Textures already loaded, or on their way, are shared as usual.
+	if(s_resourceMap.find(fileName) != s_resourceMap.end())
+	{
+		return Texture(fileName);
+	}
+	
+	//The placeholder gets the same settings, so nothing but the pixels changes once they're uploaded.
+	const PlaceholderImage& placeholder = GetPlaceholderImage(placeholderFileName);
+	unsigned char* data = (unsigned char*)&placeholder.m_pixels[0];
+	GLenum attachment = GL_NONE;
+	
+	TextureData* textureData = new TextureData(GL_TEXTURE_2D, placeholder.m_width, placeholder.m_height, 1, &data, 
+		&filter, &internalFormat, &format, clamp, &attachment, 1, false);
+	s_resourceMap.insert(std::pair<std::string, TextureData*>(fileName, textureData));
+	
+	Texture result(textureData, fileName);
+	AssetLoader::GetAssetLoader().Load(DecodeFile, UploadFile, 
+		new TextureLoadRequest(result, fileName, filter, internalFormat, format, clamp));
+	return result;
+}
+
+void Texture::DecodeFile(void* request)
+{
+	TextureLoadRequest* textureRequest = (TextureLoadRequest*)request;
+	
+	int bytesPerPixel;
+	textureRequest->m_data = stbi_load(("./res/textures/" + textureRequest->m_fileName).c_str(), 
+		&textureRequest->m_width, &textureRequest->m_height, &bytesPerPixel, 4);
+}
+
+void Texture::UploadFile(void* request)
+{
+	TextureLoadRequest* textureRequest = (TextureLoadRequest*)request;
+	TextureData* textureData = textureRequest->m_texture.m_textureData;
+	
+	if(textureRequest->m_data == NULL)
+	{
+		//The placeholder is kept, so there's still something to draw.
+		std::cerr << "Unable to load texture: " << textureRequest->m_fileName << std::endl;
+	}
+	else
+	{
+		textureData->SetData(textureRequest->m_width, textureRequest->m_height, textureRequest->m_data, 
+			textureRequest->m_filter, textureRequest->m_internalFormat, textureRequest->m_format, textureRequest->m_clamp);
+		stbi_image_free(textureRequest->m_data);
+	}
+	
+	delete textureRequest;
+}
+
 Texture::Texture(const Texture& texture) :
 	m_textureData(texture.m_textureData),
+	m_textureNum(texture.m_textureNum),
+	m_layer(texture.m_layer),
 	m_fileName(texture.m_fileName)
 {
 	m_textureData->AddReference();
@@ -226,11 +402,64 @@ Texture::~Texture()
 void Texture::Bind(unsigned int unit) const
 {
 	assert(unit >= 0 && unit <= 31);
-	glActiveTexture(GL_TEXTURE0 + unit);
-	m_textureData->Bind(0);
+	m_textureData->Bind(unit, m_textureNum);
 }
 
 void Texture::BindAsRenderTarget() const
 {
-	m_textureData->BindAsRenderTarget();
+	m_textureData->BindAsRenderTarget(m_layer);
+}
+
+Texture Texture::GetAttachment(int textureNum) const
+{
+	assert(textureNum >= 0 && textureNum < m_textureData->GetNumTextures());
+	
+	Texture result(*this);
+	result.m_textureNum = textureNum;
+	return result;
+}
+
+Texture Texture::GetLayer(int layer) const
+{
+	assert(layer >= 0 && layer < m_textureData->GetNumLayers());
+	
+	Texture result(*this);
+	result.m_layer = layer;
+	return result;
+}
+
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static const PlaceholderImage& GetPlaceholderImage(const std::string& fileName)
+{
+	//Decoded once and kept, since every texture loading behind the same placeholder shares it.
+	static std::map<std::string, PlaceholderImage> placeholders;
+	
+	std::map<std::string, PlaceholderImage>::iterator it = placeholders.find(fileName);
+	if(it != placeholders.end())
+	{
+		return it->second;
+	}
+	
+	PlaceholderImage& placeholder = placeholders[fileName];
+	
+	int bytesPerPixel;
+	unsigned char* data = stbi_load(("./res/textures/" + fileName).c_str(), &placeholder.m_width, &placeholder.m_height, &bytesPerPixel, 4);
+	
+	if(data == NULL)
+	{
+		std::cerr << "Unable to load texture: " << fileName << std::endl;
+		
+		placeholder.m_width = 1;
+		placeholder.m_height = 1;
+		placeholder.m_pixels.assign(4, 255);
+	}
+	else
+	{
+		placeholder.m_pixels.assign(data, data + placeholder.m_width * placeholder.m_height * 4);
+		stbi_image_free(data);
+	}
+	
+	return placeholder;
 }
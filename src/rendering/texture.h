@@ -18,6 +18,7 @@
 #define TEXTURE_H
 
 #include "../core/referenceCounter.h"
+#include "../core/memoryPool.h"
 #include <GL/glew.h>
 #include <string>
 #include <map>
@@ -25,30 +26,44 @@
 class TextureData : public ReferenceCounter
 {
 public:
-	TextureData(GLenum textureTarget, int width, int height, int numTextures, unsigned char** data, GLfloat* filters, GLenum* internalFormat, GLenum* format, bool clamp, GLenum* attachments);
+	//Data created with isLoaded false is a placeholder, until SetData replaces it.
+	TextureData(GLenum textureTarget, int width, int height, int numTextures, unsigned char** data, GLfloat* filters, GLenum* internalFormat, GLenum* format, bool clamp, GLenum* attachments, int numLayers = 1, bool isLoaded = true);
 	
-	void Bind(int textureNum) const;
-	void BindAsRenderTarget() const;
+	void Bind(unsigned int unit, int textureNum) const;
+	void BindAsRenderTarget(int layer) const;
+	
+	//Replaces the pixels of a single texture that isn't rendered to, resizing it if needed.
+	void SetData(int width, int height, unsigned char* data, GLfloat filter, GLenum internalFormat, GLenum format, bool clamp);
 	
 	inline int GetWidth()  const { return m_width; }
 	inline int GetHeight() const { return m_height; }
+	inline int GetNumTextures() const { return m_numTextures; }
+	inline int GetNumLayers() const { return m_numLayers; }
+	inline bool IsLoaded() const { return m_isLoaded; }
 	
 	virtual ~TextureData();
+	
+	static void* operator new(size_t size)                 { return GetMemoryPool().Allocate(size); }
+	static void operator delete(void* object, size_t size) { GetMemoryPool().Free(object, size); }
 protected:	
 private:
 	TextureData(TextureData& other) {}
 	void operator=(TextureData& other) {}
+	
+	static MemoryPool& GetMemoryPool();
 
 	void InitTextures(unsigned char** data, GLfloat* filter, GLenum* internalFormat, GLenum* format, bool clamp);
 	void InitRenderTargets(GLenum* attachments);
 
 	GLuint* m_textureID;
 	GLenum m_textureTarget;
-	GLuint m_frameBuffer;
+	GLuint* m_frameBuffers; //One per layer
 	GLuint m_renderBuffer;
 	int m_numTextures;
+	int m_numLayers;
 	int m_width;
 	int m_height;
+	bool m_isLoaded;
 };
 
 class Texture
@@ -56,23 +71,52 @@ class Texture
 public:
 	Texture(const std::string& fileName, GLenum textureTarget = GL_TEXTURE_2D, GLfloat filter = GL_LINEAR_MIPMAP_LINEAR, GLenum internalFormat = GL_RGBA, GLenum format = GL_RGBA, bool clamp = false, GLenum attachment = GL_NONE);
 	Texture(int width = 0, int height = 0, unsigned char* data = 0, GLenum textureTarget = GL_TEXTURE_2D, GLfloat filter = GL_LINEAR_MIPMAP_LINEAR, GLenum internalFormat = GL_RGBA, GLenum format = GL_RGBA, bool clamp = false, GLenum attachment = GL_NONE);
+	
+	//Several empty textures rendered to through one framebuffer, one per attachment.
+	//GL_TEXTURE_2D_ARRAY textures have numLayers layers, each with its own framebuffer.
+	Texture(int width, int height, int numTextures, GLenum textureTarget, GLfloat* filters, GLenum* internalFormats, GLenum* formats, bool clamp, GLenum* attachments, int numLayers = 1);
 	Texture(const Texture& texture);
 	void operator=(Texture texture);
 	virtual ~Texture();
+	
+	//Returns at once with a texture showing placeholderFileName, which switches to
+	//fileName's pixels once the AssetLoader has decoded them and they've been uploaded.
+	static Texture LoadAsync(const std::string& fileName, const std::string& placeholderFileName = "defaultTexture.png", 
+		GLfloat filter = GL_LINEAR_MIPMAP_LINEAR, GLenum internalFormat = GL_RGBA, GLenum format = GL_RGBA, bool clamp = false);
 
 	void Bind(unsigned int unit = 0) const;	
 	void BindAsRenderTarget() const;
 	
-	inline int GetWidth()  const { return m_textureData->GetWidth(); }
-	inline int GetHeight() const { return m_textureData->GetHeight(); }
+	//A texture sharing this one's data that binds its textureNum'th texture instead.
+	Texture GetAttachment(int textureNum) const;
+	
+	//A texture sharing this one's data that renders to its layer'th layer instead.
+	Texture GetLayer(int layer) const;
+	
+	inline int GetWidth()     const { return m_textureData->GetWidth(); }
+	inline int GetHeight()    const { return m_textureData->GetHeight(); }
+	inline int GetNumLayers() const { return m_textureData->GetNumLayers(); }
+	inline bool IsLoaded()    const { return m_textureData->IsLoaded(); }
 	
-	bool operator==(const Texture& texture) const { return m_textureData == texture.m_textureData; }
+	bool operator==(const Texture& texture) const 
+	{ 
+		return m_textureData == texture.m_textureData && m_textureNum == texture.m_textureNum && m_layer == texture.m_layer; 
+	}
 	bool operator!=(const Texture& texture) const { return !operator==(texture); }
 protected:
 private:
 	static std::map<std::string, TextureData*> s_resourceMap;
+	
+	//Run by the AssetLoader for LoadAsync; the first on a loader thread, the second on the GL thread.
+	static void DecodeFile(void* request);
+	static void UploadFile(void* request);
+	
+	//Takes over the reference the data was created with.
+	Texture(TextureData* textureData, const std::string& fileName);
 
 	TextureData* m_textureData;
+	int m_textureNum;
+	int m_layer;
 	std::string m_fileName;
 };
 
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "vertexFormat.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+const float VertexFormat::MAX_HALF_TEX_COORD = 4.0f;
+
+VertexFormat::VertexFormat(int flags) :
+	m_flags(flags & GetSupportedFlags())
+{
+	int texCoordSize = (m_flags & HALF_TEX_COORDS) ? 2 * sizeof(unsigned short) : sizeof(Vector2f);
+	int normalSize = (m_flags & PACKED_NORMALS) ? sizeof(unsigned int) : sizeof(Vector3f);
+	
+	m_offsets[POSITION] = 0;
+	m_offsets[TEX_COORD] = m_offsets[POSITION] + sizeof(Vector3f);
+	m_offsets[NORMAL] = m_offsets[TEX_COORD] + texCoordSize;
+	m_offsets[TANGENT] = m_offsets[NORMAL] + normalSize;
+	m_stride = m_offsets[TANGENT] + normalSize;
+}
+
+VertexFormat VertexFormat::Choose(int flags, const std::vector<Vector2f>& texCoords)
+{
+	for(unsigned int i = 0; i < texCoords.size() && (flags & HALF_TEX_COORDS); i++)
+	{
+		if(fabs(texCoords[i].GetX()) > MAX_HALF_TEX_COORD || fabs(texCoords[i].GetY()) > MAX_HALF_TEX_COORD)
+		{
+			flags &= ~HALF_TEX_COORDS;
+		}
+	}
+	
+	return VertexFormat(flags);
+}
+
+void VertexFormat::Pack(const std::vector<Vector3f>& positions, const std::vector<Vector2f>& texCoords, 
+                        const std::vector<Vector3f>& normals, const std::vector<Vector3f>& tangents, 
+                        std::vector<unsigned char>* data) const
+{
+	data->resize(positions.size() * m_stride);
+	
+	for(unsigned int i = 0; i < positions.size(); i++)
+	{
+		unsigned char* vertex = &(*data)[i * m_stride];
+		memcpy(vertex + m_offsets[POSITION], &positions[i], sizeof(Vector3f));
+		
+		if(m_flags & HALF_TEX_COORDS)
+		{
+			unsigned short texCoord[2] = { PackHalf(texCoords[i].GetX()), PackHalf(texCoords[i].GetY()) };
+			memcpy(vertex + m_offsets[TEX_COORD], texCoord, sizeof(texCoord));
+		}
+		else
+		{
+			memcpy(vertex + m_offsets[TEX_COORD], &texCoords[i], sizeof(Vector2f));
+		}
+		
+		if(m_flags & PACKED_NORMALS)
+		{
+			unsigned int normal = PackNormal(normals[i]);
+			unsigned int tangent = PackNormal(tangents[i]);
+			memcpy(vertex + m_offsets[NORMAL], &normal, sizeof(normal));
+			memcpy(vertex + m_offsets[TANGENT], &tangent, sizeof(tangent));
+		}
+		else
+		{
+			memcpy(vertex + m_offsets[NORMAL], &normals[i], sizeof(Vector3f));
+			memcpy(vertex + m_offsets[TANGENT], &tangents[i], sizeof(Vector3f));
+		}
+	}
+}
+
+void VertexFormat::SetAttribPointers() const
+{
+	for(int i = 0; i < NUM_ATTRIBUTES; i++)
+	{
+		glEnableVertexAttribArray(i);
+	}
+	
+	glVertexAttribPointer(POSITION, 3, GL_FLOAT, GL_FALSE, m_stride, (const GLvoid*)(size_t)m_offsets[POSITION]);
+	
+	if(m_flags & HALF_TEX_COORDS)
+		glVertexAttribPointer(TEX_COORD, 2, GL_HALF_FLOAT, GL_FALSE, m_stride, (const GLvoid*)(size_t)m_offsets[TEX_COORD]);
+	else
+		glVertexAttribPointer(TEX_COORD, 2, GL_FLOAT, GL_FALSE, m_stride, (const GLvoid*)(size_t)m_offsets[TEX_COORD]);
+	
+	//Packed normals come out as vec4s, whose w is ignored by shaders reading a vec3.
+	if(m_flags & PACKED_NORMALS)
+	{
+		glVertexAttribPointer(NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, m_stride, (const GLvoid*)(size_t)m_offsets[NORMAL]);
+		glVertexAttribPointer(TANGENT, 4, GL_INT_2_10_10_10_REV, GL_TRUE, m_stride, (const GLvoid*)(size_t)m_offsets[TANGENT]);
+	}
+	else
+	{
+		glVertexAttribPointer(NORMAL, 3, GL_FLOAT, GL_FALSE, m_stride, (const GLvoid*)(size_t)m_offsets[NORMAL]);
+		glVertexAttribPointer(TANGENT, 3, GL_FLOAT, GL_FALSE, m_stride, (const GLvoid*)(size_t)m_offsets[TANGENT]);
+	}
+}
+
+int VertexFormat::GetUnpackedStride()
+{
+	return 3 * sizeof(Vector3f) + sizeof(Vector2f);
+}
+
+int VertexFormat::GetSupportedFlags()
+{
+	//Without a context, such as in unit tests, formats are only packed on the CPU.
+	if(!glVertexAttribPointer)
+		return COMPACT;
+	
+	int flags = 0;
+	
+	if(GLEW_VERSION_3_0 || GLEW_ARB_half_float_vertex)
+		flags |= HALF_TEX_COORDS;
+	
+	if(GLEW_VERSION_3_3 || GLEW_ARB_vertex_type_2_10_10_10_rev)
+		flags |= PACKED_NORMALS;
+	
+	return flags;
+}
+
+unsigned short VertexFormat::PackHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	
+	unsigned int sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	unsigned int mantissa = bits & 0x7FFFFF;
+	
+	//Infinity and NaN keep their meaning, and anything too large becomes infinity.
+	if(((bits >> 23) & 0xFF) == 0xFF)
+		return (unsigned short)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	if(exponent >= 31)
+		return (unsigned short)(sign | 0x7C00);
+	
+	//Too small for a normal half float, so it's stored as a denormal, or as 0.
+	if(exponent <= 0)
+	{
+		if(exponent < -10)
+			return (unsigned short)sign;
+		
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		unsigned int half = mantissa >> shift;
+		
+		if((mantissa >> (shift - 1)) & 1)
+			half++;
+		
+		return (unsigned short)(sign | half);
+	}
+	
+	//Rounding can carry into the exponent, which still gives the right value.
+	unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+	if(mantissa & 0x1000)
+		half++;
+	
+	return (unsigned short)half;
+}
+
+float VertexFormat::UnpackHalf(unsigned short value)
+{
+	float sign = (value & 0x8000) ? -1.0f : 1.0f;
+	int exponent = (value >> 10) & 0x1F;
+	int mantissa = value & 0x3FF;
+	
+	if(exponent == 0)
+		return sign * ldexp((float)mantissa, -24);
+	if(exponent == 31)
+		return mantissa ? NAN : sign * INFINITY;
+	
+	return sign * ldexp((float)(mantissa | 0x400), exponent - 25);
+}
+
+unsigned int VertexFormat::PackNormal(const Vector3f& normal)
+{
+	float length = normal.Length();
+	Vector3f direction = length > 0.0f ? Vector3f(normal / length) : normal;
+	
+	unsigned int result = 0;
+	for(int i = 0; i < 3; i++)
+	{
+		int component = (int)floor(Clamp(direction[i], -1.0f, 1.0f) * 511.0f + 0.5f);
+		result |= ((unsigned int)component & 0x3FF) << (i * 10);
+	}
+	
+	return result;
+}
+
+Vector3f VertexFormat::UnpackNormal(unsigned int value)
+{
+	Vector3f result;
+	for(int i = 0; i < 3; i++)
+	{
+		int component = (int)((value >> (i * 10)) & 0x3FF);
+		if(component >= 512)
+			component -= 1024;
+		
+		result[i] = std::max((float)component / 511.0f, -1.0f);
+	}
+	
+	return result;
+}
+
+void VertexFormat::Test()
+{
+	//Half floats are exact for small integers and simple fractions.
+	float exactValues[] = { 0.0f, 1.0f, -1.0f, 0.5f, -2.5f, 1024.0f, 65504.0f };
+	for(unsigned int i = 0; i < sizeof(exactValues) / sizeof(exactValues[0]); i++)
+	{
+		assert(UnpackHalf(PackHalf(exactValues[i])) == exactValues[i]);
+	}
+	
+	assert(PackHalf(1.0f) == 0x3C00);
+	assert(PackHalf(-2.0f) == 0xC000);
+	assert(PackHalf(100000.0f) == 0x7C00);
+	assert(UnpackHalf(PackHalf(1e-6f)) > 0.0f);
+	
+	//Texture coordinates in range keep about three decimal places.
+	for(float value = -MAX_HALF_TEX_COORD; value <= MAX_HALF_TEX_COORD; value += 0.01f)
+	{
+		assert(fabs(UnpackHalf(PackHalf(value)) - value) <= 0.001f);
+	}
+	
+	//Packed normals stay within a fraction of a degree, and come back unit length.
+	Vector3f normals[] = { Vector3f(1, 0, 0), Vector3f(0, -1, 0), Vector3f(0, 0, 1), Vector3f(1, 2, -3), Vector3f(-0.3f, 0.1f, 0.9f) };
+	for(unsigned int i = 0; i < sizeof(normals) / sizeof(normals[0]); i++)
+	{
+		Vector3f normal = normals[i].Normalized();
+		Vector3f unpacked = UnpackNormal(PackNormal(normals[i] * 3.0f));
+		
+		assert(normal.Dot(unpacked) > 0.9999f);
+		assert(fabs(unpacked.Length() - 1.0f) < 0.005f);
+	}
+	
+	assert(PackNormal(Vector3f(0, 0, 0)) == 0);
+	
+	//The compact format is a little over half the size of separate floats.
+	VertexFormat fullFormat(0);
+	VertexFormat compactFormat(COMPACT);
+	assert(fullFormat.GetStride() == GetUnpackedStride());
+	assert(compactFormat.GetStride() == 24);
+	assert(compactFormat.GetOffset(TANGENT) == 20);
+	
+	//Texture coordinates out of range keep full precision.
+	std::vector<Vector2f> texCoords(2, Vector2f(0.5f, 0.5f));
+	assert(Choose(COMPACT, texCoords).GetFlags() == COMPACT);
+	texCoords[1] = Vector2f(0.0f, 40.0f);
+	assert(Choose(COMPACT, texCoords).GetFlags() == PACKED_NORMALS);
+	
+	//Each vertex is written at its stride, with every attribute at its offset.
+	std::vector<Vector3f> positions(2, Vector3f(1, 2, 3));
+	std::vector<Vector3f> directions(2, Vector3f(0, 1, 0));
+	texCoords[1] = Vector2f(0.25f, 0.75f);
+	positions[1] = Vector3f(4, 5, 6);
+	
+	std::vector<unsigned char> data;
+	compactFormat.Pack(positions, texCoords, directions, directions, &data);
+	assert((int)data.size() == 2 * compactFormat.GetStride());
+	
+	Vector3f position;
+	unsigned short texCoord[2];
+	unsigned int tangent;
+	memcpy(&position, &data[compactFormat.GetStride()], sizeof(position));
+	memcpy(texCoord, &data[compactFormat.GetStride() + compactFormat.GetOffset(TEX_COORD)], sizeof(texCoord));
+	memcpy(&tangent, &data[compactFormat.GetStride() + compactFormat.GetOffset(TANGENT)], sizeof(tangent));
+	
+	assert(position == Vector3f(4, 5, 6));
+	assert(UnpackHalf(texCoord[0]) == 0.25f && UnpackHalf(texCoord[1]) == 0.75f);
+	assert(UnpackNormal(tangent) == Vector3f(0, 1, 0));
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2014 Benny Bobaganoosh
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include "../core/math3d.h"
+#include <vector>
+
+//How a mesh's vertices are laid out in its vertex buffer. Every attribute is
+//interleaved into one buffer, so a vertex is fetched with a single read.
+//
+//Positions are always 32-bit floats. Texture coordinates can be half floats, and
+//normals and tangents can be packed into 10 bits per axis as GL_INT_2_10_10_10_REV.
+//The shaders read all of them the same way, since GL unpacks them into floats.
+class VertexFormat
+{
+public:
+	enum Flags
+	{
+		HALF_TEX_COORDS = 1,
+		PACKED_NORMALS  = 2,
+		
+		COMPACT         = HALF_TEX_COORDS | PACKED_NORMALS
+	};
+	
+	enum Attribute
+	{
+		POSITION,
+		TEX_COORD,
+		NORMAL,
+		TANGENT,
+		
+		NUM_ATTRIBUTES
+	};
+	
+	//Half floats are only used for texture coordinates within this of 0, since they
+	//lose precision quickly past it.
+	static const float MAX_HALF_TEX_COORD;
+	
+	//The flags are for whatever the mesh can use. Those the driver doesn't support are left out.
+	VertexFormat(int flags = 0);
+	
+	//A format that's only as compact as the texture coordinates allow.
+	static VertexFormat Choose(int flags, const std::vector<Vector2f>& texCoords);
+	
+	//Interleaves the vertices into data, which is resized to fit them.
+	void Pack(const std::vector<Vector3f>& positions, const std::vector<Vector2f>& texCoords, 
+	          const std::vector<Vector3f>& normals, const std::vector<Vector3f>& tangents, 
+	          std::vector<unsigned char>* data) const;
+	
+	//Points attributes 0 to 3 at the vertex buffer that's currently bound.
+	void SetAttribPointers() const;
+	
+	inline int GetFlags()                       const { return m_flags; }
+	inline int GetStride()                      const { return m_stride; }
+	inline int GetOffset(Attribute attribute)   const { return m_offsets[attribute]; }
+	
+	//Bytes a vertex takes with every attribute stored as separate 32-bit floats.
+	static int GetUnpackedStride();
+	
+	static unsigned short PackHalf(float value);
+	static float UnpackHalf(unsigned short value);
+	
+	//Normalizes the vector first, so it uses the whole range.
+	static unsigned int PackNormal(const Vector3f& normal);
+	static Vector3f UnpackNormal(unsigned int value);
+	
+	/** Performs a Unit Test of this class */
+	static void Test();
+protected:
+private:
+	int m_flags;
+	int m_stride;
+	int m_offsets[NUM_ATTRIBUTES];
+	
+	static int GetSupportedFlags();
+};
+
+#endif // VERTEXFORMAT_H
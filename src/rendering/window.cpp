@@ -15,6 +15,7 @@
  */
 
 #include "window.h"
+#include "glState.h"
 #include "../core/profiling.h"
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
@@ -57,6 +58,8 @@ Window::Window(int width, int height, const std::string& title) :
 	{
 		fprintf(stderr, "Error: '%s'\n", glewGetErrorString(res));
 	}
+	
+	GLState::Invalidate();
 }
 
 Window::~Window()
@@ -132,13 +135,13 @@ void Window::SwapBuffers()
 
 void Window::BindAsRenderTarget() const
 {
-	glBindTexture(GL_TEXTURE_2D,0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindTexture(GLState::GetActiveTextureUnit(), GL_TEXTURE_2D, 0);
+	GLState::BindFramebuffer(0);
 	
 	#if PROFILING_SET_1x1_VIEWPORT == 0
-		glViewport(0, 0, GetWidth(), GetHeight());
+		GLState::Viewport(0, 0, GetWidth(), GetHeight());
 	#else
-		glViewport(0, 0, 1, 1);
+		GLState::Viewport(0, 0, 1, 1);
 	#endif
 }
 
@@ -19,7 +19,7 @@
 
 #include "simddefines.h"
 
-#if defined(SIMD_CPU_ARCH_x86) || defined(SIMD_CPU_ARCH_x86_64)
+#if SIMD_CPU_ARCH == SIMD_CPU_ARCH_x86 || SIMD_CPU_ARCH == SIMD_CPU_ARCH_x86_64
 	#include "x86simdaccel.h"
 #else
 	#include "simdemulator.h"
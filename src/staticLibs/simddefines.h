@@ -43,7 +43,7 @@
 #endif
 
 //Detect supported SIMD features
-#if defined(SIMD_CPU_ARCH_x86) || defined(SIMD_CPU_ARCH_x86_64)
+#if SIMD_CPU_ARCH == SIMD_CPU_ARCH_x86 || SIMD_CPU_ARCH == SIMD_CPU_ARCH_x86_64
 	#if defined(INSTRSET)
 		#define SIMD_SUPPORTED_LEVEL INSTRSET
 	#elif defined(__AVX2__)
@@ -58,7 +58,7 @@
 		#define SIMD_SUPPORTED_LEVEL SIMD_LEVEL_x86_SSSE3
 	#elif defined(__SSE3__)
 		#define SIMD_SUPPORTED_LEVEL SIMD_LEVEL_x86_SSE3
-	#elif defined(__SSE2__) || defined(SIMD_CPU_ARCH_x86_64)
+	#elif defined(__SSE2__) || SIMD_CPU_ARCH == SIMD_CPU_ARCH_x86_64
 		#define SIMD_SUPPORTED_LEVEL SIMD_LEVEL_x86_SSE2
 	#elif defined(__SSE__)
 		#define SIMD_SUPPORTED_LEVEL SIMD_LEVEL_x86_SSE
@@ -72,7 +72,7 @@
 #endif
 
 //Include appropriate header files for SIMD features and CPU architecture
-#if defined(SIMD_CPU_ARCH_x86) || defined(SIMD_CPU_ARCH_x86_64)
+#if SIMD_CPU_ARCH == SIMD_CPU_ARCH_x86 || SIMD_CPU_ARCH == SIMD_CPU_ARCH_x86_64
 	#if SIMD_SUPPORTED_LEVEL >= SIMD_LEVEL_x86_AVX2
 		#ifdef __GNUC__
 			#include <x86intrin.h>
@@ -73,7 +73,7 @@ public:
 		Set((const int32_t*)data);
 	}
 
-	inline SIMD4i Pick(const SIMD4i& sourceIfTrue, const SIMD4i& sourceIfFalse)
+	inline SIMD4i Pick(const SIMD4i& sourceIfTrue, const SIMD4i& sourceIfFalse) const
 	{
 		int32_t result[4];
 		
@@ -93,7 +93,7 @@ public:
 //		return ((*this) & sourceIfTrue) | AndNot(sourceIfFalse);
 	}
 	
-	inline SIMD4i ConditionalAdd(const SIMD4i& num1, const SIMD4i& num2)
+	inline SIMD4i ConditionalAdd(const SIMD4i& num1, const SIMD4i& num2) const
 	{
 		return num1 + ((*this) & num2);
 	}
@@ -103,7 +103,7 @@ public:
 	//Bit 2/3: Which element goes to slot 2
 	//Bit 4/5: Which element goes to slot 3
 	//Bit 6/7: Which element goes to slot 4
-	inline SIMD4i Shuffle(int8_t shuffleByte)
+	inline SIMD4i Shuffle(int8_t shuffleByte) const
 	{
 		int index0 = (shuffleByte)      & 3;
 		int index1 = (shuffleByte >> 2) & 3;
@@ -113,7 +113,7 @@ public:
 		return SIMD4i(m_data[index0], m_data[index1], m_data[index2], m_data[index3]);
 	}
 	
-	inline int32_t HorizontalAdd()
+	inline int32_t HorizontalAdd() const
 	{
 		int32_t result = int32_t(0);
 		for(int i = 0; i < 4; i++)
@@ -124,19 +124,19 @@ public:
 		return result;
 	}
 	
-	inline SIMD4i Max(const SIMD4i& other)
+	inline SIMD4i Max(const SIMD4i& other) const
 	{
 		SIMD4i isGreater = (*this) > other;
 		return isGreater.Pick((*this), other);
 	}
 	
-	inline SIMD4i Min(const SIMD4i& other)
+	inline SIMD4i Min(const SIMD4i& other) const
 	{
 		SIMD4i isGreater = (*this) > other;
 		return isGreater.Pick(other, (*this));
 	}
 	
-	inline SIMD4i Abs()
+	inline SIMD4i Abs() const
 	{
 		int32_t result[4];
 		for(int i = 0; i < 4; i++)
@@ -385,7 +385,7 @@ public:
 		return SIMD4f(result);
 	}
 	
-	inline SIMD4f Pick(const SIMD4f& sourceIfTrue, const SIMD4f& sourceIfFalse)
+	inline SIMD4f Pick(const SIMD4f& sourceIfTrue, const SIMD4f& sourceIfFalse) const
 	{
 		float result[4];
 		
@@ -404,7 +404,7 @@ public:
 		return SIMD4f(result);
 	}
 	
-	inline SIMD4f ConditionalAdd(const SIMD4f& num1, const SIMD4f& num2)
+	inline SIMD4f ConditionalAdd(const SIMD4f& num1, const SIMD4f& num2) const
 	{
 		return num1 + ((*this) & num2);
 	}
@@ -414,7 +414,7 @@ public:
 	//Bit 2/3: Which element goes to slot 2
 	//Bit 4/5: Which element goes to slot 3
 	//Bit 6/7: Which element goes to slot 4
-	inline SIMD4f Shuffle(int8_t shuffleByte)
+	inline SIMD4f Shuffle(int8_t shuffleByte) const
 	{
 		int index0 = (shuffleByte)      & 3;
 		int index1 = (shuffleByte >> 2) & 3;
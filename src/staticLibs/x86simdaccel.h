@@ -53,16 +53,16 @@ public:
 		Set((const int32_t*)data);
 	}
 
-	inline SIMD4i Pick(const SIMD4i& sourceIfTrue, const SIMD4i& sourceIfFalse)
+	inline SIMD4i Pick(const SIMD4i& sourceIfTrue, const SIMD4i& sourceIfFalse) const
 	{
 		#if SIMD_SUPPORTED_LEVEL >= SIMD_LEVEL_x86_SSE4_1
-			return SIMD4i(_mm_blendv_epi8((*this), sourceIfTrue, sourceIfFalse));
+			return SIMD4i(_mm_blendv_epi8(sourceIfFalse, sourceIfTrue, (*this)));
 		#else
-			return ((*this) & sourceIfTrue) | (this->AndNot(sourceIfFalse));
+			return ((*this) & sourceIfTrue) | sourceIfFalse.AndNot(*this);
 		#endif
 	}
 	
-	inline SIMD4i ConditionalAdd(const SIMD4i& num1, const SIMD4i& num2)
+	inline SIMD4i ConditionalAdd(const SIMD4i& num1, const SIMD4i& num2) const
 	{
 		return num1 + ((*this) & num2);
 	}
@@ -72,15 +72,15 @@ public:
 	//Bit 2/3: Which element goes to slot 2
 	//Bit 4/5: Which element goes to slot 3
 	//Bit 6/7: Which element goes to slot 4
-	inline SIMD4i Shuffle(int8_t shuffleByte)
+	inline SIMD4i Shuffle(int8_t shuffleByte) const
 	{
 		return SIMD4i(_mm_shuffle_epi32(m_data, shuffleByte));
 	}
 	
-	inline int32_t HorizontalAdd()
+	inline int32_t HorizontalAdd() const
 	{
 		#if  SIMD_SUPPORTED_LEVEL >= SIMD_LEVEL_x86_SSSE3
-			SIMD4i temp1 = SIMD4i(_mm_hadd_epi32(m_data, other.m_data));
+			SIMD4i temp1 = SIMD4i(_mm_hadd_epi32(m_data, m_data));
 			SIMD4i temp2 = SIMD4i(_mm_hadd_epi32(temp1, temp1));
 			return _mm_cvtsi128_si32(temp2);
 		#else
@@ -92,7 +92,7 @@ public:
 		#endif
 	}
 	
-	inline SIMD4i Max(const SIMD4i& other)
+	inline SIMD4i Max(const SIMD4i& other) const
 	{
 		#if SIMD_SUPPORTED_LEVEL >= SIMD_LEVEL_x86_SSE4_1
 			return SIMD4i(_mm_max_epi32(m_data, other.m_data));
@@ -102,7 +102,7 @@ public:
 		#endif
 	}
 	
-	inline SIMD4i Min(const SIMD4i& other)
+	inline SIMD4i Min(const SIMD4i& other) const
 	{
 		#if SIMD_SUPPORTED_LEVEL >= SIMD_LEVEL_x86_SSE4_1
 			return SIMD4i(_mm_min_epi32(m_data, other.m_data));
@@ -112,7 +112,7 @@ public:
 		#endif
 	}
 	
-	inline SIMD4i Abs()
+	inline SIMD4i Abs() const
 	{
 		#if SIMD_SUPPORTED_LEVEL >= SIMD_LEVEL_x86_SSSE3
 			return SIMD4i(_mm_sign_epi32(m_data, m_data));
@@ -243,16 +243,16 @@ public:
 		return SIMD4f(_mm_min_ps(m_data, other.m_data));
 	}
 	
-	inline SIMD4f Pick(const SIMD4f& sourceIfTrue, const SIMD4f& sourceIfFalse)
+	inline SIMD4f Pick(const SIMD4f& sourceIfTrue, const SIMD4f& sourceIfFalse) const
 	{
 		#if SIMD_SUPPORTED_LEVEL >= SIMD_LEVEL_x86_SSE4_1
-			return SIMD4f(_mm_blendv_ps((*this), sourceIfTrue, sourceIfFalse));
+			return SIMD4f(_mm_blendv_ps(sourceIfFalse, sourceIfTrue, (*this)));
 		#else
 			return ((*this) & sourceIfTrue) | (this->AndNot(sourceIfFalse));
 		#endif
 	}
 	
-	inline SIMD4f ConditionalAdd(const SIMD4f& num1, const SIMD4f& num2)
+	inline SIMD4f ConditionalAdd(const SIMD4f& num1, const SIMD4f& num2) const
 	{
 		return num1 + ((*this) & num2);
 	}
@@ -262,7 +262,7 @@ public:
 	//Bit 2/3: Which element goes to slot 2
 	//Bit 4/5: Which element goes to slot 3
 	//Bit 6/7: Which element goes to slot 4
-	inline SIMD4f Shuffle(int8_t shuffleByte)
+	inline SIMD4f Shuffle(int8_t shuffleByte) const
 	{
 		return SIMD4f(_mm_shuffle_ps(m_data, m_data, shuffleByte));
 	}
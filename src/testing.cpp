@@ -4,16 +4,117 @@
 #include "physics/aabb.h"
 #include "physics/plane.h"
 #include "physics/physicsObject.h"
+#include "core/transform.h"
+#include "core/transformStore.h"
+#include "core/entityComponent.h"
+#include "core/jobSystem.h"
+#include "core/archetypeStore.h"
+#include "core/memoryPool.h"
+#include "core/frameArena.h"
+#include "core/mappedFile.h"
+#include "core/assetLoader.h"
+#include "core/propertyTable.h"
+#include "rendering/frustum.h"
+#include "rendering/boundingVolumeHierarchy.h"
+#include "rendering/meshOptimizer.h"
+#include "rendering/meshSimplifier.h"
+#include "rendering/packedMesh.h"
+#include "rendering/lightClusters.h"
+#include "rendering/occlusionCuller.h"
+#include "rendering/shadowAtlas.h"
+#include "rendering/shadowCascades.h"
+#include "rendering/shadowMapCache.h"
+#include "rendering/vertexFormat.h"
+#include "rendering/glState.h"
+#include "rendering/renderingEngine.h"
+#include "rendering/renderQueue.h"
+#include "rendering/shader.h"
+#include "rendering/camera.h"
+#include "rendering/lighting.h"
+#include "components/archetypeStoreComponent.h"
+#include "components/freeLook.h"
+#include "components/freeMove.h"
+#include "components/meshRenderer.h"
+#include "components/physicsEngineComponent.h"
+#include "components/physicsObjectComponent.h"
 
 #include <iostream>
 #include <cassert>
 
+static void TestEngineComponentsArePooled();
+
 void Testing::RunAllTests()
 {
 	BoundingSphere::Test();
 	AABB::Test();
 	Plane::Test();
 	PhysicsObject::Test();
+	Transform::Test();
+	TransformStore::Test();
+	JobSystem::Test();
+	ArchetypeStore::Test();
+	MemoryPool::Test();
+	EntityComponent::Test();
+	TestEngineComponentsArePooled();
+	FrameArena::Test();
+	MappedFile::Test();
+	AssetLoader::Test();
+	PropertyTable::Test();
+	Frustum::Test();
+	BoundingVolumeHierarchy::Test();
+	MeshOptimizer::Test();
+	MeshSimplifier::Test();
+	PackedMesh::Test();
+	LightClusters::Test();
+	OcclusionCuller::Test();
+	ShadowAtlas::Test();
+	ShadowCascades::Test();
+	ShadowMapCache::Test();
+	VertexFormat::Test();
+	GLState::Test();
+	SpotLight::Test();
+	RenderingEngine::Test();
+	RenderQueue::Test();
+	UniformBinding::Test();
 }
 
+void Testing::RunAllBenchmarks()
+{
+	TransformStore::Benchmark(50000);
+	ArchetypeStore::Benchmark(100000);
+	BoundingVolumeHierarchy::Benchmark(50000);
+	LightClusters::Benchmark(1);
+	LightClusters::Benchmark(16);
+	LightClusters::Benchmark(256);
+	LightClusters::Benchmark(1024);
+	OcclusionCuller::Benchmark(64);
+	OcclusionCuller::Benchmark(512);
+}
 
+//--------------------------------------------------------------------------------
+// Static Function Implementations
+//--------------------------------------------------------------------------------
+static void TestEngineComponentsArePooled()
+{
+	//None of the engine's own components should ever fall back to the heap.
+	size_t sizes[] = 
+	{ 
+		sizeof(MeshRenderer), sizeof(DirectionalLight), sizeof(PointLight), sizeof(SpotLight), 
+		sizeof(CameraComponent), sizeof(FreeLook), sizeof(FreeMove), sizeof(PhysicsEngineComponent), 
+		sizeof(PhysicsObjectComponent), sizeof(ArchetypeStoreComponent)
+	};
+	
+	for(unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		MemoryPool& pool = EntityComponent::GetMemoryPool(sizes[i]);
+		int numLiveObjects = pool.GetNumLiveObjects();
+		int numHeapObjects = pool.GetNumHeapObjects();
+		
+		void* component = EntityComponent::operator new(sizes[i]);
+		assert(pool.GetNumLiveObjects() == numLiveObjects + 1);
+		assert(pool.GetNumHeapObjects() == numHeapObjects);
+		
+		EntityComponent::operator delete(component, sizes[i]);
+		assert(pool.GetNumLiveObjects() == numLiveObjects);
+	}
+}
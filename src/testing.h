@@ -4,6 +4,7 @@
 namespace Testing
 {
 	void RunAllTests();
+	void RunAllBenchmarks();
 };
 
 #endif